@@ -0,0 +1,113 @@
+// Frustum culling cost of DynamicAABBTree with N objects (default 100000) spread through a cube
+// of space like the stress scene, while the camera turns a full circle inside it. Every frame
+// a share of the objects moves first (move(): refit or reinsert), then the tree is culled.
+// The tree's result is checked against testing every object's box against the frustum.
+//
+// usage: frustum_cull_bench [objects] [frames] [moving %]
+#include "aabb_tree.h"
+#include "camera.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// the exact test the tree must agree with: box touching every plane's inner half space
+static bool insideFrustum(const AABB &box, const std::array<glm::vec4, 6> &planes)
+{
+    const glm::vec3 center = 0.5f * (box.Min + box.Max), extent = 0.5f * (box.Max - box.Min);
+    for (const glm::vec4 &plane : planes)
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -glm::dot(glm::abs(glm::vec3(plane)), extent))
+            return false;
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    const size_t count = argc > 1 ? (size_t)std::strtoull(argv[1], nullptr, 10) : 100000;
+    const unsigned int frames = argc > 2 ? (unsigned int)std::atoi(argv[2]) : 360;
+    const float movingShare = (argc > 3 ? (float)std::atof(argv[3]) : 5.0f) / 100.0f;
+
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    const float side = 1.5f * std::cbrt((float)count);
+    std::vector<glm::vec3> positions(count);
+    std::vector<float> sizes(count);
+    std::vector<glm::vec3> velocities(count, glm::vec3(0.0f));
+    for (size_t i = 0; i < count; ++i)
+    {
+        positions[i] = (glm::vec3(unit(rng), unit(rng), unit(rng)) - 0.5f) * side;
+        sizes[i] = 0.15f + 0.2f * unit(rng);
+        if (unit(rng) < movingShare)
+            velocities[i] = (glm::vec3(unit(rng), unit(rng), unit(rng)) - 0.5f) * 4.0f; // units per second
+    }
+    auto bounds = [&](size_t i) { return AABB{ positions[i] - sizes[i], positions[i] + sizes[i] }; };
+
+    DynamicAABBTree tree;
+    std::vector<int32_t> proxies(count);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i)
+        proxies[i] = tree.insert(bounds(i), (uint32_t)i);
+    auto end = std::chrono::steady_clock::now();
+    std::cout << std::fixed << std::setprecision(1) << count << " objects, " << movingShare * 100.0f << "% moving; tree built in "
+              << std::chrono::duration<double, std::milli>(end - start).count() << " ms, height " << tree.height() << "\n";
+
+    Camera camera(glm::vec3(0.0f));
+    const glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+    const float dt = 1.0f / 60.0f;
+    std::vector<uint32_t> visible, expected;
+    std::vector<char> seen(count);
+    CullStats stats;
+    double cullSum = 0.0, cullMax = 0.0, moveSum = 0.0, bruteSum = 0.0;
+    uint64_t visitedSum = 0, visibleSum = 0, treeChanges = 0;
+    size_t missing = 0;
+    for (unsigned int frame = 0; frame < frames; ++frame)
+    {
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (velocities[i] == glm::vec3(0.0f))
+                continue;
+            positions[i] += velocities[i] * dt;
+            treeChanges += tree.move(proxies[i], bounds(i));
+        }
+        end = std::chrono::steady_clock::now();
+        moveSum += std::chrono::duration<double, std::micro>(end - start).count();
+
+        camera.ProcessMouseMovement(360.0f / frames / camera.MouseSensitivity, 0.0f);
+        const std::array<glm::vec4, 6> planes = camera.GetFrustumPlanes(projection);
+        tree.cull(planes, visible, stats);
+        cullSum += stats.Microseconds;
+        cullMax = std::max(cullMax, (double)stats.Microseconds);
+        visitedSum += stats.NodesVisited;
+        visibleSum += stats.Visible;
+
+        // every object the exact test keeps must be reported (the tree may keep a few more,
+        // its boxes are grown by the margin)
+        start = std::chrono::steady_clock::now();
+        expected.clear();
+        for (size_t i = 0; i < count; ++i)
+            if (insideFrustum(bounds(i), planes))
+                expected.push_back((uint32_t)i);
+        end = std::chrono::steady_clock::now();
+        bruteSum += std::chrono::duration<double, std::micro>(end - start).count();
+        std::fill(seen.begin(), seen.end(), 0);
+        for (uint32_t id : visible)
+            seen[id] = 1;
+        for (uint32_t id : expected)
+            missing += !seen[id];
+    }
+
+    std::cout << "per frame: " << visibleSum / frames << " visible, " << visitedSum / frames << " nodes visited, "
+              << treeChanges / frames << " tree updates\n"
+              << "  cull       " << std::setw(8) << cullSum / frames << " us avg, " << cullMax << " us max\n"
+              << "  move       " << std::setw(8) << moveSum / frames << " us avg\n"
+              << "  brute force" << std::setw(8) << bruteSum / frames << " us avg (every box against the frustum)\n"
+              << missing << " visible objects missed by the tree\n";
+    return missing == 0 ? 0 : 1;
+}
@@ -0,0 +1,425 @@
+// Counts the GL calls of one frame of the lighting scene, before and after: "after" is
+// LightingScene::Draw, the same function main() calls every frame, set up the way main() sets
+// it up with the app's default options (quantized meshes, LOD, persistently mapped object
+// stream); "before" draws the same cube, sphere and lamp the way the render loop used to, with
+// every uniform re-sent by name and view/projection/viewPos uploaded to each program. The
+// optional scenes are left out, as in a run without --stress, --lights or --nanosuit.
+//
+// No context is needed: glad's function pointers are replaced by counting stubs, so this runs
+// on build machines without a GPU. The stub "driver" parses the real shader sources to know
+// which uniforms each program exposes, and hands out real memory for mapped buffers.
+//
+// usage: gl_call_count [frames]
+// defaults to 1000 frames; run from bin/ like the app
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "app_options.h"
+#include "lighting_scene.h"
+#include "stream_buffer.h"
+#include "render_queue.h"
+#include "shader_variants.h"
+#include "simulation.h"
+#include "thread_pool.h"
+#include "uniform_buffer.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::map<std::string, unsigned long> calls;
+#define COUNT_CALL() (++calls[__func__ + 4]) // strip the "stub" prefix
+
+// --- a tiny fake driver ----------------------------------------------------------------
+std::map<GLuint, std::string> shaderSources;
+std::map<GLuint, std::vector<GLuint>> programShaders;
+std::map<GLuint, std::vector<std::string>> programUniforms;
+std::map<GLuint, std::vector<std::string>> programBlocks;
+std::map<GLenum, GLuint> boundBuffers;
+std::map<GLuint, std::vector<unsigned char>> bufferStore;
+GLuint nextName = 1;
+
+std::vector<std::string> tokenize(const std::string &source)
+{
+    std::vector<std::string> tokens;
+    std::string current;
+    for (char c : source)
+    {
+        if (std::isspace((unsigned char)c) || c == ';' || c == '{' || c == '}')
+        {
+            if (!current.empty())
+                tokens.push_back(current);
+            current.clear();
+            if (!std::isspace((unsigned char)c))
+                tokens.push_back(std::string(1, c));
+        }
+        else
+            current += c;
+    }
+    if (!current.empty())
+        tokens.push_back(current);
+    return tokens;
+}
+
+// collects default-block uniforms (expanding struct members) and uniform block names
+void parseUniforms(const std::string &source, std::vector<std::string> &uniforms, std::vector<std::string> &blocks)
+{
+    std::vector<std::string> t = tokenize(source);
+    std::map<std::string, std::vector<std::string>> structs;
+    for (size_t i = 0; i < t.size(); ++i)
+    {
+        if (t[i] == "struct" && i + 2 < t.size() && t[i + 2] == "{")
+        {
+            std::vector<std::string> &members = structs[t[i + 1]];
+            for (i += 3; i < t.size() && t[i] != "}"; ++i)
+                if (t[i] == ";")
+                    members.push_back(t[i - 1]);
+        }
+        else if (t[i] == "uniform" && i + 2 < t.size())
+        {
+            if (t[i + 2] == "{")
+            {
+                blocks.push_back(t[i + 1]);
+                while (i < t.size() && t[i] != "}")
+                    ++i;
+                continue;
+            }
+            const std::string &type = t[i + 1];
+            const std::string &name = t[i + 2];
+            auto s = structs.find(type);
+            if (s == structs.end())
+                uniforms.push_back(name);
+            else
+                for (const std::string &member : s->second)
+                    uniforms.push_back(name + "." + member);
+        }
+    }
+}
+
+GLuint APIENTRY stubCreateShader(GLenum) { COUNT_CALL(); return nextName++; }
+void APIENTRY stubShaderSource(GLuint shader, GLsizei count, const GLchar *const *string, const GLint *)
+{
+    COUNT_CALL();
+    for (GLsizei i = 0; i < count; ++i)
+        shaderSources[shader] += string[i];
+}
+void APIENTRY stubCompileShader(GLuint) { COUNT_CALL(); }
+void APIENTRY stubGetShaderiv(GLuint, GLenum, GLint *params) { COUNT_CALL(); *params = GL_TRUE; }
+void APIENTRY stubGetShaderInfoLog(GLuint, GLsizei, GLsizei *length, GLchar *) { COUNT_CALL(); if (length) *length = 0; }
+void APIENTRY stubDeleteShader(GLuint) { COUNT_CALL(); }
+GLuint APIENTRY stubCreateProgram() { COUNT_CALL(); return nextName++; }
+void APIENTRY stubAttachShader(GLuint program, GLuint shader) { COUNT_CALL(); programShaders[program].push_back(shader); }
+void APIENTRY stubLinkProgram(GLuint program)
+{
+    COUNT_CALL();
+    std::vector<std::string> &uniforms = programUniforms[program];
+    std::vector<std::string> &blocks = programBlocks[program];
+    for (GLuint shader : programShaders[program])
+    {
+        std::vector<std::string> found, foundBlocks;
+        parseUniforms(shaderSources[shader], found, foundBlocks);
+        for (const std::string &u : found)
+            if (std::find(uniforms.begin(), uniforms.end(), u) == uniforms.end())
+                uniforms.push_back(u);
+        for (const std::string &b : foundBlocks)
+            if (std::find(blocks.begin(), blocks.end(), b) == blocks.end())
+                blocks.push_back(b);
+    }
+}
+void APIENTRY stubGetProgramiv(GLuint program, GLenum pname, GLint *params)
+{
+    COUNT_CALL();
+    const std::vector<std::string> &uniforms = programUniforms[program];
+    if (pname == GL_ACTIVE_UNIFORMS)
+        *params = (GLint)uniforms.size();
+    else if (pname == GL_ACTIVE_UNIFORM_MAX_LENGTH)
+    {
+        size_t longest = 0;
+        for (const std::string &u : uniforms)
+            longest = std::max(longest, u.size() + 1);
+        *params = (GLint)longest;
+    }
+    else
+        *params = GL_TRUE;
+}
+void APIENTRY stubGetProgramInfoLog(GLuint, GLsizei, GLsizei *length, GLchar *) { COUNT_CALL(); if (length) *length = 0; }
+void APIENTRY stubGetActiveUniform(GLuint program, GLuint index, GLsizei bufSize, GLsizei *length, GLint *size, GLenum *type, GLchar *name)
+{
+    COUNT_CALL();
+    const std::string &u = programUniforms[program][index];
+    GLsizei n = std::min<GLsizei>((GLsizei)u.size(), bufSize - 1);
+    std::memcpy(name, u.data(), n);
+    name[n] = '\0';
+    if (length) *length = n;
+    *size = 1;
+    *type = GL_FLOAT;
+}
+GLint APIENTRY stubGetUniformLocation(GLuint program, const GLchar *name)
+{
+    COUNT_CALL();
+    const std::vector<std::string> &uniforms = programUniforms[program];
+    for (size_t i = 0; i < uniforms.size(); ++i)
+        if (uniforms[i] == name)
+            return (GLint)i;
+    return -1;
+}
+GLuint APIENTRY stubGetUniformBlockIndex(GLuint program, const GLchar *name)
+{
+    COUNT_CALL();
+    const std::vector<std::string> &blocks = programBlocks[program];
+    for (size_t i = 0; i < blocks.size(); ++i)
+        if (blocks[i] == name)
+            return (GLuint)i;
+    return GL_INVALID_INDEX;
+}
+void APIENTRY stubUniformBlockBinding(GLuint, GLuint, GLuint) { COUNT_CALL(); }
+void APIENTRY stubUseProgram(GLuint) { COUNT_CALL(); }
+void APIENTRY stubDeleteProgram(GLuint) { COUNT_CALL(); }
+void APIENTRY stubUniform1i(GLint, GLint) { COUNT_CALL(); }
+void APIENTRY stubUniform1f(GLint, GLfloat) { COUNT_CALL(); }
+void APIENTRY stubUniform2f(GLint, GLfloat, GLfloat) { COUNT_CALL(); }
+void APIENTRY stubUniform2fv(GLint, GLsizei, const GLfloat *) { COUNT_CALL(); }
+void APIENTRY stubUniform3f(GLint, GLfloat, GLfloat, GLfloat) { COUNT_CALL(); }
+void APIENTRY stubUniform3fv(GLint, GLsizei, const GLfloat *) { COUNT_CALL(); }
+void APIENTRY stubUniform4f(GLint, GLfloat, GLfloat, GLfloat, GLfloat) { COUNT_CALL(); }
+void APIENTRY stubUniform4fv(GLint, GLsizei, const GLfloat *) { COUNT_CALL(); }
+void APIENTRY stubUniformMatrix2fv(GLint, GLsizei, GLboolean, const GLfloat *) { COUNT_CALL(); }
+void APIENTRY stubUniformMatrix3fv(GLint, GLsizei, GLboolean, const GLfloat *) { COUNT_CALL(); }
+void APIENTRY stubUniformMatrix4fv(GLint, GLsizei, GLboolean, const GLfloat *) { COUNT_CALL(); }
+
+// a 4.5 context (so the object stream maps persistently) with 256-byte uniform buffer offsets
+void APIENTRY stubGetIntegerv(GLenum pname, GLint *data)
+{
+    COUNT_CALL();
+    *data = pname == GL_MAJOR_VERSION ? 4 : pname == GL_MINOR_VERSION ? 5 : pname == GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT ? 256 : 0;
+}
+void APIENTRY stubClearColor(GLfloat, GLfloat, GLfloat, GLfloat) { COUNT_CALL(); }
+void APIENTRY stubClear(GLbitfield) { COUNT_CALL(); }
+void APIENTRY stubGenBuffers(GLsizei n, GLuint *buffers) { COUNT_CALL(); for (GLsizei i = 0; i < n; ++i) buffers[i] = nextName++; }
+void APIENTRY stubDeleteBuffers(GLsizei n, const GLuint *buffers) { COUNT_CALL(); for (GLsizei i = 0; i < n; ++i) bufferStore.erase(buffers[i]); }
+void APIENTRY stubBindBuffer(GLenum target, GLuint buffer) { COUNT_CALL(); boundBuffers[target] = buffer; }
+void APIENTRY stubBindBufferBase(GLenum, GLuint, GLuint) { COUNT_CALL(); }
+void APIENTRY stubBindBufferRange(GLenum, GLuint, GLuint, GLintptr, GLsizeiptr) { COUNT_CALL(); }
+void APIENTRY stubBufferData(GLenum target, GLsizeiptr size, const void *, GLenum) { COUNT_CALL(); bufferStore[boundBuffers[target]].assign((size_t)size, 0); }
+void APIENTRY stubBufferStorage(GLenum target, GLsizeiptr size, const void *, GLbitfield) { COUNT_CALL(); bufferStore[boundBuffers[target]].assign((size_t)size, 0); }
+void APIENTRY stubBufferSubData(GLenum, GLintptr, GLsizeiptr, const void *) { COUNT_CALL(); }
+void *APIENTRY stubMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr, GLbitfield) { COUNT_CALL(); return bufferStore[boundBuffers[target]].data() + offset; }
+void APIENTRY stubFlushMappedBufferRange(GLenum, GLintptr, GLsizeiptr) { COUNT_CALL(); }
+GLboolean APIENTRY stubUnmapBuffer(GLenum) { COUNT_CALL(); return GL_TRUE; }
+GLsync APIENTRY stubFenceSync(GLenum, GLbitfield) { COUNT_CALL(); return reinterpret_cast<GLsync>((size_t)nextName++); }
+GLenum APIENTRY stubClientWaitSync(GLsync, GLbitfield, GLuint64) { COUNT_CALL(); return GL_ALREADY_SIGNALED; }
+void APIENTRY stubDeleteSync(GLsync) { COUNT_CALL(); }
+void APIENTRY stubGenVertexArrays(GLsizei n, GLuint *arrays) { COUNT_CALL(); for (GLsizei i = 0; i < n; ++i) arrays[i] = nextName++; }
+void APIENTRY stubDeleteVertexArrays(GLsizei, const GLuint *) { COUNT_CALL(); }
+void APIENTRY stubBindVertexArray(GLuint) { COUNT_CALL(); }
+void APIENTRY stubEnableVertexAttribArray(GLuint) { COUNT_CALL(); }
+void APIENTRY stubVertexAttribPointer(GLuint, GLint, GLenum, GLboolean, GLsizei, const void *) { COUNT_CALL(); }
+void APIENTRY stubVertexAttribDivisor(GLuint, GLuint) { COUNT_CALL(); }
+void APIENTRY stubActiveTexture(GLenum) { COUNT_CALL(); }
+void APIENTRY stubBindTexture(GLenum, GLuint) { COUNT_CALL(); }
+void APIENTRY stubDrawElements(GLenum, GLsizei, GLenum, const void *) { COUNT_CALL(); }
+void APIENTRY stubDrawElementsInstanced(GLenum, GLsizei, GLenum, const void *, GLsizei) { COUNT_CALL(); }
+void APIENTRY stubMultiDrawElements(GLenum, const GLsizei *, GLenum, const void *const *, GLsizei) { COUNT_CALL(); }
+
+// what the stream buffer asks the context's loader for
+void *stubLoad(const char *name)
+{
+    return std::strcmp(name, "glBufferStorage") == 0 ? (void*)stubBufferStorage : nullptr;
+}
+
+void installStubs()
+{
+    glad_glCreateShader = stubCreateShader;
+    glad_glShaderSource = stubShaderSource;
+    glad_glCompileShader = stubCompileShader;
+    glad_glGetShaderiv = stubGetShaderiv;
+    glad_glGetShaderInfoLog = stubGetShaderInfoLog;
+    glad_glDeleteShader = stubDeleteShader;
+    glad_glCreateProgram = stubCreateProgram;
+    glad_glAttachShader = stubAttachShader;
+    glad_glLinkProgram = stubLinkProgram;
+    glad_glGetProgramiv = stubGetProgramiv;
+    glad_glGetProgramInfoLog = stubGetProgramInfoLog;
+    glad_glGetActiveUniform = stubGetActiveUniform;
+    glad_glGetUniformLocation = stubGetUniformLocation;
+    glad_glGetUniformBlockIndex = stubGetUniformBlockIndex;
+    glad_glUniformBlockBinding = stubUniformBlockBinding;
+    glad_glUseProgram = stubUseProgram;
+    glad_glDeleteProgram = stubDeleteProgram;
+    glad_glUniform1i = stubUniform1i;
+    glad_glUniform1f = stubUniform1f;
+    glad_glUniform2f = stubUniform2f;
+    glad_glUniform2fv = stubUniform2fv;
+    glad_glUniform3f = stubUniform3f;
+    glad_glUniform3fv = stubUniform3fv;
+    glad_glUniform4f = stubUniform4f;
+    glad_glUniform4fv = stubUniform4fv;
+    glad_glUniformMatrix2fv = stubUniformMatrix2fv;
+    glad_glUniformMatrix3fv = stubUniformMatrix3fv;
+    glad_glUniformMatrix4fv = stubUniformMatrix4fv;
+    glad_glGetIntegerv = stubGetIntegerv;
+    glad_glClearColor = stubClearColor;
+    glad_glClear = stubClear;
+    glad_glGenBuffers = stubGenBuffers;
+    glad_glDeleteBuffers = stubDeleteBuffers;
+    glad_glBindBuffer = stubBindBuffer;
+    glad_glBindBufferBase = stubBindBufferBase;
+    glad_glBindBufferRange = stubBindBufferRange;
+    glad_glBufferData = stubBufferData;
+    glad_glBufferSubData = stubBufferSubData;
+    glad_glMapBufferRange = stubMapBufferRange;
+    glad_glFlushMappedBufferRange = stubFlushMappedBufferRange;
+    glad_glUnmapBuffer = stubUnmapBuffer;
+    glad_glFenceSync = stubFenceSync;
+    glad_glClientWaitSync = stubClientWaitSync;
+    glad_glDeleteSync = stubDeleteSync;
+    glad_glGenVertexArrays = stubGenVertexArrays;
+    glad_glDeleteVertexArrays = stubDeleteVertexArrays;
+    glad_glBindVertexArray = stubBindVertexArray;
+    glad_glEnableVertexAttribArray = stubEnableVertexAttribArray;
+    glad_glVertexAttribPointer = stubVertexAttribPointer;
+    glad_glVertexAttribDivisor = stubVertexAttribDivisor;
+    glad_glActiveTexture = stubActiveTexture;
+    glad_glBindTexture = stubBindTexture;
+    glad_glDrawElements = stubDrawElements;
+    glad_glDrawElementsInstanced = stubDrawElementsInstanced;
+    glad_glMultiDrawElements = stubMultiDrawElements;
+}
+
+// --- the frame, before and after --------------------------------------------------------
+const unsigned int SCR_WIDTH = 800;
+const unsigned int SCR_HEIGHT = 600;
+const float FIXED_TIMESTEP = 1.0f / 60.0f;
+const float NEAR_PLANE = 0.1f;
+const float FAR_PLANE = 100.0f;
+
+// the render loop body as it was: every uniform re-sent by name, the camera to both programs,
+// one draw per object in the order it was written
+void frameBefore(GLuint lighting, GLuint lightCube, const LightingScene &scene, Camera &camera, const FrameSnapshot &snapshot, float alpha)
+{
+    auto loc = [](GLuint program, const char *name) { return glGetUniformLocation(program, name); };
+    glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    const glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, NEAR_PLANE, FAR_PLANE);
+    const glm::mat4 view = camera.GetViewMatrix();
+
+    glUseProgram(lighting);
+    glUniform3fv(loc(lighting, "light.position"), 1, &LightingScene::LIGHT_POSITION[0]);
+    glUniform3fv(loc(lighting, "viewPos"), 1, &camera.Position[0]);
+    const glm::vec3 diffuseColor = snapshot.lightColor(alpha) * glm::vec3(0.5f);
+    const glm::vec3 ambientColor = diffuseColor * glm::vec3(0.2f);
+    glUniform3fv(loc(lighting, "light.ambient"), 1, &ambientColor[0]);
+    glUniform3fv(loc(lighting, "light.diffuse"), 1, &diffuseColor[0]);
+    glUniform3f(loc(lighting, "light.specular"), 1.0f, 1.0f, 1.0f);
+    glUniform3f(loc(lighting, "material.ambient"), 1.0f, 0.5f, 0.31f);
+    glUniform3f(loc(lighting, "material.diffuse"), 1.0f, 0.5f, 0.31f);
+    glUniform3f(loc(lighting, "material.specular"), 0.5f, 0.5f, 0.5f);
+    glUniform1f(loc(lighting, "material.shininess"), 32.0f);
+    glUniformMatrix4fv(loc(lighting, "projection"), 1, GL_FALSE, &projection[0][0]);
+    glUniformMatrix4fv(loc(lighting, "view"), 1, GL_FALSE, &view[0][0]);
+    glUniformMatrix4fv(loc(lighting, "model"), 1, GL_FALSE, &snapshot.CubeModel[0][0]);
+    glBindVertexArray(scene.Cube.VAO);
+    glDrawElements(GL_TRIANGLES, (GLsizei)scene.Cube.IndexCount, GL_UNSIGNED_INT, (void*)0);
+    glUniformMatrix4fv(loc(lighting, "model"), 1, GL_FALSE, &snapshot.SphereModel[0][0]);
+    glBindVertexArray(scene.Sphere.VAO);
+    glDrawElements(GL_TRIANGLES, (GLsizei)scene.Sphere.IndexCount, GL_UNSIGNED_INT, (void*)0);
+
+    glUseProgram(lightCube);
+    glUniformMatrix4fv(loc(lightCube, "projection"), 1, GL_FALSE, &projection[0][0]);
+    glUniformMatrix4fv(loc(lightCube, "view"), 1, GL_FALSE, &view[0][0]);
+    glUniformMatrix4fv(loc(lightCube, "model"), 1, GL_FALSE, &snapshot.LampModel[0][0]);
+    glBindVertexArray(scene.LightCubeVAO);
+    glDrawElements(GL_TRIANGLES, (GLsizei)scene.Cube.IndexCount, GL_UNSIGNED_INT, (void*)0);
+}
+
+// calls per frame of frame(), in the steady state: once every region of the object stream has
+// been used and so has a fence to wait on
+std::map<std::string, unsigned long> runFrames(size_t frames, const std::function<void()> &frame)
+{
+    for (unsigned int i = 0; i < StreamBuffer::FRAMES_IN_FLIGHT; ++i)
+        frame();
+    calls.clear();
+    for (size_t i = 0; i < frames; ++i)
+        frame();
+    return calls;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    const size_t frames = std::max<size_t>(argc > 1 ? (size_t)std::strtoull(argv[1], nullptr, 10) : 1000, 1);
+    installStubs();
+
+    const AppOptions options;
+    UniformBuffer<CameraBlock> cameraUBO(CAMERA_BINDING);
+    ShaderVariants surfaces("../shaders/surface.vs", "../shaders/surface.fs", LightingScene::surfaceSetup(cameraUBO));
+    surfaces.get(SHADER_LIT);
+    surfaces.get(0);
+    const VertexTolerance vertexTolerance = { options.PositionTolerance, options.NormalToleranceDegrees, options.TexCoordTolerance };
+    const VertexTolerance *quantize = options.Quantize ? &vertexTolerance : nullptr;
+    StreamBuffer objectStream(GL_UNIFORM_BUFFER, 64 * 1024, stubLoad, options.PersistentMapping);
+    RenderQueue renderQueue(objectStream);
+    renderQueue.reserveBuckets(1);
+    LightingScene scene(surfaces, renderQueue, cameraUBO, quantize, (float)SCR_WIDTH, (float)SCR_HEIGHT, NEAR_PLANE, FAR_PLANE);
+    scene.Lods.Enabled = options.Lod;
+
+    // lockstep, like a headless run: every frame draws the next step
+    ThreadPool simulationJobs(options.Threads);
+    Simulation simulation(simulationJobs, Camera(glm::vec3(0.0f, 0.0f, 3.0f)), LightingScene::LIGHT_POSITION, FIXED_TIMESTEP, true);
+    simulation.start();
+
+    // frameBefore() still asks for view/projection/viewPos and the material by name; they now
+    // live in uniform blocks and resolve to -1, but the number of calls is what the old loop
+    // made either way
+    const GLuint lighting = surfaces.get(SHADER_LIT).ID, lightCube = surfaces.get(0).ID;
+    std::map<std::string, unsigned long> before = runFrames(frames, [&]() {
+        const FrameSnapshot &snapshot = simulation.acquire();
+        const float alpha = simulation.alpha(snapshot);
+        Camera camera = snapshot.camera(alpha);
+        frameBefore(lighting, lightCube, scene, camera, snapshot, alpha);
+    });
+    std::map<std::string, unsigned long> after = runFrames(frames, [&]() {
+        const FrameSnapshot &snapshot = simulation.acquire();
+        const float alpha = simulation.alpha(snapshot);
+        Camera camera = snapshot.camera(alpha);
+        scene.Draw(camera, snapshot, alpha, [](RenderBucket &, const CameraBlock &) {});
+    });
+    simulation.stop();
+
+    std::map<std::string, unsigned long> all = before;
+    all.insert(after.begin(), after.end());
+    unsigned long totalBefore = 0, totalAfter = 0;
+    std::cout << "GL calls per frame (" << frames << " frames, after = LightingScene::Draw, stream buffer "
+              << (objectStream.Persistent ? "persistent" : "mapped per frame") << ")\n";
+    std::cout << std::left << std::setw(28) << "function" << std::right << std::setw(10) << "before" << std::setw(10) << "after"
+              << std::setw(10) << "change" << "\n";
+    for (const auto &entry : all)
+    {
+        const double b = before[entry.first] / (double)frames;
+        const double a = after[entry.first] / (double)frames;
+        totalBefore += before[entry.first];
+        totalAfter += after[entry.first];
+        std::cout << std::left << std::setw(28) << ("gl" + entry.first) << std::right << std::setw(10) << b << std::setw(10) << a
+                  << std::setw(10) << std::showpos << a - b << std::noshowpos << "\n";
+    }
+    const double b = totalBefore / (double)frames, a = totalAfter / (double)frames;
+    std::cout << std::left << std::setw(28) << "total" << std::right << std::setw(10) << b << std::setw(10) << a
+              << std::setw(10) << std::showpos << a - b << std::noshowpos << "\n";
+
+    scene.Release();
+    glDeleteBuffers(1, &cameraUBO.ID);
+    objectStream.Release();
+    surfaces.Release();
+    return 0;
+}
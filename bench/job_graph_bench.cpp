@@ -0,0 +1,133 @@
+// ThreadPool job graphs and the TripleBuffer hand-off the simulation thread uses.
+//
+// Job graph: stages of jobs where every job of a stage needs the whole previous stage, run once
+// with the caller waiting for each stage in turn (a barrier) and once built up front with
+// after() so workers go from one stage to the next by themselves. Both count jobs that started
+// before their stage's dependencies were done, which must stay 0.
+//
+// Triple buffer: a writer publishes numbered snapshots as fast as it can while a reader takes
+// the newest; every snapshot read must be whole (no slot written while read) and newer than
+// the one before.
+//
+// usage: job_graph_bench [threads] [stages] [jobs per stage] [microseconds per job]
+// defaults to hardware_concurrency(), 64 stages of 32 jobs of 20 us
+#include "thread_pool.h"
+#include "triple_buffer.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static void spin(unsigned microseconds)
+{
+    const Clock::time_point end = Clock::now() + std::chrono::microseconds(microseconds);
+    while (Clock::now() < end)
+        ;
+}
+
+struct GraphRun {
+    double Milliseconds;
+    unsigned Violations;
+};
+
+static GraphRun runGraph(ThreadPool &pool, unsigned stages, unsigned jobs, unsigned microseconds, bool dependencies)
+{
+    std::unique_ptr<std::atomic<unsigned>[]> finished(new std::atomic<unsigned>[stages]);
+    for (unsigned stage = 0; stage < stages; ++stage)
+        finished[stage] = 0;
+    std::atomic<unsigned> violations{ 0 };
+    auto job = [&](unsigned stage) {
+        if (stage > 0 && finished[stage - 1].load() != jobs)
+            ++violations;
+        spin(microseconds);
+        ++finished[stage];
+    };
+
+    const Clock::time_point start = Clock::now();
+    if (dependencies)
+    {
+        std::vector<JobCounter> counters(stages);
+        for (unsigned stage = 0; stage < stages; ++stage)
+            for (unsigned i = 0; i < jobs; ++i)
+            {
+                if (stage == 0)
+                    pool.submit([&job] { job(0); }, &counters[0]);
+                else
+                    pool.after(counters[stage - 1], [&job, stage] { job(stage); }, &counters[stage]);
+            }
+        pool.wait(counters[stages - 1]);
+    }
+    else
+    {
+        for (unsigned stage = 0; stage < stages; ++stage)
+        {
+            JobCounter counter;
+            for (unsigned i = 0; i < jobs; ++i)
+                pool.submit([&job, stage] { job(stage); }, &counter);
+            pool.wait(counter);
+        }
+    }
+    pool.wait();
+    return { std::chrono::duration<double, std::milli>(Clock::now() - start).count(), violations.load() };
+}
+
+struct Snapshot {
+    uint64_t Values[32];                // all equal to the sequence number
+};
+
+int main(int argc, char *argv[])
+{
+    const unsigned threads = argc > 1 ? (unsigned)std::atoi(argv[1]) : std::max(1u, std::thread::hardware_concurrency());
+    const unsigned stages = argc > 2 ? (unsigned)std::atoi(argv[2]) : 64;
+    const unsigned jobs = argc > 3 ? (unsigned)std::atoi(argv[3]) : 32;
+    const unsigned microseconds = argc > 4 ? (unsigned)std::atoi(argv[4]) : 20;
+
+    ThreadPool pool(threads);
+    std::cout << std::fixed << std::setprecision(2) << pool.size() << " threads, " << stages << " stages of " << jobs << " jobs of "
+              << microseconds << " us (" << stages * jobs * microseconds / 1000.0 << " ms of work)" << std::endl;
+    for (bool dependencies : { false, true })
+    {
+        const GraphRun run = runGraph(pool, stages, jobs, microseconds, dependencies);
+        std::cout << (dependencies ? "  after() dependencies: " : "  barrier per stage:    ") << std::setw(8) << run.Milliseconds
+                  << " ms, ordering violations " << run.Violations << std::endl;
+    }
+
+    TripleBuffer<Snapshot> buffer;
+    std::atomic<bool> writing{ true };
+    uint64_t published = 0;
+    std::thread writer([&] {
+        while (writing.load(std::memory_order_relaxed))
+        {
+            Snapshot &next = buffer.back();
+            ++published;
+            for (uint64_t &value : next.Values)
+                value = published;
+            buffer.publish();
+        }
+    });
+    uint64_t acquired = 0, last = 0, torn = 0, stale = 0;
+    const Clock::time_point end = Clock::now() + std::chrono::milliseconds(250);
+    while (Clock::now() < end)
+    {
+        if (!buffer.acquire())
+            continue;
+        const Snapshot &snapshot = buffer.front();
+        ++acquired;
+        for (uint64_t value : snapshot.Values)
+            torn += value != snapshot.Values[0];
+        stale += snapshot.Values[0] <= last;
+        last = snapshot.Values[0];
+    }
+    writing = false;
+    writer.join();
+    std::cout << "triple buffer: " << published << " snapshots published, " << acquired << " acquired in 250 ms, "
+              << torn << " torn, " << stale << " out of order" << std::endl;
+    return 0;
+}
@@ -0,0 +1,104 @@
+// Startup cost of every OBJ under models/: parsing the text versus opening the binary
+// .meshcache. The cache is a scratch copy in the temp directory, so the app's own caches are
+// never touched. Both paths end with the copy glBufferData would make, into a scratch buffer,
+// so the mapped path pays for actually faulting its pages in.
+//
+// usage: mesh_cache_bench [models dir] [runs]
+#include "mesh_cache.h"
+#include "obj_loader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::vector<unsigned char> uploadScratch;
+
+// stand-in for glBufferData: the driver copies both streams out of client memory
+void upload(const MeshView &view)
+{
+    const size_t vertexBytes = (size_t)view.VertexCount * sizeof(Vertex);
+    const size_t indexBytes = (size_t)view.IndexCount * sizeof(uint32_t);
+    uploadScratch.resize(vertexBytes + indexBytes);
+    std::memcpy(uploadScratch.data(), view.Vertices, vertexBytes);
+    std::memcpy(uploadScratch.data() + vertexBytes, view.Indices, indexBytes);
+}
+
+template <typename F>
+double medianMs(int runs, F &&body)
+{
+    std::vector<double> times;
+    for (int i = 0; i < runs; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        body();
+        auto end = std::chrono::steady_clock::now();
+        times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    const std::string modelsDir = argc > 1 ? argv[1] : "../models";
+    const int runs = argc > 2 ? std::max(1, std::atoi(argv[2])) : 9;
+
+    std::vector<std::string> models;
+    for (const auto &entry : std::filesystem::recursive_directory_iterator(modelsDir))
+        if (entry.is_regular_file() && entry.path().extension() == ".obj")
+            models.push_back(entry.path().string());
+    std::sort(models.begin(), models.end());
+
+    std::cout << std::left << std::setw(40) << "model" << std::right
+              << std::setw(10) << "verts" << std::setw(10) << "tris"
+              << std::setw(12) << "obj KB" << std::setw(12) << "cache KB"
+              << std::setw(12) << "text ms" << std::setw(12) << "cache ms" << std::setw(10) << "speedup" << "\n";
+
+    double totalText = 0.0, totalCache = 0.0;
+    for (const std::string &path : models)
+    {
+        MeshData parsed;
+        const double textMs = medianMs(runs, [&] {
+            ObjLoader::load(path, parsed);
+            upload(parsed.view());
+        });
+
+        // the cache goes to a scratch file, built by the same miss path as the app's (so it
+        // holds optimized data), and the app's own .meshcache is left alone; then the warm start
+        const std::string cacheFile = (std::filesystem::temp_directory_path() / ("mesh_cache_bench." +
+                                       std::filesystem::path(path).filename().string() + ".meshcache")).string();
+        std::filesystem::remove(cacheFile);
+        { CachedMesh build(path, cacheFile, false, false); }
+        bool hit = true;
+        const double cacheMs = medianMs(runs, [&] {
+            CachedMesh cached(path, cacheFile, false, false);
+            hit = hit && cached.FromCache;
+            upload(cached.View);
+        });
+        const uintmax_t cacheBytes = std::filesystem::file_size(cacheFile);
+        std::filesystem::remove(cacheFile);
+
+        totalText += textMs;
+        totalCache += cacheMs;
+        std::cout << std::left << std::setw(40) << std::filesystem::path(path).lexically_relative(modelsDir).string() << std::right
+                  << std::setw(10) << parsed.Vertices.size() << std::setw(10) << parsed.Indices.size() / 3
+                  << std::setw(12) << std::fixed << std::setprecision(1) << std::filesystem::file_size(path) / 1024.0
+                  << std::setw(12) << cacheBytes / 1024.0
+                  << std::setw(12) << std::setprecision(3) << textMs << std::setw(12) << cacheMs
+                  << std::setw(9) << std::setprecision(1) << textMs / cacheMs << "x"
+                  << (hit ? "" : "  (cache miss!)") << "\n";
+    }
+    std::cout << std::left << std::setw(84) << "total" << std::right << std::setprecision(3)
+              << std::setw(12) << totalText << std::setw(12) << totalCache
+              << std::setw(9) << std::setprecision(1) << totalText / totalCache << "x\n";
+    return 0;
+}
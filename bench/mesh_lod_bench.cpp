@@ -0,0 +1,137 @@
+// LOD chains built by MeshSimplifier: triangles, error and build time per level, and how many
+// seam vertices of the full mesh each level still references. The seams must hold: every seam
+// position the full mesh uses is locked, so each level still uses it, and no level opens an
+// edge (a crack along the seam) that was closed in the full mesh. Fails if they don't, if a
+// mesh with seams keeps none of its seam vertices, or if no seam vertex was tested at all.
+//
+// usage: mesh_lod_bench [file.obj ...]
+// defaults to sphere2, the Stanford bunny, the low-poly sphere and the nanosuit under ../models;
+// only the nanosuit has UV and normal seams
+#include "obj_loader.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::string> files(argv + 1, argv + argc);
+    if (files.empty())
+        files = { "../models/sphere2.obj", "../models/Stanford Bunny.obj", "../models/sphere.obj", "../models/nanosuit/nanosuit.obj" };
+
+    size_t failures = 0, seamsTested = 0;
+    for (const std::string &path : files)
+    {
+        MeshData mesh;
+        if (!ObjLoader::load(path, mesh))
+            continue;
+        MeshOptimizer::optimize(mesh);
+        // buildLods leaves meshes with several materials at level 0; only the geometry matters
+        // here, so their ranges become one
+        if (mesh.SubMeshes.size() > 1)
+        {
+            mesh.SubMeshes.resize(1);
+            mesh.SubMeshes[0].IndexOffset = 0;
+            mesh.SubMeshes[0].IndexCount = (uint32_t)mesh.Indices.size();
+        }
+        const auto start = std::chrono::steady_clock::now();
+        MeshSimplifier::buildLods(mesh);
+        const auto end = std::chrono::steady_clock::now();
+
+        glm::vec3 lower(INFINITY), upper(-INFINITY);
+        for (const Vertex &vertex : mesh.Vertices)
+        {
+            lower = glm::min(lower, vertex.Position);
+            upper = glm::max(upper, vertex.Position);
+        }
+        const float extent = std::max(upper.x - lower.x, std::max(upper.y - lower.y, upper.z - lower.z));
+
+        // vertices sharing their position with another one are on a seam
+        std::vector<glm::vec3> positions(mesh.Vertices.size()), points;
+        for (size_t v = 0; v < mesh.Vertices.size(); ++v)
+            positions[v] = mesh.Vertices[v].Position;
+        std::vector<uint32_t> remap;
+        MeshOptimizer::weldVertices(positions.data(), positions.size(), points, remap);
+        std::vector<uint32_t> owners(points.size(), 0);
+        for (uint32_t p : remap)
+            ++owners[p];
+
+        std::cout << path << ": " << mesh.Vertices.size() << " vertices, " << mesh.Lods.size() << " levels built in " << std::fixed
+                  << std::setprecision(1) << std::chrono::duration<double, std::milli>(end - start).count() << " ms\n";
+        std::unordered_map<uint64_t, uint32_t> fullEdges;
+        std::vector<char> fullPoints;
+        for (size_t level = 0; level < mesh.Lods.size(); ++level)
+        {
+            const MeshLod &lod = mesh.Lods[level];
+            std::vector<char> referenced(mesh.Vertices.size(), 0);
+            for (uint32_t i = 0; i < lod.IndexCount; ++i)
+                referenced[mesh.Indices[lod.IndexOffset + i]] = 1;
+            size_t seams = 0, seamsKept = 0;
+            for (size_t v = 0; v < mesh.Vertices.size(); ++v)
+            {
+                if (owners[remap[v]] < 2)
+                    continue;
+                ++seams;
+                seamsKept += referenced[v];
+            }
+
+            // seam positions are locked, so every one the full mesh uses is used by each level
+            std::vector<char> usedPoints(points.size(), 0);
+            for (size_t v = 0; v < mesh.Vertices.size(); ++v)
+                usedPoints[remap[v]] |= referenced[v];
+            // edges by position, counted per triangle; a level must not open an edge (a crack)
+            // that was closed in the full mesh
+            std::unordered_map<uint64_t, uint32_t> edges;
+            for (uint32_t i = 0; i < lod.IndexCount; i += 3)
+                for (uint32_t k = 0; k < 3; ++k)
+                {
+                    const uint32_t a = remap[mesh.Indices[lod.IndexOffset + i + k]];
+                    const uint32_t b = remap[mesh.Indices[lod.IndexOffset + i + (k + 1) % 3]];
+                    ++edges[(uint64_t)std::min(a, b) << 32 | std::max(a, b)];
+                }
+            if (level == 0)
+            {
+                fullEdges = edges;
+                fullPoints = usedPoints;
+            }
+            size_t seamPoints = 0, seamPointsLost = 0, cracks = 0;
+            for (size_t p = 0; p < points.size(); ++p)
+                if (owners[p] >= 2 && fullPoints[p])
+                {
+                    ++seamPoints;
+                    seamPointsLost += !usedPoints[p];
+                }
+            for (const auto &edge : edges)
+            {
+                const auto full = fullEdges.find(edge.first);
+                cracks += edge.second != 2 && full != fullEdges.end() && full->second == 2;
+                cracks += edge.second != 2 && full == fullEdges.end();
+            }
+            if (seamPointsLost || cracks || (seams && !seamsKept))
+                ++failures;
+            seamsTested += seamsKept;
+            const VertexCacheStats cache = MeshOptimizer::analyzeVertexCache(mesh.Indices.data() + lod.IndexOffset, lod.IndexCount, mesh.Vertices.size());
+            std::cout << "  LOD " << level << ": " << std::setw(6) << lod.IndexCount / 3 << " triangles (" << std::setw(5) << std::setprecision(1)
+                      << 100.0 * lod.IndexCount / mesh.Lods[0].IndexCount << "%), error " << std::setprecision(4) << lod.Error << " ("
+                      << std::setprecision(2) << 100.0 * lod.Error / extent << "% of extent), ACMR " << cache.ACMR
+                      << ", seam vertices kept " << seamsKept << "/" << seams;
+            if (seamPointsLost)
+                std::cout << ", LOST " << seamPointsLost << " of " << seamPoints << " seam positions";
+            if (cracks)
+                std::cout << ", " << cracks << " CRACKED edges";
+            std::cout << "\n";
+        }
+    }
+    if (!seamsTested)
+    {
+        std::cout << "ERROR::MESH_LOD_BENCH::NO_SEAMS: none of the meshes has a UV or normal seam to check" << std::endl;
+        ++failures;
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,232 @@
+// MeshletBuilder and MeshletCuller on the repo's models: meshlets built and their fill, the
+// post-transform cache cost of the reordered indices, then culling from three rings of
+// cameras around each mesh, looking at it:
+//
+//   orbit  3 bounding radii away, the whole mesh in view: only backface cones reject much
+//   near   1.2 radii away, so most of the mesh is off screen
+//   far    80 radii away, a few pixels tall, so the small meshlet test rejects most of it
+//
+// reporting the share of triangles each test rejected and the CPU cost per 100k triangles.
+// "bunny x64" is 64 bunnies in one mesh, enough meshlets for the culler to use the pool.
+//
+// Every meshlet must be a permutation of its submesh's triangles within the size limits, every
+// triangle of a meshlet rejected as backfacing must face away from the eye and every one of a
+// meshlet rejected as outside must lie outside a frustum plane; the ranges drawn must hold
+// exactly the triangles not rejected.
+//
+// usage: meshlet_bench [views per ring]
+// defaults to 64 views
+#include "camera.h"
+#include "mesh_optimizer.h"
+#include "meshlet_builder.h"
+#include "meshlet_culler.h"
+#include "obj_loader.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct Check {
+    size_t BadMeshlets = 0;             // over the limits, or not a permutation of the submesh
+    size_t WrongBackfacing = 0;         // front facing triangles in meshlets rejected as backfacing
+    size_t WrongOutside = 0;            // triangles inside the frustum in meshlets rejected as outside
+    size_t WrongRanges = 0;             // views whose ranges don't hold exactly the survivors
+};
+
+static void checkMeshlets(const MeshData &before, const MeshData &after, Check &check)
+{
+    auto sortedTriangles = [](const uint32_t *indices, uint32_t count) {
+        std::vector<std::array<uint32_t, 3>> triangles;
+        for (uint32_t i = 0; i + 2 < count; i += 3)
+            triangles.push_back({ indices[i], indices[i + 1], indices[i + 2] });
+        std::sort(triangles.begin(), triangles.end());
+        return triangles;
+    };
+    std::vector<SubMeshRange> ranges(before.SubMeshes);
+    if (ranges.empty())
+        ranges.push_back({ 0, (uint32_t)before.Indices.size(), {} });
+    for (const SubMeshRange &range : ranges)
+        if (sortedTriangles(before.Indices.data() + range.IndexOffset, range.IndexCount) !=
+            sortedTriangles(after.Indices.data() + range.IndexOffset, range.IndexCount))
+            ++check.BadMeshlets;
+    for (const Meshlet &meshlet : after.Meshlets)
+    {
+        std::vector<uint32_t> vertices(after.Indices.begin() + meshlet.IndexOffset,
+                                       after.Indices.begin() + meshlet.IndexOffset + meshlet.TriangleCount * 3);
+        std::sort(vertices.begin(), vertices.end());
+        const size_t unique = std::unique(vertices.begin(), vertices.end()) - vertices.begin();
+        const SubMeshRange &range = ranges[meshlet.SubMesh];
+        check.BadMeshlets += unique != meshlet.VertexCount || unique > MeshletBuilder::MAX_VERTICES ||
+                             meshlet.TriangleCount > MeshletBuilder::MAX_TRIANGLES || meshlet.IndexOffset < range.IndexOffset ||
+                             meshlet.IndexOffset + meshlet.TriangleCount * 3 > range.IndexOffset + range.IndexCount;
+    }
+}
+
+static void checkCull(const MeshData &mesh, const MeshletCuller &culler, const glm::mat4 &model, const std::array<glm::vec4, 6> &planes,
+                      const glm::vec3 &eye, size_t subMeshes, Check &check)
+{
+    const std::vector<Meshlet> &meshlets = culler.getMeshlets();
+    const std::vector<MeshletVerdict> &verdicts = culler.getVerdicts();
+    size_t drawn = 0, ranged = 0;
+    for (size_t i = 0; i < meshlets.size(); ++i)
+    {
+        const Meshlet &meshlet = meshlets[i];
+        if (verdicts[i] == MESHLET_DRAWN)
+            drawn += meshlet.TriangleCount * 3;
+        if (verdicts[i] != MESHLET_BACKFACING && verdicts[i] != MESHLET_OUTSIDE)
+            continue;
+        for (uint32_t t = 0; t < meshlet.TriangleCount; ++t)
+        {
+            glm::vec3 corners[3];
+            for (int corner = 0; corner < 3; ++corner)
+                corners[corner] = glm::vec3(model * glm::vec4(mesh.Vertices[mesh.Indices[meshlet.IndexOffset + t * 3 + corner]].Position, 1.0f));
+            if (verdicts[i] == MESHLET_BACKFACING)
+            {
+                const glm::vec3 normal = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+                const glm::vec3 toTriangle = corners[0] - eye;
+                // slivers, whose normal is mostly rounding, and triangles seen edge on (within
+                // 0.06 degrees, the rounding of the transform) cover no pixels either way
+                const float sliver = 1e-4f * glm::length(corners[1] - corners[0]) * glm::length(corners[2] - corners[0]);
+                check.WrongBackfacing += glm::length(normal) > sliver &&
+                                         glm::dot(normal, toTriangle) < -1e-3f * glm::length(normal) * glm::length(toTriangle);
+                continue;
+            }
+            bool outside = false;
+            for (const glm::vec4 &plane : planes)
+            {
+                bool all = true;
+                for (const glm::vec3 &corner : corners)
+                    all = all && glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f;
+                outside = outside || all;
+            }
+            check.WrongOutside += !outside;
+        }
+    }
+    for (size_t subMesh = 0; subMesh < subMeshes; ++subMesh)
+        for (GLsizei count : culler.drawRanges(subMesh).Counts)
+            ranged += (size_t)count;
+    check.WrongRanges += ranged != drawn;
+}
+
+int main(int argc, char *argv[])
+{
+    const int views = argc > 1 ? std::max(1, std::atoi(argv[1])) : 64;
+
+    struct Model { const char *Name; MeshData Mesh; };
+    std::vector<Model> models(4);
+    models[0].Name = "nanosuit";
+    models[1].Name = "bunny";
+    models[2].Name = "sphere2";
+    models[3].Name = "bunny x64";
+    const char *files[] = { "../models/nanosuit/nanosuit.obj", "../models/Stanford Bunny.obj", "../models/sphere2.obj" };
+    for (int i = 0; i < 3; ++i)
+    {
+        if (!ObjLoader::load(files[i], models[i].Mesh))
+            return 1;
+        MeshOptimizer::optimize(models[i].Mesh);
+    }
+    {
+        // a 4x4x4 grid of bunnies two bunnies apart, in one mesh
+        const MeshData &bunny = models[1].Mesh;
+        glm::vec3 lower(INFINITY), upper(-INFINITY);
+        for (const Vertex &vertex : bunny.Vertices)
+        {
+            lower = glm::min(lower, vertex.Position);
+            upper = glm::max(upper, vertex.Position);
+        }
+        const float spacing = 2.0f * glm::length(upper - lower);
+        MeshData &grid = models[3].Mesh;
+        for (int copy = 0; copy < 64; ++copy)
+        {
+            const glm::vec3 offset = spacing * glm::vec3((float)(copy % 4), (float)(copy / 4 % 4), (float)(copy / 16));
+            const uint32_t base = (uint32_t)grid.Vertices.size();
+            for (Vertex vertex : bunny.Vertices)
+            {
+                vertex.Position += offset;
+                grid.Vertices.push_back(vertex);
+            }
+            for (uint32_t index : bunny.Indices)
+                grid.Indices.push_back(base + index);
+        }
+    }
+
+    ThreadPool pool;
+    std::cout << std::fixed << std::setprecision(2) << views << " views per ring, " << pool.size() << " threads" << std::endl;
+    Check check;
+    for (Model &model : models)
+    {
+        MeshData &mesh = model.Mesh;
+        const MeshData before = mesh;
+        const VertexCacheStats cacheBefore = MeshOptimizer::analyzeVertexCache(mesh.Indices.data(), mesh.Indices.size(), mesh.Vertices.size());
+        const auto buildStart = std::chrono::steady_clock::now();
+        MeshletBuilder::build(mesh);
+        const double buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count();
+        const VertexCacheStats cacheAfter = MeshOptimizer::analyzeVertexCache(mesh.Indices.data(), mesh.Indices.size(), mesh.Vertices.size());
+        checkMeshlets(before, mesh, check);
+        size_t vertices = 0;
+        for (const Meshlet &meshlet : mesh.Meshlets)
+            vertices += meshlet.VertexCount;
+        const size_t triangles = mesh.Indices.size() / 3;
+        std::cout << model.Name << ": " << triangles << " triangles in " << mesh.Meshlets.size() << " meshlets, "
+                  << (double)triangles / mesh.Meshlets.size() << " triangles and " << (double)vertices / mesh.Meshlets.size()
+                  << " vertices each, built in " << buildMs << " ms; ACMR " << cacheBefore.ACMR << " -> " << cacheAfter.ACMR << std::endl;
+
+        // a model matrix that turns and shrinks, so the cull runs in model space for real
+        glm::vec3 lower(INFINITY), upper(-INFINITY);
+        for (const Vertex &vertex : mesh.Vertices)
+        {
+            lower = glm::min(lower, vertex.Position);
+            upper = glm::max(upper, vertex.Position);
+        }
+        const glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(3.0f, 0.0f, -2.0f)) *
+                                    glm::rotate(glm::mat4(1.0f), 0.7f, glm::vec3(0.0f, 1.0f, 0.0f)) *
+                                    glm::scale(glm::mat4(1.0f), glm::vec3(2.0f / glm::length(upper - lower)));
+        const glm::vec3 center = glm::vec3(transform * glm::vec4((lower + upper) * 0.5f, 1.0f));
+        const float radius = 1.0f;
+        const size_t subMeshes = std::max<size_t>(mesh.SubMeshes.size(), 1);
+        MeshletCuller culler(mesh.Meshlets, subMeshes, pool);
+
+        struct Ring { const char *Name; float Distance; };
+        for (const Ring &ring : { Ring{ "orbit", 3.0f }, Ring{ "near", 1.2f }, Ring{ "far", 80.0f } })
+        {
+            MeshletStats sum;
+            double microseconds = 0.0;
+            for (int view = 0; view < views; ++view)
+            {
+                // a Fibonacci sphere of directions, kept off the poles the camera can't look along
+                const float y = 0.9f * (1.0f - 2.0f * (view + 0.5f) / views), around = 2.39996323f * view;
+                const glm::vec3 direction(std::cos(around) * std::sqrt(1.0f - y * y), y, std::sin(around) * std::sqrt(1.0f - y * y));
+                const glm::vec3 eye = center + direction * ring.Distance * radius;
+                const glm::vec3 front = -direction;
+                Camera camera(eye, glm::vec3(0.0f, 1.0f, 0.0f), glm::degrees(std::atan2(front.z, front.x)), glm::degrees(std::asin(front.y)));
+                const glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.01f, 1000.0f);
+                const std::array<glm::vec4, 6> planes = camera.GetFrustumPlanes(projection);
+                culler.cull(transform, planes, eye, camera.GetProjectionScale(projection, 600.0f));
+                checkCull(mesh, culler, transform, planes, eye, subMeshes, check);
+                sum.Triangles += culler.Frame.Triangles;
+                sum.Outside += culler.Frame.Outside;
+                sum.Backfacing += culler.Frame.Backfacing;
+                sum.Small += culler.Frame.Small;
+                sum.Ranges += culler.Frame.Ranges;
+                microseconds += culler.Frame.Microseconds;
+            }
+            const double all = (double)sum.Triangles;
+            std::cout << "  " << std::left << std::setw(6) << ring.Name << std::right << std::setw(6)
+                      << 100.0 * (sum.Outside + sum.Backfacing + sum.Small) / all << "% rejected (" << std::setw(5) << 100.0 * sum.Outside / all
+                      << "% outside, " << std::setw(5) << 100.0 * sum.Backfacing / all << "% backfacing, " << std::setw(6) << 100.0 * sum.Small / all
+                      << "% small), " << std::setw(6) << sum.Ranges / views << " ranges, " << std::setw(8) << microseconds / views << " us/cull, "
+                      << std::setw(6) << microseconds / all * 100000.0 << " us per 100k triangles" << std::endl;
+        }
+    }
+    std::cout << check.BadMeshlets << " bad meshlets, " << check.WrongBackfacing << " front facing triangles culled, " << check.WrongOutside
+              << " visible triangles culled, " << check.WrongRanges << " views with wrong ranges" << std::endl;
+    return check.BadMeshlets + check.WrongBackfacing + check.WrongOutside + check.WrongRanges ? 1 : 0;
+}
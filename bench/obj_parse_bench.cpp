@@ -0,0 +1,66 @@
+// Throughput of ObjLoader::parse at 1..N threads, in MB/s of OBJ text and vertices/s.
+//
+// usage: obj_parse_bench [max threads] [runs] [file.obj ...]
+// defaults to hardware_concurrency() threads and the nanosuit, the Stanford bunny and sphere2
+// under ../models. Files are only split into chunks of at least ObjLoader::MIN_CHUNK_BYTES.
+#include "obj_loader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+int main(int argc, char *argv[])
+{
+    const unsigned maxThreads = argc > 1 && std::atoi(argv[1]) > 0 ? (unsigned)std::atoi(argv[1])
+                                                                  : std::max(1u, std::thread::hardware_concurrency());
+    const int runs = argc > 2 ? std::max(1, std::atoi(argv[2])) : 15;
+    std::vector<std::string> files;
+    for (int i = 3; i < argc; ++i)
+        files.push_back(argv[i]);
+    if (files.empty())
+        files = { "../models/nanosuit/nanosuit.obj", "../models/Stanford Bunny.obj", "../models/sphere2.obj" };
+
+    for (const std::string &path : files)
+    {
+        ObjData obj;
+        if (!ObjLoader::parse(path, obj, 1))
+            continue;
+        const double megabytes = std::filesystem::file_size(path) / (1024.0 * 1024.0);
+        std::cout << path << ": " << std::fixed << std::setprecision(2) << megabytes << " MB, "
+                  << obj.Positions.size() << " v, " << obj.TexCoords.size() << " vt, " << obj.Normals.size() << " vn, "
+                  << obj.Corners.size() / 3 << " triangles, " << obj.MaterialRanges.size() << " material runs\n";
+        std::cout << std::setw(10) << "threads" << std::setw(12) << "ms" << std::setw(12) << "MB/s"
+                  << std::setw(14) << "Mverts/s" << std::setw(12) << "speedup" << "\n";
+
+        double singleThreaded = 0.0;
+        for (unsigned threads = 1; threads <= maxThreads; threads = threads < maxThreads && threads * 2 > maxThreads ? maxThreads : threads * 2)
+        {
+            std::vector<double> times;
+            for (int r = 0; r < runs; ++r)
+            {
+                auto start = std::chrono::steady_clock::now();
+                ObjLoader::parse(path, obj, threads);
+                auto end = std::chrono::steady_clock::now();
+                times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+            }
+            std::sort(times.begin(), times.end());
+            const double ms = times[times.size() / 2];
+            if (threads == 1)
+                singleThreaded = ms;
+            std::cout << std::setw(10) << threads << std::setw(12) << std::setprecision(3) << ms
+                      << std::setw(12) << std::setprecision(1) << megabytes / (ms / 1000.0)
+                      << std::setw(14) << std::setprecision(2) << obj.Positions.size() / (ms / 1000.0) / 1e6
+                      << std::setw(11) << std::setprecision(2) << singleThreaded / ms << "x\n";
+            if (threads == maxThreads)
+                break;
+        }
+        std::cout << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,145 @@
+// OcclusionBuffer on the Cornell box: the walls and both boxes are the occluders, seen from
+// the box's usual camera, and a field of random boxes inside and around it are the occludees.
+// Reports the rasterization and test time per frame for one worker thread and for all of them,
+// and the share of boxes found occluded.
+//
+// The depth buffer must come out the same whatever the thread count. Every box found occluded
+// is checked by casting rays from the eye to a grid of points on its faces against a BVH of
+// the occluders; a box with a point the rays reach was wrongly occluded. The rasterizer is
+// conservative, so the bench fails on any.
+//
+// usage: occlusion_bench [boxes] [frames] [buffer width] [buffer height]
+// defaults to 20000 boxes, 100 frames, a 256x192 buffer
+#include "obj_loader.h"
+#include "bvh.h"
+#include "occlusion_buffer.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Occluder {
+    std::vector<glm::vec3> Positions;
+    std::vector<uint32_t> Indices;
+};
+
+struct Run {
+    double RasterMilliseconds;
+    double TestMilliseconds;
+    size_t Occluded;
+    std::vector<float> Depth;
+    std::vector<uint32_t> Visible;
+};
+
+static Run measure(unsigned int threads, const std::vector<Occluder> &occluders, const std::vector<AABB> &boxes, const glm::mat4 &viewProjection,
+                   int width, int height, unsigned int frames)
+{
+    ThreadPool pool(threads);
+    OcclusionBuffer buffer(pool, width, height);
+    Run run = { 0.0, 0.0, 0, {}, {} };
+    for (unsigned int frame = 0; frame < frames; ++frame)
+    {
+        buffer.begin(viewProjection);
+        for (const Occluder &occluder : occluders)
+            buffer.addOccluder(occluder.Positions, occluder.Indices, glm::mat4(1.0f));
+        buffer.rasterize();
+        run.Visible.resize(boxes.size());
+        for (uint32_t i = 0; i < boxes.size(); ++i)
+            run.Visible[i] = i;
+        buffer.cull(run.Visible, [&boxes](uint32_t id) { return boxes[id]; });
+        run.RasterMilliseconds += buffer.Frame.RasterMicroseconds / 1000.0 / frames;
+        run.TestMilliseconds += buffer.Frame.TestMicroseconds / 1000.0 / frames;
+        run.Occluded = buffer.Frame.Occluded;
+    }
+    run.Depth = buffer.getDepth();
+    return run;
+}
+
+int main(int argc, char *argv[])
+{
+    const size_t boxCount = argc > 1 ? (size_t)std::strtoull(argv[1], nullptr, 10) : 20000;
+    const unsigned int frames = argc > 2 ? (unsigned int)std::atoi(argv[2]) : 100;
+    const int width = argc > 3 ? std::atoi(argv[3]) : 256;
+    const int height = argc > 4 ? std::atoi(argv[4]) : 192;
+
+    std::vector<Occluder> occluders;
+    std::vector<BVHTriangle> triangles;
+    for (const char *name : { "floor.obj", "left.obj", "right.obj", "tallbox.obj", "shortbox.obj" })
+    {
+        MeshData mesh;
+        if (!ObjLoader::load(std::string("../models/cornellbox/") + name, mesh, 1))
+            return 1;
+        Occluder occluder;
+        for (const Vertex &vertex : mesh.Vertices)
+            occluder.Positions.push_back(vertex.Position);
+        occluder.Indices = mesh.Indices;
+        for (size_t i = 0; i + 2 < mesh.Indices.size(); i += 3)
+            triangles.push_back({ occluder.Positions[mesh.Indices[i]], occluder.Positions[mesh.Indices[i + 1]], occluder.Positions[mesh.Indices[i + 2]] });
+        occluders.push_back(occluder);
+    }
+    BVH bvh;
+    bvh.build(triangles);
+
+    // the box's own camera, and boxes of 10 to 60 mm from well left of it to well behind it
+    const glm::vec3 eye(278.0f, 273.0f, -800.0f);
+    const glm::mat4 viewProjection = glm::perspective(glm::radians(39.3f), (float)width / height, 1.0f, 5000.0f) *
+                                     glm::lookAt(eye, glm::vec3(278.0f, 273.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    std::mt19937 random(5);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<AABB> boxes(boxCount);
+    for (AABB &box : boxes)
+    {
+        const glm::vec3 center(-400.0f + 1350.0f * unit(random), 550.0f * unit(random), -100.0f + 1300.0f * unit(random));
+        const glm::vec3 half = 0.5f * (10.0f + 50.0f * glm::vec3(unit(random), unit(random), unit(random)));
+        box = { center - half, center + half };
+    }
+
+    const unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+    std::cout << std::fixed << std::setprecision(3) << boxCount << " boxes behind " << triangles.size() << " occluder triangles, "
+              << width << "x" << height << " buffer, " << frames << " frames" << std::endl;
+    const Run single = measure(1, occluders, boxes, viewProjection, width, height, frames);
+    const Run parallel = measure(cores, occluders, boxes, viewProjection, width, height, frames);
+    for (const Run *run : { &single, &parallel })
+        std::cout << "  " << std::setw(2) << (run == &single ? 1 : cores) << " threads: raster " << std::setw(7) << run->RasterMilliseconds
+                  << " ms, test " << std::setw(7) << run->TestMilliseconds << " ms, " << run->Occluded << " occluded ("
+                  << std::setprecision(1) << 100.0 * run->Occluded / std::max<size_t>(boxCount, 1) << "%)" << std::setprecision(3) << std::endl;
+    size_t failures = single.Depth != parallel.Depth;
+    std::cout << "depth buffers " << (single.Depth == parallel.Depth ? "match" : "DIFFER") << " across thread counts" << std::endl;
+
+    // a 5x5 grid on every face of every occluded box, each point looked for from the eye
+    std::vector<char> visible(boxCount, 0);
+    for (uint32_t id : single.Visible)
+        visible[id] = 1;
+    size_t wrong = 0;
+    for (size_t i = 0; i < boxCount; ++i)
+    {
+        if (visible[i])
+            continue;
+        const AABB &box = boxes[i];
+        bool seen = false;
+        for (int face = 0; face < 6 && !seen; ++face)
+            for (int u = 0; u < 5 && !seen; ++u)
+                for (int v = 0; v < 5 && !seen; ++v)
+                {
+                    glm::vec3 t;
+                    const int axis = face / 2;
+                    t[axis] = (float)(face % 2);
+                    t[(axis + 1) % 3] = u / 4.0f;
+                    t[(axis + 2) % 3] = v / 4.0f;
+                    const glm::vec3 point = glm::mix(box.Min, box.Max, t);
+                    const float length = glm::length(point - eye);
+                    seen = !bvh.occluded(Ray(eye, (point - eye) / length, length * 0.999f));
+                }
+        wrong += seen;
+    }
+    std::cout << "ray check: " << wrong << " of " << single.Occluded << " occluded boxes have a point visible from the eye" << std::endl;
+    failures += wrong;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,56 @@
+// Path tracer throughput (Mrays/s, counting camera, bounce and shadow rays) on the Cornell
+// box for 1, 2, 4, ... threads, with speedup and parallel efficiency against one thread.
+//
+// usage: path_tracer_bench [max threads] [passes] [width] [height]
+// defaults to hardware_concurrency(), 8 passes, 256x256; writes the last image to pathtrace_bench.png
+#include "path_tracer.h"
+#include "png_writer.h"
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+int main(int argc, char *argv[])
+{
+    const unsigned maxThreads = argc > 1 ? (unsigned)std::atoi(argv[1]) : std::max(1u, std::thread::hardware_concurrency());
+    const unsigned passes = argc > 2 ? (unsigned)std::atoi(argv[2]) : 8;
+    const unsigned width = argc > 3 ? (unsigned)std::atoi(argv[3]) : 256;
+    const unsigned height = argc > 4 ? (unsigned)std::atoi(argv[4]) : 256;
+
+    std::vector<unsigned> threadCounts;
+    for (unsigned threads = 1; threads < maxThreads; threads *= 2)
+        threadCounts.push_back(threads);
+    threadCounts.push_back(maxThreads);
+
+    double baseline = 0.0;
+    std::vector<unsigned char> pixels;
+    std::cout << std::fixed << std::setprecision(2);
+    for (unsigned threads : threadCounts)
+    {
+        PathTracer tracer(width, height);
+        if (!tracer.Loaded)
+            return -1;
+        ThreadPool pool(threads);
+        uint64_t rays = 0;
+        double seconds = 0.0;
+        for (unsigned pass = 0; pass < passes; ++pass)
+        {
+            tracer.renderPass(pool);
+            rays += tracer.LastPassRays;
+            seconds += tracer.LastPassSeconds;
+        }
+        const double mrays = rays / seconds / 1.0e6;
+        if (threads == threadCounts.front())
+            baseline = mrays / threads;
+        std::cout << std::setw(3) << threads << " threads: " << std::setw(8) << mrays << " Mrays/s, "
+                  << std::setw(7) << 1000.0 * seconds / passes << " ms/pass, speedup " << mrays / baseline
+                  << "x, efficiency " << std::setprecision(0) << 100.0 * mrays / (baseline * threads) << "%"
+                  << std::setprecision(2) << std::endl;
+        tracer.resolve(pixels);
+        if (threads == threadCounts.back())
+            PngWriter::write("pathtrace_bench.png", pixels.data(), width, height);
+    }
+    return 0;
+}
@@ -0,0 +1,185 @@
+// Ray query throughput (Mrays/s) of the binary BVH against the 8-wide RayQuery on each of its
+// paths: scalar, SSE, AVX2 and AVX2 ray packets. Coherent rays are a 512x512 pinhole camera
+// looking at the model (traced as 4x2 pixel packets), incoherent rays cross the bounding
+// sphere between random points. Every path must find the same hits as the binary BVH.
+//
+// usage: ray_query_bench [file.obj ...]
+// defaults to sphere2, the Stanford bunny and the nanosuit under ../models
+#include "obj_loader.h"
+#include "bvh8.h"
+
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+static const unsigned int IMAGE_SIZE = 512;
+static const unsigned int RANDOM_RAYS = IMAGE_SIZE * IMAGE_SIZE;
+
+struct Result {
+    double Seconds;
+    std::vector<RayHit> Hits;
+};
+
+// best of three runs
+static Result measure(size_t rayCount, const std::function<void(std::vector<RayHit>&)> &trace)
+{
+    Result result = { 1e30, std::vector<RayHit>(rayCount) };
+    for (int run = 0; run < 3; ++run)
+    {
+        auto start = std::chrono::steady_clock::now();
+        trace(result.Hits);
+        auto end = std::chrono::steady_clock::now();
+        result.Seconds = std::min(result.Seconds, std::chrono::duration<double>(end - start).count());
+    }
+    return result;
+}
+
+// same triangle for every ray, or a distance within tolerance where two triangles meet
+static size_t mismatches(const std::vector<RayHit> &reference, const std::vector<RayHit> &hits)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < hits.size(); ++i)
+    {
+        if (reference[i].Triangle == hits[i].Triangle)
+            continue;
+        if (reference[i].Triangle == UINT32_MAX || hits[i].Triangle == UINT32_MAX ||
+            std::fabs(reference[i].T - hits[i].T) > 1e-3f * std::max(1.0f, reference[i].T))
+            ++count;
+    }
+    return count;
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::string> files(argv + 1, argv + argc);
+    if (files.empty())
+        files = { "../models/sphere2.obj", "../models/Stanford Bunny.obj", "../models/nanosuit/nanosuit.obj" };
+
+    std::cout << "detected path: " << rayQueryPathName(RayQuery::detectPath()) << "\n" << std::fixed;
+    for (const std::string &path : files)
+    {
+        MeshData mesh;
+        if (!ObjLoader::load(path, mesh))
+            continue;
+        std::vector<BVHTriangle> triangles;
+        glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+        for (size_t i = 0; i + 2 < mesh.Indices.size(); i += 3)
+        {
+            BVHTriangle triangle = { mesh.Vertices[mesh.Indices[i]].Position, mesh.Vertices[mesh.Indices[i + 1]].Position,
+                                     mesh.Vertices[mesh.Indices[i + 2]].Position };
+            boundsMin = glm::min(boundsMin, glm::min(triangle.V0, glm::min(triangle.V1, triangle.V2)));
+            boundsMax = glm::max(boundsMax, glm::max(triangle.V0, glm::max(triangle.V1, triangle.V2)));
+            triangles.push_back(triangle);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        BVH bvh;
+        bvh.build(triangles);
+        auto middle = std::chrono::steady_clock::now();
+        RayQuery query;
+        query.build(bvh);
+        auto end = std::chrono::steady_clock::now();
+        std::cout << "\n" << path << ": " << triangles.size() << " triangles, " << bvh.Nodes.size() << " binary nodes ("
+                  << std::setprecision(1) << std::chrono::duration<double, std::milli>(middle - start).count() << " ms), "
+                  << query.Nodes.size() << " BVH8 nodes, " << query.Packets.size() << " triangle packets ("
+                  << std::chrono::duration<double, std::milli>(end - middle).count() << " ms collapse)\n";
+
+        // camera rays, stored so every 8 consecutive rays form a 4x2 pixel block
+        const glm::vec3 center = 0.5f * (boundsMin + boundsMax);
+        const float radius = 0.5f * glm::length(boundsMax - boundsMin);
+        const glm::vec3 eye = center + glm::vec3(0.3f, 0.2f, 1.0f) * (2.2f * radius);
+        const glm::vec3 forward = glm::normalize(center - eye);
+        const glm::vec3 right = glm::normalize(glm::cross(forward, glm::vec3(0.0f, 1.0f, 0.0f)));
+        const glm::vec3 up = glm::cross(right, forward);
+        const float scale = std::tan(glm::radians(25.0f));
+        std::vector<Ray> coherent;
+        coherent.reserve(IMAGE_SIZE * IMAGE_SIZE);
+        for (unsigned int by = 0; by < IMAGE_SIZE; by += 2)
+            for (unsigned int bx = 0; bx < IMAGE_SIZE; bx += 4)
+                for (unsigned int i = 0; i < 8; ++i)
+                {
+                    const float x = ((bx + i % 4 + 0.5f) / IMAGE_SIZE * 2.0f - 1.0f) * scale;
+                    const float y = ((by + i / 4 + 0.5f) / IMAGE_SIZE * 2.0f - 1.0f) * scale;
+                    coherent.push_back(Ray(eye, glm::normalize(forward + x * right + y * up)));
+                }
+
+        std::mt19937 random(42);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        auto pointInSphere = [&]() {
+            glm::vec3 p;
+            do
+                p = glm::vec3(unit(random), unit(random), unit(random));
+            while (glm::dot(p, p) > 1.0f);
+            return center + p * radius;
+        };
+        std::vector<Ray> incoherent;
+        incoherent.reserve(RANDOM_RAYS);
+        for (unsigned int i = 0; i < RANDOM_RAYS; ++i)
+        {
+            const glm::vec3 from = pointInSphere();
+            incoherent.push_back(Ray(from, glm::normalize(pointInSphere() - from)));
+        }
+
+        for (int set = 0; set < 2; ++set)
+        {
+            const std::vector<Ray> &rays = set == 0 ? coherent : incoherent;
+            std::cout << (set == 0 ? "  coherent (camera)" : "  incoherent (random)") << "\n";
+
+            const Result reference = measure(rays.size(), [&](std::vector<RayHit> &hits) {
+                for (size_t i = 0; i < rays.size(); ++i)
+                {
+                    Ray ray = rays[i];
+                    hits[i] = RayHit();
+                    bvh.intersect(ray, hits[i]);
+                }
+            });
+            size_t hitCount = 0;
+            for (const RayHit &hit : reference.Hits)
+                hitCount += hit.Triangle != UINT32_MAX;
+            auto report = [&](const char *name, const Result &result) {
+                std::cout << "    " << std::left << std::setw(14) << name << std::right << std::setprecision(2) << std::setw(8)
+                          << rays.size() / result.Seconds / 1e6 << " Mrays/s  " << std::setw(6)
+                          << reference.Seconds / result.Seconds << "x  " << mismatches(reference.Hits, result.Hits)
+                          << " mismatches\n";
+            };
+            std::cout << "    " << hitCount << " of " << rays.size() << " rays hit\n";
+            report("binary BVH", reference);
+
+            const RayQueryPath paths[] = { RayQueryPath::Scalar, RayQueryPath::SSE, RayQueryPath::AVX2 };
+            for (RayQueryPath queryPath : paths)
+            {
+                if (queryPath > RayQuery::detectPath())
+                    continue;
+                query.Path = queryPath;
+                report(rayQueryPathName(queryPath), measure(rays.size(), [&](std::vector<RayHit> &hits) {
+                    for (size_t i = 0; i < rays.size(); ++i)
+                    {
+                        Ray ray = rays[i];
+                        hits[i] = RayHit();
+                        query.intersect(ray, hits[i]);
+                    }
+                }));
+            }
+            if (set == 0 && RayQuery::detectPath() == RayQueryPath::AVX2)
+            {
+                query.Path = RayQueryPath::AVX2;
+                report("AVX2 packets", measure(rays.size(), [&](std::vector<RayHit> &hits) {
+                    RayPacket8 packet;
+                    for (size_t i = 0; i + 8 <= rays.size(); i += 8)
+                    {
+                        for (unsigned int lane = 0; lane < 8; ++lane)
+                            packet.set(lane, rays[i + lane]);
+                        query.intersect(packet, &hits[i]);
+                    }
+                }));
+            }
+        }
+        query.Path = RayQuery::detectPath();
+    }
+    return 0;
+}
@@ -0,0 +1,126 @@
+// CPU cost of laying out text with TextBatch over a GlyphAtlas, per glyph, without a context:
+//
+//   cold      the first frame of N labels, every run shaped and every glyph rasterized
+//   warm      the same labels every frame, runs and glyphs all cached
+//   changing  labels whose text changes every frame (a counter), so every run is shaped again
+//   evicting  ASCII at a different size from 10 to 24 px every frame into a 256x256 atlas,
+//             which holds one size but not all of them, so shelves are evicted and glyphs
+//             rasterized again all the time
+//
+// After every frame no two glyphs in the atlas may overlap and every quad's atlas coordinates
+// must be those of a glyph in it.
+//
+// usage: text_bench [labels] [frames] [font.ttf]
+// defaults to 5000 labels, 100 frames and ../fonts/DejaVuSansMono.ttf
+#include "glyph_atlas.h"
+#include "text_batch.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct Check {
+    size_t Overlaps = 0;                // atlas pixels claimed by two glyphs
+    size_t StrayQuads = 0;              // quads not matching any glyph in the atlas
+};
+
+static void check(const GlyphAtlas &atlas, const TextBatch &batch, Check &result)
+{
+    std::vector<uint32_t> owner((size_t)atlas.getWidth() * atlas.getHeight(), UINT32_MAX);
+    for (uint32_t glyph = 0; glyph < atlas.glyphCount(); ++glyph)
+    {
+        const GlyphInfo &info = atlas.info(glyph);
+        if (info.Shelf < 0)
+            continue;
+        for (int y = info.Y; y < info.Y + info.Height; ++y)
+            for (int x = info.X; x < info.X + info.Width; ++x)
+            {
+                uint32_t &pixel = owner[(size_t)y * atlas.getWidth() + x];
+                result.Overlaps += pixel != UINT32_MAX;
+                pixel = glyph;
+            }
+    }
+    for (size_t quad = 0; quad + 3 < batch.Vertices.size(); quad += 4)
+    {
+        const TextVertex &corner = batch.Vertices[quad], &opposite = batch.Vertices[quad + 2];
+        const int x = (int)(corner.U * atlas.getWidth() + 0.5f), y = (int)(corner.V * atlas.getHeight() + 0.5f);
+        const uint32_t glyph = owner[(size_t)y * atlas.getWidth() + x];
+        const GlyphInfo *info = glyph != UINT32_MAX ? &atlas.info(glyph) : nullptr;
+        result.StrayQuads += !info || info->X != x || info->Y != y || (int)(opposite.U * atlas.getWidth() + 0.5f) != x + info->Width;
+    }
+}
+
+// lays out frames frames of frame(index, batch), returning microseconds per frame
+static double run(const char *name, GlyphAtlas &atlas, TextBatch &batch, unsigned int frames, const std::function<void(unsigned int)> &frame)
+{
+    Check result;
+    double microseconds = 0.0;
+    size_t glyphs = 0, shaped = 0;
+    const size_t rasterizedBefore = atlas.Stats.Rasterized, evictedBefore = atlas.Stats.EvictedShelves, droppedBefore = atlas.Stats.Dropped;
+    for (unsigned int i = 0; i < frames; ++i)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        frame(i);
+        microseconds += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        glyphs += batch.Frame.Glyphs;
+        shaped += batch.Frame.RunsShaped;
+        check(atlas, batch, result);
+        batch.newFrame();
+    }
+    std::cout << "  " << std::left << std::setw(9) << name << std::right << std::setw(9) << microseconds / frames << " us/frame, "
+              << std::setw(6) << glyphs / frames << " glyphs/frame, " << std::setw(6) << 1000.0 * microseconds / std::max<size_t>(glyphs, 1)
+              << " ns/glyph; " << shaped / frames << " runs shaped, " << (atlas.Stats.Rasterized - rasterizedBefore) / frames
+              << " glyphs rasterized, " << (atlas.Stats.EvictedShelves - evictedBefore) / (double)frames << " shelves evicted, "
+              << (atlas.Stats.Dropped - droppedBefore) / frames << " dropped per frame; " << result.Overlaps << " overlaps, "
+              << result.StrayQuads << " stray quads" << std::endl;
+    return microseconds / frames;
+}
+
+int main(int argc, char *argv[])
+{
+    const unsigned int labels = argc > 1 ? (unsigned int)std::atoi(argv[1]) : 5000;
+    const unsigned int frames = argc > 2 ? (unsigned int)std::atoi(argv[2]) : 100;
+    const std::string font = argc > 3 ? argv[3] : "../fonts/DejaVuSansMono.ttf";
+
+    GlyphAtlas atlas(font);
+    if (!atlas.valid())
+        return 1;
+    TextBatch batch(atlas);
+    std::vector<std::string> names(labels);
+    for (unsigned int i = 0; i < labels; ++i)
+        names[i] = (i % 2 ? "sphere " : "cube ") + std::to_string(i / 2);
+    const glm::vec4 white(1.0f);
+    auto layout = [&](unsigned int) {
+        for (unsigned int i = 0; i < labels; ++i)
+            batch.add((float)(i % 64) * 12.0f, (float)(i / 64) * 14.0f, 12, white, names[i].c_str(), TEXT_CENTER);
+    };
+
+    std::cout << std::fixed << std::setprecision(2) << labels << " labels, " << frames << " frames, " << font << std::endl;
+    run("cold", atlas, batch, 1, layout);
+    run("warm", atlas, batch, frames, layout);
+    char changing[64];
+    run("changing", atlas, batch, frames, [&](unsigned int frame) {
+        for (unsigned int i = 0; i < labels; ++i)
+        {
+            std::snprintf(changing, sizeof(changing), "%u: %.2f m", i, (frame * labels + i) * 0.01);
+            batch.add((float)(i % 64) * 12.0f, (float)(i / 64) * 14.0f, 12, white, changing, TEXT_LEFT);
+        }
+    });
+
+    GlyphAtlas small(font, 256, 256);
+    TextBatch churn(small);
+    std::string ascii;
+    for (char c = 33; c < 127; ++c)
+        ascii.push_back(c);
+    run("evicting", small, churn, frames, [&](unsigned int frame) {
+        // one size per frame, which fits, but the sizes before it don't fit alongside
+        const int size = 10 + (int)(frame % 8) * 2;
+        churn.add(0.0f, (float)size, size, white, ascii.c_str());
+    });
+    return 0;
+}
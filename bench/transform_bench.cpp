@@ -0,0 +1,145 @@
+// TransformHierarchy::update() on a few shapes of hierarchy, with one worker thread and with
+// all of them, in world matrices recomputed per second:
+//
+//   flat    N roots, every one turned each frame
+//   deep    chains of 64 nodes, every chain's root turned each frame, so everything below moves
+//   sparse  the same chains with only 1% of the roots turned, so 1% of the nodes are recomputed
+//   tree    one root with four children per node, the root turned each frame
+//
+// Every node is bound to an output matrix, which must match worldMatrix(), and the world
+// matrices must match parent * translate * rotate * scale computed one node at a time.
+//
+// usage: transform_bench [nodes] [frames]
+// defaults to 1000000 nodes and 20 frames
+#include "transform_hierarchy.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Shape {
+    const char *Name;
+    // adds the nodes to hierarchy and returns the ones turned each frame
+    std::function<std::vector<uint32_t>(TransformHierarchy&, size_t, std::mt19937&)> Build;
+};
+
+// the biggest difference between the hierarchy's world matrices and the same computed naively
+static float check(const TransformHierarchy &hierarchy, const std::vector<glm::mat4> &outputs, size_t &mismatched)
+{
+    std::vector<glm::mat4> reference(hierarchy.size());
+    float error = 0.0f;
+    for (uint32_t node = 0; node < hierarchy.size(); ++node)
+    {
+        // handles are given out in order, so a parent's is always done before its children's
+        const glm::mat4 local = glm::translate(glm::mat4(1.0f), hierarchy.position(node)) * glm::mat4_cast(hierarchy.rotation(node)) *
+                                glm::scale(glm::mat4(1.0f), hierarchy.scale(node));
+        const uint32_t parent = hierarchy.parent(node);
+        reference[node] = parent == TransformHierarchy::NONE ? local : reference[parent] * local;
+        const glm::mat4 &world = hierarchy.worldMatrix(node);
+        mismatched += world != outputs[node];
+        for (int column = 0; column < 4; ++column)
+        {
+            const glm::vec4 difference = glm::abs(world[column] - reference[node][column]) / glm::max(glm::vec4(1.0f), glm::abs(reference[node][column]));
+            error = std::max(error, std::max(std::max(difference.x, difference.y), std::max(difference.z, difference.w)));
+        }
+    }
+    return error;
+}
+
+int main(int argc, char *argv[])
+{
+    const size_t nodes = argc > 1 ? (size_t)std::strtoull(argv[1], nullptr, 10) : 1000000;
+    const unsigned int frames = argc > 2 ? (unsigned int)std::atoi(argv[2]) : 20;
+
+    const auto randomLocal = [](TransformHierarchy &hierarchy, uint32_t parent, std::mt19937 &random) {
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        const glm::vec3 axis = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + 0.01f);
+        return hierarchy.add(parent, glm::vec3(unit(random), unit(random), unit(random)), glm::angleAxis(unit(random) * 3.14159265f, axis),
+                             glm::vec3(0.9f + 0.1f * unit(random)));
+    };
+    const std::vector<Shape> shapes = {
+        { "flat", [&](TransformHierarchy &hierarchy, size_t count, std::mt19937 &random) {
+            std::vector<uint32_t> turned;
+            for (size_t i = 0; i < count; ++i)
+                turned.push_back(randomLocal(hierarchy, TransformHierarchy::NONE, random));
+            return turned;
+        } },
+        { "deep", [&](TransformHierarchy &hierarchy, size_t count, std::mt19937 &random) {
+            // chain after chain, so the nodes arrive out of depth order and are sorted
+            std::vector<uint32_t> turned;
+            for (size_t chain = 0; chain < count / 64; ++chain)
+            {
+                uint32_t node = randomLocal(hierarchy, TransformHierarchy::NONE, random);
+                turned.push_back(node);
+                for (int depth = 1; depth < 64; ++depth)
+                    node = randomLocal(hierarchy, node, random);
+            }
+            return turned;
+        } },
+        { "sparse", [&](TransformHierarchy &hierarchy, size_t count, std::mt19937 &random) {
+            std::vector<uint32_t> turned;
+            for (size_t chain = 0; chain < count / 64; ++chain)
+            {
+                uint32_t node = randomLocal(hierarchy, TransformHierarchy::NONE, random);
+                if (chain % 100 == 0)
+                    turned.push_back(node);
+                for (int depth = 1; depth < 64; ++depth)
+                    node = randomLocal(hierarchy, node, random);
+            }
+            return turned;
+        } },
+        { "tree", [&](TransformHierarchy &hierarchy, size_t count, std::mt19937 &random) {
+            const uint32_t root = randomLocal(hierarchy, TransformHierarchy::NONE, random);
+            for (size_t i = 1; i < count; ++i)
+                randomLocal(hierarchy, (uint32_t)((i - 1) / 4), random);
+            return std::vector<uint32_t>{ root };
+        } },
+    };
+
+    const unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+    std::cout << std::fixed << std::setprecision(2) << nodes << " nodes, " << frames << " frames" << std::endl;
+    for (const Shape &shape : shapes)
+    {
+        for (unsigned int threads = 1; threads <= cores; threads = threads < cores ? cores : cores + 1)
+        {
+            ThreadPool pool(threads);
+            TransformHierarchy hierarchy;
+            std::mt19937 random(7);
+            const std::vector<uint32_t> turned = shape.Build(hierarchy, nodes, random);
+            std::vector<glm::mat4> outputs(hierarchy.size());
+            for (uint32_t node = 0; node < hierarchy.size(); ++node)
+                hierarchy.bind(node, &outputs[node]);
+            hierarchy.update(&pool);
+            const double sortMicroseconds = hierarchy.Frame.Microseconds;
+
+            double microseconds = 0.0;
+            size_t updated = 0;
+            for (unsigned int frame = 0; frame < frames; ++frame)
+            {
+                const glm::quat spin = glm::angleAxis(0.01f, glm::vec3(0.0f, 1.0f, 0.0f));
+                for (uint32_t node : turned)
+                    hierarchy.setRotation(node, spin * hierarchy.rotation(node));
+                hierarchy.update(&pool);
+                microseconds += hierarchy.Frame.Microseconds;
+                updated += hierarchy.Frame.Updated;
+            }
+            size_t mismatched = 0;
+            const float error = check(hierarchy, outputs, mismatched);
+            std::cout << "  " << std::left << std::setw(7) << shape.Name << std::right << std::setw(3) << threads << " threads: "
+                      << std::setw(4) << hierarchy.Frame.Levels << " levels, " << std::setw(8) << updated / frames << " updated, "
+                      << std::setw(9) << microseconds / frames / 1000.0 << " ms/update, " << std::setw(7) << updated / std::max(microseconds, 1.0)
+                      << " M matrices/s; first update " << sortMicroseconds / 1000.0 << " ms; max error " << std::scientific
+                      << std::setprecision(1) << error << std::fixed << std::setprecision(2) << ", " << mismatched << " outputs differ" << std::endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,140 @@
+// What VertexQuantizer makes of the repo's models: the formats it picks at a few tolerances,
+// bytes per vertex against the 32 of a float Vertex, the vertex memory saved and how fast it
+// packs. The packed bytes are decoded again the way the shaders do, and the errors found must
+// match the quantizer's and stay within the tolerance.
+//
+// usage: vertex_quant_bench [obj...]
+// defaults to the spheres, the bunny, the nanosuit and the Cornell box from ../models
+#include "obj_loader.h"
+#include "vertex_quantizer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// the vertices back out of the packed bytes, as the vertex shader sees them
+static QuantizationError decodeError(const Vertex *vertices, size_t count, const QuantizedVertices &quantized)
+{
+    const VertexFormat &format = quantized.Format;
+    QuantizationError error;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const uint8_t *vertex = &quantized.Data[i * format.Stride];
+        glm::vec3 position;
+        if (format.Position == POSITION_UNORM16)
+        {
+            glm::u16vec3 stored;
+            std::memcpy(&stored, vertex + format.PositionOffset, sizeof(stored));
+            position = VertexQuantizer::decodePosition(stored, format.Offset, format.Scale);
+        }
+        else
+            std::memcpy(&position, vertex + format.PositionOffset, sizeof(position));
+        error.Position = std::max(error.Position, glm::length(position - vertices[i].Position));
+
+        glm::vec3 normal;
+        if (format.Normal == NORMAL_OCT16)
+        {
+            uint16_t stored[2];
+            std::memcpy(stored, vertex + format.NormalOffset, sizeof(stored));
+            normal = VertexQuantizer::decodeNormal(glm::uvec2(stored[0], stored[1]), 16);
+        }
+        else if (format.Normal == NORMAL_OCT8)
+            normal = VertexQuantizer::decodeNormal(glm::uvec2(vertex[format.NormalOffset], vertex[format.NormalOffset + 1]), 8);
+        else
+            std::memcpy(&normal, vertex + format.NormalOffset, sizeof(normal));
+        const float cosine = glm::dot(glm::normalize(normal), glm::normalize(vertices[i].Normal));
+        error.NormalDegrees = std::max(error.NormalDegrees, glm::degrees(std::acos(std::min(1.0f, std::max(-1.0f, cosine)))));
+
+        glm::vec2 uv(0.0f);
+        if (format.TexCoords == TEXCOORD_HALF)
+        {
+            uint16_t stored[2];
+            std::memcpy(stored, vertex + format.TexCoordOffset, sizeof(stored));
+            uv = glm::vec2(VertexQuantizer::fromHalf(stored[0]), VertexQuantizer::fromHalf(stored[1]));
+        }
+        else if (format.TexCoords == TEXCOORD_FLOAT)
+            std::memcpy(&uv, vertex + format.TexCoordOffset, sizeof(uv));
+        const glm::vec2 difference = glm::abs(uv - vertices[i].TexCoords);
+        error.TexCoord = std::max(error.TexCoord, std::max(difference.x, difference.y));
+    }
+    return error;
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::string> files(argv + 1, argv + argc);
+    if (files.empty())
+        files = { "../models/sphere.obj", "../models/sphere2.obj", "../models/Stanford Bunny.obj", "../models/nanosuit/nanosuit.obj",
+                  "../models/cornellbox/floor.obj", "../models/cornellbox/tallbox.obj" };
+
+    struct Setting { const char *Name; VertexTolerance Tolerance; };
+    std::vector<Setting> settings(3);
+    settings[0].Name = "default";
+    settings[1].Name = "loose";
+    settings[1].Tolerance = { 1e-3f, 4.0f, 1.0f / 512.0f };
+    settings[2].Name = "tight";
+    settings[2].Tolerance = { 1e-5f, 0.1f, 1.0f / 16384.0f };
+
+    std::cout << std::fixed << std::setprecision(2);
+    size_t failures = 0;
+    for (const Setting &setting : settings)
+    {
+        std::cout << setting.Name << " tolerance: " << std::scientific << std::setprecision(1) << setting.Tolerance.Position << " of the extent, "
+                  << setting.Tolerance.NormalDegrees << " deg, " << setting.Tolerance.TexCoord << " uv" << std::fixed << std::setprecision(2) << std::endl;
+        size_t floatBytes = 0, packedBytes = 0;
+        for (const std::string &file : files)
+        {
+            MeshData mesh;
+            if (!ObjLoader::load(file, mesh) || mesh.Vertices.empty())
+                continue;
+            const Vertex *vertices = mesh.Vertices.data();
+            const size_t count = mesh.Vertices.size();
+
+            const int runs = 5;
+            QuantizedVertices quantized;
+            double best = 1e30;
+            for (int run = 0; run < runs; ++run)
+            {
+                const auto start = std::chrono::steady_clock::now();
+                quantized = VertexQuantizer::quantize(vertices, count, setting.Tolerance);
+                best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            }
+
+            glm::vec3 lo = vertices[0].Position, hi = lo;
+            for (size_t i = 0; i < count; ++i)
+            {
+                lo = glm::min(lo, vertices[i].Position);
+                hi = glm::max(hi, vertices[i].Position);
+            }
+            const float largest = std::max(std::max(hi.x - lo.x, hi.y - lo.y), hi.z - lo.z);
+            const QuantizationError decoded = decodeError(vertices, count, quantized);
+            const QuantizationError &reported = quantized.Error;
+            // the decoded errors may be a rounding above the quantizer's own
+            const bool within = decoded.Position <= setting.Tolerance.Position * largest * 1.001f &&
+                                decoded.NormalDegrees <= setting.Tolerance.NormalDegrees + 0.01f &&
+                                decoded.TexCoord <= setting.Tolerance.TexCoord * 1.001f &&
+                                decoded.Position <= reported.Position * 1.001f + 1e-7f &&
+                                decoded.NormalDegrees <= reported.NormalDegrees + 0.01f &&
+                                decoded.TexCoord <= reported.TexCoord * 1.001f + 1e-7f;
+            failures += !within;
+            floatBytes += count * sizeof(Vertex);
+            packedBytes += quantized.Data.size();
+
+            const std::string name = file.substr(file.find_last_of('/') + 1);
+            std::cout << "  " << std::left << std::setw(16) << name << std::right << std::setw(8) << count << " vertices, " << sizeof(Vertex)
+                      << " -> " << std::setw(2) << quantized.Format.Stride << " bytes/vertex (" << quantized.Format.describe() << "), "
+                      << std::setw(7) << count / std::max(best, 1e-3) / 1000.0 << " M vertices/s; max error " << std::scientific
+                      << std::setprecision(1) << decoded.Position / std::max(largest, 1e-20f) << " of the extent, " << decoded.NormalDegrees
+                      << " deg, " << decoded.TexCoord << " uv" << std::fixed << std::setprecision(2) << (within ? "" : "  OUT OF TOLERANCE")
+                      << std::endl;
+        }
+        std::cout << "  vertex memory: " << floatBytes / 1024 << " KB as float, " << packedBytes / 1024 << " KB packed, "
+                  << 100.0 * (1.0 - (double)packedBytes / std::max<size_t>(floatBytes, 1)) << "% saved" << std::endl;
+    }
+    return failures ? 1 : 0;
+}
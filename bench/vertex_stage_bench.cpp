@@ -0,0 +1,338 @@
+// What the normal matrix costs the vertex stage. The vertex shaders used to invert the model
+// matrix for every vertex (mat3(transpose(inverse(model)))); the LIT permutations of
+// surface.vs read one NormalMatrices computed on the CPU, once per object. "before" is
+// surface.vs with that expression put back, "after" is surface.vs as it is. Both draw a dense
+// mesh into a single pixel, so what is timed is vertex fetch and shading: as one draw
+// per copy, each with its Object block (what the RenderQueue does), and as one instanced draw.
+//
+// It also times NormalMatrices::compute against glm's inverse transpose on random
+// non-uniformly scaled transforms (they must agree) and compiles every permutation of the
+// surface shaders through ShaderVariants (all must link).
+//
+// Needs an OpenGL 3.3 context, made with surfaceless EGL (Mesa's llvmpipe without a GPU).
+//
+// usage: vertex_stage_bench [obj] [copies]
+// defaults to ../models/sphere2.obj and 64 copies
+#include <glad/glad.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "instanced_renderer.h"
+#include "mesh.h"
+#include "normal_matrix.h"
+#include "obj_loader.h"
+#include "shader.h"
+#include "shader_variants.h"
+#include "uniform_buffer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static bool createContext()
+{
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    EGLDisplay display = getPlatformDisplay ? getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL) : EGL_NO_DISPLAY;
+    if (display == EGL_NO_DISPLAY)
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    EGLint major, minor;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor) || !eglBindAPI(EGL_OPENGL_API))
+        return false;
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttribs);
+    if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+        return false;
+    return gladLoadGLLoader((GLADloadproc)eglGetProcAddress) != 0;
+}
+
+static std::string readFile(const char *path)
+{
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream stream;
+    stream << file.rdbuf();
+    return stream.str();
+}
+
+// 0 on failure, with the log printed
+static GLuint link(const std::string &vertexCode, const std::string &fragmentCode)
+{
+    GLuint program = glCreateProgram();
+    const std::string *sources[2] = { &vertexCode, &fragmentCode };
+    const GLenum types[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+    for (int i = 0; i < 2; ++i)
+    {
+        GLuint shader = glCreateShader(types[i]);
+        const char *code = sources[i]->c_str();
+        glShaderSource(shader, 1, &code, NULL);
+        glCompileShader(shader);
+        glAttachShader(program, shader);
+        glDeleteShader(shader);
+    }
+    glLinkProgram(program);
+    GLint success = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        char log[1024];
+        glGetProgramInfoLog(program, sizeof(log), NULL, log);
+        std::cout << "ERROR::PROGRAM_LINKING_ERROR\n" << log << std::endl;
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+// a rotation, a non-uniform scale (mirrored now and then) and a translation
+static glm::mat4 randomModel(std::mt19937 &rng)
+{
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    const glm::vec3 axis = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) + 0.01f);
+    glm::vec3 scale(0.2f + 2.0f * unit(rng), 0.2f + 2.0f * unit(rng), 0.2f + 2.0f * unit(rng));
+    if (unit(rng) < 0.1f)
+        scale.x = -scale.x;
+    const glm::mat4 rotation = glm::mat4_cast(glm::angleAxis(unit(rng) * 6.2831853f, axis));
+    const glm::vec3 position = (glm::vec3(unit(rng), unit(rng), unit(rng)) - 0.5f) * 20.0f;
+    return glm::translate(glm::mat4(1.0f), position) * rotation * glm::scale(glm::mat4(1.0f), scale);
+}
+
+// NormalMatrices against glm; returns the largest difference relative to the column's length
+static float normalMatrixError(const std::vector<glm::mat4> &models, const std::vector<NormalMatrix> &normals)
+{
+    float worst = 0.0f;
+    for (size_t i = 0; i < models.size(); ++i)
+    {
+        const glm::mat3 expected = glm::transpose(glm::inverse(glm::mat3(models[i])));
+        for (int column = 0; column < 3; ++column)
+        {
+            const float length = glm::length(expected[column]);
+            worst = std::max(worst, glm::length(glm::vec3(normals[i].Columns[column]) - expected[column]) / std::max(length, 1e-20f));
+        }
+    }
+    return worst;
+}
+
+int main(int argc, char *argv[])
+{
+    const std::string file = argc > 1 ? argv[1] : "../models/sphere2.obj";
+    const size_t copies = argc > 2 ? (size_t)std::max(1, std::atoi(argv[2])) : 64;
+    size_t failures = 0;
+    std::cout << std::fixed << std::setprecision(2);
+
+    // normal matrices on the CPU; an odd count so the scalar tail runs too
+    {
+        std::mt19937 rng(7);
+        std::vector<glm::mat4> models(100003);
+        for (glm::mat4 &model : models)
+            model = randomModel(rng);
+        std::vector<NormalMatrix> normals(models.size());
+        std::vector<glm::mat3> reference(models.size());
+        double batched = 1e30, scalar = 1e30;
+        for (int run = 0; run < 5; ++run)
+        {
+            Clock::time_point start = Clock::now();
+            NormalMatrices::compute(models.data(), sizeof(glm::mat4), normals.data(), sizeof(NormalMatrix), models.size());
+            batched = std::min(batched, std::chrono::duration<double, std::nano>(Clock::now() - start).count());
+            start = Clock::now();
+            for (size_t i = 0; i < models.size(); ++i)
+                reference[i] = glm::transpose(glm::inverse(glm::mat3(models[i])));
+            scalar = std::min(scalar, std::chrono::duration<double, std::nano>(Clock::now() - start).count());
+        }
+        volatile float sink = reference[models.size() / 2][1][1];
+        (void)sink;
+        const float error = normalMatrixError(models, normals);
+        failures += !(error < 1e-4f);
+        std::cout << "normal matrices: " << batched / models.size() << " ns each batched, " << scalar / models.size()
+                  << " ns with glm's inverse transpose; largest difference " << std::scientific << std::setprecision(1) << error
+                  << std::fixed << std::setprecision(2) << (error < 1e-4f ? "" : "  WRONG") << std::endl;
+    }
+
+    if (!createContext())
+    {
+        std::cout << "ERROR::VERTEX_STAGE_BENCH::NO_CONTEXT: surfaceless EGL with OpenGL 3.3 core is needed" << std::endl;
+        return 1;
+    }
+    std::cout << "context: " << glGetString(GL_RENDERER) << " | " << glGetString(GL_VERSION) << std::endl;
+
+    // every permutation, first compiled (or loaded from the program binary cache), then found again
+    {
+        ShaderVariants surfaces("../shaders/surface.vs", "../shaders/surface.fs");
+        const Clock::time_point start = Clock::now();
+        for (uint32_t features = 0; features < (1u << SHADER_FEATURE_COUNT); ++features)
+            failures += surfaces.get(features).ID == 0;
+        const double milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        size_t same = 0;
+        for (uint32_t features = 0; features < (1u << SHADER_FEATURE_COUNT); ++features)
+            same += surfaces.get(features).Features == features;
+        failures += same != surfaces.size() || surfaces.size() != (1u << SHADER_FEATURE_COUNT);
+        std::cout << "permutations: " << surfaces.size() << " of surface.vs/.fs ready in " << milliseconds << " ms ("
+                  << surfaces.fromCache() << " from the program binary cache)" << std::endl;
+        surfaces.Release();
+    }
+
+    MeshData data;
+    if (!ObjLoader::load(file, data) || data.Indices.empty())
+    {
+        std::cout << "ERROR::VERTEX_STAGE_BENCH::NO_MESH: " << file << std::endl;
+        return 1;
+    }
+    Mesh mesh(data.view());
+    const unsigned int instancedVAO = mesh.createVertexArray();
+
+    // before: the inverse per vertex back in place of the normal matrix
+    const std::string vertexCode = readFile("../shaders/surface.vs");
+    const std::string perObject = "Normal = normalMatrix * decodeNormal(aNormal);";
+    const std::string perVertex = "Normal = mat3(transpose(inverse(model))) * decodeNormal(aNormal);";
+    std::string beforeCode = vertexCode;
+    const std::string::size_type at = beforeCode.find(perObject);
+    if (at == std::string::npos)
+    {
+        std::cout << "ERROR::VERTEX_STAGE_BENCH::NORMAL_MATRIX_NOT_FOUND in surface.vs" << std::endl;
+        return 1;
+    }
+    beforeCode.replace(at, perObject.size(), perVertex);
+    // nothing is rasterized, but the program must link with something that reads both outputs
+    const std::string fragmentCode = "#version 330 core\nin vec3 FragPos;\nin vec3 Normal;\nout vec4 FragColor;\n"
+                                     "void main() { FragColor = vec4(FragPos + Normal, 1.0); }\n";
+
+    // copies of the mesh, each turned, scaled and moved differently
+    std::mt19937 rng(42);
+    std::vector<glm::mat4> models(copies);
+    for (glm::mat4 &model : models)
+        model = randomModel(rng);
+    std::vector<ObjectBlock> blocks(copies);
+    std::vector<InstanceData> instances(copies);
+    for (size_t i = 0; i < copies; ++i)
+    {
+        blocks[i] = ObjectBlock();
+        blocks[i].model = instances[i].Model = models[i];
+        instances[i].Diffuse = glm::vec4(0.5f, 0.5f, 0.5f, 32.0f);
+        instances[i].Specular = glm::vec4(0.5f);
+    }
+    NormalMatrices::compute(&blocks.data()->model, sizeof(ObjectBlock), &blocks.data()->normalMatrix, sizeof(ObjectBlock), copies);
+    NormalMatrices::compute(&instances.data()->Model, sizeof(InstanceData), &instances.data()->Normal, sizeof(InstanceData), copies);
+
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    const size_t stride = (sizeof(ObjectBlock) + alignment - 1) / alignment * alignment;
+    std::vector<char> objectData(stride * copies);
+    for (size_t i = 0; i < copies; ++i)
+        std::memcpy(&objectData[i * stride], &blocks[i], sizeof(ObjectBlock));
+    GLuint objects;
+    glGenBuffers(1, &objects);
+    glBindBuffer(GL_UNIFORM_BUFFER, objects);
+    glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr)objectData.size(), objectData.data(), GL_STATIC_DRAW);
+
+    UniformBuffer<CameraBlock> cameraUBO(CAMERA_BINDING);
+    CameraBlock camera;
+    camera.view = glm::lookAt(glm::vec3(0.0f, 0.0f, 30.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    camera.projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+    camera.viewPos = glm::vec4(0.0f, 0.0f, 30.0f, 1.0f);
+    cameraUBO.update(camera);
+
+    InstanceBuffer instanceBuffer(copies);
+    instanceBuffer.attach(instancedVAO);
+    instanceBuffer.upload(instances);
+
+    struct Variant { const char *Name; GLuint Program[2]; double Milliseconds[2]; };
+    Variant variants[2] = { { "before (inverse per vertex)", {}, {} }, { "after (normal matrix per object)", {}, {} } };
+    for (int v = 0; v < 2; ++v)
+        for (int instanced = 0; instanced < 2; ++instanced)
+        {
+            const uint32_t features = SHADER_LIT | (instanced ? SHADER_INSTANCED : 0);
+            GLuint program = link(Shader::withFeatures(v == 0 ? beforeCode : vertexCode, features), fragmentCode);
+            if (!program)
+                return 1;
+            glUniformBlockBinding(program, glGetUniformBlockIndex(program, "Camera"), CAMERA_BINDING);
+            if (!instanced)
+                glUniformBlockBinding(program, glGetUniformBlockIndex(program, "Object"), OBJECT_BINDING);
+            variants[v].Program[instanced] = program;
+        }
+
+    // a single pixel to draw into, so next to nothing is rasterized and shaded; llvmpipe skips
+    // the whole draw under GL_RASTERIZER_DISCARD, vertex shading included
+    GLuint framebuffer, colour;
+    glGenFramebuffers(1, &framebuffer);
+    glGenRenderbuffers(1, &colour);
+    glBindRenderbuffer(GL_RENDERBUFFER, colour);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, 1, 1);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colour);
+    glViewport(0, 0, 1, 1);
+
+    // best of several rounds of every copy, before and after taking turns so both see the same
+    // machine; round 0 compiles the programs in the driver and is not counted
+    const int rounds = 15;
+    for (int instanced = 0; instanced < 2; ++instanced)
+    {
+        glBindVertexArray(instanced ? instancedVAO : mesh.VAO);
+        for (Variant &variant : variants)
+            variant.Milliseconds[instanced] = 1e30;
+        for (int round = 0; round <= rounds; ++round)
+            for (Variant &variant : variants)
+            {
+                glUseProgram(variant.Program[instanced]);
+                glFinish();
+                const Clock::time_point start = Clock::now();
+                if (instanced)
+                    glDrawElementsInstanced(GL_TRIANGLES, (GLsizei)mesh.IndexCount, GL_UNSIGNED_INT, (void*)0, (GLsizei)copies);
+                else
+                    for (size_t i = 0; i < copies; ++i)
+                    {
+                        glBindBufferRange(GL_UNIFORM_BUFFER, OBJECT_BINDING, objects, (GLintptr)(i * stride), sizeof(ObjectBlock));
+                        glDrawElements(GL_TRIANGLES, (GLsizei)mesh.IndexCount, GL_UNSIGNED_INT, (void*)0);
+                    }
+                glFinish();
+                if (round > 0)
+                    variant.Milliseconds[instanced] = std::min(variant.Milliseconds[instanced], std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+            }
+    }
+    const GLenum error = glGetError();
+    if (error != GL_NO_ERROR)
+    {
+        std::cout << "ERROR::VERTEX_STAGE_BENCH::GL_ERROR: 0x" << std::hex << error << std::dec << std::endl;
+        ++failures;
+    }
+
+    const size_t submitted = (size_t)mesh.IndexCount * copies;
+    std::cout << file.substr(file.find_last_of('/') + 1) << ": " << data.Vertices.size() << " vertices, " << mesh.IndexCount / 3
+              << " triangles, " << copies << " copies, " << submitted / 1000 << "k vertices submitted per round" << std::endl;
+    for (int instanced = 0; instanced < 2; ++instanced)
+    {
+        std::cout << (instanced ? "  instanced draw" : "  draw per copy") << std::endl;
+        for (const Variant &variant : variants)
+            std::cout << "    " << std::left << std::setw(34) << variant.Name << std::right << std::setw(8) << variant.Milliseconds[instanced]
+                      << " ms, " << std::setw(6) << 1e6 * variant.Milliseconds[instanced] / submitted << " ns per vertex" << std::endl;
+        std::cout << "    speedup " << variants[0].Milliseconds[instanced] / variants[1].Milliseconds[instanced] << "x" << std::endl;
+    }
+
+    for (const Variant &variant : variants)
+        for (GLuint program : variant.Program)
+            glDeleteProgram(program);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &colour);
+    glDeleteBuffers(1, &objects);
+    glDeleteBuffers(1, &cameraUBO.ID);
+    glDeleteBuffers(1, &instanceBuffer.ID);
+    glDeleteVertexArrays(1, &instancedVAO);
+    mesh.Release();
+    return failures ? 1 : 0;
+}
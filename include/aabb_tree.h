@@ -0,0 +1,424 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AABB_TREE_SSE 1
+#include <emmintrin.h>
+#endif
+
+struct AABB {
+    glm::vec3 Min;
+    glm::vec3 Max;
+
+    // half the surface area; only ever compared
+    float area() const
+    {
+        const glm::vec3 extent = Max - Min;
+        return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+    }
+
+    bool contains(const AABB &other) const
+    {
+        return glm::all(glm::lessThanEqual(Min, other.Min)) && glm::all(glm::greaterThanEqual(Max, other.Max));
+    }
+
+    static AABB merge(const AABB &a, const AABB &b)
+    {
+        return { glm::min(a.Min, b.Min), glm::max(a.Max, b.Max) };
+    }
+
+    // world bounds of the local box [-halfExtent, halfExtent] placed by model
+    static AABB transformed(const glm::mat4 &model, const glm::vec3 &halfExtent)
+    {
+        const glm::vec3 center(model[3]);
+        const glm::vec3 extent = glm::abs(glm::vec3(model[0])) * halfExtent.x + glm::abs(glm::vec3(model[1])) * halfExtent.y +
+                                 glm::abs(glm::vec3(model[2])) * halfExtent.z;
+        return { center - extent, center + extent };
+    }
+};
+
+// what the last DynamicAABBTree::cull() did
+struct CullStats {
+    uint32_t NodesVisited = 0;
+    uint32_t Visible = 0;
+    uint32_t Culled = 0;
+    float Microseconds = 0.0f;
+};
+
+// A bounding volume hierarchy over moving objects, kept balanced by tree rotations as objects
+// are inserted and removed (after Box2D's b2DynamicTree). Every object is a leaf ("proxy")
+// whose box is the object's bounds grown by Margin, so an object moving a little stays inside
+// its leaf box and costs nothing; one moving further is refit in place while it stays inside
+// its parent's box, and only reinserted when it leaves it.
+//
+// cull() walks the tree against the six frustum planes from Camera::GetFrustumPlanes(). All
+// planes are tested against a node at once (SSE, two groups of four), and a node found
+// entirely inside the frustum contributes its whole subtree without further tests.
+class DynamicAABBTree
+{
+public:
+    static const int32_t NULL_NODE = -1;
+    float Margin;
+
+    explicit DynamicAABBTree(float margin = 0.1f) : Margin(margin) {}
+
+    // returns the proxy id used by move() / remove(); userData is what cull() reports
+    int32_t insert(const AABB &box, uint32_t userData)
+    {
+        const int32_t leaf = allocateNode();
+        nodes[leaf].Box = fatten(box);
+        nodes[leaf].UserData = userData;
+        links[leaf].Height = 0;
+        insertLeaf(leaf);
+        ++proxyCount;
+        return leaf;
+    }
+
+    void remove(int32_t proxy)
+    {
+        removeLeaf(proxy);
+        freeNode(proxy);
+        --proxyCount;
+    }
+
+    // new bounds of a moving object; returns false when its leaf box still covers them
+    bool move(int32_t proxy, const AABB &box)
+    {
+        if (nodes[proxy].Box.contains(box))
+            return false;
+        const AABB fat = fatten(box);
+        const int32_t parent = links[proxy].Parent;
+        if (parent != NULL_NODE && nodes[parent].Box.contains(fat))
+        {
+            // still inside the parent: no ancestor changes, refit the leaf alone
+            nodes[proxy].Box = fat;
+            return true;
+        }
+        removeLeaf(proxy);
+        nodes[proxy].Box = fat;
+        insertLeaf(proxy);
+        return true;
+    }
+
+    uint32_t userData(int32_t proxy) const { return nodes[proxy].UserData; }
+    const AABB &fatBox(int32_t proxy) const { return nodes[proxy].Box; }
+    size_t size() const { return proxyCount; }
+    int32_t height() const { return root == NULL_NODE ? 0 : links[root].Height; }
+
+    // replaces visible with the userData of every proxy whose box touches the frustum
+    void cull(const std::array<glm::vec4, 6> &frustum, std::vector<uint32_t> &visible, CullStats &stats) const
+    {
+        auto start = std::chrono::steady_clock::now();
+        visible.clear();
+        stats.NodesVisited = 0;
+
+        // planes as structure-of-arrays, padded to eight with planes everything is inside of
+        PlaneSet planes;
+        for (int i = 0; i < 8; ++i)
+        {
+            const glm::vec4 plane = i < 6 ? frustum[i] : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+            planes.NX[i] = plane.x;
+            planes.NY[i] = plane.y;
+            planes.NZ[i] = plane.z;
+            planes.D[i] = plane.w;
+            planes.AX[i] = std::fabs(plane.x);
+            planes.AY[i] = std::fabs(plane.y);
+            planes.AZ[i] = std::fabs(plane.z);
+        }
+
+        // a popped node classifies both of its children at once (two independent tests instead
+        // of a chain of dependent ones); surviving leaves are reported without being pushed.
+        // Entries carry the planes the node is already entirely inside of, which holds for its
+        // children as well; ALL_INSIDE means the subtree needs no more tests.
+        struct Entry { int32_t Node; unsigned int Inside; };
+        std::vector<Entry> stack;
+        stack.reserve((size_t)height() + 2);
+        if (root != NULL_NODE)
+        {
+            unsigned int outside, inside;
+            classify(nodes[root].Box, planes, outside, inside);
+            ++stats.NodesVisited;
+            if (!outside)
+                stack.push_back({ root, inside });
+        }
+        while (!stack.empty())
+        {
+            const Entry entry = stack.back();
+            stack.pop_back();
+            const Node &node = nodes[entry.Node];
+            if (node.isLeaf())
+            {
+                visible.push_back(node.UserData); // only a lone root leaf gets here
+                continue;
+            }
+            const Node &child1 = nodes[node.Child1], &child2 = nodes[node.Child2];
+            stats.NodesVisited += 2;
+            unsigned int inside1 = ALL_INSIDE, inside2 = ALL_INSIDE;
+            if (entry.Inside != ALL_INSIDE)
+            {
+                unsigned int outside1, outside2;
+                classify(child1.Box, planes, outside1, inside1);
+                classify(child2.Box, planes, outside2, inside2);
+                inside1 = outside1 ? 0 : inside1 | entry.Inside;
+                inside2 = outside2 ? 0 : inside2 | entry.Inside;
+            }
+            if (inside2)
+            {
+                if (child2.isLeaf())
+                    visible.push_back(child2.UserData);
+                else
+                    stack.push_back({ node.Child2, inside2 });
+            }
+            if (inside1)
+            {
+                if (child1.isLeaf())
+                    visible.push_back(child1.UserData);
+                else
+                    stack.push_back({ node.Child1, inside1 });
+            }
+        }
+
+        stats.Visible = (uint32_t)visible.size();
+        stats.Culled = (uint32_t)(proxyCount - visible.size());
+        stats.Microseconds = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+
+private:
+    // what cull() reads, 32 bytes; the rest lives in links so two nodes share a cache line
+    struct Node {
+        AABB Box;
+        int32_t Child1;          // NULL_NODE for leaves
+        union {
+            int32_t Child2;
+            uint32_t UserData;   // leaves
+        };
+
+        bool isLeaf() const { return Child1 == NULL_NODE; }
+    };
+    static_assert(sizeof(Node) == 32, "Node should stay half a cache line");
+
+    struct Link {
+        int32_t Parent;  // next free node while on the free list
+        int32_t Height;  // 0 for leaves, -1 while free
+    };
+
+    struct PlaneSet {
+        alignas(16) float NX[8], NY[8], NZ[8], D[8];
+        alignas(16) float AX[8], AY[8], AZ[8]; // |normal|, for the box's projected radius
+    };
+
+    static const unsigned int ALL_INSIDE = 0xff;
+
+    std::vector<Node> nodes;
+    std::vector<Link> links;   // indexed like nodes
+    int32_t root = NULL_NODE;
+    int32_t freeList = NULL_NODE;
+    size_t proxyCount = 0;
+
+    AABB fatten(const AABB &box) const
+    {
+        return { box.Min - glm::vec3(Margin), box.Max + glm::vec3(Margin) };
+    }
+
+    // per plane bit: the box is entirely outside (-> culled) / entirely inside
+    static void classify(const AABB &box, const PlaneSet &planes, unsigned int &outside, unsigned int &inside)
+    {
+        const glm::vec3 center = 0.5f * (box.Min + box.Max), extent = 0.5f * (box.Max - box.Min);
+#ifdef AABB_TREE_SSE
+        const __m128 cx = _mm_set1_ps(center.x), cy = _mm_set1_ps(center.y), cz = _mm_set1_ps(center.z);
+        const __m128 ex = _mm_set1_ps(extent.x), ey = _mm_set1_ps(extent.y), ez = _mm_set1_ps(extent.z);
+        outside = inside = 0;
+        for (int group = 0; group < 8; group += 4)
+        {
+            const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_load_ps(planes.NX + group), cx), _mm_mul_ps(_mm_load_ps(planes.NY + group), cy)),
+                                               _mm_add_ps(_mm_mul_ps(_mm_load_ps(planes.NZ + group), cz), _mm_load_ps(planes.D + group)));
+            const __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_load_ps(planes.AX + group), ex), _mm_mul_ps(_mm_load_ps(planes.AY + group), ey)),
+                                             _mm_mul_ps(_mm_load_ps(planes.AZ + group), ez));
+            outside |= (unsigned int)_mm_movemask_ps(_mm_cmplt_ps(distance, _mm_sub_ps(_mm_setzero_ps(), radius))) << group;
+            inside |= (unsigned int)_mm_movemask_ps(_mm_cmpge_ps(distance, radius)) << group;
+        }
+#else
+        outside = inside = 0;
+        for (int i = 0; i < 8; ++i)
+        {
+            const float distance = planes.NX[i] * center.x + planes.NY[i] * center.y + planes.NZ[i] * center.z + planes.D[i];
+            const float radius = planes.AX[i] * extent.x + planes.AY[i] * extent.y + planes.AZ[i] * extent.z;
+            outside |= (distance < -radius ? 1u : 0u) << i;
+            inside |= (distance >= radius ? 1u : 0u) << i;
+        }
+#endif
+    }
+
+    int32_t allocateNode()
+    {
+        int32_t index;
+        if (freeList != NULL_NODE)
+        {
+            index = freeList;
+            freeList = links[index].Parent;
+        }
+        else
+        {
+            index = (int32_t)nodes.size();
+            nodes.emplace_back();
+            links.emplace_back();
+        }
+        nodes[index].Child1 = nodes[index].Child2 = NULL_NODE;
+        links[index].Parent = NULL_NODE;
+        links[index].Height = 0;
+        return index;
+    }
+
+    void freeNode(int32_t index)
+    {
+        links[index].Parent = freeList;
+        links[index].Height = -1;
+        freeList = index;
+    }
+
+    void insertLeaf(int32_t leaf)
+    {
+        if (root == NULL_NODE)
+        {
+            root = leaf;
+            links[leaf].Parent = NULL_NODE;
+            return;
+        }
+
+        // walk down to the sibling that adds the least area to the tree
+        const AABB box = nodes[leaf].Box;
+        int32_t index = root;
+        while (!nodes[index].isLeaf())
+        {
+            const Node &node = nodes[index];
+            const float area = node.Box.area();
+            const float combinedArea = AABB::merge(node.Box, box).area();
+            // pairing with this node creates a parent of combinedArea; descending instead
+            // still grows this node (and every ancestor) by the difference
+            const float cost = 2.0f * combinedArea;
+            const float inheritanceCost = 2.0f * (combinedArea - area);
+            const float cost1 = descendCost(node.Child1, box) + inheritanceCost;
+            const float cost2 = descendCost(node.Child2, box) + inheritanceCost;
+            if (cost < cost1 && cost < cost2)
+                break;
+            index = cost1 < cost2 ? node.Child1 : node.Child2;
+        }
+        const int32_t sibling = index;
+
+        const int32_t oldParent = links[sibling].Parent;
+        const int32_t newParent = allocateNode();
+        links[newParent].Parent = oldParent;
+        nodes[newParent].Box = AABB::merge(box, nodes[sibling].Box);
+        links[newParent].Height = links[sibling].Height + 1;
+        nodes[newParent].Child1 = sibling;
+        nodes[newParent].Child2 = leaf;
+        links[sibling].Parent = newParent;
+        links[leaf].Parent = newParent;
+        if (oldParent == NULL_NODE)
+            root = newParent;
+        else if (nodes[oldParent].Child1 == sibling)
+            nodes[oldParent].Child1 = newParent;
+        else
+            nodes[oldParent].Child2 = newParent;
+
+        refitAncestors(links[leaf].Parent);
+    }
+
+    float descendCost(int32_t child, const AABB &box) const
+    {
+        const float combined = AABB::merge(nodes[child].Box, box).area();
+        return nodes[child].isLeaf() ? combined : combined - nodes[child].Box.area();
+    }
+
+    void removeLeaf(int32_t leaf)
+    {
+        if (leaf == root)
+        {
+            root = NULL_NODE;
+            return;
+        }
+        const int32_t parent = links[leaf].Parent;
+        const int32_t grandParent = links[parent].Parent;
+        const int32_t sibling = nodes[parent].Child1 == leaf ? nodes[parent].Child2 : nodes[parent].Child1;
+        freeNode(parent);
+        links[sibling].Parent = grandParent;
+        if (grandParent == NULL_NODE)
+        {
+            root = sibling;
+            return;
+        }
+        if (nodes[grandParent].Child1 == parent)
+            nodes[grandParent].Child1 = sibling;
+        else
+            nodes[grandParent].Child2 = sibling;
+        refitAncestors(grandParent);
+    }
+
+    // rebalances and recomputes boxes and heights from index up to the root
+    void refitAncestors(int32_t index)
+    {
+        while (index != NULL_NODE)
+        {
+            index = balance(index);
+            Node &node = nodes[index];
+            links[index].Height = 1 + std::max(links[node.Child1].Height, links[node.Child2].Height);
+            node.Box = AABB::merge(nodes[node.Child1].Box, nodes[node.Child2].Box);
+            index = links[index].Parent;
+        }
+    }
+
+    // if one subtree of a is more than one level taller than the other, rotates its taller
+    // child up into a's place; returns the index of the node now at that place
+    int32_t balance(int32_t a)
+    {
+        if (nodes[a].isLeaf() || links[a].Height < 2)
+            return a;
+        const int32_t b = nodes[a].Child1, c = nodes[a].Child2;
+        const int32_t difference = links[c].Height - links[b].Height;
+        if (difference > 1)
+            return rotateUp(a, c, b, false);
+        if (difference < -1)
+            return rotateUp(a, b, c, true);
+        return a;
+    }
+
+    // moves child (the taller child of a) up into a's place; a keeps other and the shorter of
+    // child's children, child keeps its taller one and gets a
+    int32_t rotateUp(int32_t a, int32_t child, int32_t other, bool childIsFirst)
+    {
+        const int32_t f = nodes[child].Child1, g = nodes[child].Child2;
+        nodes[child].Child1 = a;
+        links[child].Parent = links[a].Parent;
+        links[a].Parent = child;
+        const int32_t parent = links[child].Parent;
+        if (parent == NULL_NODE)
+            root = child;
+        else if (nodes[parent].Child1 == a)
+            nodes[parent].Child1 = child;
+        else
+            nodes[parent].Child2 = child;
+
+        const int32_t taller = links[f].Height > links[g].Height ? f : g;
+        const int32_t shorter = taller == f ? g : f;
+        nodes[child].Child2 = taller;
+        if (childIsFirst)
+            nodes[a].Child1 = shorter;
+        else
+            nodes[a].Child2 = shorter;
+        links[shorter].Parent = a;
+
+        nodes[a].Box = AABB::merge(nodes[other].Box, nodes[shorter].Box);
+        links[a].Height = 1 + std::max(links[other].Height, links[shorter].Height);
+        nodes[child].Box = AABB::merge(nodes[a].Box, nodes[taller].Box);
+        links[child].Height = 1 + std::max(links[a].Height, links[taller].Height);
+        return child;
+    }
+};
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Command line switches of the demo executable
+struct AppOptions
+{
+    // --stress N: add N instanced cubes/spheres and print frame time + draw calls
+    size_t StressCount = 0;
+    // --no-instancing: draw the stress scene one object at a time, for comparison
+    bool Instancing = true;
+    // --no-culling: submit every stress object instead of only those in the view frustum
+    bool Culling = true;
+    // --occlusion: stand the Cornell box in the stress field and skip the objects it hides,
+    // found by rasterizing it on the CPU
+    bool Occlusion = false;
+    // --spin: group the stress objects into clusters that turn in place, every object's world
+    // matrix recomputed through the transform hierarchy each frame
+    bool Spin = false;
+    // --hires-spheres: the stress spheres are sphere2.obj (10k vertices) instead of sphere.obj
+    bool HiresSpheres = false;
+    // --no-lod: always draw meshes at full detail instead of picking a level by screen-space error
+    bool Lod = true;
+    // --lights N: a field of pillars behind the scene lit by N moving point lights through
+    // clustered forward shading; prints the light assignment time and the frame time
+    size_t LightCount = 0;
+    // --nanosuit: also draw the textured nanosuit, its textures streamed in by worker threads
+    bool Nanosuit = false;
+    // --meshlets: split the nanosuit into meshlets and cull them against the frustum, their
+    // backface cones and a pixel on screen every frame, drawing the rest with glMultiDrawElements
+    bool Meshlets = false;
+    // --no-persistent: stream per-object data by mapping each frame's region (the GL 3.3 path)
+    // even where persistent mapping is available
+    bool PersistentMapping = true;
+    // --no-quantize: upload meshes as float vertices instead of the smallest formats within
+    // --vertex-tolerance POSITION,DEGREES,UV (see VertexTolerance; position is a fraction of
+    // the mesh's largest side)
+    bool Quantize = true;
+    float PositionTolerance = 1e-4f;
+    float NormalToleranceDegrees = 1.0f;
+    float TexCoordTolerance = 1.0f / 2048.0f;
+
+    // --profile: show the profiler overlay (CPU/GPU zones of the last frame)
+    bool Profile = false;
+    // --hud: frame time and scene counters drawn as text in the corner (FreeType builds only)
+    bool Hud = false;
+    // --labels: a text label over every stress object drawn, to load the text renderer
+    bool Labels = false;
+    // --trace FILE: record every profiler zone and write them as Chrome trace_event JSON at exit
+    std::string TraceFile;
+
+    // --headless: render offscreen for Frames frames, replaying CameraPathFile at a fixed timestep
+    bool Headless = false;
+    size_t Frames = 600;
+    std::string CameraPathFile = "../camera_paths/flythrough.txt";
+    // --stats FILE: per-frame CPU/GPU times, CSV or JSON by extension
+    std::string StatsFile;
+    // --dump-frames 0,100,599: write those frames as PNG into DumpDir
+    std::vector<size_t> DumpFrames;
+    std::string DumpDir = ".";
+    // --record FILE: save the camera input of a windowed session as a path for --headless
+    std::string RecordFile;
+
+    // --pathtrace: progressive CPU path tracing of the Cornell box instead of the raster scene;
+    // headless runs trace Frames samples per pixel and write DumpDir/pathtrace.png
+    bool PathTrace = false;
+    // --threads N: worker threads of the path tracer, the texture streamer and the simulation
+    // jobs, 0 = one per core
+    unsigned int Threads = 0;
+
+    // returns false (after printing usage) on an unknown or incomplete switch
+    bool parse(int argc, char *argv[])
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            const bool hasValue = i + 1 < argc;
+            if (arg == "--stress" && hasValue)
+                StressCount = (size_t)std::strtoull(argv[++i], nullptr, 10);
+            else if (arg == "--no-instancing")
+                Instancing = false;
+            else if (arg == "--no-culling")
+                Culling = false;
+            else if (arg == "--occlusion")
+                Occlusion = true;
+            else if (arg == "--spin")
+                Spin = true;
+            else if (arg == "--hires-spheres")
+                HiresSpheres = true;
+            else if (arg == "--no-lod")
+                Lod = false;
+            else if (arg == "--lights" && hasValue)
+                LightCount = (size_t)std::strtoull(argv[++i], nullptr, 10);
+            else if (arg == "--nanosuit")
+                Nanosuit = true;
+            else if (arg == "--meshlets")
+                Meshlets = true;
+            else if (arg == "--no-persistent")
+                PersistentMapping = false;
+            else if (arg == "--no-quantize")
+                Quantize = false;
+            else if (arg == "--vertex-tolerance" && hasValue)
+            {
+                std::istringstream in(argv[++i]);
+                char comma;
+                in >> PositionTolerance >> comma >> NormalToleranceDegrees >> comma >> TexCoordTolerance;
+            }
+            else if (arg == "--profile")
+                Profile = true;
+            else if (arg == "--hud")
+                Hud = true;
+            else if (arg == "--labels")
+                Labels = true;
+            else if (arg == "--trace" && hasValue)
+                TraceFile = argv[++i];
+            else if (arg == "--headless")
+                Headless = true;
+            else if (arg == "--frames" && hasValue)
+                Frames = (size_t)std::strtoull(argv[++i], nullptr, 10);
+            else if (arg == "--camera-path" && hasValue)
+                CameraPathFile = argv[++i];
+            else if (arg == "--stats" && hasValue)
+                StatsFile = argv[++i];
+            else if (arg == "--dump-frames" && hasValue)
+                DumpFrames = parseList(argv[++i]);
+            else if (arg == "--dump-dir" && hasValue)
+                DumpDir = argv[++i];
+            else if (arg == "--record" && hasValue)
+                RecordFile = argv[++i];
+            else if (arg == "--pathtrace")
+                PathTrace = true;
+            else if (arg == "--threads" && hasValue)
+                Threads = (unsigned int)std::strtoul(argv[++i], nullptr, 10);
+            else
+            {
+                std::cout << "unknown or incomplete option: " << arg << "\n";
+                printUsage(argv[0]);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static void printUsage(const char *program)
+    {
+        std::cout << "usage: " << program << " [options]\n"
+                  << "  --stress N          add N instanced objects and report frame time / draw calls\n"
+                  << "  --no-instancing     draw the stress objects with one draw call each\n"
+                  << "  --no-culling        draw the stress objects without frustum culling\n"
+                  << "  --occlusion         put the Cornell box in the stress field and cull what it hides\n"
+                  << "  --spin              turn the stress objects in clusters, updating their transforms every frame\n"
+                  << "  --hires-spheres     use the 10k vertex sphere for the stress objects\n"
+                  << "  --no-lod            draw every mesh at full detail\n"
+                  << "  --lights N          light a field of pillars with N moving point lights (clustered shading)\n"
+                  << "  --nanosuit          draw the textured nanosuit, streaming its textures in\n"
+                  << "  --meshlets          cull the nanosuit per meshlet (frustum, backface cone, size)\n"
+                  << "  --no-persistent     map the per-object stream buffer every frame instead of once\n"
+                  << "  --no-quantize       upload float vertices instead of quantized ones\n"
+                  << "  --vertex-tolerance P,DEG,UV  largest quantization error (default 1e-4,1,0.00049)\n"
+                  << "  --profile           show the profiler overlay\n"
+                  << "  --hud               draw frame time and scene counters as text\n"
+                  << "  --labels            label every stress object drawn with its name\n"
+                  << "  --trace FILE        write the profiler zones as Chrome trace JSON (chrome://tracing)\n"
+                  << "  --headless          render offscreen (EGL surfaceless or a hidden window) and exit\n"
+                  << "  --frames N          number of headless frames (default 600)\n"
+                  << "  --camera-path FILE  camera path replayed at a fixed 60 Hz timestep\n"
+                  << "  --stats FILE        write per-frame CPU/GPU ms as .csv or .json\n"
+                  << "  --dump-frames LIST  comma separated frame numbers to save as PNG\n"
+                  << "  --dump-dir DIR      where the PNG dumps go (default .)\n"
+                  << "  --record FILE       record the windowed camera input as a camera path\n"
+                  << "  --pathtrace         path trace the Cornell box on the CPU (headless: --frames = samples)\n"
+                  << "  --threads N         worker threads per pool (default: one per core)\n";
+    }
+
+private:
+    static std::vector<size_t> parseList(const std::string &list)
+    {
+        std::vector<size_t> values;
+        std::istringstream in(list);
+        std::string item;
+        while (std::getline(in, item, ','))
+            if (!item.empty())
+                values.push_back((size_t)std::strtoull(item.c_str(), nullptr, 10));
+        return values;
+    }
+};
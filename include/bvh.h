@@ -0,0 +1,349 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+struct Ray {
+    glm::vec3 Origin;
+    glm::vec3 Direction;
+    glm::vec3 InvDirection;
+    float TMax;
+
+    Ray() = default;
+    Ray(const glm::vec3 &origin, const glm::vec3 &direction, float tMax = FLT_MAX)
+        : Origin(origin), Direction(direction), InvDirection(1.0f / direction), TMax(tMax) {}
+};
+
+// closest hit along a ray; Triangle is an index into the triangles given to BVH::build()
+struct RayHit {
+    float T = FLT_MAX;
+    float U = 0.0f, V = 0.0f;
+    uint32_t Triangle = UINT32_MAX;
+};
+
+struct BVHTriangle {
+    glm::vec3 V0, V1, V2;
+};
+
+// 32 bytes, two per cache line. Interior nodes (Count == 0) keep their children next to each
+// other at LeftFirst and LeftFirst + 1; leaves hold Count triangles starting at LeftFirst.
+struct BVHNode {
+    glm::vec3 BoundsMin;
+    uint32_t LeftFirst;
+    glm::vec3 BoundsMax;
+    uint32_t Count;
+};
+static_assert(sizeof(BVHNode) == 32, "BVHNode should stay 32 bytes");
+
+// Binary BVH over triangles, built top-down with a binned surface area heuristic: at every node
+// the centroids are dropped into SAH_BINS buckets per axis and the cheapest bucket boundary is
+// taken, or the node becomes a leaf if splitting costs more than intersecting everything.
+class BVH
+{
+public:
+    static const unsigned int SAH_BINS = 16;
+    static const unsigned int MAX_LEAF_SIZE = 8;
+    // relative costs of a node visit and a triangle test
+    static constexpr float TRAVERSAL_COST = 1.0f;
+    static constexpr float INTERSECTION_COST = 1.0f;
+
+    std::vector<BVHNode> Nodes;
+    std::vector<BVHTriangle> Triangles;   // reordered so every leaf's triangles are contiguous
+    std::vector<uint32_t> TriangleIds;    // build() index of Triangles[i]
+
+    void build(const std::vector<BVHTriangle> &triangles)
+    {
+        Triangles = triangles;
+        TriangleIds.resize(triangles.size());
+        centroids.resize(triangles.size());
+        for (uint32_t i = 0; i < triangles.size(); ++i)
+        {
+            TriangleIds[i] = i;
+            centroids[i] = (triangles[i].V0 + triangles[i].V1 + triangles[i].V2) / 3.0f;
+        }
+        Nodes.clear();
+        Nodes.reserve(std::max<size_t>(1, 2 * triangles.size()));
+        Nodes.push_back(BVHNode());
+        Nodes[0].LeftFirst = 0;
+        Nodes[0].Count = (uint32_t)triangles.size();
+        updateBounds(0);
+        subdivide(0);
+
+        // subdivide() only permuted TriangleIds; now store the triangles in leaf order
+        std::vector<BVHTriangle> ordered(triangles.size());
+        for (size_t i = 0; i < triangles.size(); ++i)
+            ordered[i] = triangles[TriangleIds[i]];
+        Triangles.swap(ordered);
+        centroids.clear();
+        centroids.shrink_to_fit();
+    }
+
+    // closest hit; on success hit is filled in and ray.TMax shortened to it
+    bool intersect(Ray &ray, RayHit &hit) const
+    {
+        if (Nodes.empty() || !intersectBounds(Nodes[0], ray))
+            return false;
+        uint32_t stack[64];
+        unsigned int stackSize = 0;
+        uint32_t nodeIndex = 0;
+        bool found = false;
+        for (;;)
+        {
+            const BVHNode &node = Nodes[nodeIndex];
+            if (node.Count > 0)
+            {
+                for (uint32_t i = node.LeftFirst; i < node.LeftFirst + node.Count; ++i)
+                {
+                    float t, u, v;
+                    if (intersectTriangle(Triangles[i], ray, t, u, v))
+                    {
+                        ray.TMax = t;
+                        hit.T = t;
+                        hit.U = u;
+                        hit.V = v;
+                        hit.Triangle = TriangleIds[i];
+                        found = true;
+                    }
+                }
+            }
+            else
+            {
+                // visit the nearer child first, so the far one is often culled by then
+                uint32_t nearChild = node.LeftFirst, farChild = node.LeftFirst + 1;
+                float nearT = intersectBounds(Nodes[nearChild], ray);
+                float farT = intersectBounds(Nodes[farChild], ray);
+                if (farT && (!nearT || farT < nearT))
+                {
+                    std::swap(nearChild, farChild);
+                    std::swap(nearT, farT);
+                }
+                if (nearT)
+                {
+                    if (farT)
+                        stack[stackSize++] = farChild;
+                    nodeIndex = nearChild;
+                    continue;
+                }
+            }
+            // pop the next node still in front of the closest hit
+            for (;;)
+            {
+                if (stackSize == 0)
+                    return found;
+                nodeIndex = stack[--stackSize];
+                if (intersectBounds(Nodes[nodeIndex], ray))
+                    break;
+            }
+        }
+    }
+
+    // any hit closer than ray.TMax, for shadow rays
+    bool occluded(const Ray &ray) const
+    {
+        if (Nodes.empty())
+            return false;
+        uint32_t stack[64];
+        unsigned int stackSize = 0;
+        stack[stackSize++] = 0;
+        while (stackSize > 0)
+        {
+            const BVHNode &node = Nodes[stack[--stackSize]];
+            if (!intersectBounds(node, ray))
+                continue;
+            if (node.Count > 0)
+            {
+                float t, u, v;
+                for (uint32_t i = node.LeftFirst; i < node.LeftFirst + node.Count; ++i)
+                    if (intersectTriangle(Triangles[i], ray, t, u, v))
+                        return true;
+            }
+            else
+            {
+                stack[stackSize++] = node.LeftFirst + 1;
+                stack[stackSize++] = node.LeftFirst;
+            }
+        }
+        return false;
+    }
+
+    // Möller–Trumbore; accepts hits in (epsilon, ray.TMax)
+    static bool intersectTriangle(const BVHTriangle &triangle, const Ray &ray, float &t, float &u, float &v)
+    {
+        const glm::vec3 edge1 = triangle.V1 - triangle.V0;
+        const glm::vec3 edge2 = triangle.V2 - triangle.V0;
+        const glm::vec3 p = glm::cross(ray.Direction, edge2);
+        const float det = glm::dot(edge1, p);
+        if (std::fabs(det) < 1e-12f)
+            return false;
+        const float invDet = 1.0f / det;
+        const glm::vec3 s = ray.Origin - triangle.V0;
+        u = glm::dot(s, p) * invDet;
+        if (u < 0.0f || u > 1.0f)
+            return false;
+        const glm::vec3 q = glm::cross(s, edge1);
+        v = glm::dot(ray.Direction, q) * invDet;
+        if (v < 0.0f || u + v > 1.0f)
+            return false;
+        t = glm::dot(edge2, q) * invDet;
+        return t > 1e-4f && t < ray.TMax;
+    }
+
+    // slab test; returns the entry distance, or 0 when the ray misses or the box lies beyond TMax
+    static float intersectBounds(const BVHNode &node, const Ray &ray)
+    {
+        const glm::vec3 t0 = (node.BoundsMin - ray.Origin) * ray.InvDirection;
+        const glm::vec3 t1 = (node.BoundsMax - ray.Origin) * ray.InvDirection;
+        const glm::vec3 tNear = glm::min(t0, t1), tFar = glm::max(t0, t1);
+        const float entry = std::max(std::max(tNear.x, tNear.y), tNear.z);
+        const float exit = std::min(std::min(tFar.x, tFar.y), tFar.z);
+        if (exit < entry || exit <= 0.0f || entry >= ray.TMax)
+            return 0.0f;
+        return std::max(entry, 1e-30f);
+    }
+
+    // SAH cost of the whole tree relative to the root's surface, for comparing builds
+    float cost() const
+    {
+        if (Nodes.empty())
+            return 0.0f;
+        float total = 0.0f;
+        const float rootArea = area(Nodes[0].BoundsMin, Nodes[0].BoundsMax);
+        for (const BVHNode &node : Nodes)
+        {
+            const float relative = area(node.BoundsMin, node.BoundsMax) / rootArea;
+            total += relative * (node.Count ? node.Count * INTERSECTION_COST : TRAVERSAL_COST);
+        }
+        return total;
+    }
+
+private:
+    std::vector<glm::vec3> centroids; // build-time only, indexed like TriangleIds
+
+    struct Bin {
+        glm::vec3 BoundsMin = glm::vec3(FLT_MAX);
+        glm::vec3 BoundsMax = glm::vec3(-FLT_MAX);
+        uint32_t Count = 0;
+    };
+
+    static float area(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax)
+    {
+        const glm::vec3 extent = glm::max(boundsMax - boundsMin, glm::vec3(0.0f));
+        return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+    }
+
+    void grow(glm::vec3 &boundsMin, glm::vec3 &boundsMax, const BVHTriangle &triangle) const
+    {
+        boundsMin = glm::min(boundsMin, glm::min(triangle.V0, glm::min(triangle.V1, triangle.V2)));
+        boundsMax = glm::max(boundsMax, glm::max(triangle.V0, glm::max(triangle.V1, triangle.V2)));
+    }
+
+    void updateBounds(uint32_t nodeIndex)
+    {
+        BVHNode &node = Nodes[nodeIndex];
+        node.BoundsMin = glm::vec3(FLT_MAX);
+        node.BoundsMax = glm::vec3(-FLT_MAX);
+        for (uint32_t i = node.LeftFirst; i < node.LeftFirst + node.Count; ++i)
+            grow(node.BoundsMin, node.BoundsMax, Triangles[TriangleIds[i]]);
+    }
+
+    void subdivide(uint32_t nodeIndex)
+    {
+        const uint32_t first = Nodes[nodeIndex].LeftFirst, count = Nodes[nodeIndex].Count;
+        if (count <= 2)
+            return;
+
+        glm::vec3 centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+        for (uint32_t i = first; i < first + count; ++i)
+        {
+            centroidMin = glm::min(centroidMin, centroids[TriangleIds[i]]);
+            centroidMax = glm::max(centroidMax, centroids[TriangleIds[i]]);
+        }
+
+        int bestAxis = -1;
+        unsigned int bestSplit = 0;
+        float bestCost = FLT_MAX;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const float extent = centroidMax[axis] - centroidMin[axis];
+            if (extent <= 0.0f)
+                continue;
+            Bin bins[SAH_BINS];
+            const float scale = SAH_BINS / extent;
+            for (uint32_t i = first; i < first + count; ++i)
+            {
+                const uint32_t id = TriangleIds[i];
+                Bin &bin = bins[binIndex(centroids[id][axis], centroidMin[axis], scale)];
+                ++bin.Count;
+                grow(bin.BoundsMin, bin.BoundsMax, Triangles[id]);
+            }
+            // sweep from both sides to get the area/count left and right of every boundary
+            float leftArea[SAH_BINS - 1], rightArea[SAH_BINS - 1];
+            uint32_t leftCount[SAH_BINS - 1], rightCount[SAH_BINS - 1];
+            Bin left, right;
+            for (unsigned int i = 0; i < SAH_BINS - 1; ++i)
+            {
+                left.Count += bins[i].Count;
+                left.BoundsMin = glm::min(left.BoundsMin, bins[i].BoundsMin);
+                left.BoundsMax = glm::max(left.BoundsMax, bins[i].BoundsMax);
+                leftCount[i] = left.Count;
+                leftArea[i] = area(left.BoundsMin, left.BoundsMax);
+                const Bin &mirror = bins[SAH_BINS - 1 - i];
+                right.Count += mirror.Count;
+                right.BoundsMin = glm::min(right.BoundsMin, mirror.BoundsMin);
+                right.BoundsMax = glm::max(right.BoundsMax, mirror.BoundsMax);
+                rightCount[SAH_BINS - 2 - i] = right.Count;
+                rightArea[SAH_BINS - 2 - i] = area(right.BoundsMin, right.BoundsMax);
+            }
+            for (unsigned int i = 0; i < SAH_BINS - 1; ++i)
+            {
+                if (leftCount[i] == 0 || rightCount[i] == 0)
+                    continue;
+                const float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = i;
+                }
+            }
+        }
+
+        const BVHNode &node = Nodes[nodeIndex];
+        const float leafCost = count * INTERSECTION_COST;
+        const float splitCost = TRAVERSAL_COST + INTERSECTION_COST * bestCost / area(node.BoundsMin, node.BoundsMax);
+        if (bestAxis < 0 || (splitCost >= leafCost && count <= MAX_LEAF_SIZE))
+            return;
+
+        // partition around the chosen bucket boundary
+        const float scale = SAH_BINS / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+        const float axisMin = centroidMin[bestAxis];
+        uint32_t *middle = std::partition(TriangleIds.data() + first, TriangleIds.data() + first + count, [&](uint32_t id) {
+            return binIndex(centroids[id][bestAxis], axisMin, scale) <= bestSplit;
+        });
+        const uint32_t leftCount = (uint32_t)(middle - (TriangleIds.data() + first));
+
+        const uint32_t leftChild = (uint32_t)Nodes.size();
+        Nodes.push_back(BVHNode());
+        Nodes.push_back(BVHNode());
+        Nodes[leftChild].LeftFirst = first;
+        Nodes[leftChild].Count = leftCount;
+        Nodes[leftChild + 1].LeftFirst = first + leftCount;
+        Nodes[leftChild + 1].Count = count - leftCount;
+        Nodes[nodeIndex].LeftFirst = leftChild;
+        Nodes[nodeIndex].Count = 0;
+        updateBounds(leftChild);
+        updateBounds(leftChild + 1);
+        subdivide(leftChild);
+        subdivide(leftChild + 1);
+    }
+
+    static unsigned int binIndex(float centroid, float axisMin, float scale)
+    {
+        return std::min(SAH_BINS - 1, (unsigned int)((centroid - axisMin) * scale));
+    }
+};
@@ -0,0 +1,676 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "bvh.h"
+
+#include <cfloat>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define BVH8_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// Kernels are compiled for their instruction set through function attributes, so the rest of
+// the program keeps the default target and the AVX2 path is only entered after CPUID says so.
+// The shared traversal is force-inlined into each target-specific wrapper, after which the
+// AVX2 kernels (plain inline: forcing them would fail in the default-target template) inline too.
+#if defined(__GNUC__) || defined(__clang__)
+#define BVH8_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define BVH8_INLINE inline __attribute__((always_inline))
+#else
+#define BVH8_TARGET_AVX2
+#define BVH8_INLINE __forceinline
+#endif
+
+enum class RayQueryPath { Scalar, SSE, AVX2 };
+
+inline const char *rayQueryPathName(RayQueryPath path)
+{
+    return path == RayQueryPath::AVX2 ? "AVX2" : path == RayQueryPath::SSE ? "SSE" : "scalar";
+}
+
+// Eight child boxes as structure-of-arrays, so one node is a single 8-wide slab test. Child[i]
+// is a node index when Count[i] == 0, otherwise the first of Count[i] triangle packets. Unused
+// slots have Child == EMPTY and all bounds at +inf, which no ray can hit.
+struct alignas(32) BVH8Node {
+    float MinX[8], MinY[8], MinZ[8];
+    float MaxX[8], MaxY[8], MaxZ[8];
+    uint32_t Child[8];
+    uint32_t Count[8];
+
+    static const uint32_t EMPTY = UINT32_MAX;
+};
+static_assert(sizeof(BVH8Node) == 256, "BVH8Node should stay four cache lines");
+
+// Eight triangles as vertex + two edges, structure-of-arrays. Padding lanes are zero-area
+// (never hit) and have Id == UINT32_MAX.
+struct alignas(32) TrianglePacket8 {
+    float V0X[8], V0Y[8], V0Z[8];
+    float E1X[8], E1Y[8], E1Z[8];
+    float E2X[8], E2Y[8], E2Z[8];
+    uint32_t Id[8];
+};
+
+// Eight rays traced together through RayQuery::intersect(RayPacket8&, ...). Coherent rays
+// (neighbouring camera pixels) visit nearly the same nodes, so testing one box or triangle
+// against all eight at once replaces eight separate traversals.
+struct alignas(32) RayPacket8 {
+    float OriginX[8], OriginY[8], OriginZ[8];
+    float DirectionX[8], DirectionY[8], DirectionZ[8];
+    float TMax[8];
+
+    void set(unsigned int lane, const Ray &ray)
+    {
+        OriginX[lane] = ray.Origin.x;
+        OriginY[lane] = ray.Origin.y;
+        OriginZ[lane] = ray.Origin.z;
+        DirectionX[lane] = ray.Direction.x;
+        DirectionY[lane] = ray.Direction.y;
+        DirectionZ[lane] = ray.Direction.z;
+        TMax[lane] = ray.TMax;
+    }
+
+    Ray get(unsigned int lane) const
+    {
+        return Ray(glm::vec3(OriginX[lane], OriginY[lane], OriginZ[lane]),
+                   glm::vec3(DirectionX[lane], DirectionY[lane], DirectionZ[lane]), TMax[lane]);
+    }
+};
+
+// Ray queries against a triangle mesh through an 8-wide BVH. The tree is a SAH BVH (bvh.h)
+// collapsed so every node holds up to eight children, with leaves packed eight triangles at a
+// time. Node and triangle tests run 8 lanes at once with AVX2, as two 4-lane halves with SSE,
+// or lane by lane; Path is picked from CPUID at construction and may be overridden to compare.
+class RayQuery
+{
+public:
+    std::vector<BVH8Node> Nodes;
+    std::vector<TrianglePacket8> Packets;
+    RayQueryPath Path;
+
+    RayQuery() : Path(detectPath()) {}
+
+    void build(const std::vector<BVHTriangle> &triangles)
+    {
+        BVH binary;
+        binary.build(triangles);
+        build(binary);
+    }
+
+    // collapses an already built binary BVH
+    void build(const BVH &binary)
+    {
+        Nodes.clear();
+        Packets.clear();
+        if (binary.Nodes.empty() || binary.Triangles.empty())
+            return;
+        Nodes.reserve(binary.Nodes.size() / 4 + 1);
+        Packets.reserve(binary.Triangles.size() / 4 + 1);
+        if (binary.Nodes[0].Count > 0)
+        {
+            // a single leaf: wrap it in a root with one child
+            Nodes.push_back(emptyNode());
+            setChild(0, 0, binary.Nodes[0], makePackets(binary, binary.Nodes[0]));
+            return;
+        }
+        collapse(binary, 0);
+    }
+
+    static RayQueryPath detectPath()
+    {
+#ifdef BVH8_X86
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            return RayQueryPath::AVX2;
+        if (__builtin_cpu_supports("sse2"))
+            return RayQueryPath::SSE;
+#else
+        int info[4];
+        __cpuid(info, 0);
+        const int maxLeaf = info[0];
+        __cpuid(info, 1);
+        const bool sse2 = (info[3] & (1 << 26)) != 0;
+        const bool fma = (info[2] & (1 << 12)) != 0;
+        // AVX state must also be enabled by the OS (OSXSAVE + XCR0 bits 1 and 2)
+        const bool osAvx = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+        bool avx2 = false;
+        if (maxLeaf >= 7)
+        {
+            __cpuidex(info, 7, 0);
+            avx2 = (info[1] & (1 << 5)) != 0;
+        }
+        if (avx2 && fma && osAvx)
+            return RayQueryPath::AVX2;
+        if (sse2)
+            return RayQueryPath::SSE;
+#endif
+#endif
+        return RayQueryPath::Scalar;
+    }
+
+    // closest hit; on success hit is filled in and ray.TMax shortened to it
+    bool intersect(Ray &ray, RayHit &hit) const
+    {
+        switch (Path)
+        {
+#ifdef BVH8_X86
+        case RayQueryPath::AVX2: return intersectAVX2(ray, hit, false);
+        case RayQueryPath::SSE:  return intersectSSE(ray, hit, false);
+#endif
+        default:                 return intersectScalar(ray, hit, false);
+        }
+    }
+
+    // any hit closer than ray.TMax
+    bool occluded(const Ray &ray) const
+    {
+        Ray shadow = ray;
+        RayHit hit;
+        switch (Path)
+        {
+#ifdef BVH8_X86
+        case RayQueryPath::AVX2: return intersectAVX2(shadow, hit, true);
+        case RayQueryPath::SSE:  return intersectSSE(shadow, hit, true);
+#endif
+        default:                 return intersectScalar(shadow, hit, true);
+        }
+    }
+
+    // closest hits of eight rays; packet.TMax is shortened like Ray::TMax. Only the AVX2 path
+    // traces packets natively, the others trace the eight rays one after another.
+    void intersect(RayPacket8 &packet, RayHit hits[8]) const
+    {
+#ifdef BVH8_X86
+        if (Path == RayQueryPath::AVX2)
+        {
+            intersectPacketAVX2(packet, hits);
+            return;
+        }
+#endif
+        for (unsigned int lane = 0; lane < 8; ++lane)
+        {
+            Ray ray = packet.get(lane);
+            hits[lane] = RayHit();
+            intersect(ray, hits[lane]);
+            packet.TMax[lane] = ray.TMax;
+        }
+    }
+
+private:
+    static const unsigned int STACK_SIZE = 256;
+
+    static BVH8Node emptyNode()
+    {
+        BVH8Node node;
+        for (int i = 0; i < 8; ++i)
+        {
+            node.MinX[i] = node.MinY[i] = node.MinZ[i] = FLT_MAX * 2.0f; // +inf
+            node.MaxX[i] = node.MaxY[i] = node.MaxZ[i] = FLT_MAX * 2.0f;
+            node.Child[i] = BVH8Node::EMPTY;
+            node.Count[i] = 0;
+        }
+        return node;
+    }
+
+    void setChild(uint32_t nodeIndex, int slot, const BVHNode &bounds, uint32_t child, uint32_t count = 0)
+    {
+        BVH8Node &node = Nodes[nodeIndex];
+        node.MinX[slot] = bounds.BoundsMin.x;
+        node.MinY[slot] = bounds.BoundsMin.y;
+        node.MinZ[slot] = bounds.BoundsMin.z;
+        node.MaxX[slot] = bounds.BoundsMax.x;
+        node.MaxY[slot] = bounds.BoundsMax.y;
+        node.MaxZ[slot] = bounds.BoundsMax.z;
+        node.Child[slot] = child;
+        node.Count[slot] = count;
+    }
+
+    void setChild(uint32_t nodeIndex, int slot, const BVHNode &leaf, const std::pair<uint32_t, uint32_t> &packets)
+    {
+        setChild(nodeIndex, slot, leaf, packets.first, packets.second);
+    }
+
+    // packs a binary leaf's triangles, eight per packet; returns (first packet, packet count)
+    std::pair<uint32_t, uint32_t> makePackets(const BVH &binary, const BVHNode &leaf)
+    {
+        const uint32_t first = (uint32_t)Packets.size();
+        for (uint32_t base = 0; base < leaf.Count; base += 8)
+        {
+            TrianglePacket8 packet = {};
+            for (uint32_t lane = 0; lane < 8; ++lane)
+            {
+                packet.Id[lane] = UINT32_MAX;
+                if (base + lane >= leaf.Count)
+                    continue;
+                const uint32_t index = leaf.LeftFirst + base + lane;
+                const BVHTriangle &triangle = binary.Triangles[index];
+                const glm::vec3 edge1 = triangle.V1 - triangle.V0, edge2 = triangle.V2 - triangle.V0;
+                packet.V0X[lane] = triangle.V0.x; packet.V0Y[lane] = triangle.V0.y; packet.V0Z[lane] = triangle.V0.z;
+                packet.E1X[lane] = edge1.x;       packet.E1Y[lane] = edge1.y;       packet.E1Z[lane] = edge1.z;
+                packet.E2X[lane] = edge2.x;       packet.E2Y[lane] = edge2.y;       packet.E2Z[lane] = edge2.z;
+                packet.Id[lane] = binary.TriangleIds[index];
+            }
+            Packets.push_back(packet);
+        }
+        return { first, (uint32_t)Packets.size() - first };
+    }
+
+    // Pulls the binary subtree's children up until there are eight, always opening the child
+    // with the largest surface area (the one most rays would have to enter anyway).
+    uint32_t collapse(const BVH &binary, uint32_t binaryIndex)
+    {
+        const BVHNode &root = binary.Nodes[binaryIndex];
+        std::vector<uint32_t> children = { root.LeftFirst, root.LeftFirst + 1 };
+        while (children.size() < 8)
+        {
+            int widest = -1;
+            float widestArea = -1.0f;
+            for (size_t i = 0; i < children.size(); ++i)
+            {
+                const BVHNode &child = binary.Nodes[children[i]];
+                if (child.Count > 0)
+                    continue;
+                const glm::vec3 extent = child.BoundsMax - child.BoundsMin;
+                const float area = extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+                if (area > widestArea)
+                {
+                    widestArea = area;
+                    widest = (int)i;
+                }
+            }
+            if (widest < 0)
+                break;
+            const uint32_t opened = children[widest];
+            children[widest] = binary.Nodes[opened].LeftFirst;
+            children.push_back(binary.Nodes[opened].LeftFirst + 1);
+        }
+
+        const uint32_t nodeIndex = (uint32_t)Nodes.size();
+        Nodes.push_back(emptyNode());
+        for (size_t slot = 0; slot < children.size(); ++slot)
+        {
+            const BVHNode &child = binary.Nodes[children[slot]];
+            if (child.Count > 0)
+                setChild(nodeIndex, (int)slot, child, makePackets(binary, child));
+            else
+                setChild(nodeIndex, (int)slot, child, collapse(binary, children[slot]));
+        }
+        return nodeIndex;
+    }
+
+    static unsigned int lowestBit(unsigned int mask)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return (unsigned int)__builtin_ctz(mask);
+#else
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return (unsigned int)index;
+#endif
+    }
+
+    // ---- kernels: one ray against a node's eight boxes / a packet's eight triangles ----------
+    // every kernel returns a bit mask of the lanes hit (box entry or triangle distance < tMax)
+
+    struct ScalarKernel {
+        static BVH8_INLINE unsigned int intersectNode(const BVH8Node &node, const Ray &ray, float tNear[8])
+        {
+            unsigned int mask = 0;
+            for (int i = 0; i < 8; ++i)
+            {
+                const float t0x = (node.MinX[i] - ray.Origin.x) * ray.InvDirection.x, t1x = (node.MaxX[i] - ray.Origin.x) * ray.InvDirection.x;
+                const float t0y = (node.MinY[i] - ray.Origin.y) * ray.InvDirection.y, t1y = (node.MaxY[i] - ray.Origin.y) * ray.InvDirection.y;
+                const float t0z = (node.MinZ[i] - ray.Origin.z) * ray.InvDirection.z, t1z = (node.MaxZ[i] - ray.Origin.z) * ray.InvDirection.z;
+                const float entry = std::max(std::max(std::min(t0x, t1x), std::min(t0y, t1y)), std::max(std::min(t0z, t1z), 0.0f));
+                const float exit = std::min(std::min(std::max(t0x, t1x), std::max(t0y, t1y)), std::min(std::max(t0z, t1z), ray.TMax));
+                tNear[i] = entry;
+                mask |= (entry <= exit ? 1u : 0u) << i;
+            }
+            return mask;
+        }
+
+        static BVH8_INLINE unsigned int intersectTriangles(const TrianglePacket8 &packet, const Ray &ray, float t[8], float u[8], float v[8])
+        {
+            unsigned int mask = 0;
+            for (int i = 0; i < 8; ++i)
+            {
+                const glm::vec3 edge1(packet.E1X[i], packet.E1Y[i], packet.E1Z[i]);
+                const glm::vec3 edge2(packet.E2X[i], packet.E2Y[i], packet.E2Z[i]);
+                const glm::vec3 p = glm::cross(ray.Direction, edge2);
+                const float det = glm::dot(edge1, p);
+                if (std::fabs(det) < 1e-12f)
+                    continue;
+                const float invDet = 1.0f / det;
+                const glm::vec3 s = ray.Origin - glm::vec3(packet.V0X[i], packet.V0Y[i], packet.V0Z[i]);
+                u[i] = glm::dot(s, p) * invDet;
+                const glm::vec3 q = glm::cross(s, edge1);
+                v[i] = glm::dot(ray.Direction, q) * invDet;
+                t[i] = glm::dot(edge2, q) * invDet;
+                if (u[i] >= 0.0f && v[i] >= 0.0f && u[i] + v[i] <= 1.0f && t[i] > 1e-4f && t[i] < ray.TMax)
+                    mask |= 1u << i;
+            }
+            return mask;
+        }
+    };
+
+#ifdef BVH8_X86
+    // SSE2 is part of x86-64, so this path needs no target attribute
+    struct SSEKernel {
+        static BVH8_INLINE unsigned int intersectNode(const BVH8Node &node, const Ray &ray, float tNear[8])
+        {
+            const __m128 ox = _mm_set1_ps(ray.Origin.x), oy = _mm_set1_ps(ray.Origin.y), oz = _mm_set1_ps(ray.Origin.z);
+            const __m128 ix = _mm_set1_ps(ray.InvDirection.x), iy = _mm_set1_ps(ray.InvDirection.y), iz = _mm_set1_ps(ray.InvDirection.z);
+            const __m128 zero = _mm_setzero_ps(), tMax = _mm_set1_ps(ray.TMax);
+            unsigned int mask = 0;
+            for (int half = 0; half < 8; half += 4)
+            {
+                const __m128 t0x = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.MinX + half), ox), ix);
+                const __m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.MaxX + half), ox), ix);
+                const __m128 t0y = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.MinY + half), oy), iy);
+                const __m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.MaxY + half), oy), iy);
+                const __m128 t0z = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.MinZ + half), oz), iz);
+                const __m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.MaxZ + half), oz), iz);
+                const __m128 entry = _mm_max_ps(_mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y)), _mm_max_ps(_mm_min_ps(t0z, t1z), zero));
+                const __m128 exit = _mm_min_ps(_mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y)), _mm_min_ps(_mm_max_ps(t0z, t1z), tMax));
+                _mm_storeu_ps(tNear + half, entry);
+                mask |= (unsigned int)_mm_movemask_ps(_mm_cmple_ps(entry, exit)) << half;
+            }
+            return mask;
+        }
+
+        static BVH8_INLINE unsigned int intersectTriangles(const TrianglePacket8 &packet, const Ray &ray, float t[8], float u[8], float v[8])
+        {
+            const __m128 dx = _mm_set1_ps(ray.Direction.x), dy = _mm_set1_ps(ray.Direction.y), dz = _mm_set1_ps(ray.Direction.z);
+            const __m128 ox = _mm_set1_ps(ray.Origin.x), oy = _mm_set1_ps(ray.Origin.y), oz = _mm_set1_ps(ray.Origin.z);
+            const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+            const __m128 epsilon = _mm_set1_ps(1e-12f), tMin = _mm_set1_ps(1e-4f), tMax = _mm_set1_ps(ray.TMax);
+            const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+            unsigned int mask = 0;
+            for (int half = 0; half < 8; half += 4)
+            {
+                const __m128 e1x = _mm_load_ps(packet.E1X + half), e1y = _mm_load_ps(packet.E1Y + half), e1z = _mm_load_ps(packet.E1Z + half);
+                const __m128 e2x = _mm_load_ps(packet.E2X + half), e2y = _mm_load_ps(packet.E2Y + half), e2z = _mm_load_ps(packet.E2Z + half);
+                // p = dir x e2, det = e1 . p
+                const __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+                const __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+                const __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+                const __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+                const __m128 invDet = _mm_div_ps(one, det);
+                // s = origin - v0, q = s x e1
+                const __m128 sx = _mm_sub_ps(ox, _mm_load_ps(packet.V0X + half));
+                const __m128 sy = _mm_sub_ps(oy, _mm_load_ps(packet.V0Y + half));
+                const __m128 sz = _mm_sub_ps(oz, _mm_load_ps(packet.V0Z + half));
+                const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+                const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+                const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+                const __m128 uu = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), invDet);
+                const __m128 vv = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDet);
+                const __m128 tt = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+                __m128 hit = _mm_cmpge_ps(_mm_and_ps(det, absMask), epsilon);
+                hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(uu, zero), _mm_cmpge_ps(vv, zero)));
+                hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(uu, vv), one));
+                hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpgt_ps(tt, tMin), _mm_cmplt_ps(tt, tMax)));
+                _mm_storeu_ps(t + half, tt);
+                _mm_storeu_ps(u + half, uu);
+                _mm_storeu_ps(v + half, vv);
+                mask |= (unsigned int)_mm_movemask_ps(hit) << half;
+            }
+            return mask;
+        }
+    };
+
+    struct AVX2Kernel {
+        static BVH8_TARGET_AVX2 inline unsigned int intersectNode(const BVH8Node &node, const Ray &ray, float tNear[8])
+        {
+            const __m256 ox = _mm256_set1_ps(ray.Origin.x), oy = _mm256_set1_ps(ray.Origin.y), oz = _mm256_set1_ps(ray.Origin.z);
+            const __m256 ix = _mm256_set1_ps(ray.InvDirection.x), iy = _mm256_set1_ps(ray.InvDirection.y), iz = _mm256_set1_ps(ray.InvDirection.z);
+            const __m256 t0x = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.MinX), ox), ix);
+            const __m256 t1x = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.MaxX), ox), ix);
+            const __m256 t0y = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.MinY), oy), iy);
+            const __m256 t1y = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.MaxY), oy), iy);
+            const __m256 t0z = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.MinZ), oz), iz);
+            const __m256 t1z = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.MaxZ), oz), iz);
+            const __m256 entry = _mm256_max_ps(_mm256_max_ps(_mm256_min_ps(t0x, t1x), _mm256_min_ps(t0y, t1y)),
+                                               _mm256_max_ps(_mm256_min_ps(t0z, t1z), _mm256_setzero_ps()));
+            const __m256 exit = _mm256_min_ps(_mm256_min_ps(_mm256_max_ps(t0x, t1x), _mm256_max_ps(t0y, t1y)),
+                                              _mm256_min_ps(_mm256_max_ps(t0z, t1z), _mm256_set1_ps(ray.TMax)));
+            _mm256_storeu_ps(tNear, entry);
+            return (unsigned int)_mm256_movemask_ps(_mm256_cmp_ps(entry, exit, _CMP_LE_OQ));
+        }
+
+        // Möller–Trumbore for the triangles of one packet, or one triangle broadcast over the
+        // rays of a RayPacket8: every argument is a lane vector
+        static BVH8_TARGET_AVX2 inline __m256 intersectTriangles(__m256 ox, __m256 oy, __m256 oz, __m256 dx, __m256 dy, __m256 dz, __m256 tMax,
+                                                                   __m256 v0x, __m256 v0y, __m256 v0z, __m256 e1x, __m256 e1y, __m256 e1z,
+                                                                   __m256 e2x, __m256 e2y, __m256 e2z, __m256 &t, __m256 &u, __m256 &v)
+        {
+            const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+            const __m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+            const __m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+            const __m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+            const __m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)), _mm256_mul_ps(e1z, pz));
+            const __m256 invDet = _mm256_div_ps(one, det);
+            const __m256 sx = _mm256_sub_ps(ox, v0x), sy = _mm256_sub_ps(oy, v0y), sz = _mm256_sub_ps(oz, v0z);
+            const __m256 qx = _mm256_sub_ps(_mm256_mul_ps(sy, e1z), _mm256_mul_ps(sz, e1y));
+            const __m256 qy = _mm256_sub_ps(_mm256_mul_ps(sz, e1x), _mm256_mul_ps(sx, e1z));
+            const __m256 qz = _mm256_sub_ps(_mm256_mul_ps(sx, e1y), _mm256_mul_ps(sy, e1x));
+            u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, px), _mm256_mul_ps(sy, py)), _mm256_mul_ps(sz, pz)), invDet);
+            v = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz)), invDet);
+            t = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)), invDet);
+            const __m256 absDet = _mm256_and_ps(det, _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff)));
+            __m256 hit = _mm256_cmp_ps(absDet, _mm256_set1_ps(1e-12f), _CMP_GE_OQ);
+            hit = _mm256_and_ps(hit, _mm256_and_ps(_mm256_cmp_ps(u, zero, _CMP_GE_OQ), _mm256_cmp_ps(v, zero, _CMP_GE_OQ)));
+            hit = _mm256_and_ps(hit, _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ));
+            hit = _mm256_and_ps(hit, _mm256_and_ps(_mm256_cmp_ps(t, _mm256_set1_ps(1e-4f), _CMP_GT_OQ), _mm256_cmp_ps(t, tMax, _CMP_LT_OQ)));
+            return hit;
+        }
+
+        static BVH8_TARGET_AVX2 inline unsigned int intersectTriangles(const TrianglePacket8 &packet, const Ray &ray, float t[8], float u[8], float v[8])
+        {
+            __m256 tt, uu, vv;
+            const __m256 hit = intersectTriangles(
+                _mm256_set1_ps(ray.Origin.x), _mm256_set1_ps(ray.Origin.y), _mm256_set1_ps(ray.Origin.z),
+                _mm256_set1_ps(ray.Direction.x), _mm256_set1_ps(ray.Direction.y), _mm256_set1_ps(ray.Direction.z), _mm256_set1_ps(ray.TMax),
+                _mm256_load_ps(packet.V0X), _mm256_load_ps(packet.V0Y), _mm256_load_ps(packet.V0Z),
+                _mm256_load_ps(packet.E1X), _mm256_load_ps(packet.E1Y), _mm256_load_ps(packet.E1Z),
+                _mm256_load_ps(packet.E2X), _mm256_load_ps(packet.E2Y), _mm256_load_ps(packet.E2Z), tt, uu, vv);
+            _mm256_storeu_ps(t, tt);
+            _mm256_storeu_ps(u, uu);
+            _mm256_storeu_ps(v, vv);
+            return (unsigned int)_mm256_movemask_ps(hit);
+        }
+    };
+#endif
+
+    // ---- traversal, shared by every kernel --------------------------------------------------
+
+    template <class Kernel>
+    BVH8_INLINE bool traverse(Ray &ray, RayHit &hit, bool anyHit) const
+    {
+        struct Entry { uint32_t Child, Count; float Distance; };
+        if (Nodes.empty())
+            return false;
+        Entry stack[STACK_SIZE];
+        unsigned int stackSize = 0;
+        stack[stackSize++] = { 0, 0, 0.0f };
+        bool found = false;
+        alignas(32) float t[8], u[8], v[8];
+        while (stackSize > 0)
+        {
+            const Entry entry = stack[--stackSize];
+            if (entry.Distance >= ray.TMax)
+                continue;
+            if (entry.Count == 0)
+            {
+                const BVH8Node &node = Nodes[entry.Child];
+                unsigned int mask = Kernel::intersectNode(node, ray, t);
+                // push far to near so the nearest child is popped first (insertion sort, <= 8)
+                Entry hits[8];
+                unsigned int hitCount = 0;
+                while (mask)
+                {
+                    const unsigned int i = lowestBit(mask);
+                    mask &= mask - 1;
+                    Entry child = { node.Child[i], node.Count[i], t[i] };
+                    unsigned int j = hitCount++;
+                    while (j > 0 && hits[j - 1].Distance < child.Distance)
+                    {
+                        hits[j] = hits[j - 1];
+                        --j;
+                    }
+                    hits[j] = child;
+                }
+                for (unsigned int i = 0; i < hitCount; ++i)
+                    stack[stackSize++] = hits[i];
+                continue;
+            }
+            for (uint32_t p = entry.Child; p < entry.Child + entry.Count; ++p)
+            {
+                const TrianglePacket8 &packet = Packets[p];
+                unsigned int mask = Kernel::intersectTriangles(packet, ray, t, u, v);
+                while (mask)
+                {
+                    const unsigned int i = lowestBit(mask);
+                    mask &= mask - 1;
+                    if (t[i] >= ray.TMax)
+                        continue;
+                    ray.TMax = t[i];
+                    hit.T = t[i];
+                    hit.U = u[i];
+                    hit.V = v[i];
+                    hit.Triangle = packet.Id[i];
+                    found = true;
+                    if (anyHit)
+                        return true;
+                }
+            }
+        }
+        return found;
+    }
+
+    bool intersectScalar(Ray &ray, RayHit &hit, bool anyHit) const
+    {
+        return traverse<ScalarKernel>(ray, hit, anyHit);
+    }
+
+#ifdef BVH8_X86
+    bool intersectSSE(Ray &ray, RayHit &hit, bool anyHit) const
+    {
+        return traverse<SSEKernel>(ray, hit, anyHit);
+    }
+
+    BVH8_TARGET_AVX2 bool intersectAVX2(Ray &ray, RayHit &hit, bool anyHit) const
+    {
+        return traverse<AVX2Kernel>(ray, hit, anyHit);
+    }
+
+    // Packet traversal: every node child and every triangle is tested against all eight rays.
+    // A child is entered when any ray hits it; children are ordered by their nearest entry.
+    BVH8_TARGET_AVX2 void intersectPacketAVX2(RayPacket8 &packet, RayHit hits[8]) const
+    {
+        const __m256 ox = _mm256_load_ps(packet.OriginX), oy = _mm256_load_ps(packet.OriginY), oz = _mm256_load_ps(packet.OriginZ);
+        const __m256 dx = _mm256_load_ps(packet.DirectionX), dy = _mm256_load_ps(packet.DirectionY), dz = _mm256_load_ps(packet.DirectionZ);
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 ix = _mm256_div_ps(one, dx), iy = _mm256_div_ps(one, dy), iz = _mm256_div_ps(one, dz);
+        __m256 tMax = _mm256_load_ps(packet.TMax);
+        __m256 hitT = _mm256_set1_ps(FLT_MAX), hitU = _mm256_setzero_ps(), hitV = _mm256_setzero_ps();
+        __m256i hitId = _mm256_set1_epi32(-1);
+        for (unsigned int lane = 0; lane < 8; ++lane)
+            hits[lane] = RayHit();
+        if (Nodes.empty())
+            return;
+
+        struct Entry { uint32_t Child, Count; float Distance; };
+        Entry stack[STACK_SIZE];
+        unsigned int stackSize = 0;
+        stack[stackSize++] = { 0, 0, 0.0f };
+        alignas(32) float entries[8];
+        while (stackSize > 0)
+        {
+            const Entry entry = stack[--stackSize];
+            if (entry.Count == 0)
+            {
+                const BVH8Node &node = Nodes[entry.Child];
+                Entry children[8];
+                unsigned int childCount = 0;
+                for (unsigned int i = 0; i < 8 && node.Child[i] != BVH8Node::EMPTY; ++i)
+                {
+                    const __m256 t0x = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.MinX[i]), ox), ix);
+                    const __m256 t1x = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.MaxX[i]), ox), ix);
+                    const __m256 t0y = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.MinY[i]), oy), iy);
+                    const __m256 t1y = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.MaxY[i]), oy), iy);
+                    const __m256 t0z = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.MinZ[i]), oz), iz);
+                    const __m256 t1z = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.MaxZ[i]), oz), iz);
+                    const __m256 entryT = _mm256_max_ps(_mm256_max_ps(_mm256_min_ps(t0x, t1x), _mm256_min_ps(t0y, t1y)),
+                                                        _mm256_max_ps(_mm256_min_ps(t0z, t1z), _mm256_setzero_ps()));
+                    const __m256 exitT = _mm256_min_ps(_mm256_min_ps(_mm256_max_ps(t0x, t1x), _mm256_max_ps(t0y, t1y)),
+                                                       _mm256_min_ps(_mm256_max_ps(t0z, t1z), tMax));
+                    const unsigned int mask = (unsigned int)_mm256_movemask_ps(_mm256_cmp_ps(entryT, exitT, _CMP_LE_OQ));
+                    if (!mask)
+                        continue;
+                    _mm256_store_ps(entries, entryT);
+                    float nearest = FLT_MAX;
+                    for (unsigned int bits = mask; bits; bits &= bits - 1)
+                        nearest = std::min(nearest, entries[lowestBit(bits)]);
+                    Entry child = { node.Child[i], node.Count[i], nearest };
+                    unsigned int j = childCount++;
+                    while (j > 0 && children[j - 1].Distance < child.Distance)
+                    {
+                        children[j] = children[j - 1];
+                        --j;
+                    }
+                    children[j] = child;
+                }
+                for (unsigned int i = 0; i < childCount; ++i)
+                    stack[stackSize++] = children[i];
+                continue;
+            }
+            for (uint32_t p = entry.Child; p < entry.Child + entry.Count; ++p)
+            {
+                const TrianglePacket8 &triangles = Packets[p];
+                for (unsigned int i = 0; i < 8 && triangles.Id[i] != UINT32_MAX; ++i)
+                {
+                    __m256 t, u, v;
+                    const __m256 hit = AVX2Kernel::intersectTriangles(ox, oy, oz, dx, dy, dz, tMax,
+                        _mm256_set1_ps(triangles.V0X[i]), _mm256_set1_ps(triangles.V0Y[i]), _mm256_set1_ps(triangles.V0Z[i]),
+                        _mm256_set1_ps(triangles.E1X[i]), _mm256_set1_ps(triangles.E1Y[i]), _mm256_set1_ps(triangles.E1Z[i]),
+                        _mm256_set1_ps(triangles.E2X[i]), _mm256_set1_ps(triangles.E2Y[i]), _mm256_set1_ps(triangles.E2Z[i]), t, u, v);
+                    if (_mm256_testz_ps(hit, hit))
+                        continue;
+                    tMax = _mm256_blendv_ps(tMax, t, hit);
+                    hitT = _mm256_blendv_ps(hitT, t, hit);
+                    hitU = _mm256_blendv_ps(hitU, u, hit);
+                    hitV = _mm256_blendv_ps(hitV, v, hit);
+                    hitId = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(hitId),
+                                                                 _mm256_castsi256_ps(_mm256_set1_epi32((int)triangles.Id[i])), hit));
+                }
+            }
+        }
+
+        alignas(32) float t[8], u[8], v[8];
+        alignas(32) uint32_t ids[8];
+        _mm256_store_ps(packet.TMax, tMax);
+        _mm256_store_ps(t, hitT);
+        _mm256_store_ps(u, hitU);
+        _mm256_store_ps(v, hitV);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(ids), hitId);
+        for (unsigned int lane = 0; lane < 8; ++lane)
+        {
+            if (ids[lane] == UINT32_MAX)
+                continue;
+            hits[lane].T = t[lane];
+            hits[lane].U = u[lane];
+            hits[lane].V = v[lane];
+            hits[lane].Triangle = ids[lane];
+        }
+    }
+#endif
+};
@@ -4,6 +4,7 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <array>
 #include <vector>
 
 // Defines several possible options for camera movement. Used as abstraction to stay away from window-system specific input methods
@@ -67,6 +68,26 @@ public:
         return glm::lookAt(Position, Position + Front, Up);
     }
 
+    // returns how many pixels one world unit covers at distance 1 in front of the camera, for a
+    // perspective projection and a viewport viewportHeight pixels tall; divide by the distance
+    // for anything further away
+    float GetProjectionScale(const glm::mat4 &projection, float viewportHeight)
+    {
+        return projection[1][1] * viewportHeight * 0.5f; // projection[1][1] is 1 / tan(fovy / 2)
+    }
+
+    // returns the six frustum planes (left, right, bottom, top, near, far) of projection * view as
+    // (normal, distance) with unit normals pointing inwards: a point p is inside the frustum when
+    // dot(normal, p) + distance >= 0 for every plane (Gribb & Hartmann)
+    std::array<glm::vec4, 6> GetFrustumPlanes(const glm::mat4 &projection)
+    {
+        const glm::mat4 m = glm::transpose(projection * GetViewMatrix()); // m[i] is now row i
+        std::array<glm::vec4, 6> planes = { m[3] + m[0], m[3] - m[0], m[3] + m[1], m[3] - m[1], m[3] + m[2], m[3] - m[2] };
+        for (glm::vec4 &plane : planes)
+            plane /= glm::length(glm::vec3(plane));
+        return planes;
+    }
+
     // processes input received from any keyboard-like input system. Accepts input parameter in the form of camera defined ENUM (to abstract it from windowing systems)
     void ProcessKeyboard(Camera_Movement direction, float deltaTime)
     {
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "camera.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// One fixed-timestep step of camera input: the movement keys held (bit n set for
+// Camera_Movement n) and the mouse offset, in pixels, accumulated during the step.
+struct CameraPathStep {
+    unsigned int Keys;
+    float MouseX;
+    float MouseY;
+};
+
+// A recorded camera path, fed back through Camera::ProcessKeyboard/ProcessMouseMovement so a
+// replay moves the camera exactly like the original input did. Text format, one step per line:
+//
+//     # comment
+//     WD -5.3 0      <- keys held (any of W S A D Q E, or - for none), mouse x/y offset
+//
+// Replays always use a fixed timestep, so a path gives the same frames on every machine.
+class CameraPath
+{
+public:
+    std::vector<CameraPathStep> Steps;
+
+    bool load(const std::string &path)
+    {
+        std::ifstream in(path);
+        if (!in)
+        {
+            std::cout << "ERROR::CAMERA_PATH::FILE_NOT_SUCCESFULLY_READ: " << path << std::endl;
+            return false;
+        }
+        Steps.clear();
+        std::string line;
+        for (unsigned int lineNumber = 1; std::getline(in, line); ++lineNumber)
+        {
+            std::istringstream fields(line);
+            std::string keys;
+            if (!(fields >> keys) || keys[0] == '#')
+                continue;
+            CameraPathStep step = { 0, 0.0f, 0.0f };
+            bool valid = (bool)(fields >> step.MouseX >> step.MouseY);
+            for (char key : keys)
+            {
+                if (key == '-')
+                    continue;
+                int bit = keyBit(key);
+                valid = valid && bit >= 0;
+                step.Keys |= bit >= 0 ? 1u << bit : 0u;
+            }
+            if (!valid)
+            {
+                std::cout << "ERROR::CAMERA_PATH::BAD_LINE: " << path << ":" << lineNumber << std::endl;
+                return false;
+            }
+            Steps.push_back(step);
+        }
+        return true;
+    }
+
+    bool save(const std::string &path) const
+    {
+        std::ofstream out(path);
+        if (!out)
+            return false;
+        out << "# camera path: keys (W S A D Q E, - for none) then mouse x/y offset, one fixed step per line\n";
+        for (const CameraPathStep &step : Steps)
+        {
+            std::string keys;
+            for (int bit = FORWARD; bit <= DOWN; ++bit)
+                if (step.Keys & (1u << bit))
+                    keys += KEY_NAMES[bit];
+            out << (keys.empty() ? "-" : keys) << ' ' << step.MouseX << ' ' << step.MouseY << '\n';
+        }
+        return (bool)out;
+    }
+
+    void record(unsigned int keys, float mouseX, float mouseY)
+    {
+        Steps.push_back({ keys, mouseX, mouseY });
+    }
+
+    // applies step `index` (wrapping around, so a short path can drive a long run)
+    void apply(Camera &camera, size_t index, float deltaTime) const
+    {
+        if (Steps.empty())
+            return;
+        const CameraPathStep &step = Steps[index % Steps.size()];
+        for (int bit = FORWARD; bit <= DOWN; ++bit)
+            if (step.Keys & (1u << bit))
+                camera.ProcessKeyboard((Camera_Movement)bit, deltaTime);
+        if (step.MouseX != 0.0f || step.MouseY != 0.0f)
+            camera.ProcessMouseMovement(step.MouseX, step.MouseY);
+    }
+
+private:
+    // indexed by Camera_Movement
+    static constexpr const char *KEY_NAMES = "WSADEQ";
+
+    static int keyBit(char key)
+    {
+        for (int bit = FORWARD; bit <= DOWN; ++bit)
+            if (KEY_NAMES[bit] == key)
+                return bit;
+        return -1;
+    }
+};
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "shader.h"
+#include "uniform_buffer.h"
+#include "light_clusters.h"
+#include "profiler.h"
+#include "render_queue.h"
+#include "simulation.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// A floor with a field of pillars behind the main scene, lit by thousands of moving point
+// lights through LightClusters. Every light circles its own anchor above the floor, moved by
+// the simulation step (animate()) and taken from its FrameSnapshot by Draw(); the
+// lights' radius shrinks as their number grows, so any point is reached by about the same
+// number of them (OVERLAP) at 1k lights as at 10k and the frame cost shows the clustering
+// rather than the light count. Light assignment time and frame time are printed once per
+// second.
+class ClusteredScene
+{
+public:
+    // lights reaching an average point of the floor
+    static constexpr float OVERLAP = 12.0f;
+
+    LightClusters Clusters;
+
+    ClusteredScene(size_t lightCount, unsigned int cubeVAO, GLsizei cubeIndexCount, const UniformBuffer<CameraBlock> &cameraUBO,
+                   RenderQueue &queue, float nearPlane, float farPlane, float viewportWidth, float viewportHeight, unsigned int threads = 0)
+        : Clusters(workers, nearPlane, farPlane), cubeVAO(cubeVAO), cubeIndexCount(cubeIndexCount),
+          shader("../shaders/surface.vs", "../shaders/clustered.fs", SHADER_LIT), queue(queue), workers(threads)
+    {
+        cameraUBO.attach(shader, "Camera");
+        Clusters.attach(shader, viewportWidth, viewportHeight);
+        shader.setVec3("ambientLight", glm::vec3(0.05f));
+        program = queue.addProgram(shader);
+
+        std::mt19937 random(7);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        auto range = [&](float low, float high) { return low + (high - low) * unit(random); };
+
+        // the floor, then a grid of pillars of random height standing on it
+        models.push_back(glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, FLOOR_Y - 0.1f, (NEAR_Z + FAR_Z) * 0.5f)),
+                                    glm::vec3(HALF_WIDTH * 2.0f, 0.2f, NEAR_Z - FAR_Z)));
+        materials.push_back({ glm::vec3(0.6f), glm::vec3(0.6f), glm::vec3(0.2f), 16.0f });
+        for (float z = NEAR_Z - 2.0f; z > FAR_Z + 1.0f; z -= PILLAR_SPACING)
+            for (float x = -HALF_WIDTH + 1.0f; x < HALF_WIDTH - 1.0f; x += PILLAR_SPACING)
+            {
+                const float height = range(0.5f, 3.0f);
+                models.push_back(glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(x, FLOOR_Y + height * 0.5f, z)), glm::vec3(0.6f, height, 0.6f)));
+                const float shade = range(0.5f, 0.9f);
+                materials.push_back({ glm::vec3(shade), glm::vec3(shade), glm::vec3(0.5f), 32.0f });
+            }
+
+        const float area = HALF_WIDTH * 2.0f * (NEAR_Z - FAR_Z);
+        const float radius = std::min(6.0f, std::max(0.75f, std::sqrt(OVERLAP * area / (3.14159265f * lightCount))));
+        Clusters.Lights.resize(std::min(lightCount, LightClusters::MAX_LIGHTS));
+        for (PointLight &light : Clusters.Lights)
+        {
+            Orbit orbit;
+            orbit.Anchor = glm::vec3(range(-HALF_WIDTH, HALF_WIDTH), FLOOR_Y + range(0.3f, 2.5f), range(FAR_Z, NEAR_Z));
+            orbit.Radius = range(0.5f, 2.0f);
+            orbit.Speed = range(0.3f, 1.2f) * (unit(random) < 0.5f ? -1.0f : 1.0f);
+            orbit.Phase = range(0.0f, 6.2831853f);
+            orbits.push_back(orbit);
+            light.Position = orbit.at(0.0f);
+            // a saturated colour of random hue; brighter when each light covers less floor
+            const glm::vec3 hue = glm::clamp(glm::abs(glm::mod(range(0.0f, 6.0f) + glm::vec3(0.0f, 4.0f, 2.0f), 6.0f) - 3.0f) - 1.0f, 0.0f, 1.0f);
+            light.Color = hue * (1.0f + radius * 0.5f);
+            light.Radius = radius;
+        }
+        std::cout << "clustered lights: " << Clusters.Lights.size() << " lights of radius " << radius << " over " << models.size() - 1
+                  << " pillars, " << LightClusters::TILES_X << "x" << LightClusters::TILES_Y << "x" << LightClusters::SLICES << " clusters" << std::endl;
+    }
+
+    // simulation thread: the lights' positions at time (seconds), into snapshot
+    void animate(FrameSnapshot &snapshot, float time, ThreadPool &jobs) const
+    {
+        PROFILE_ZONE("clustered lights");
+        std::vector<glm::vec3> &positions = snapshot.LightPositions;
+        positions.resize(orbits.size());
+        JobCounter moved;
+        for (size_t first = 0; first < orbits.size(); first += MOVE_CHUNK)
+        {
+            const size_t last = std::min(orbits.size(), first + MOVE_CHUNK);
+            jobs.submit([this, &positions, time, first, last] {
+                for (size_t i = first; i < last; ++i)
+                    positions[i] = orbits[i].at(time);
+            }, &moved);
+        }
+        jobs.wait(moved);
+    }
+
+    // takes the light positions of snapshot (the initial ones before the first step), assigns
+    // the lights to the clusters of view/projection, uploads the result and records the floor
+    // and the pillars
+    void Draw(const FrameSnapshot &snapshot, const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &viewPos, float farPlane)
+    {
+        {
+            JobCounter moved;
+            const std::vector<glm::vec3> &positions = snapshot.LightPositions;
+            const size_t count = positions.size() == Clusters.Lights.size() ? positions.size() : 0;
+            for (size_t first = 0; first < count; first += MOVE_CHUNK)
+                workers.submit([this, &positions, first, count] {
+                    for (size_t i = first; i < std::min(count, first + MOVE_CHUNK); ++i)
+                        Clusters.Lights[i].Position = positions[i];
+                }, &moved);
+            // the assignment's first jobs start as soon as every light has moved
+            Clusters.assign(view, projection, &moved);
+        }
+        Clusters.upload();
+
+        RenderBucket &bucket = queue.bucket(0);
+        for (size_t i = 0; i < models.size(); ++i)
+        {
+            const float depth = glm::length(glm::vec3(models[i][3]) - viewPos) / farPlane;
+            bucket.draw({ RenderQueue::makeKey(RenderQueue::OPAQUE_PASS, program, (uint32_t)i, cubeVAO, depth), &models[i], &materials[i],
+                          program, cubeVAO, 0, (uint32_t)cubeIndexCount, 0, 0 });
+        }
+    }
+
+    void Report(float deltaTime, bool force = false)
+    {
+        Clusters.Report(deltaTime, force);
+    }
+
+    void Release()
+    {
+        Clusters.Release();
+        glDeleteProgram(shader.ID);
+    }
+
+private:
+    static constexpr float FLOOR_Y = -1.5f;
+    static constexpr float HALF_WIDTH = 20.0f;
+    static constexpr float NEAR_Z = 0.0f;
+    static constexpr float FAR_Z = -40.0f;
+    static constexpr float PILLAR_SPACING = 2.5f;
+    static const size_t MOVE_CHUNK = 1024;
+
+    struct Orbit {
+        glm::vec3 Anchor;
+        float Radius;
+        float Speed;                    // radians per second, either direction
+        float Phase;
+
+        glm::vec3 at(float time) const
+        {
+            const float angle = Phase + Speed * time;
+            return Anchor + glm::vec3(std::cos(angle) * Radius, 0.25f * std::sin(2.0f * angle), std::sin(angle) * Radius);
+        }
+    };
+
+    unsigned int cubeVAO;
+    GLsizei cubeIndexCount;
+    Shader shader;
+    RenderQueue &queue;
+    uint32_t program;
+    ThreadPool workers;                 // Clusters only keeps a reference, so it may be built first
+    std::vector<glm::mat4> models;
+    std::vector<RenderMaterial> materials;
+    std::vector<Orbit> orbits;
+};
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Per-frame CPU and GPU times of a benchmark run.
+//
+// CPU time is the wall time between beginFrame() and endFrame(), i.e. building and submitting
+// the frame. GPU time is the difference of two GL_TIMESTAMP queries around the same commands
+// (timestamps rather than GL_TIME_ELAPSED, which can't nest with other timer queries). Queries
+// are recycled through a small ring and read back QUERY_LATENCY frames later, when the GPU has
+// long finished with them; waiting on the oldest one also keeps the CPU from running more than
+// QUERY_LATENCY frames ahead when there is no swap to throttle it.
+//
+// Software rasterizers (llvmpipe) stamp the queries when they are queued, so there the GPU
+// column is close to zero and the CPU column carries the rasterization cost.
+class FrameStats
+{
+public:
+    static const unsigned int QUERY_LATENCY = 4;
+
+    std::vector<double> CpuMs;
+    std::vector<double> GpuMs;
+
+    explicit FrameStats(size_t expectedFrames = 0)
+    {
+        CpuMs.reserve(expectedFrames);
+        GpuMs.reserve(expectedFrames);
+        glGenQueries(2 * QUERY_LATENCY, queries);
+    }
+
+    void beginFrame()
+    {
+        const size_t frame = CpuMs.size();
+        if (frame >= QUERY_LATENCY)
+            collect(frame - QUERY_LATENCY);
+        glQueryCounter(queries[2 * (frame % QUERY_LATENCY)], GL_TIMESTAMP);
+        frameStart = std::chrono::steady_clock::now();
+    }
+
+    void endFrame()
+    {
+        glQueryCounter(queries[2 * (CpuMs.size() % QUERY_LATENCY) + 1], GL_TIMESTAMP);
+        const auto frameEnd = std::chrono::steady_clock::now();
+        CpuMs.push_back(std::chrono::duration<double, std::milli>(frameEnd - frameStart).count());
+        GpuMs.push_back(0.0);
+    }
+
+    // reads back the queries still in flight; call once after the last frame
+    void finish()
+    {
+        const size_t frames = CpuMs.size();
+        for (size_t frame = frames > QUERY_LATENCY ? frames - QUERY_LATENCY : 0; frame < frames; ++frame)
+            collect(frame);
+        glDeleteQueries(2 * QUERY_LATENCY, queries);
+    }
+
+    // nearest-rank percentile, p in [0, 100]
+    static double percentile(std::vector<double> values, double p)
+    {
+        if (values.empty())
+            return 0.0;
+        std::sort(values.begin(), values.end());
+        size_t rank = (size_t)(p / 100.0 * values.size() + 0.5);
+        rank = std::min(std::max(rank, (size_t)1), values.size());
+        return values[rank - 1];
+    }
+
+    static double mean(const std::vector<double> &values)
+    {
+        double sum = 0.0;
+        for (double value : values)
+            sum += value;
+        return values.empty() ? 0.0 : sum / values.size();
+    }
+
+    void printSummary() const
+    {
+        std::cout << std::fixed << std::setprecision(3) << CpuMs.size() << " frames\n"
+                  << "ms        mean      p50      p95      p99      max\n";
+        printRow("cpu", CpuMs);
+        printRow("gpu", GpuMs);
+        std::cout.unsetf(std::ios::floatfield);
+    }
+
+    // per-frame rows as CSV, or summary + per-frame arrays when the path ends in ".json"
+    bool write(const std::string &path) const
+    {
+        std::ofstream out(path);
+        if (!out)
+        {
+            std::cout << "ERROR::FRAME_STATS::FILE_NOT_SUCCESFULLY_WRITTEN: " << path << std::endl;
+            return false;
+        }
+        out << std::fixed << std::setprecision(4);
+        const bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+        if (!json)
+        {
+            out << "frame,cpu_ms,gpu_ms\n";
+            for (size_t i = 0; i < CpuMs.size(); ++i)
+                out << i << ',' << CpuMs[i] << ',' << GpuMs[i] << '\n';
+            return (bool)out;
+        }
+        out << "{\n  \"frames\": " << CpuMs.size() << ",\n";
+        writeJsonSeries(out, "cpu_ms", CpuMs);
+        out << ",\n";
+        writeJsonSeries(out, "gpu_ms", GpuMs);
+        out << "\n}\n";
+        return (bool)out;
+    }
+
+private:
+    unsigned int queries[2 * QUERY_LATENCY]; // start/end timestamp pairs
+    std::chrono::steady_clock::time_point frameStart;
+
+    void collect(size_t frame)
+    {
+        GLuint64 start = 0, end = 0;
+        glGetQueryObjectui64v(queries[2 * (frame % QUERY_LATENCY)], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(queries[2 * (frame % QUERY_LATENCY) + 1], GL_QUERY_RESULT, &end);
+        GpuMs[frame] = end > start ? (end - start) / 1.0e6 : 0.0;
+    }
+
+    static void printRow(const char *name, const std::vector<double> &values)
+    {
+        std::cout << name << "  " << std::setw(9) << mean(values) << std::setw(9) << percentile(values, 50.0)
+                  << std::setw(9) << percentile(values, 95.0) << std::setw(9) << percentile(values, 99.0)
+                  << std::setw(9) << percentile(values, 100.0) << "\n";
+    }
+
+    static void writeJsonSeries(std::ofstream &out, const char *name, const std::vector<double> &values)
+    {
+        out << "  \"" << name << "\": {\n"
+            << "    \"mean\": " << mean(values) << ", \"p50\": " << percentile(values, 50.0)
+            << ", \"p95\": " << percentile(values, 95.0) << ", \"p99\": " << percentile(values, 99.0)
+            << ", \"max\": " << percentile(values, 100.0) << ",\n    \"frames\": [";
+        for (size_t i = 0; i < values.size(); ++i)
+            out << (i ? ", " : "") << values[i];
+        out << "]\n  }";
+    }
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "shader.h"
+
+// A CPU-written RGBA8 image shown across the whole viewport: upload() replaces the texture
+// contents, Draw() renders a single screen-covering triangle (shaders/fullscreen.vs generates
+// it from gl_VertexID, so the VAO is empty).
+class FullscreenTexture
+{
+public:
+    unsigned int Texture = 0;
+    unsigned int VAO = 0;
+    unsigned int Width, Height;
+
+    FullscreenTexture(unsigned int width, unsigned int height)
+        : Width(width), Height(height), shader("../shaders/fullscreen.vs", "../shaders/fullscreen.fs")
+    {
+        glGenVertexArrays(1, &VAO);
+        glGenTextures(1, &Texture);
+        glBindTexture(GL_TEXTURE_2D, Texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, Width, Height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        shader.use();
+        shader.setInt("image", 0);
+    }
+
+    // width * height RGBA8 pixels, bottom row first
+    void upload(const unsigned char *pixels)
+    {
+        glBindTexture(GL_TEXTURE_2D, Texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, Width, Height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    }
+
+    void Draw() const
+    {
+        glDisable(GL_DEPTH_TEST);
+        shader.use();
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, Texture);
+        glBindVertexArray(VAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glEnable(GL_DEPTH_TEST);
+    }
+
+    void Release()
+    {
+        glDeleteTextures(1, &Texture);
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteProgram(shader.ID);
+    }
+
+private:
+    Shader shader;
+};
@@ -0,0 +1,332 @@
+#pragma once
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// One glyph of one pixel size. The metrics never change once loaded; where the glyph sits in
+// the atlas is only valid while Shelf >= 0, since shelves are reused when the atlas is full.
+struct GlyphInfo {
+    uint32_t FontIndex;                 // FreeType's index of the glyph in the face
+    uint16_t Size;                      // pixels per em
+    int16_t BearingX, BearingY;         // bitmap's left edge and top from the pen, y up
+    uint16_t Width, Height;             // bitmap, pixels
+    float Advance;                      // pixels
+    uint16_t X = 0, Y = 0;              // bitmap's top-left in the atlas
+    int32_t Shelf = -1;                 // -1 when not in the atlas
+    uint32_t LastUsed = 0;              // frame, see GlyphAtlas::place()
+};
+
+// What the atlas did since it was created
+struct GlyphAtlasStats {
+    size_t Rasterized = 0;              // bitmaps rendered by FreeType, reloads included
+    size_t EvictedShelves = 0;
+    size_t EvictedGlyphs = 0;
+    size_t Dropped = 0;                 // glyphs that found no room, see place()
+};
+
+// A single channel atlas of glyph bitmaps rasterized by FreeType on demand, for any number of
+// pixel sizes of one face. Glyphs are packed into shelves: rows as tall as the glyphs they
+// hold, each filled left to right, a new one opened below the last while there is room. Once
+// the atlas is full, the shelf used least recently (and tall enough) is emptied for the
+// glyph, and the glyphs it held are rasterized again the next time they are needed. When no
+// single shelf is tall enough, adjacent ones are merged, and a shelf much taller than the
+// glyph is split, so a change of sizes doesn't leave the atlas in rows too short to use.
+// Glyphs used in the current frame are never evicted, so everything already laid out stays
+// valid.
+//
+// The pixels live on the CPU; whoever draws with them uploads the rows between DirtyMinY and
+// DirtyMaxY and calls clean(). No GL here, so the atlas can be measured without a context.
+class GlyphAtlas
+{
+public:
+    // every glyph gets this many empty pixels right of and below it, so bilinear filtering
+    // never picks up a neighbour
+    static const int PADDING = 1;
+
+    GlyphAtlasStats Stats;
+    int DirtyMinY, DirtyMaxY;           // rows changed since clean(), empty when min > max
+
+    GlyphAtlas(const std::string &fontPath, int width = 1024, int height = 1024)
+        : width(width), height(height), pixels((size_t)width * height, 0)
+    {
+        clean();
+        if (FT_Init_FreeType(&library))
+        {
+            std::cout << "ERROR::FREETYPE::INIT_FAILED" << std::endl;
+            library = nullptr;
+            return;
+        }
+        if (FT_New_Face(library, fontPath.c_str(), 0, &face))
+        {
+            std::cout << "ERROR::FREETYPE::FONT_NOT_LOADED: " << fontPath << std::endl;
+            face = nullptr;
+        }
+    }
+
+    GlyphAtlas(const GlyphAtlas&) = delete;
+    GlyphAtlas& operator=(const GlyphAtlas&) = delete;
+
+    ~GlyphAtlas()
+    {
+        if (face)
+            FT_Done_Face(face);
+        if (library)
+            FT_Done_FreeType(library);
+    }
+
+    bool valid() const { return face != nullptr; }
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    const uint8_t* getPixels() const { return pixels.data(); }
+    size_t glyphCount() const { return glyphs.size(); }
+    size_t shelfCount() const
+    {
+        return (size_t)std::count_if(shelves.begin(), shelves.end(), [](const Shelf &shelf) { return shelf.Height > 0; });
+    }
+
+    const GlyphInfo& info(uint32_t glyph) const { return glyphs[glyph]; }
+
+    // the glyph of codepoint at size, its metrics loaded the first time it is asked for;
+    // returns an index for info() and place()
+    uint32_t glyph(uint32_t codepoint, int size)
+    {
+        const uint64_t key = (uint64_t)codepoint << 16 | (uint16_t)size;
+        const auto found = lookup.find(key);
+        if (found != lookup.end())
+            return found->second;
+        const uint32_t index = (uint32_t)glyphs.size();
+        lookup.emplace(key, index);
+        glyphs.emplace_back();
+        GlyphInfo &info = glyphs.back();
+        info.FontIndex = FT_Get_Char_Index(face, codepoint);
+        info.Size = (uint16_t)size;
+        if (render(index))
+        {
+            const FT_GlyphSlot slot = face->glyph;
+            info.BearingX = (int16_t)slot->bitmap_left;
+            info.BearingY = (int16_t)slot->bitmap_top;
+            info.Width = (uint16_t)slot->bitmap.width;
+            info.Height = (uint16_t)slot->bitmap.rows;
+            info.Advance = slot->advance.x / 64.0f;
+        }
+        else
+        {
+            info.BearingX = info.BearingY = 0;
+            info.Width = info.Height = 0;
+            info.Advance = 0.0f;
+        }
+        return index;
+    }
+
+    // pen offset between two glyphs of the same size, pixels
+    float kerning(uint32_t left, uint32_t right)
+    {
+        if (!FT_HAS_KERNING(face))
+            return 0.0f;
+        const GlyphInfo &a = glyphs[left], &b = glyphs[right];
+        rendered = UINT32_MAX;          // a size change may clear the slot
+        setSize(a.Size);
+        FT_Vector delta;
+        if (FT_Get_Kerning(face, a.FontIndex, b.FontIndex, FT_KERNING_DEFAULT, &delta))
+            return 0.0f;
+        return delta.x / 64.0f;
+    }
+
+    // makes sure glyph is in the atlas and marks it used in frame (which only ever grows).
+    // Returns false, and counts the glyph as dropped, when every shelf tall enough holds a
+    // glyph already used in this frame
+    bool place(uint32_t glyph, uint32_t frame)
+    {
+        GlyphInfo &info = glyphs[glyph];
+        info.LastUsed = frame;
+        if (info.Shelf >= 0)
+        {
+            shelves[info.Shelf].LastUsed = frame;
+            return true;
+        }
+        return info.Width == 0 || info.Height == 0 || insert(glyph, frame);
+    }
+
+    void clean()
+    {
+        DirtyMinY = height;
+        DirtyMaxY = -1;
+    }
+
+private:
+    struct Shelf {
+        int Y, Height;
+        int X = 0;                      // next free column
+        uint32_t LastUsed = 0;
+        std::vector<uint32_t> Glyphs;
+    };
+
+    int width, height;
+    std::vector<uint8_t> pixels;
+    FT_Library library = nullptr;
+    FT_Face face = nullptr;
+    int currentSize = 0;
+    uint32_t rendered = UINT32_MAX;     // the glyph whose bitmap is in face->glyph
+    std::vector<GlyphInfo> glyphs;
+    std::unordered_map<uint64_t, uint32_t> lookup;  // codepoint << 16 | size
+    std::vector<Shelf> shelves;
+    int nextShelfY = 0;
+
+    // place() for a glyph not in the atlas: rasterizes it into the shelf findShelf() picks
+    bool insert(uint32_t glyph, uint32_t frame)
+    {
+        GlyphInfo &info = glyphs[glyph];
+        const int w = info.Width + PADDING, h = info.Height + PADDING;
+        const int shelf = findShelf(w, h, frame);
+        if (shelf < 0)
+        {
+            ++Stats.Dropped;
+            return false;
+        }
+        if (rendered != glyph && !render(glyph))
+            return false;
+        Shelf &target = shelves[shelf];
+        info.X = (uint16_t)target.X;
+        info.Y = (uint16_t)target.Y;
+        info.Shelf = shelf;
+        target.X += w;
+        target.LastUsed = frame;
+        target.Glyphs.push_back(glyph);
+
+        const FT_Bitmap &bitmap = face->glyph->bitmap;
+        for (unsigned int row = 0; row < bitmap.rows; ++row)
+            std::memcpy(&pixels[(size_t)(info.Y + row) * width + info.X], bitmap.buffer + (ptrdiff_t)row * bitmap.pitch, bitmap.width);
+        markDirty(info.Y, info.Y + info.Height - 1);
+        return true;
+    }
+
+    void setSize(int size)
+    {
+        if (size == currentSize)
+            return;
+        FT_Set_Pixel_Sizes(face, 0, (FT_UInt)size);
+        currentSize = size;
+    }
+
+    // leaves the bitmap of glyph in face->glyph
+    bool render(uint32_t glyph)
+    {
+        const GlyphInfo &info = glyphs[glyph];
+        setSize(info.Size);
+        rendered = UINT32_MAX;
+        if (FT_Load_Glyph(face, info.FontIndex, FT_LOAD_RENDER))
+            return false;
+        rendered = glyph;
+        ++Stats.Rasterized;
+        return true;
+    }
+
+    void markDirty(int minY, int maxY)
+    {
+        DirtyMinY = std::min(DirtyMinY, minY);
+        DirtyMaxY = std::max(DirtyMaxY, maxY);
+    }
+
+    // the best fitting shelf with room for w x h: an open one at most a third taller, a new
+    // one, or the least recently used one tall enough (merged from its neighbours if need be),
+    // emptied
+    int findShelf(int w, int h, uint32_t frame)
+    {
+        int best = -1;
+        for (size_t i = 0; i < shelves.size(); ++i)
+        {
+            const Shelf &shelf = shelves[i];
+            if (shelf.Height >= h && shelf.Height * 3 <= h * 4 && shelf.X + w <= width && (best < 0 || shelf.Height < shelves[best].Height))
+                best = (int)i;
+        }
+        if (best >= 0)
+            return best;
+
+        // new shelves are rounded up to 4 rows so glyphs of close sizes share them
+        const int shelfHeight = std::min((h + 3) & ~3, height);
+        if (nextShelfY + shelfHeight <= height && w <= width)
+        {
+            Shelf shelf;
+            shelf.Y = nextShelfY;
+            shelf.Height = shelfHeight;
+            nextShelfY += shelfHeight;
+            shelves.push_back(shelf);
+            return (int)shelves.size() - 1;
+        }
+
+        if (w > width)
+            return -1;
+        // the least recently used run of adjacent shelves, none used in this frame, together
+        // tall enough; a single shelf is a run of one, and the shortest run wins a tie
+        std::vector<int> order;
+        for (size_t i = 0; i < shelves.size(); ++i)
+            if (shelves[i].Height > 0)
+                order.push_back((int)i);
+        std::sort(order.begin(), order.end(), [this](int a, int b) { return shelves[a].Y < shelves[b].Y; });
+        size_t first = 0, count = 0;
+        uint32_t oldest = 0;
+        int oldestHeight = 0;
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            uint32_t lastUsed = 0;
+            int total = 0;
+            size_t j = i;
+            for (; j < order.size() && total < h && shelves[order[j]].LastUsed < frame; ++j)
+            {
+                lastUsed = std::max(lastUsed, shelves[order[j]].LastUsed);
+                total += shelves[order[j]].Height;
+            }
+            if (total >= h && (count == 0 || lastUsed < oldest || (lastUsed == oldest && total < oldestHeight)))
+            {
+                first = i;
+                count = j - i;
+                oldest = lastUsed;
+                oldestHeight = total;
+            }
+        }
+        if (count == 0)
+            return -1;
+
+        // the run is emptied into its first shelf, and what the glyph doesn't need of it is
+        // split off into a shelf of its own (in a slot a merge left empty, if there is one)
+        const int target = order[first];
+        for (size_t i = first; i < first + count; ++i)
+        {
+            Shelf &shelf = shelves[order[i]];
+            for (uint32_t glyph : shelf.Glyphs)
+                glyphs[glyph].Shelf = -1;
+            Stats.EvictedGlyphs += shelf.Glyphs.size();
+            ++Stats.EvictedShelves;
+            shelf.Glyphs.clear();
+            shelf.X = 0;
+            if (i > first)
+                shelf.Height = 0;
+        }
+        Shelf &shelf = shelves[target];
+        shelf.Height = oldestHeight;
+        std::fill(pixels.begin() + (size_t)shelf.Y * width, pixels.begin() + (size_t)(shelf.Y + shelf.Height) * width, 0);
+        markDirty(shelf.Y, shelf.Y + shelf.Height - 1);
+        if (shelf.Height - shelfHeight >= 4)
+        {
+            Shelf rest;
+            rest.Y = shelf.Y + shelfHeight;
+            rest.Height = shelf.Height - shelfHeight;
+            rest.LastUsed = shelf.LastUsed;
+            shelf.Height = shelfHeight;
+            auto empty = std::find_if(shelves.begin(), shelves.end(), [](const Shelf &s) { return s.Height == 0; });
+            if (empty != shelves.end())
+                *empty = rest;
+            else
+                shelves.push_back(rest);
+        }
+        return target;
+    }
+};
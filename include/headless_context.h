@@ -0,0 +1,190 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#ifdef HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include <iostream>
+#include <vector>
+
+// An OpenGL context without a visible window, rendering into its own framebuffer object.
+//
+// With EGL (HAVE_EGL, Linux/Mesa) the context is created on the surfaceless platform, so it
+// works on build machines with no X server and no GPU (Mesa falls back to llvmpipe). Without
+// EGL a hidden GLFW window provides the context instead. Either way all rendering goes to
+// FBO, sized width x height, and readPixels() fetches the colour attachment.
+class HeadlessContext
+{
+public:
+    unsigned int FBO = 0;
+    unsigned int Width, Height;
+
+    HeadlessContext(unsigned int width, unsigned int height) : Width(width), Height(height) {}
+
+    bool create()
+    {
+        if (!createContext())
+            return false;
+        std::cout << "headless context: " << glGetString(GL_RENDERER) << " | " << glGetString(GL_VERSION) << std::endl;
+
+        glGenFramebuffers(1, &FBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glGenRenderbuffers(2, renderbuffers);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, Width, Height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, Width, Height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cout << "ERROR::HEADLESS::FRAMEBUFFER_INCOMPLETE" << std::endl;
+            return false;
+        }
+        glViewport(0, 0, Width, Height);
+        return true;
+    }
+
+    // the loader the context was created with, for entry points glad doesn't load
+    GLADloadproc procAddress() const
+    {
+#ifdef HAVE_EGL
+        if (display != EGL_NO_DISPLAY)
+            return (GLADloadproc)eglGetProcAddress;
+#endif
+        return (GLADloadproc)glfwGetProcAddress;
+    }
+
+    // RGBA8 colour of the last frame, bottom row first (OpenGL convention)
+    std::vector<unsigned char> readPixels() const
+    {
+        std::vector<unsigned char> pixels((size_t)Width * Height * 4);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, Width, Height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        return pixels;
+    }
+
+    void destroy()
+    {
+        if (FBO)
+        {
+            glDeleteFramebuffers(1, &FBO);
+            glDeleteRenderbuffers(2, renderbuffers);
+            FBO = 0;
+        }
+#ifdef HAVE_EGL
+        if (display != EGL_NO_DISPLAY)
+        {
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            if (context != EGL_NO_CONTEXT)
+                eglDestroyContext(display, context);
+            if (surface != EGL_NO_SURFACE)
+                eglDestroySurface(display, surface);
+            eglTerminate(display);
+            display = EGL_NO_DISPLAY;
+        }
+#endif
+        if (window)
+        {
+            glfwDestroyWindow(window);
+            glfwTerminate();
+            window = nullptr;
+        }
+    }
+
+private:
+    unsigned int renderbuffers[2] = { 0, 0 };
+    GLFWwindow *window = nullptr;
+#ifdef HAVE_EGL
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+    EGLSurface surface = EGL_NO_SURFACE;
+#endif
+
+    bool createContext()
+    {
+#ifdef HAVE_EGL
+        if (createEGLContext())
+            return true;
+        std::cout << "EGL context creation failed, falling back to a hidden GLFW window" << std::endl;
+#endif
+        return createGLFWContext();
+    }
+
+#ifdef HAVE_EGL
+    bool createEGLContext()
+    {
+        // prefer the surfaceless platform: no display server needed at all
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay)
+            display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        if (display == EGL_NO_DISPLAY)
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        EGLint major, minor;
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+        {
+            display = EGL_NO_DISPLAY;
+            return false;
+        }
+        if (!eglBindAPI(EGL_OPENGL_API))
+            return false;
+
+        const EGLint configAttribs[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_NONE
+        };
+        EGLConfig config = NULL;
+        EGLint configCount = 0;
+        eglChooseConfig(display, configAttribs, &config, 1, &configCount);
+
+        const EGLint contextAttribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 3,
+            EGL_CONTEXT_MINOR_VERSION, 3,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        context = eglCreateContext(display, configCount > 0 ? config : EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttribs);
+        if (context == EGL_NO_CONTEXT)
+            return false;
+
+        // surfaceless if the driver allows it, otherwise a 1x1 pbuffer just to make current
+        if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+        {
+            const EGLint pbufferAttribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+            if (configCount > 0)
+                surface = eglCreatePbufferSurface(display, config, pbufferAttribs);
+            if (surface == EGL_NO_SURFACE || !eglMakeCurrent(display, surface, surface, context))
+                return false;
+        }
+        return gladLoadGLLoader((GLADloadproc)eglGetProcAddress) != 0;
+    }
+#endif
+
+    bool createGLFWContext()
+    {
+        if (!glfwInit())
+            return false;
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        window = glfwCreateWindow(Width, Height, "LearnOpenGL (headless)", NULL, NULL);
+        if (window == NULL)
+        {
+            glfwTerminate();
+            return false;
+        }
+        glfwMakeContextCurrent(window);
+        return gladLoadGLLoader((GLADloadproc)glfwGetProcAddress) != 0;
+    }
+};
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "normal_matrix.h"
+
+#include <cstddef>
+#include <vector>
+
+// Per-instance attributes read by the INSTANCED permutations of surface.vs:
+//
+//     layout (location = 3) in mat4 aModel;          // locations 3..6
+//     layout (location = 7) in vec4 aDiffuse;        // rgb + shininess in w
+//     layout (location = 8) in vec4 aSpecular;       // rgb, w unused
+//     layout (location = 11) in mat3 aNormalMatrix;  // locations 11..13, NormalMatrices::compute(Model)
+//
+// 9 and 10 are the mesh's vertex decode constants (see Mesh).
+struct InstanceData {
+    glm::mat4 Model;
+    glm::vec4 Diffuse;
+    glm::vec4 Specular;
+    NormalMatrix Normal;
+};
+static_assert(sizeof(InstanceData) == 144, "InstanceData is uploaded as-is into the instance VBO");
+
+// first attribute locations used by the instance stream; 0..2 are position/normal/uv
+const GLuint INSTANCE_ATTRIB_LOCATION = 3;
+const GLuint INSTANCE_NORMAL_ATTRIB_LOCATION = 11;
+
+// An instance VBO plus the draws that consume it. attach() adds the per-instance attributes
+// (divisor 1) to a mesh VAO, upload() streams this frame's instances, and a whole batch is
+// then drawn with a single glDraw*Instanced call.
+class InstanceBuffer
+{
+public:
+    unsigned int ID = 0;
+    size_t Capacity = 0;
+    size_t Count = 0;
+
+    explicit InstanceBuffer(size_t capacity = 1024)
+    {
+        glGenBuffers(1, &ID);
+        reserve(capacity);
+    }
+
+    // adds the instance attributes to vao (which must already have its vertex attributes)
+    void attach(unsigned int vao) const
+    {
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, ID);
+        // a mat4 attribute occupies four consecutive vec4 locations
+        for (GLuint column = 0; column < 4; ++column)
+        {
+            glEnableVertexAttribArray(INSTANCE_ATTRIB_LOCATION + column);
+            glVertexAttribPointer(INSTANCE_ATTRIB_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                                  (void*)(offsetof(InstanceData, Model) + column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(INSTANCE_ATTRIB_LOCATION + column, 1);
+        }
+        glEnableVertexAttribArray(INSTANCE_ATTRIB_LOCATION + 4);
+        glVertexAttribPointer(INSTANCE_ATTRIB_LOCATION + 4, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)offsetof(InstanceData, Diffuse));
+        glVertexAttribDivisor(INSTANCE_ATTRIB_LOCATION + 4, 1);
+        glEnableVertexAttribArray(INSTANCE_ATTRIB_LOCATION + 5);
+        glVertexAttribPointer(INSTANCE_ATTRIB_LOCATION + 5, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)offsetof(InstanceData, Specular));
+        glVertexAttribDivisor(INSTANCE_ATTRIB_LOCATION + 5, 1);
+        // the mat3's columns are vec4s in the buffer, of which the attributes read xyz
+        for (GLuint column = 0; column < 3; ++column)
+        {
+            glEnableVertexAttribArray(INSTANCE_NORMAL_ATTRIB_LOCATION + column);
+            glVertexAttribPointer(INSTANCE_NORMAL_ATTRIB_LOCATION + column, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                                  (void*)(offsetof(InstanceData, Normal) + column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(INSTANCE_NORMAL_ATTRIB_LOCATION + column, 1);
+        }
+        glBindVertexArray(0);
+    }
+
+    // replaces the buffer contents; the old storage is orphaned so in-flight draws don't stall
+    void upload(const InstanceData *instances, size_t count)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, ID);
+        if (count > Capacity)
+            reserve(count + count / 2);
+        else
+            glBufferData(GL_ARRAY_BUFFER, Capacity * sizeof(InstanceData), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(InstanceData), instances);
+        Count = count;
+    }
+
+    void upload(const std::vector<InstanceData> &instances)
+    {
+        upload(instances.data(), instances.size());
+    }
+
+    // one draw call for every uploaded instance of an indexed mesh
+    void drawElements(unsigned int vao, GLsizei indexCount) const
+    {
+        glBindVertexArray(vao);
+        glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, (void*)0, (GLsizei)Count);
+    }
+
+    // same for a non-indexed mesh
+    void drawArrays(unsigned int vao, GLsizei vertexCount) const
+    {
+        glBindVertexArray(vao);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, vertexCount, (GLsizei)Count);
+    }
+
+private:
+    void reserve(size_t capacity)
+    {
+        Capacity = capacity;
+        glBindBuffer(GL_ARRAY_BUFFER, ID);
+        glBufferData(GL_ARRAY_BUFFER, Capacity * sizeof(InstanceData), NULL, GL_STREAM_DRAW);
+    }
+};
@@ -0,0 +1,398 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "profiler.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define LIGHT_CLUSTERS_SSE 1
+#include <immintrin.h>
+#endif
+
+// A point light of the clustered shader; it adds nothing beyond Radius
+struct PointLight {
+    glm::vec3 Position;                 // world space
+    float Radius;
+    glm::vec3 Color;
+};
+
+// What one light assignment cost and produced
+struct ClusterStats {
+    size_t Lights = 0;
+    size_t Visible = 0;                 // lights reaching at least one depth slice (near to far)
+    size_t References = 0;              // light indices written, over all clusters
+    size_t Dropped = 0;                 // references over the index buffer's texel limit
+    unsigned int MaxPerCluster = 0;
+    double AssignMicroseconds = 0.0;    // CPU, from assign() to the index list being complete
+};
+
+// Clustered forward shading: the view frustum is cut into TILES_X x TILES_Y screen tiles and
+// SLICES depth slices (exponentially spaced, so clusters stay roughly cubic), every light is
+// listed in the clusters its sphere touches, and the fragment shader (clustered.fs) loops over
+// the lights of its own cluster only, whatever the total.
+//
+// Assignment runs on the CPU every frame as two rounds of jobs: lights are moved into view
+// space in chunks, then each depth slice tests the lights reaching it first against each row
+// of tiles and then each tile, four spheres against a cluster box at a time with SSE. Slices
+// write disjoint parts of the grid, so nothing is shared between jobs. The result goes to the
+// GPU through texture buffers, which GL 3.3 has and which need no size known to the shader:
+//
+//     clusterLights   RGBA32F, two texels per light: position + radius, colour
+//     clusterGrid     RG32UI per cluster: first index, count
+//     clusterIndices  R16UI light indices, cluster after cluster
+class LightClusters
+{
+public:
+    static const unsigned int TILES_X = 16;
+    static const unsigned int TILES_Y = 9;
+    static const unsigned int SLICES = 24;
+    static const unsigned int CLUSTER_COUNT = TILES_X * TILES_Y * SLICES;
+    static const size_t MAX_LIGHTS = 65535;   // indices are 16 bit
+    // texture units of the three buffers; unit 0 stays free for material textures
+    static const int LIGHT_UNIT = 1, GRID_UNIT = 2, INDEX_UNIT = 3;
+
+    std::vector<PointLight> Lights;
+    ClusterStats Frame;
+
+    // pool runs the assignment jobs; the calling thread joins in while waiting for them
+    LightClusters(ThreadPool &pool, float nearPlane, float farPlane) : pool(pool), nearPlane(nearPlane), farPlane(farPlane)
+    {
+        GLint maxTexels = 65536;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+        maxIndices = (size_t)maxTexels;
+        glGenBuffers(3, buffers);
+        glGenTextures(3, textures);
+        const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R16UI };
+        for (int i = 0; i < 3; ++i)
+        {
+            glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+            glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        grid.resize(2 * CLUSTER_COUNT);
+        slices.resize(SLICES);
+    }
+
+    LightClusters(const LightClusters&) = delete;
+    LightClusters& operator=(const LightClusters&) = delete;
+
+    // points the samplers of a program using clustered.fs at the buffers and tells it how the
+    // grid is laid out over a viewport of the given size
+    void attach(const Shader &shader, float viewportWidth, float viewportHeight) const
+    {
+        shader.use();
+        shader.setInt("clusterLights", LIGHT_UNIT);
+        shader.setInt("clusterGrid", GRID_UNIT);
+        shader.setInt("clusterIndices", INDEX_UNIT);
+        glUniform3i(shader.getUniformLocation("clusterCounts"), TILES_X, TILES_Y, SLICES);
+        shader.setVec2("clusterTileScale", TILES_X / viewportWidth, TILES_Y / viewportHeight);
+        // slice = log(depth) * scale + bias, the inverse of sliceDepth()
+        const float scale = SLICES / std::log(farPlane / nearPlane);
+        shader.setVec2("clusterSliceScaleBias", scale, -std::log(nearPlane) * scale);
+    }
+
+    // assigns Lights to the clusters of the frustum given by view and projection (perspective,
+    // with the near and far planes passed to the constructor). Lights are read once the jobs
+    // counted by dependency are done, if there is one, so whatever moves them can still be
+    // running. Returns with the cluster lists complete; upload() sends them to the GPU
+    void assign(const glm::mat4 &view, const glm::mat4 &projection, JobCounter *dependency = nullptr)
+    {
+        PROFILE_ZONE("assign lights");
+        const auto start = std::chrono::steady_clock::now();
+        const size_t count = std::min(Lights.size(), MAX_LIGHTS);
+        viewLights.resize(count);
+        tanHalfX = 1.0f / projection[0][0];
+        tanHalfY = 1.0f / projection[1][1];
+
+        // round one: view space and the range of slices each light reaches
+        JobCounter transformed, assigned;
+        for (size_t first = 0; first < count; first += LIGHT_CHUNK)
+        {
+            const size_t last = std::min(count, first + LIGHT_CHUNK);
+            auto job = [this, &view, first, last] { transform(view, first, last); };
+            if (dependency)
+                pool.after(*dependency, job, &transformed);
+            else
+                pool.submit(job, &transformed);
+        }
+        // round two: one job per slice once every light is in view space
+        for (unsigned int slice = 0; slice < SLICES; ++slice)
+            pool.after(transformed, [this, slice] { assignSlice(slice); }, &assigned);
+        pool.wait(assigned);
+
+        // the slices' lists back to back, grid offsets made absolute
+        Frame = ClusterStats();
+        Frame.Lights = Lights.size();
+        indices.clear();
+        for (unsigned int slice = 0; slice < SLICES; ++slice)
+        {
+            const uint32_t base = (uint32_t)indices.size();
+            const std::vector<uint16_t> &list = slices[slice].Indices;
+            const size_t kept = std::min(list.size(), maxIndices - std::min(maxIndices, indices.size()));
+            indices.insert(indices.end(), list.begin(), list.begin() + kept);
+            Frame.Dropped += list.size() - kept;
+            for (uint32_t cluster = slice * TILES_X * TILES_Y; cluster < (slice + 1) * TILES_X * TILES_Y; ++cluster)
+            {
+                uint32_t &offset = grid[2 * cluster], &clusterCount = grid[2 * cluster + 1];
+                offset += base;
+                clusterCount = std::min<uint32_t>(clusterCount, (uint32_t)std::max<int64_t>(0, (int64_t)indices.size() - offset));
+                Frame.MaxPerCluster = std::max(Frame.MaxPerCluster, clusterCount);
+            }
+        }
+        for (const ViewLight &light : viewLights)
+            Frame.Visible += light.FirstSlice <= light.LastSlice;
+        Frame.References = indices.size() + Frame.Dropped;
+        Frame.AssignMicroseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // GL thread: the lights, the grid and the index list of the last assign(), bound to their
+    // texture units for the draws that follow
+    void upload()
+    {
+        PROFILE_ZONE("upload clusters");
+        lightTexels.resize(2 * Lights.size());
+        for (size_t i = 0; i < Lights.size(); ++i)
+        {
+            lightTexels[2 * i] = glm::vec4(Lights[i].Position, Lights[i].Radius);
+            lightTexels[2 * i + 1] = glm::vec4(Lights[i].Color, 0.0f);
+        }
+        // orphaned every frame, like the instance buffers, so the previous frame's draws don't stall
+        fill(0, lightTexels.data(), lightTexels.size() * sizeof(glm::vec4));
+        fill(1, grid.data(), grid.size() * sizeof(uint32_t));
+        fill(2, indices.data(), indices.size() * sizeof(uint16_t));
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        const int units[3] = { LIGHT_UNIT, GRID_UNIT, INDEX_UNIT };
+        for (int i = 0; i < 3; ++i)
+        {
+            glActiveTexture(GL_TEXTURE0 + units[i]);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // averages once per second, like the stress scene; force prints the last frame right away
+    void Report(float deltaTime, bool force = false)
+    {
+        elapsed += deltaTime;
+        ++frames;
+        assignMicroseconds += Frame.AssignMicroseconds;
+        if (elapsed < 1.0f && !force)
+            return;
+        std::cout << "clustered lights: " << Frame.Lights << " lights (" << Frame.Visible << " between near and far), " << Frame.References
+                  << " cluster references, at most " << Frame.MaxPerCluster << " in a cluster, " << Frame.Dropped << " dropped; assignment "
+                  << assignMicroseconds / frames / 1000.0 << " ms on " << pool.size() << " threads";
+        if (!force)
+            std::cout << ", " << 1000.0f * elapsed / frames << " ms/frame (" << frames / elapsed << " fps)";
+        std::cout << std::endl;
+        elapsed = 0.0f;
+        assignMicroseconds = 0.0;
+        frames = 0;
+    }
+
+    void Release()
+    {
+        glDeleteTextures(3, textures);
+        glDeleteBuffers(3, buffers);
+    }
+
+private:
+    static const size_t LIGHT_CHUNK = 1024;
+
+    struct ViewLight {
+        float X, Y, Depth, Radius;      // view space, depth positive in front of the camera
+        uint8_t FirstSlice, LastSlice;  // First > Last when no slice is reached
+    };
+
+    // lights as structure-of-arrays, padded to a multiple of 4 with spheres nothing touches
+    struct LightSoA {
+        std::vector<float> X, Y, Depth, Radius;
+        std::vector<uint16_t> Index;
+
+        void clear()
+        {
+            X.clear();
+            Y.clear();
+            Depth.clear();
+            Radius.clear();
+            Index.clear();
+        }
+
+        void push(float x, float y, float depth, float radius, uint16_t index)
+        {
+            X.push_back(x);
+            Y.push_back(y);
+            Depth.push_back(depth);
+            Radius.push_back(radius);
+            Index.push_back(index);
+        }
+
+        // returns the real count
+        size_t pad()
+        {
+            const size_t count = Index.size();
+            while (Index.size() % 4)
+                push(1e30f, 1e30f, 1e30f, 0.0f, 0);
+            return count;
+        }
+    };
+
+    struct Box {
+        float MinX, MaxX, MinY, MaxY, MinDepth, MaxDepth;
+    };
+
+    // what one slice job works with; each job has its own
+    struct Slice {
+        LightSoA Candidates, Row;
+        std::vector<uint16_t> Indices;
+    };
+
+    ThreadPool &pool;
+    float nearPlane, farPlane;
+    float tanHalfX = 1.0f, tanHalfY = 1.0f;
+    size_t maxIndices;
+    unsigned int buffers[3], textures[3];
+    std::vector<ViewLight> viewLights;
+    std::vector<Slice> slices;
+    std::vector<uint32_t> grid;         // offset and count per cluster
+    std::vector<uint16_t> indices;
+    std::vector<glm::vec4> lightTexels;
+    float elapsed = 0.0f;
+    double assignMicroseconds = 0.0;
+    unsigned int frames = 0;
+
+    float sliceDepth(unsigned int slice) const
+    {
+        return nearPlane * std::pow(farPlane / nearPlane, (float)slice / SLICES);
+    }
+
+    int sliceOf(float depth) const
+    {
+        return (int)std::floor(std::log(depth / nearPlane) / std::log(farPlane / nearPlane) * SLICES);
+    }
+
+    void fill(int buffer, const void *data, size_t bytes)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers[buffer]);
+        glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(bytes, 16), NULL, GL_STREAM_DRAW);
+        if (bytes)
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+    }
+
+    void transform(const glm::mat4 &view, size_t first, size_t last)
+    {
+        for (size_t i = first; i < last; ++i)
+        {
+            const PointLight &light = Lights[i];
+            const glm::vec3 position = glm::vec3(view * glm::vec4(light.Position, 1.0f));
+            ViewLight &out = viewLights[i];
+            out.X = position.x;
+            out.Y = position.y;
+            out.Depth = -position.z;
+            out.Radius = light.Radius;
+            out.FirstSlice = 1;
+            out.LastSlice = 0;
+            const float nearest = out.Depth - out.Radius, furthest = out.Depth + out.Radius;
+            if (furthest < nearPlane || nearest > farPlane)
+                continue;
+            out.FirstSlice = (uint8_t)std::max(0, sliceOf(std::max(nearest, nearPlane)));
+            out.LastSlice = (uint8_t)std::min((int)SLICES - 1, sliceOf(std::min(furthest, farPlane)));
+        }
+    }
+
+    // the view-space box around the part of the frustum between two depths and two tile
+    // columns/rows; tile edges are slopes, so the box spans them at both depths
+    Box clusterBox(unsigned int x0, unsigned int x1, unsigned int y0, unsigned int y1, float nearDepth, float farDepth) const
+    {
+        const float left = (2.0f * x0 / TILES_X - 1.0f) * tanHalfX, right = (2.0f * x1 / TILES_X - 1.0f) * tanHalfX;
+        const float bottom = (2.0f * y0 / TILES_Y - 1.0f) * tanHalfY, top = (2.0f * y1 / TILES_Y - 1.0f) * tanHalfY;
+        return { std::min(left * nearDepth, left * farDepth), std::max(right * nearDepth, right * farDepth),
+                 std::min(bottom * nearDepth, bottom * farDepth), std::max(top * nearDepth, top * farDepth), nearDepth, farDepth };
+    }
+
+    // calls emit(i) for every light i of in whose sphere touches box
+    template <typename Emit>
+    static void overlapping(const LightSoA &in, size_t count, const Box &box, Emit emit)
+    {
+#ifdef LIGHT_CLUSTERS_SSE
+        const __m128 minX = _mm_set1_ps(box.MinX), maxX = _mm_set1_ps(box.MaxX);
+        const __m128 minY = _mm_set1_ps(box.MinY), maxY = _mm_set1_ps(box.MaxY);
+        const __m128 minZ = _mm_set1_ps(box.MinDepth), maxZ = _mm_set1_ps(box.MaxDepth);
+        const __m128 zero = _mm_setzero_ps();
+        for (size_t i = 0; i < count; i += 4)
+        {
+            const __m128 x = _mm_loadu_ps(&in.X[i]), y = _mm_loadu_ps(&in.Y[i]), z = _mm_loadu_ps(&in.Depth[i]);
+            const __m128 r = _mm_loadu_ps(&in.Radius[i]);
+            // distance from the centre to the box along each axis, 0 inside
+            const __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minX, x), _mm_sub_ps(x, maxX)), zero);
+            const __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minY, y), _mm_sub_ps(y, maxY)), zero);
+            const __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minZ, z), _mm_sub_ps(z, maxZ)), zero);
+            const __m128 distance2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+            const int mask = _mm_movemask_ps(_mm_cmple_ps(distance2, _mm_mul_ps(r, r)));
+            if (!mask)
+                continue;
+            for (size_t lane = 0; lane < 4; ++lane)
+                if ((mask >> lane) & 1 && i + lane < count)
+                    emit(i + lane);
+        }
+#else
+        for (size_t i = 0; i < count; ++i)
+        {
+            const float dx = std::max(std::max(box.MinX - in.X[i], in.X[i] - box.MaxX), 0.0f);
+            const float dy = std::max(std::max(box.MinY - in.Y[i], in.Y[i] - box.MaxY), 0.0f);
+            const float dz = std::max(std::max(box.MinDepth - in.Depth[i], in.Depth[i] - box.MaxDepth), 0.0f);
+            if (dx * dx + dy * dy + dz * dz <= in.Radius[i] * in.Radius[i])
+                emit(i);
+        }
+#endif
+    }
+
+    void assignSlice(unsigned int slice)
+    {
+        PROFILE_ZONE("assign slice");
+        Slice &work = slices[slice];
+        work.Candidates.clear();
+        work.Indices.clear();
+        for (size_t i = 0; i < viewLights.size(); ++i)
+        {
+            const ViewLight &light = viewLights[i];
+            if (light.FirstSlice <= slice && slice <= light.LastSlice)
+                work.Candidates.push(light.X, light.Y, light.Depth, light.Radius, (uint16_t)i);
+        }
+        const size_t candidates = work.Candidates.pad();
+        const float nearDepth = sliceDepth(slice), farDepth = sliceDepth(slice + 1);
+        for (unsigned int y = 0; y < TILES_Y; ++y)
+        {
+            // a whole row first, so each tile only tests the lights that reach its row
+            const LightSoA &from = work.Candidates;
+            LightSoA &row = work.Row;
+            row.clear();
+            overlapping(from, candidates, clusterBox(0, TILES_X, y, y + 1, nearDepth, farDepth), [&](size_t i) {
+                row.push(from.X[i], from.Y[i], from.Depth[i], from.Radius[i], from.Index[i]);
+            });
+            const size_t inRow = row.pad();
+            for (unsigned int x = 0; x < TILES_X; ++x)
+            {
+                const uint32_t cluster = (slice * TILES_Y + y) * TILES_X + x;
+                // relative to the slice's list until assign() puts the slices together
+                grid[2 * cluster] = (uint32_t)work.Indices.size();
+                overlapping(row, inRow, clusterBox(x, x + 1, y, y + 1, nearDepth, farDepth), [&](size_t i) {
+                    work.Indices.push_back(row.Index[i]);
+                });
+                grid[2 * cluster + 1] = (uint32_t)work.Indices.size() - grid[2 * cluster];
+            }
+        }
+    }
+};
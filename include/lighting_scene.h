@@ -0,0 +1,209 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "camera.h"
+#include "lod_selector.h"
+#include "mesh.h"
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
+#include "profiler.h"
+#include "render_queue.h"
+#include "shader_variants.h"
+#include "simulation.h"
+#include "uniform_buffer.h"
+
+#include <vector>
+
+// The scene every run draws: the coral cube, the sphere next to it and the lamp, lit by one
+// point light through the LIT surface permutation (the lamp through the unlit one). Draw() is
+// all of a frame's scene work on the GL thread: the clear, the Camera block, the light
+// colours, recording the three draws (and whatever the optional scenes add to the bucket) and
+// the render queue's sorted submit. main() calls it every frame, and bench/gl_call_count calls
+// the same function against a counting stub driver.
+class LightingScene
+{
+public:
+    // where the lamp is; the light doesn't move, only its colour does
+    static inline const glm::vec3 LIGHT_POSITION = glm::vec3(1.2f, 1.0f, 2.0f);
+
+    Mesh Cube;
+    Mesh Sphere;
+    unsigned int LightCubeVAO = 0;      // the cube's buffers again, for the lamp
+    // picks the sphere's level; the stress scene and the nanosuit use it too
+    LodSelector Lods;
+
+    // every mesh in the smallest vertex formats within quantize (null: floats)
+    LightingScene(ShaderVariants &surfaces, RenderQueue &queue, const UniformBuffer<CameraBlock> &cameraUBO, const VertexTolerance *quantize,
+                  float viewportWidth, float viewportHeight, float nearPlane, float farPlane)
+        : Cube(cubeData().view(), quantize), Sphere(CachedMesh("../models/sphere2.obj", true).View, quantize), surfaces(surfaces),
+          queue(queue), cameraUBO(cameraUBO), viewportWidth(viewportWidth), viewportHeight(viewportHeight), nearPlane(nearPlane), farPlane(farPlane)
+    {
+        LightCubeVAO = Cube.createVertexArray();
+        lightingProgram = queue.addProgram(surfaces.get(SHADER_LIT));
+        lightCubeProgram = queue.addProgram(surfaces.get(0));
+    }
+
+    LightingScene(const LightingScene&) = delete;
+    LightingScene& operator=(const LightingScene&) = delete;
+
+    // what every surface permutation needs set once, as it is created and again whenever the
+    // shader watcher swaps in a recompiled program; model and normal matrices and materials
+    // are the render queue's business
+    static ShaderVariants::Setup surfaceSetup(const UniformBuffer<CameraBlock> &cameraUBO)
+    {
+        return [&cameraUBO](Shader &shader) {
+            cameraUBO.attach(shader, "Camera");
+            shader.use();
+            if (shader.Features & SHADER_LIT)
+            {
+                shader.setVec3("light.position", LIGHT_POSITION);
+                shader.setVec3("light.specular", 1.0f, 1.0f, 1.0f);
+            }
+            if (shader.Features & SHADER_TEXTURED)
+                shader.setInt("texture_diffuse1", 0);
+        };
+    }
+
+    // distance of model's origin from the camera as a fraction of the far plane, for sort keys
+    float viewDepth(const Camera &camera, const glm::mat4 &model) const
+    {
+        return glm::length(glm::vec3(model[3]) - camera.Position) / farPlane;
+    }
+
+    // one frame of the scene as seen by camera, with the light and the transforms of snapshot
+    // at alpha; recordMore(bucket, cameraBlock) records the optional scenes among the cube,
+    // the sphere and the lamp. Returns the Camera block it uploaded
+    template <typename RecordMore>
+    CameraBlock Draw(Camera &camera, const FrameSnapshot &snapshot, float alpha, const RecordMore &recordMore)
+    {
+        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        // view/projection transformations, uploaded once for every program
+        CameraBlock cameraBlock;
+        cameraBlock.projection = glm::perspective(glm::radians(camera.Zoom), viewportWidth / viewportHeight, nearPlane, farPlane);
+        cameraBlock.view = camera.GetViewMatrix();
+        cameraBlock.viewPos = glm::vec4(camera.Position, 1.0f);
+        cameraUBO.update(cameraBlock);
+        Lods.ProjectionScale = camera.GetProjectionScale(cameraBlock.projection, viewportHeight);
+
+        // light properties, for every lit permutation (be sure to activate each before setting them)
+        glm::vec3 lightColor = snapshot.lightColor(alpha);
+        glm::vec3 diffuseColor = lightColor   * glm::vec3(0.5f); // decrease the influence
+        glm::vec3 ambientColor = diffuseColor * glm::vec3(0.2f); // low influence
+        surfaces.forEach([&](Shader &shader) {
+            if (!(shader.Features & SHADER_LIT))
+                return;
+            shader.use();
+            shader.setVec3("light.ambient", ambientColor);
+            shader.setVec3("light.diffuse", diffuseColor);
+        });
+
+        // record the cube, the sphere next to it, the optional scenes and the lamp object in
+        // any order; the queue sorts them and binds only what changes. World transformations
+        // come from the snapshot, which outlives the queue's submit
+        {
+            PROFILE_ZONE("record");
+            RenderBucket &bucket = queue.bucket(0);
+            const glm::mat4 &cubeModel = snapshot.CubeModel;
+            const glm::mat4 &sphereModel = snapshot.SphereModel;
+            const glm::mat4 &lampModel = snapshot.LampModel;
+            bucket.draw({ RenderQueue::makeKey(RenderQueue::OPAQUE_PASS, lightingProgram, 0, Cube.VAO, viewDepth(camera, cubeModel)), &cubeModel, &coral,
+                          lightingProgram, Cube.VAO, 0, Cube.IndexCount, 0, 0 });
+            const MeshLod sphereRange = Sphere.lod(Lods.select(Sphere.Lods.data(), Sphere.Lods.size(), 0.5f,
+                                                               viewDepth(camera, sphereModel) * farPlane, sphereLod));
+            bucket.draw({ RenderQueue::makeKey(RenderQueue::OPAQUE_PASS, lightingProgram, 0, Sphere.VAO, viewDepth(camera, sphereModel)), &sphereModel, &coral,
+                          lightingProgram, Sphere.VAO, 0, sphereRange.IndexCount, sphereRange.IndexOffset, 0 });
+            recordMore(bucket, cameraBlock);
+            bucket.draw({ RenderQueue::makeKey(RenderQueue::OPAQUE_PASS, lightCubeProgram, 0, LightCubeVAO, viewDepth(camera, lampModel)), &lampModel, nullptr,
+                          lightCubeProgram, LightCubeVAO, 0, Cube.IndexCount, 0, 0 });
+        }
+        {
+            PROFILE_GPU_ZONE("gpu scene");
+            queue.submit();
+        }
+        return cameraBlock;
+    }
+
+    void Release()
+    {
+        glDeleteVertexArrays(1, &LightCubeVAO);
+        Cube.Release();
+        Sphere.Release();
+    }
+
+private:
+    ShaderVariants &surfaces;
+    RenderQueue &queue;
+    const UniformBuffer<CameraBlock> &cameraUBO;
+    float viewportWidth, viewportHeight, nearPlane, farPlane;
+    uint32_t lightingProgram = 0, lightCubeProgram = 0;
+    uint8_t sphereLod = 0;
+    // specular lighting doesn't have full effect on this object's material
+    const RenderMaterial coral = { glm::vec3(1.0f, 0.5f, 0.31f), glm::vec3(1.0f, 0.5f, 0.31f), glm::vec3(0.5f, 0.5f, 0.5f), 32.0f };
+
+    // the 36 corners of a unit cube welded into unique vertices + an index buffer, then ordered
+    // for the post-transform cache and for fetch locality; no texture coordinates
+    static MeshData cubeData()
+    {
+        static const float vertices[] = {
+            -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+             0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+             0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+             0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+            -0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+            -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+
+            -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
+             0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
+             0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
+             0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
+            -0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
+            -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
+
+            -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
+            -0.5f,  0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
+            -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
+            -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
+            -0.5f, -0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
+            -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
+
+             0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
+             0.5f,  0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
+             0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
+             0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
+             0.5f, -0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
+             0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
+
+            -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
+             0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
+             0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
+             0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
+            -0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
+            -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
+
+            -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,
+             0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,
+             0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
+             0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
+            -0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
+            -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f
+        };
+        struct CubeVertex { glm::vec3 Position; glm::vec3 Normal; };
+        const size_t cubeStride = sizeof(CubeVertex) / sizeof(float);
+        std::vector<CubeVertex> cubeVertices;
+        std::vector<uint32_t> cubeIndices;
+        MeshOptimizer::weldVertices(reinterpret_cast<const CubeVertex*>(vertices), sizeof(vertices) / sizeof(float) / cubeStride, cubeVertices, cubeIndices);
+        MeshOptimizer::optimizeVertexCache(cubeIndices.data(), cubeIndices.size(), cubeVertices.size());
+        MeshOptimizer::optimizeVertexFetch(cubeVertices, cubeIndices);
+
+        MeshData data;
+        for (const CubeVertex &vertex : cubeVertices)
+            data.Vertices.push_back({ vertex.Position, vertex.Normal, glm::vec2(0.0f) });
+        data.Indices = cubeIndices;
+        return data;
+    }
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "mesh_data.h"
+
+#include <algorithm>
+#include <cstdint>
+
+// Screen-space error LOD selection. A level's MeshLod::Error, scaled into world units and
+// projected at the object's distance, is how many pixels the simplified surface may be off;
+// the coarsest level under Threshold pixels is drawn. Levels only get coarser once the error
+// is under Threshold * (1 - Hysteresis), so an object sitting at a switching distance doesn't
+// pop back and forth from frame to frame. Each object keeps its current level in a byte the
+// caller owns.
+struct LodSelector
+{
+    bool Enabled = true;
+    float Threshold = 1.0f;             // pixels
+    float Hysteresis = 0.25f;
+    float ProjectionScale = 1.0f;       // Camera::GetProjectionScale() of this frame
+
+    // scale turns model units into world units, distance is from the camera in world units
+    uint32_t select(const MeshLod *lods, size_t count, float scale, float distance, uint8_t &current) const
+    {
+        if (!Enabled || count < 2)
+            return current = 0;
+        const float pixelsPerUnit = scale * ProjectionScale / std::max(distance, 1e-3f);
+        const size_t last = std::min<size_t>(count, 256) - 1;
+        size_t level = std::min<size_t>(current, last);
+        // too coarse: step back to the coarsest level that is good enough
+        while (level > 0 && lods[level].Error * pixelsPerUnit > Threshold)
+            --level;
+        if (level == current)
+        {
+            // fine enough to coarsen: only with some margin
+            while (level < last && lods[level + 1].Error * pixelsPerUnit <= Threshold * (1.0f - Hysteresis))
+                ++level;
+        }
+        current = (uint8_t)level;
+        return (uint32_t)level;
+    }
+};
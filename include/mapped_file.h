@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only memory mapping of a whole file. The pages are only faulted in when touched, so
+// passing data() to glBufferData reads the file exactly once, with no staging copy.
+class MappedFile
+{
+public:
+    MappedFile() {}
+    explicit MappedFile(const std::string &path) { open(path); }
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile &&other) noexcept { *this = std::move(other); }
+    MappedFile& operator=(MappedFile &&other) noexcept
+    {
+        if (this != &other)
+        {
+            close();
+            ptr = other.ptr;
+            length = other.length;
+#ifdef _WIN32
+            fileHandle = other.fileHandle;
+            mappingHandle = other.mappingHandle;
+            other.fileHandle = INVALID_HANDLE_VALUE;
+            other.mappingHandle = NULL;
+#endif
+            other.ptr = nullptr;
+            other.length = 0;
+        }
+        return *this;
+    }
+
+    bool open(const std::string &path)
+    {
+        close();
+#ifdef _WIN32
+        fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (fileHandle == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(fileHandle, &size) || size.QuadPart == 0)
+        {
+            close();
+            return false;
+        }
+        mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mappingHandle == NULL)
+        {
+            close();
+            return false;
+        }
+        ptr = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+        length = (size_t)size.QuadPart;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        void *mapped = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // the mapping keeps the file alive
+        if (mapped == MAP_FAILED)
+            return false;
+        ptr = mapped;
+        length = (size_t)st.st_size;
+#endif
+        if (ptr == nullptr)
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if (ptr)
+            UnmapViewOfFile(ptr);
+        if (mappingHandle != NULL)
+            CloseHandle(mappingHandle);
+        if (fileHandle != INVALID_HANDLE_VALUE)
+            CloseHandle(fileHandle);
+        mappingHandle = NULL;
+        fileHandle = INVALID_HANDLE_VALUE;
+#else
+        if (ptr)
+            munmap(ptr, length);
+#endif
+        ptr = nullptr;
+        length = 0;
+    }
+
+    bool isOpen() const { return ptr != nullptr; }
+    const unsigned char* data() const { return static_cast<const unsigned char*>(ptr); }
+    size_t size() const { return length; }
+
+private:
+    void *ptr = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    HANDLE fileHandle = INVALID_HANDLE_VALUE;
+    HANDLE mappingHandle = NULL;
+#endif
+};
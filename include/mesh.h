@@ -0,0 +1,175 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "mesh_data.h"
+#include "vertex_quantizer.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Vertex bytes of every Mesh created so far, as uploaded and as float Vertex streams
+struct VertexMemory {
+    size_t Uploaded = 0;
+    size_t Float = 0;
+};
+
+// GPU copy of an indexed mesh. Without a tolerance the vertex and index streams are passed to
+// glBufferData directly from the MeshView, which for a cached mesh is the memory-mapped file
+// itself; with one the vertices are first packed by the VertexQuantizer, and the VAO reads them
+// in whatever format it picked (see Format). IndexCount is the full detail mesh; further levels
+// of detail, if any, follow it in EBO.
+class Mesh
+{
+public:
+    unsigned int VAO = 0, VBO = 0, EBO = 0;
+    std::vector<SubMeshRange> SubMeshes;
+    std::vector<MeshLod> Lods;
+    std::vector<Meshlet> Meshlets;      // empty unless the mesh was built with them
+    unsigned int IndexCount = 0;
+    unsigned int VertexCount = 0;
+    VertexFormat Format;
+    QuantizationError Error;            // zero without a tolerance
+
+    explicit Mesh(const MeshView &view, const VertexTolerance *tolerance = nullptr)
+    {
+        SubMeshes.assign(view.SubMeshes, view.SubMeshes + view.SubMeshCount);
+        Lods.assign(view.Lods, view.Lods + view.LodCount);
+        Meshlets.assign(view.Meshlets, view.Meshlets + view.MeshletCount);
+        IndexCount = Lods.empty() ? view.IndexCount : Lods[0].IndexCount;
+        VertexCount = view.VertexCount;
+
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        if (tolerance)
+        {
+            const QuantizedVertices quantized = VertexQuantizer::quantize(view.Vertices, view.VertexCount, *tolerance);
+            Format = quantized.Format;
+            Error = quantized.Error;
+            glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)quantized.Data.size(), quantized.Data.data(), GL_STATIC_DRAW);
+        }
+        else
+            glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)view.VertexCount * sizeof(Vertex), view.Vertices, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)view.IndexCount * sizeof(uint32_t), view.Indices, GL_STATIC_DRAW);
+        if (Format.needsDecode())
+        {
+            glm::vec4 decode[2];
+            VertexQuantizer::decodeAttributes(Format, decode);
+            glGenBuffers(1, &decodeBuffer);
+            glBindBuffer(GL_ARRAY_BUFFER, decodeBuffer);
+            glBufferData(GL_ARRAY_BUFFER, sizeof(decode), decode, GL_STATIC_DRAW);
+        }
+        VAO = createVertexArray();
+
+        totals().Uploaded += vertexBytes();
+        totals().Float += (size_t)VertexCount * sizeof(Vertex);
+    }
+
+    // every Mesh created so far
+    static VertexMemory& totals()
+    {
+        static VertexMemory memory;
+        return memory;
+    }
+
+    size_t vertexBytes() const
+    {
+        return (size_t)VertexCount * Format.Stride;
+    }
+
+    // the vertex format, its size and how far it is from the float vertices
+    void Report(const std::string &name) const
+    {
+        std::cout << "vertices: " << name << ": " << VertexCount << " vertices, " << sizeof(Vertex) << " -> " << Format.Stride << " bytes/vertex ("
+                  << Format.describe() << "), max error " << Error.Position << " position, " << Error.NormalDegrees << " deg normal, "
+                  << Error.TexCoord << " uv" << std::endl;
+    }
+
+    // another VAO over the same buffers, for callers that add per-instance attributes of their
+    // own; the caller deletes it
+    unsigned int createVertexArray() const
+    {
+        unsigned int vao;
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+        // vertex positions, normalized to 0..1 when quantized
+        const GLsizei stride = (GLsizei)Format.Stride;
+        glEnableVertexAttribArray(0);
+        if (Format.Position == POSITION_UNORM16)
+            glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)(size_t)Format.PositionOffset);
+        else
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)(size_t)Format.PositionOffset);
+        // vertex normals, or their octahedral coordinates normalized to 0..1
+        glEnableVertexAttribArray(1);
+        if (Format.Normal == NORMAL_OCT16)
+            glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)(size_t)Format.NormalOffset);
+        else if (Format.Normal == NORMAL_OCT8)
+            glVertexAttribPointer(1, 2, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)(size_t)Format.NormalOffset);
+        else
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(size_t)Format.NormalOffset);
+        // vertex texture coords; left disabled (reading 0, 0) when there are none
+        if (Format.TexCoords != TEXCOORD_NONE)
+        {
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 2, Format.TexCoords == TEXCOORD_HALF ? GL_HALF_FLOAT : GL_FLOAT, GL_FALSE, stride, (void*)(size_t)Format.TexCoordOffset);
+        }
+        // the decode attributes: one element, read by every vertex of every instance
+        if (decodeBuffer)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, decodeBuffer);
+            for (GLuint i = 0; i < 2; ++i)
+            {
+                glEnableVertexAttribArray(VertexQuantizer::DECODE_ATTRIB_LOCATION + i);
+                glVertexAttribPointer(VertexQuantizer::DECODE_ATTRIB_LOCATION + i, 4, GL_FLOAT, GL_FALSE, 0, (void*)(i * sizeof(glm::vec4)));
+                glVertexAttribDivisor(VertexQuantizer::DECODE_ATTRIB_LOCATION + i, DECODE_DIVISOR);
+            }
+        }
+
+        glBindVertexArray(0);
+        return vao;
+    }
+
+    // index range of a level of detail; level 0 without a LOD chain is the whole mesh
+    MeshLod lod(size_t level) const
+    {
+        return Lods.empty() ? MeshLod{ 0, IndexCount, 0.0f, 0 } : Lods[std::min(level, Lods.size() - 1)];
+    }
+
+    // draws the whole mesh in one call; the caller binds the program and sets uniforms
+    void Draw() const
+    {
+        glBindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, (GLsizei)IndexCount, GL_UNSIGNED_INT, (void*)0);
+    }
+
+    // draws a single material range, for callers that switch material per submesh
+    void DrawSubMesh(size_t index) const
+    {
+        const SubMeshRange &range = SubMeshes[index];
+        glBindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, (GLsizei)range.IndexCount, GL_UNSIGNED_INT, (void*)(range.IndexOffset * sizeof(uint32_t)));
+    }
+
+    void Release()
+    {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        if (decodeBuffer)
+            glDeleteBuffers(1, &decodeBuffer);
+    }
+
+private:
+    // no draw has this many instances, so every instance reads element 0
+    static const GLuint DECODE_DIVISOR = 0x7fffffff;
+
+    unsigned int decodeBuffer = 0;
+};
@@ -0,0 +1,227 @@
+#pragma once
+
+#include "mesh_data.h"
+#include "mapped_file.h"
+#include "obj_loader.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "meshlet_builder.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <system_error>
+
+// On-disk layout of a ".meshcache" file, written next to the source OBJ:
+//
+//     MeshCacheHeader | Vertex[VertexCount] | uint32_t[IndexCount] | SubMeshRange[SubMeshCount]
+//                     | MeshLod[LodCount] | Meshlet[MeshletCount]
+//
+// Every section starts on a 16 byte boundary. The cache is valid while the source's size and
+// mtime match the header; if only the mtime moved (touch, checkout) the source is hashed and
+// compared against SourceHash before falling back to a re-parse.
+struct MeshCacheHeader {
+    char Magic[4];
+    uint32_t Version;
+    uint64_t SourceMtime;
+    uint64_t SourceSize;
+    uint64_t SourceHash;
+    uint32_t VertexStride;
+    uint32_t VertexCount;
+    uint32_t IndexCount;
+    uint32_t SubMeshCount;
+    uint64_t VertexOffset;
+    uint64_t IndexOffset;
+    uint64_t SubMeshOffset;
+    uint32_t LodCount;
+    uint32_t MeshletCount;
+    uint64_t LodOffset;
+    uint64_t MeshletOffset;
+};
+
+const char MESH_CACHE_MAGIC[4] = { 'M', 'S', 'H', 'C' };
+const uint32_t MESH_CACHE_VERSION = 5;
+
+// Loads an OBJ through its binary cache. On a hit, View points straight into the mapped file;
+// on a miss the text is parsed and run through MeshOptimizer, the cache is (re)written and
+// View points at the parsed data. With lods the mesh also gets a MeshSimplifier LOD chain,
+// which is stored in the cache like the rest: a cache written without one counts as a miss.
+// The same goes for meshlets, which MeshletBuilder makes last, reordering level 0's indices.
+class CachedMesh
+{
+public:
+    MeshView View;
+    bool FromCache = false;
+
+    explicit CachedMesh(const std::string &objPath, bool lods = false, bool meshlets = false)
+        : CachedMesh(objPath, cachePath(objPath), lods, meshlets)
+    {
+    }
+
+    // same, with the cache somewhere other than next to the OBJ (benchmarks, scratch copies)
+    CachedMesh(const std::string &objPath, const std::string &cacheFile, bool lods, bool meshlets)
+    {
+        if (openCache(objPath, cacheFile, lods, meshlets))
+        {
+            FromCache = true;
+            return;
+        }
+        if (!ObjLoader::load(objPath, data))
+            return;
+        MeshOptimizer::optimize(data);
+        if (lods)
+            MeshSimplifier::buildLods(data);
+        if (meshlets)
+            MeshletBuilder::build(data);
+        View = data.view();
+        if (!writeCache(objPath, cacheFile, data))
+            std::cout << "WARNING::MESH_CACHE::COULD_NOT_WRITE: " << cacheFile << std::endl;
+    }
+
+    CachedMesh(const CachedMesh&) = delete;
+    CachedMesh& operator=(const CachedMesh&) = delete;
+
+    static std::string cachePath(const std::string &objPath)
+    {
+        return objPath + ".meshcache";
+    }
+
+    // FNV-1a, 64 bit: plenty to tell an edited OBJ from an untouched one
+    static uint64_t hashBytes(const unsigned char *bytes, size_t size)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    static bool writeCache(const std::string &objPath, const std::string &cacheFile, const MeshData &mesh)
+    {
+        MappedFile source(objPath);
+        if (!source.isOpen())
+            return false;
+
+        MeshCacheHeader header = {};
+        std::memcpy(header.Magic, MESH_CACHE_MAGIC, sizeof(header.Magic));
+        header.Version = MESH_CACHE_VERSION;
+        header.SourceMtime = sourceMtime(objPath);
+        header.SourceSize = source.size();
+        header.SourceHash = hashBytes(source.data(), source.size());
+        header.VertexStride = sizeof(Vertex);
+        header.VertexCount = (uint32_t)mesh.Vertices.size();
+        header.IndexCount = (uint32_t)mesh.Indices.size();
+        header.SubMeshCount = (uint32_t)mesh.SubMeshes.size();
+        header.VertexOffset = align(sizeof(MeshCacheHeader));
+        header.IndexOffset = align(header.VertexOffset + (uint64_t)header.VertexCount * sizeof(Vertex));
+        header.SubMeshOffset = align(header.IndexOffset + (uint64_t)header.IndexCount * sizeof(uint32_t));
+        header.LodCount = (uint32_t)mesh.Lods.size();
+        header.LodOffset = align(header.SubMeshOffset + (uint64_t)header.SubMeshCount * sizeof(SubMeshRange));
+        header.MeshletCount = (uint32_t)mesh.Meshlets.size();
+        header.MeshletOffset = align(header.LodOffset + (uint64_t)header.LodCount * sizeof(MeshLod));
+
+        // write to a temporary and rename, so a crash never leaves a half-written cache behind
+        const std::string tmpFile = cacheFile + ".tmp";
+        {
+            std::ofstream out(tmpFile, std::ios::binary | std::ios::trunc);
+            if (!out)
+                return false;
+            writeAt(out, 0, &header, sizeof(header));
+            writeAt(out, header.VertexOffset, mesh.Vertices.data(), mesh.Vertices.size() * sizeof(Vertex));
+            writeAt(out, header.IndexOffset, mesh.Indices.data(), mesh.Indices.size() * sizeof(uint32_t));
+            writeAt(out, header.SubMeshOffset, mesh.SubMeshes.data(), mesh.SubMeshes.size() * sizeof(SubMeshRange));
+            writeAt(out, header.LodOffset, mesh.Lods.data(), mesh.Lods.size() * sizeof(MeshLod));
+            writeAt(out, header.MeshletOffset, mesh.Meshlets.data(), mesh.Meshlets.size() * sizeof(Meshlet));
+            if (!out)
+                return false;
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmpFile, cacheFile, ec);
+        if (ec)
+        {
+            // some platforms refuse to rename over an existing file
+            std::filesystem::remove(cacheFile, ec);
+            std::filesystem::rename(tmpFile, cacheFile, ec);
+        }
+        return !ec;
+    }
+
+private:
+    MappedFile mapping;
+    MeshData data;
+
+    static uint64_t align(uint64_t offset)
+    {
+        return (offset + 15) & ~uint64_t(15);
+    }
+
+    static uint64_t sourceMtime(const std::string &path)
+    {
+        std::error_code ec;
+        auto time = std::filesystem::last_write_time(path, ec);
+        return ec ? 0 : (uint64_t)time.time_since_epoch().count();
+    }
+
+    static void writeAt(std::ofstream &out, uint64_t offset, const void *bytes, size_t size)
+    {
+        out.seekp((std::streamoff)offset);
+        if (size)
+            out.write(static_cast<const char*>(bytes), (std::streamsize)size);
+    }
+
+    // validates the header (refreshing a stale mtime when the content hash still matches),
+    // then maps the file and points View into it
+    bool openCache(const std::string &objPath, const std::string &cacheFile, bool lods, bool meshlets)
+    {
+        MeshCacheHeader header;
+        {
+            std::ifstream in(cacheFile, std::ios::binary);
+            if (!in || !in.read(reinterpret_cast<char*>(&header), sizeof(header)))
+                return false;
+        }
+        if (std::memcmp(header.Magic, MESH_CACHE_MAGIC, sizeof(header.Magic)) != 0 ||
+            header.Version != MESH_CACHE_VERSION || header.VertexStride != sizeof(Vertex) || (lods && header.LodCount == 0) ||
+            (meshlets && header.MeshletCount == 0))
+            return false;
+
+        std::error_code ec;
+        const uint64_t size = std::filesystem::file_size(objPath, ec);
+        if (ec || size != header.SourceSize)
+            return false;
+        const uint64_t mtime = sourceMtime(objPath);
+        if (mtime != header.SourceMtime)
+        {
+            MappedFile source(objPath);
+            if (!source.isOpen() || hashBytes(source.data(), source.size()) != header.SourceHash)
+                return false;
+            header.SourceMtime = mtime;
+            std::fstream patch(cacheFile, std::ios::binary | std::ios::in | std::ios::out);
+            patch.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        }
+
+        if (!mapping.open(cacheFile))
+            return false;
+        const uint64_t end = header.MeshletOffset + (uint64_t)header.MeshletCount * sizeof(Meshlet);
+        if (mapping.size() < end)
+        {
+            mapping.close();
+            return false;
+        }
+        const unsigned char *base = mapping.data();
+        View.Vertices = reinterpret_cast<const Vertex*>(base + header.VertexOffset);
+        View.VertexCount = header.VertexCount;
+        View.Indices = reinterpret_cast<const uint32_t*>(base + header.IndexOffset);
+        View.IndexCount = header.IndexCount;
+        View.SubMeshes = reinterpret_cast<const SubMeshRange*>(base + header.SubMeshOffset);
+        View.SubMeshCount = header.SubMeshCount;
+        View.Lods = reinterpret_cast<const MeshLod*>(base + header.LodOffset);
+        View.LodCount = header.LodCount;
+        View.Meshlets = reinterpret_cast<const Meshlet*>(base + header.MeshletOffset);
+        View.MeshletCount = header.MeshletCount;
+        return true;
+    }
+};
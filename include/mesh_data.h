@@ -0,0 +1,101 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Interleaved vertex as consumed by surface.vs (location 0/1/2)
+struct Vertex {
+    glm::vec3 Position;
+    glm::vec3 Normal;
+    glm::vec2 TexCoords;
+};
+static_assert(sizeof(Vertex) == 32, "Vertex must stay tightly packed, it is written to disk as-is");
+
+// A run of indices drawn with one material. Plain old data so it can live in a mapped file.
+struct SubMeshRange {
+    uint32_t IndexOffset;
+    uint32_t IndexCount;
+    char Material[56];
+
+    void setMaterial(const std::string &name)
+    {
+        std::memset(Material, 0, sizeof(Material));
+        std::strncpy(Material, name.c_str(), sizeof(Material) - 1);
+    }
+};
+static_assert(sizeof(SubMeshRange) == 64, "SubMeshRange must stay 64 bytes, it is written to disk as-is");
+
+// One level of detail: a run of the index buffer drawing the whole mesh over the shared vertex
+// buffer. Level 0 is the full mesh; Error is the largest simplification error of the level,
+// a distance in model units, which never decreases from one level to the next.
+struct MeshLod {
+    uint32_t IndexOffset;
+    uint32_t IndexCount;
+    float Error;
+    uint32_t Reserved;
+};
+static_assert(sizeof(MeshLod) == 16, "MeshLod must stay 16 bytes, it is written to disk as-is");
+
+// A cluster of at most 64 vertices and 124 triangles: a run of level 0's index buffer inside
+// one submesh, with what culling needs in model units. The triangles all face away from any
+// eye within the backface cone, that is whenever dot(normalize(ConeApex - eye), ConeAxis) >=
+// ConeCutoff; a cutoff above 1 means the normals spread too far for a cone.
+struct Meshlet {
+    glm::vec3 Center;
+    float Radius;                       // bounding sphere
+    glm::vec3 ConeApex;
+    float ConeCutoff;
+    glm::vec3 ConeAxis;
+    uint32_t IndexOffset;
+    uint32_t TriangleCount;
+    uint32_t VertexCount;
+    uint32_t SubMesh;
+    uint32_t Reserved;
+};
+static_assert(sizeof(Meshlet) == 64, "Meshlet must stay 64 bytes, it is written to disk as-is");
+
+// Non-owning view of indexed mesh data. Points either into a MeshData or straight into a
+// memory-mapped mesh cache file, so it can be handed to glBufferData without copying.
+struct MeshView {
+    const Vertex *Vertices = nullptr;
+    uint32_t VertexCount = 0;
+    const uint32_t *Indices = nullptr;
+    uint32_t IndexCount = 0;
+    const SubMeshRange *SubMeshes = nullptr;
+    uint32_t SubMeshCount = 0;
+    const MeshLod *Lods = nullptr;
+    uint32_t LodCount = 0;
+    const Meshlet *Meshlets = nullptr;
+    uint32_t MeshletCount = 0;
+};
+
+// Owning indexed mesh: one interleaved vertex stream, one index stream, per-material ranges.
+// With a LOD chain the index stream holds every level, level 0 first, and the submesh ranges
+// refer to level 0, as do the meshlets, if any.
+struct MeshData {
+    std::vector<Vertex> Vertices;
+    std::vector<uint32_t> Indices;
+    std::vector<SubMeshRange> SubMeshes;
+    std::vector<MeshLod> Lods;
+    std::vector<Meshlet> Meshlets;
+
+    MeshView view() const
+    {
+        MeshView v;
+        v.Vertices = Vertices.data();
+        v.VertexCount = (uint32_t)Vertices.size();
+        v.Indices = Indices.data();
+        v.IndexCount = (uint32_t)Indices.size();
+        v.SubMeshes = SubMeshes.data();
+        v.SubMeshCount = (uint32_t)SubMeshes.size();
+        v.Lods = Lods.data();
+        v.LodCount = (uint32_t)Lods.size();
+        v.Meshlets = Meshlets.data();
+        v.MeshletCount = (uint32_t)Meshlets.size();
+        return v;
+    }
+};
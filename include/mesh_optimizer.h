@@ -0,0 +1,265 @@
+#pragma once
+
+#include "mesh_data.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <type_traits>
+#include <vector>
+
+// Post-transform cache statistics. ACMR is vertex shader invocations per triangle (0.5 is
+// the ideal for a regular grid, 3.0 is no reuse at all); ATVR is invocations per unique
+// vertex (1.0 means every vertex is shaded exactly once).
+struct VertexCacheStats {
+    float ACMR;
+    float ATVR;
+    size_t Transforms;
+};
+
+// Mesh processing stage run before upload: weld, reorder triangles for the post-transform
+// vertex cache (Forsyth's linear-speed algorithm), then reorder vertices by first use so
+// vertex fetch walks memory forwards.
+class MeshOptimizer
+{
+public:
+    // post-transform cache size assumed by the optimizer and the statistics
+    static const unsigned CACHE_SIZE = 32;
+
+    // collapses bitwise-identical vertices of a triangle soup into an indexed mesh
+    template <typename V>
+    static void weldVertices(const V *vertices, size_t count, std::vector<V> &outVertices, std::vector<uint32_t> &outIndices)
+    {
+        static_assert(std::is_trivially_copyable<V>::value, "vertices are compared and hashed as raw bytes");
+        size_t capacity = 16;
+        while (capacity < count * 2)
+            capacity <<= 1;
+        std::vector<uint32_t> slots(capacity, UINT32_MAX);
+        outVertices.clear();
+        outVertices.reserve(count);
+        outIndices.resize(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            size_t slot = hashBytes(&vertices[i], sizeof(V)) & (capacity - 1);
+            while (slots[slot] != UINT32_MAX && std::memcmp(&outVertices[slots[slot]], &vertices[i], sizeof(V)) != 0)
+                slot = (slot + 1) & (capacity - 1);
+            if (slots[slot] == UINT32_MAX)
+            {
+                slots[slot] = (uint32_t)outVertices.size();
+                outVertices.push_back(vertices[i]);
+            }
+            outIndices[i] = slots[slot];
+        }
+    }
+
+    // same for an already indexed mesh: duplicate vertices are merged and indices remapped
+    template <typename V>
+    static void weldVertices(std::vector<V> &vertices, std::vector<uint32_t> &indices)
+    {
+        std::vector<V> unique;
+        std::vector<uint32_t> remap;
+        weldVertices(vertices.data(), vertices.size(), unique, remap);
+        for (uint32_t &index : indices)
+            index = remap[index];
+        vertices.swap(unique);
+    }
+
+    // Forsyth, "Linear-Speed Vertex Cache Optimisation": greedily emits the triangle with the
+    // best score, where vertices score high when recently used or when few triangles remain
+    static void optimizeVertexCache(uint32_t *indices, size_t indexCount, size_t vertexCount)
+    {
+        const size_t triangleCount = indexCount / 3;
+        if (triangleCount == 0)
+            return;
+
+        // vertex -> triangle adjacency, CSR style
+        std::vector<uint32_t> remaining(vertexCount, 0), offsets(vertexCount + 1, 0);
+        for (size_t i = 0; i < indexCount; ++i)
+            ++remaining[indices[i]];
+        for (size_t v = 0; v < vertexCount; ++v)
+            offsets[v + 1] = offsets[v] + remaining[v];
+        std::vector<uint32_t> adjacency(indexCount), fill(offsets.begin(), offsets.end() - 1);
+        for (size_t t = 0; t < triangleCount; ++t)
+            for (int k = 0; k < 3; ++k)
+                adjacency[fill[indices[t * 3 + k]]++] = (uint32_t)t;
+
+        std::vector<int> cachePosition(vertexCount, -1);
+        std::vector<float> vertexScore(vertexCount);
+        for (size_t v = 0; v < vertexCount; ++v)
+            vertexScore[v] = scoreVertex(cachePosition[v], remaining[v]);
+        std::vector<float> triangleScore(triangleCount);
+        std::vector<char> emitted(triangleCount, 0);
+        for (size_t t = 0; t < triangleCount; ++t)
+            triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+
+        std::vector<uint32_t> output;
+        output.reserve(indexCount);
+        uint32_t cache[CACHE_SIZE + 3], nextCache[CACHE_SIZE + 3];
+        size_t cacheCount = 0;
+        size_t scanCursor = 0;
+        int64_t best = -1;
+
+        for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount)
+        {
+            if (best < 0)
+            {
+                // nothing in the cache is adjacent to a live triangle: fall back to a linear scan
+                float bestScore = -1.0f;
+                for (size_t t = scanCursor; t < triangleCount; ++t)
+                    if (!emitted[t] && triangleScore[t] > bestScore)
+                    {
+                        bestScore = triangleScore[t];
+                        best = (int64_t)t;
+                    }
+                while (scanCursor < triangleCount && emitted[scanCursor])
+                    ++scanCursor;
+            }
+            const uint32_t *tri = indices + best * 3;
+            const uint32_t a = tri[0], b = tri[1], c = tri[2];
+            output.push_back(a);
+            output.push_back(b);
+            output.push_back(c);
+            emitted[best] = 1;
+
+            // new LRU cache: the triangle's vertices at the front, then the old contents
+            size_t nextCount = 0;
+            nextCache[nextCount++] = a;
+            nextCache[nextCount++] = b;
+            nextCache[nextCount++] = c;
+            for (size_t i = 0; i < cacheCount; ++i)
+                if (cache[i] != a && cache[i] != b && cache[i] != c)
+                    nextCache[nextCount++] = cache[i];
+
+            // the triangle no longer counts towards its vertices' valence
+            for (uint32_t v : { a, b, c })
+            {
+                uint32_t *begin = &adjacency[offsets[v]];
+                uint32_t *end = begin + remaining[v];
+                uint32_t *found = std::find(begin, end, (uint32_t)best);
+                if (found != end)
+                {
+                    std::swap(*found, *(end - 1));
+                    --remaining[v];
+                }
+            }
+
+            // rescore everything in the (oversized) cache, then pick the best triangle touching it
+            for (size_t i = 0; i < nextCount; ++i)
+            {
+                const uint32_t v = nextCache[i];
+                cachePosition[v] = i < CACHE_SIZE ? (int)i : -1;
+                const float newScore = scoreVertex(cachePosition[v], remaining[v]);
+                const float delta = newScore - vertexScore[v];
+                vertexScore[v] = newScore;
+                for (uint32_t j = 0; j < remaining[v]; ++j)
+                    triangleScore[adjacency[offsets[v] + j]] += delta;
+            }
+            best = -1;
+            float bestScore = -1.0f;
+            for (size_t i = 0; i < nextCount; ++i)
+            {
+                const uint32_t v = nextCache[i];
+                for (uint32_t j = 0; j < remaining[v]; ++j)
+                {
+                    const uint32_t t = adjacency[offsets[v] + j];
+                    if (triangleScore[t] > bestScore)
+                    {
+                        bestScore = triangleScore[t];
+                        best = (int64_t)t;
+                    }
+                }
+            }
+            cacheCount = std::min<size_t>(nextCount, CACHE_SIZE);
+            std::copy(nextCache, nextCache + cacheCount, cache);
+        }
+        std::copy(output.begin(), output.end(), indices);
+    }
+
+    // renumbers vertices in order of first use; unreferenced vertices are dropped
+    template <typename V>
+    static void optimizeVertexFetch(std::vector<V> &vertices, std::vector<uint32_t> &indices)
+    {
+        std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+        std::vector<V> reordered;
+        reordered.reserve(vertices.size());
+        for (uint32_t &index : indices)
+        {
+            if (remap[index] == UINT32_MAX)
+            {
+                remap[index] = (uint32_t)reordered.size();
+                reordered.push_back(vertices[index]);
+            }
+            index = remap[index];
+        }
+        vertices.swap(reordered);
+    }
+
+    // simulates a FIFO post-transform cache of cacheSize entries
+    static VertexCacheStats analyzeVertexCache(const uint32_t *indices, size_t indexCount, size_t vertexCount, unsigned cacheSize = CACHE_SIZE)
+    {
+        std::vector<size_t> insertedAt(vertexCount, 0);
+        std::vector<char> referenced(vertexCount, 0);
+        size_t transforms = 0, uniqueVertices = 0;
+        for (size_t i = 0; i < indexCount; ++i)
+        {
+            const uint32_t v = indices[i];
+            if (!referenced[v])
+            {
+                referenced[v] = 1;
+                ++uniqueVertices;
+            }
+            // a vertex is in the FIFO if fewer than cacheSize misses happened since it went in
+            if (insertedAt[v] == 0 || transforms - insertedAt[v] >= cacheSize)
+                insertedAt[v] = ++transforms;
+        }
+        VertexCacheStats stats;
+        stats.Transforms = transforms;
+        stats.ACMR = indexCount >= 3 ? (float)transforms / (float)(indexCount / 3) : 0.0f;
+        stats.ATVR = uniqueVertices ? (float)transforms / (float)uniqueVertices : 0.0f;
+        return stats;
+    }
+
+    // the whole stage on a loaded mesh; triangles only move within their SubMeshRange
+    static void optimize(MeshData &mesh)
+    {
+        weldVertices(mesh.Vertices, mesh.Indices);
+        if (mesh.SubMeshes.empty())
+            optimizeVertexCache(mesh.Indices.data(), mesh.Indices.size(), mesh.Vertices.size());
+        for (const SubMeshRange &range : mesh.SubMeshes)
+            optimizeVertexCache(mesh.Indices.data() + range.IndexOffset, range.IndexCount, mesh.Vertices.size());
+        optimizeVertexFetch(mesh.Vertices, mesh.Indices);
+    }
+
+private:
+    static size_t hashBytes(const void *data, size_t size)
+    {
+        const unsigned char *bytes = static_cast<const unsigned char*>(data);
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return (size_t)(hash ^ (hash >> 32));
+    }
+
+    // Forsyth's scoring: the three most recent vertices get a flat score (the triangle just
+    // drawn), older cache entries decay, and a low remaining valence boosts a vertex so
+    // stragglers get finished instead of left behind
+    static float scoreVertex(int cachePosition, uint32_t remainingTriangles)
+    {
+        if (remainingTriangles == 0)
+            return -1.0f;
+        float score = 0.0f;
+        if (cachePosition >= 0)
+        {
+            if (cachePosition < 3)
+                score = 0.75f;
+            else
+                score = std::pow(1.0f - (cachePosition - 3) / (float)(CACHE_SIZE - 3), 1.5f);
+        }
+        return score + 2.0f / std::sqrt((float)remainingTriangles);
+    }
+};
@@ -0,0 +1,337 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "mesh_data.h"
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <initializer_list>
+#include <unordered_map>
+#include <vector>
+
+// Quadric error metric simplification (Garland & Heckbert, "Surface Simplification Using
+// Quadric Error Metrics") by half-edge collapses: a vertex is merged into one of its
+// neighbours and never moved, so every surviving vertex keeps its normal and UV exactly and the
+// levels can share the full mesh's vertex buffer.
+//
+// Vertices are welded by position first. A position owned by several vertices sits on a UV or
+// normal seam, and one on an open or non-manifold edge sits on a border: both are locked, so
+// seams and silhouettes of open meshes survive every level. Each pass sorts all candidate
+// collapses by error and applies the cheapest ones that don't overlap, flip a triangle or pinch
+// the surface (more than two shared neighbours), until the target is met or the error limit
+// is reached.
+class MeshSimplifier
+{
+public:
+    // no level may deviate more than this fraction of the mesh's largest extent
+    static constexpr float MAX_RELATIVE_ERROR = 0.05f;
+
+    // simplifies the triangles in indices towards targetIndexCount indices into result, with no
+    // collapse costing more than maxError (model units); returns the largest error accepted
+    static float simplify(const Vertex *vertices, size_t vertexCount, const uint32_t *indices, size_t indexCount,
+                          size_t targetIndexCount, float maxError, std::vector<uint32_t> &result)
+    {
+        // weld by position; remap[v] is the position of vertex v
+        std::vector<glm::vec3> positions(vertexCount), points;
+        for (size_t v = 0; v < vertexCount; ++v)
+            positions[v] = vertices[v].Position;
+        std::vector<uint32_t> remap;
+        MeshOptimizer::weldVertices(positions.data(), vertexCount, points, remap);
+        const size_t pointCount = points.size();
+
+        // degenerate triangles are dropped up front, they'd only confuse the topology checks
+        result.clear();
+        for (size_t i = 0; i + 2 < indexCount; i += 3)
+        {
+            const uint32_t a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+            if (a != b && b != c && a != c)
+                result.insert(result.end(), { indices[i], indices[i + 1], indices[i + 2] });
+        }
+
+        std::vector<char> locked = lockedPoints(vertexCount, remap, pointCount, result);
+        std::vector<Quadric> quadrics(pointCount);
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            const glm::dvec3 a = points[remap[result[i]]], b = points[remap[result[i + 1]]], c = points[remap[result[i + 2]]];
+            const glm::dvec3 normal = glm::cross(b - a, c - a);
+            const double area = glm::length(normal);
+            if (area <= 0.0)
+                continue;
+            Quadric plane = Quadric::plane(normal / area, -glm::dot(normal / area, a), area);
+            for (size_t k = 0; k < 3; ++k)
+                quadrics[remap[result[i + k]]] += plane;
+        }
+
+        const double maxCost = (double)maxError * maxError;
+        double worst = 0.0;
+        std::vector<uint32_t> offsets, adjacency, vertexRemap(vertexCount);
+        std::vector<Collapse> collapses;
+        std::vector<char> touched(pointCount);
+        while (result.size() > targetIndexCount)
+        {
+            buildAdjacency(result, remap, pointCount, offsets, adjacency);
+
+            collapses.clear();
+            for (size_t i = 0; i < result.size(); i += 3)
+            {
+                for (size_t k = 0; k < 3; ++k)
+                {
+                    const uint32_t a = remap[result[i + k]], b = remap[result[i + (k + 1) % 3]];
+                    if (!locked[a])
+                        collapses.push_back({ a, b, collapseCost(quadrics, points, a, b) });
+                    if (!locked[b])
+                        collapses.push_back({ b, a, collapseCost(quadrics, points, b, a) });
+                }
+            }
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse &x, const Collapse &y) { return x.Cost < y.Cost; });
+
+            // every collapse removes about two triangles
+            const size_t triangleBudget = (result.size() - targetIndexCount) / 3;
+            size_t removed = 0, applied = 0;
+            std::fill(touched.begin(), touched.end(), 0);
+            for (size_t v = 0; v < vertexCount; ++v)
+                vertexRemap[v] = (uint32_t)v;
+            for (const Collapse &collapse : collapses)
+            {
+                if (collapse.Cost > maxCost || removed >= triangleBudget)
+                    break;
+                const uint32_t from = collapse.From, to = collapse.To;
+                if (touched[from] || touched[to])
+                    continue;
+                if (sharedNeighbours(result, remap, offsets, adjacency, from, to) > 2 ||
+                    flipsTriangle(result, remap, points, offsets, adjacency, from, to))
+                    continue;
+
+                // the unlocked vertex at from takes the attributes of to as seen from its side
+                uint32_t fromVertex = UINT32_MAX, toVertex = UINT32_MAX;
+                for (uint32_t j = offsets[from]; j < offsets[from + 1]; ++j)
+                {
+                    const uint32_t *triangle = &result[adjacency[j] * 3];
+                    for (size_t k = 0; k < 3; ++k)
+                    {
+                        if (remap[triangle[k]] == from)
+                            fromVertex = triangle[k];
+                        if (remap[triangle[k]] == to)
+                        {
+                            toVertex = triangle[k];
+                            ++removed;
+                        }
+                    }
+                }
+                vertexRemap[fromVertex] = toVertex;
+                quadrics[to] += quadrics[from];
+                worst = std::max(worst, collapse.Cost);
+                ++applied;
+
+                // the one-ring of from changes shape, nothing in it moves again this pass
+                for (uint32_t j = offsets[from]; j < offsets[from + 1]; ++j)
+                    for (size_t k = 0; k < 3; ++k)
+                        touched[remap[result[adjacency[j] * 3 + k]]] = 1;
+            }
+            if (applied == 0)
+                break;
+
+            size_t kept = 0;
+            for (size_t i = 0; i < result.size(); i += 3)
+            {
+                const uint32_t a = vertexRemap[result[i]], b = vertexRemap[result[i + 1]], c = vertexRemap[result[i + 2]];
+                if (remap[a] == remap[b] || remap[b] == remap[c] || remap[a] == remap[c])
+                    continue;
+                result[kept++] = a;
+                result[kept++] = b;
+                result[kept++] = c;
+            }
+            result.resize(kept);
+        }
+        return (float)std::sqrt(worst);
+    }
+
+    // appends a LOD chain to mesh: level 0 is the mesh as it is, then one level per ratio that
+    // still removes at least a tenth of the previous level's triangles. Meshes with several
+    // materials are left alone (levels span the whole mesh); returns the levels generated
+    static size_t buildLods(MeshData &mesh, std::initializer_list<float> ratios = { 0.5f, 0.25f, 0.1f, 0.05f })
+    {
+        const uint32_t fullCount = (uint32_t)mesh.Indices.size();
+        mesh.Lods.assign(1, { 0, fullCount, 0.0f, 0 });
+        if (mesh.SubMeshes.size() > 1 || mesh.Indices.empty())
+            return 0;
+
+        glm::vec3 lower(INFINITY), upper(-INFINITY);
+        for (const Vertex &vertex : mesh.Vertices)
+        {
+            lower = glm::min(lower, vertex.Position);
+            upper = glm::max(upper, vertex.Position);
+        }
+        const glm::vec3 size = upper - lower;
+        const float maxError = MAX_RELATIVE_ERROR * std::max(size.x, std::max(size.y, size.z));
+
+        std::vector<uint32_t> level;
+        for (float ratio : ratios)
+        {
+            const size_t target = (size_t)(fullCount / 3 * ratio) * 3;
+            const float error = simplify(mesh.Vertices.data(), mesh.Vertices.size(), mesh.Indices.data(), fullCount, target, maxError, level);
+            const MeshLod &previous = mesh.Lods.back();
+            if (level.empty() || level.size() > previous.IndexCount - previous.IndexCount / 10)
+                break;
+            MeshOptimizer::optimizeVertexCache(level.data(), level.size(), mesh.Vertices.size());
+            mesh.Lods.push_back({ (uint32_t)mesh.Indices.size(), (uint32_t)level.size(), std::max(error, previous.Error), 0 });
+            mesh.Indices.insert(mesh.Indices.end(), level.begin(), level.end());
+        }
+        return mesh.Lods.size() - 1;
+    }
+
+private:
+    // symmetric 4x4 matrix of summed, area weighted squared plane distances
+    struct Quadric {
+        double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0, weight = 0;
+
+        static Quadric plane(const glm::dvec3 &n, double d, double weight)
+        {
+            Quadric q;
+            q.a2 = n.x * n.x * weight; q.ab = n.x * n.y * weight; q.ac = n.x * n.z * weight; q.ad = n.x * d * weight;
+            q.b2 = n.y * n.y * weight; q.bc = n.y * n.z * weight; q.bd = n.y * d * weight;
+            q.c2 = n.z * n.z * weight; q.cd = n.z * d * weight;
+            q.d2 = d * d * weight;
+            q.weight = weight;
+            return q;
+        }
+
+        Quadric& operator+=(const Quadric &o)
+        {
+            a2 += o.a2; ab += o.ab; ac += o.ac; ad += o.ad; b2 += o.b2; bc += o.bc; bd += o.bd;
+            c2 += o.c2; cd += o.cd; d2 += o.d2; weight += o.weight;
+            return *this;
+        }
+
+        // mean squared distance of p to the accumulated planes
+        double error(const glm::dvec3 &p) const
+        {
+            const double e = a2 * p.x * p.x + 2 * ab * p.x * p.y + 2 * ac * p.x * p.z + 2 * ad * p.x
+                           + b2 * p.y * p.y + 2 * bc * p.y * p.z + 2 * bd * p.y
+                           + c2 * p.z * p.z + 2 * cd * p.z + d2;
+            return weight > 0.0 ? std::max(e, 0.0) / weight : 0.0;
+        }
+    };
+
+    struct Collapse {
+        uint32_t From, To;
+        double Cost;
+    };
+
+    static double collapseCost(const std::vector<Quadric> &quadrics, const std::vector<glm::vec3> &points, uint32_t from, uint32_t to)
+    {
+        Quadric q = quadrics[from];
+        q += quadrics[to];
+        return q.error(points[to]);
+    }
+
+    // seams (a position shared by several vertices) and borders (an edge without exactly two
+    // triangles) never move
+    static std::vector<char> lockedPoints(size_t vertexCount, const std::vector<uint32_t> &remap, size_t pointCount,
+                                          const std::vector<uint32_t> &indices)
+    {
+        std::vector<char> locked(pointCount, 0);
+        std::vector<uint32_t> owner(pointCount, UINT32_MAX);
+        for (uint32_t v = 0; v < (uint32_t)vertexCount; ++v)
+        {
+            uint32_t &first = owner[remap[v]];
+            if (first == UINT32_MAX)
+                first = v;
+            else
+                locked[remap[v]] = 1;
+        }
+        std::unordered_map<uint64_t, uint32_t> edges;
+        edges.reserve(indices.size());
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            for (size_t k = 0; k < 3; ++k)
+            {
+                const uint32_t a = remap[indices[i + k]], b = remap[indices[i + (k + 1) % 3]];
+                ++edges[((uint64_t)std::min(a, b) << 32) | std::max(a, b)];
+            }
+        }
+        for (const auto &edge : edges)
+        {
+            if (edge.second == 2)
+                continue;
+            locked[edge.first >> 32] = 1;
+            locked[edge.first & 0xffffffffu] = 1;
+        }
+        return locked;
+    }
+
+    // position -> triangles, CSR style
+    static void buildAdjacency(const std::vector<uint32_t> &indices, const std::vector<uint32_t> &remap, size_t pointCount,
+                               std::vector<uint32_t> &offsets, std::vector<uint32_t> &adjacency)
+    {
+        offsets.assign(pointCount + 1, 0);
+        for (uint32_t index : indices)
+            ++offsets[remap[index] + 1];
+        for (size_t p = 0; p < pointCount; ++p)
+            offsets[p + 1] += offsets[p];
+        adjacency.resize(indices.size());
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); ++i)
+            adjacency[fill[remap[indices[i]]]++] = (uint32_t)(i / 3);
+    }
+
+    // link condition: an interior edge has exactly two neighbours in common, more would pinch
+    static size_t sharedNeighbours(const std::vector<uint32_t> &indices, const std::vector<uint32_t> &remap, const std::vector<uint32_t> &offsets,
+                                   const std::vector<uint32_t> &adjacency, uint32_t a, uint32_t b)
+    {
+        uint32_t ringA[64], ringB[64];
+        const size_t countA = ring(indices, remap, offsets, adjacency, a, ringA), countB = ring(indices, remap, offsets, adjacency, b, ringB);
+        if (countA == SIZE_MAX || countB == SIZE_MAX)
+            return SIZE_MAX;
+        size_t shared = 0;
+        for (size_t i = 0; i < countA; ++i)
+            if (ringA[i] != b && std::find(ringB, ringB + countB, ringA[i]) != ringB + countB)
+                ++shared;
+        return shared;
+    }
+
+    // distinct neighbours of p; SIZE_MAX for valences too high to bother with
+    static size_t ring(const std::vector<uint32_t> &indices, const std::vector<uint32_t> &remap, const std::vector<uint32_t> &offsets,
+                       const std::vector<uint32_t> &adjacency, uint32_t p, uint32_t (&out)[64])
+    {
+        size_t count = 0;
+        for (uint32_t j = offsets[p]; j < offsets[p + 1]; ++j)
+        {
+            for (size_t k = 0; k < 3; ++k)
+            {
+                const uint32_t q = remap[indices[adjacency[j] * 3 + k]];
+                if (q == p || std::find(out, out + count, q) != out + count)
+                    continue;
+                if (count == 64)
+                    return SIZE_MAX;
+                out[count++] = q;
+            }
+        }
+        return count;
+    }
+
+    // would moving from onto to turn any surviving triangle around from over (or flat)?
+    static bool flipsTriangle(const std::vector<uint32_t> &indices, const std::vector<uint32_t> &remap, const std::vector<glm::vec3> &points,
+                              const std::vector<uint32_t> &offsets, const std::vector<uint32_t> &adjacency, uint32_t from, uint32_t to)
+    {
+        for (uint32_t j = offsets[from]; j < offsets[from + 1]; ++j)
+        {
+            const uint32_t *triangle = &indices[adjacency[j] * 3];
+            uint32_t p[3] = { remap[triangle[0]], remap[triangle[1]], remap[triangle[2]] };
+            if (p[0] == to || p[1] == to || p[2] == to)
+                continue; // collapses away
+            const glm::vec3 before = glm::cross(points[p[1]] - points[p[0]], points[p[2]] - points[p[0]]);
+            for (uint32_t &q : p)
+                if (q == from)
+                    q = to;
+            const glm::vec3 after = glm::cross(points[p[1]] - points[p[0]], points[p[2]] - points[p[0]]);
+            const float lengths = glm::length(before) * glm::length(after);
+            if (lengths <= 0.0f || glm::dot(before, after) < 0.2f * lengths)
+                return true;
+        }
+        return false;
+    }
+};
@@ -0,0 +1,211 @@
+#pragma once
+
+#include "mesh_data.h"
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Splits level 0 of a mesh into meshlets, submesh by submesh, reordering its indices so every
+// meshlet is one run of them. A meshlet is grown greedily from the first triangle not taken
+// yet: the next triangle is one sharing a position with it (so growth crosses UV and normal
+// seams), scored by the vertices it adds plus how far its normal is from the meshlet's average,
+// which keeps meshlets compact and their normal cones narrow. A meshlet ends once it is full
+// or nothing next to it fits. Each then gets a bounding sphere and a backface cone (the construction of
+// meshoptimizer's meshopt_computeMeshletBounds).
+class MeshletBuilder
+{
+public:
+    static const uint32_t MAX_VERTICES = 64;
+    static const uint32_t MAX_TRIANGLES = 124;
+    // a new vertex costs 1, a normal at right angles to the meshlet's average CONE_WEIGHT;
+    // normals more than 60 degrees off the average aren't taken at all, trading smaller
+    // meshlets on very curved meshes for cones narrow enough to cull
+    static constexpr float CONE_WEIGHT = 2.0f;
+    static constexpr float MIN_ALIGNMENT = 0.5f;
+
+    // replaces mesh.Meshlets; returns how many there are
+    static size_t build(MeshData &mesh)
+    {
+        mesh.Meshlets.clear();
+        const uint32_t levelCount = mesh.Lods.empty() ? (uint32_t)mesh.Indices.size() : mesh.Lods[0].IndexCount;
+        std::vector<SubMeshRange> ranges(mesh.SubMeshes);
+        if (ranges.empty())
+            ranges.push_back({ 0, levelCount, {} });
+
+        Scratch scratch;
+        std::vector<glm::vec3> positions(mesh.Vertices.size()), unique;
+        for (size_t i = 0; i < mesh.Vertices.size(); ++i)
+            positions[i] = mesh.Vertices[i].Position;
+        MeshOptimizer::weldVertices(positions.data(), positions.size(), unique, scratch.Position);
+        scratch.Start.resize(unique.size() + 1);
+        scratch.Stamp.assign(mesh.Vertices.size(), UINT32_MAX);
+        for (uint32_t subMesh = 0; subMesh < (uint32_t)ranges.size(); ++subMesh)
+            buildRange(mesh, ranges[subMesh].IndexOffset, ranges[subMesh].IndexCount, subMesh, scratch);
+        return mesh.Meshlets.size();
+    }
+
+private:
+    // per-vertex arrays, allocated once for all submeshes
+    struct Scratch {
+        std::vector<uint32_t> Position; // vertex to welded position
+        std::vector<uint32_t> Start;    // triangles at position p are Adjacent[Start[p]..Start[p + 1])
+        std::vector<uint32_t> Cursor;
+        std::vector<uint32_t> Adjacent;
+        std::vector<uint32_t> Stamp;    // meshlet the vertex was last added to
+    };
+
+    static void buildRange(MeshData &mesh, uint32_t offset, uint32_t count, uint32_t subMesh, Scratch &scratch)
+    {
+        uint32_t *indices = mesh.Indices.data() + offset;
+        const uint32_t triangles = count / 3;
+        if (triangles == 0)
+            return;
+
+        // position to triangle adjacency
+        const std::vector<uint32_t> &position = scratch.Position;
+        std::vector<uint32_t> &start = scratch.Start;
+        std::fill(start.begin(), start.end(), 0);
+        for (uint32_t i = 0; i < triangles * 3; ++i)
+            ++start[position[indices[i]] + 1];
+        for (size_t p = 1; p < start.size(); ++p)
+            start[p] += start[p - 1];
+        scratch.Cursor.assign(start.begin(), start.end() - 1);
+        scratch.Adjacent.resize(triangles * 3);
+        for (uint32_t i = 0; i < triangles * 3; ++i)
+            scratch.Adjacent[scratch.Cursor[position[indices[i]]]++] = i / 3;
+
+        std::vector<glm::vec3> normals(triangles);
+        for (uint32_t t = 0; t < triangles; ++t)
+        {
+            const glm::vec3 &a = mesh.Vertices[indices[t * 3]].Position, &b = mesh.Vertices[indices[t * 3 + 1]].Position,
+                            &c = mesh.Vertices[indices[t * 3 + 2]].Position;
+            const glm::vec3 normal = glm::cross(b - a, c - a);
+            const float length = glm::length(normal);
+            normals[t] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+        }
+
+        std::vector<uint8_t> taken(triangles, 0);
+        std::vector<uint32_t> order, meshletTriangles, meshletVertices;
+        order.reserve(count);
+        uint32_t seed = 0;
+        while (true)
+        {
+            while (seed < triangles && taken[seed])
+                ++seed;
+            if (seed == triangles)
+                break;
+            const uint32_t id = (uint32_t)mesh.Meshlets.size();
+            meshletTriangles.clear();
+            meshletVertices.clear();
+            glm::vec3 normalSum(0.0f);
+            uint32_t next = seed;
+            do
+            {
+                taken[next] = 1;
+                meshletTriangles.push_back(next);
+                normalSum += normals[next];
+                for (int corner = 0; corner < 3; ++corner)
+                {
+                    const uint32_t vertex = indices[next * 3 + corner];
+                    if (scratch.Stamp[vertex] != id)
+                    {
+                        scratch.Stamp[vertex] = id;
+                        meshletVertices.push_back(vertex);
+                    }
+                }
+                if (meshletTriangles.size() == MAX_TRIANGLES)
+                    break;
+
+                const float normalLength = glm::length(normalSum);
+                const glm::vec3 average = normalLength > 0.0f ? normalSum / normalLength : glm::vec3(0.0f);
+                next = UINT32_MAX;
+                float best = INFINITY;
+                for (uint32_t vertex : meshletVertices)
+                {
+                    for (uint32_t entry = start[position[vertex]]; entry < start[position[vertex] + 1]; ++entry)
+                    {
+                        const uint32_t candidate = scratch.Adjacent[entry];
+                        if (taken[candidate])
+                            continue;
+                        uint32_t added = 0;
+                        for (int corner = 0; corner < 3; ++corner)
+                            added += scratch.Stamp[indices[candidate * 3 + corner]] != id;
+                        const float alignment = glm::dot(normals[candidate], average);
+                        if (meshletVertices.size() + added > MAX_VERTICES || alignment < MIN_ALIGNMENT)
+                            continue;
+                        const float score = (float)added + CONE_WEIGHT * (1.0f - alignment);
+                        if (score < best)
+                        {
+                            best = score;
+                            next = candidate;
+                        }
+                    }
+                }
+            } while (next != UINT32_MAX);
+
+            Meshlet meshlet = bounds(mesh, indices, meshletTriangles, meshletVertices, normals);
+            meshlet.IndexOffset = offset + (uint32_t)order.size();
+            meshlet.TriangleCount = (uint32_t)meshletTriangles.size();
+            meshlet.VertexCount = (uint32_t)meshletVertices.size();
+            meshlet.SubMesh = subMesh;
+            meshlet.Reserved = 0;
+            mesh.Meshlets.push_back(meshlet);
+            for (uint32_t t : meshletTriangles)
+                order.insert(order.end(), indices + t * 3, indices + t * 3 + 3);
+        }
+
+        std::copy(order.begin(), order.end(), indices);
+    }
+
+    // bounding sphere around the box of the vertices; the cone's axis is the average normal
+    // and its apex far enough back along it that every triangle's plane passes in front of it
+    static Meshlet bounds(const MeshData &mesh, const uint32_t *indices, const std::vector<uint32_t> &triangles,
+                          const std::vector<uint32_t> &vertices, const std::vector<glm::vec3> &normals)
+    {
+        Meshlet meshlet;
+        glm::vec3 lower(INFINITY), upper(-INFINITY);
+        for (uint32_t vertex : vertices)
+        {
+            lower = glm::min(lower, mesh.Vertices[vertex].Position);
+            upper = glm::max(upper, mesh.Vertices[vertex].Position);
+        }
+        meshlet.Center = (lower + upper) * 0.5f;
+        float radius = 0.0f;
+        for (uint32_t vertex : vertices)
+            radius = std::max(radius, glm::length(mesh.Vertices[vertex].Position - meshlet.Center));
+        meshlet.Radius = radius;
+
+        glm::vec3 axis(0.0f);
+        for (uint32_t t : triangles)
+            axis += normals[t];
+        const float axisLength = glm::length(axis);
+        meshlet.ConeAxis = axisLength > 0.0f ? axis / axisLength : glm::vec3(0.0f, 0.0f, 1.0f);
+        meshlet.ConeApex = meshlet.Center;
+        meshlet.ConeCutoff = 2.0f;
+        if (axisLength == 0.0f)
+            return meshlet;
+
+        float minDot = 1.0f;
+        for (uint32_t t : triangles)
+            if (normals[t] != glm::vec3(0.0f))
+                minDot = std::min(minDot, glm::dot(normals[t], meshlet.ConeAxis));
+        // a cone over 90 degrees wide could never be culled
+        if (minDot <= 0.1f)
+            return meshlet;
+        float maxT = 0.0f;
+        for (uint32_t t : triangles)
+        {
+            if (normals[t] == glm::vec3(0.0f))
+                continue;
+            const glm::vec3 &corner = mesh.Vertices[indices[t * 3]].Position;
+            const float t0 = glm::dot(meshlet.Center - corner, normals[t]) / glm::dot(meshlet.ConeAxis, normals[t]);
+            maxT = std::max(maxT, t0);
+        }
+        meshlet.ConeApex = meshlet.Center - meshlet.ConeAxis * maxT;
+        meshlet.ConeCutoff = std::sqrt(1.0f - minDot * minDot);
+        return meshlet;
+    }
+};
@@ -0,0 +1,262 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "mesh_data.h"
+#include "render_queue.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define MESHLET_CULLER_SSE 1
+#include <immintrin.h>
+#endif
+
+// What happened to a meshlet in the last cull()
+enum MeshletVerdict : uint8_t {
+    MESHLET_DRAWN,
+    MESHLET_OUTSIDE,                    // bounding sphere outside a frustum plane
+    MESHLET_BACKFACING,                 // the eye is inside the backface cone
+    MESHLET_SMALL                       // bounding sphere under MinPixels across
+};
+
+// What one cull() rejected, in triangles
+struct MeshletStats {
+    size_t Meshlets = 0;
+    size_t Triangles = 0;               // in all meshlets
+    size_t Outside = 0;
+    size_t Backfacing = 0;
+    size_t Small = 0;
+    size_t Ranges = 0;                  // runs of indices left to draw, neighbours merged
+    double Microseconds = 0.0;          // CPU, all of cull()
+};
+
+// Culls a mesh's meshlets (see MeshletBuilder) against the frustum, their backface cones and a
+// minimum size on screen, and turns the survivors into one DrawRanges per submesh for
+// glMultiDrawElements. Meshlets next to each other in the index buffer are merged into one
+// range, so a mesh seen whole still draws in a few runs.
+//
+// Everything is tested in model space: the frustum planes are taken into it by the transpose of
+// the model matrix and the eye by its inverse, which keeps the frustum and cone tests exact
+// under any scaling (a mirroring model matrix turns faces inside out, so it skips the cone
+// test); the size test takes the scale to be uniform. The bounds are kept as structure-of-arrays
+// lanes and tested four meshlets at a time with SSE. Above PARALLEL_MIN meshlets the tests are
+// split into CHUNK sized jobs on the pool; the merge runs on the calling thread.
+class MeshletCuller
+{
+public:
+    static const size_t CHUNK = 512;   // a multiple of 4
+    static const size_t PARALLEL_MIN = 2048;
+
+    float MinPixels = 1.0f;             // smaller meshlets may cover a sample, but rarely do
+    MeshletStats Frame;
+
+    MeshletCuller(std::vector<Meshlet> meshlets, size_t subMeshCount, ThreadPool &pool)
+        : meshlets(std::move(meshlets)), pool(pool), ranges(std::max<size_t>(subMeshCount, 1))
+    {
+        // padding lanes are never culled and never read back
+        const size_t padded = (this->meshlets.size() + 3) & ~size_t(3);
+        for (std::vector<float> *lane : { &CX, &CY, &CZ, &R, &PX, &PY, &PZ, &AX, &AY, &AZ })
+            lane->assign(padded, 0.0f);
+        CUT.assign(padded, 2.0f);
+        for (size_t i = 0; i < this->meshlets.size(); ++i)
+        {
+            const Meshlet &meshlet = this->meshlets[i];
+            CX[i] = meshlet.Center.x; CY[i] = meshlet.Center.y; CZ[i] = meshlet.Center.z; R[i] = meshlet.Radius;
+            PX[i] = meshlet.ConeApex.x; PY[i] = meshlet.ConeApex.y; PZ[i] = meshlet.ConeApex.z;
+            AX[i] = meshlet.ConeAxis.x; AY[i] = meshlet.ConeAxis.y; AZ[i] = meshlet.ConeAxis.z; CUT[i] = meshlet.ConeCutoff;
+        }
+        verdicts.assign(padded, MESHLET_DRAWN);
+    }
+
+    // planes from Camera::GetFrustumPlanes(), projectionScale from Camera::GetProjectionScale()
+    void cull(const glm::mat4 &model, const std::array<glm::vec4, 6> &planes, const glm::vec3 &eye, float projectionScale)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        View view;
+        for (int i = 0; i < 6; ++i)
+        {
+            const glm::vec4 plane = glm::transpose(model) * planes[i];
+            view.Planes[i] = plane / glm::length(glm::vec3(plane));
+        }
+        view.Eye = glm::vec3(glm::inverse(model) * glm::vec4(eye, 1.0f));
+        view.Cones = glm::determinant(glm::mat3(model)) > 0.0f;
+        view.SizeScale = 2.0f * projectionScale / std::max(MinPixels, 1e-6f);
+
+        if (meshlets.size() < PARALLEL_MIN)
+            test(view, 0, verdicts.size());
+        else
+        {
+            JobCounter tested;
+            for (size_t first = 0; first < verdicts.size(); first += CHUNK)
+                pool.submit([this, &view, first] { test(view, first, std::min(verdicts.size(), first + CHUNK)); }, &tested);
+            pool.wait(tested);
+        }
+        merge();
+        Frame.Microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        total.Triangles += Frame.Triangles;
+        total.Outside += Frame.Outside;
+        total.Backfacing += Frame.Backfacing;
+        total.Small += Frame.Small;
+        total.Ranges += Frame.Ranges;
+        total.Microseconds += Frame.Microseconds;
+        ++frames;
+    }
+
+    // what the last cull() left of a submesh; empty when nothing of it is visible
+    const DrawRanges& drawRanges(size_t subMesh) const
+    {
+        return ranges[subMesh];
+    }
+
+    const std::vector<Meshlet>& getMeshlets() const { return meshlets; }
+    // indexed like getMeshlets(), padded to a multiple of 4
+    const std::vector<MeshletVerdict>& getVerdicts() const { return verdicts; }
+
+    // averages once per second, like the stress scene; force prints whatever has accumulated
+    void Report(float deltaTime, bool force = false)
+    {
+        elapsed += deltaTime;
+        if ((elapsed < 1.0f && !force) || frames == 0 || total.Triangles == 0)
+            return;
+        const double triangles = (double)total.Triangles;
+        std::cout << "meshlets: " << meshlets.size() << " meshlets, " << 100.0 * (total.Outside + total.Backfacing + total.Small) / triangles
+                  << "% of triangles rejected (" << 100.0 * total.Outside / triangles << "% outside, " << 100.0 * total.Backfacing / triangles
+                  << "% backfacing, " << 100.0 * total.Small / triangles << "% small), " << total.Ranges / frames << " ranges/frame, "
+                  << total.Microseconds / frames << " us/frame, " << total.Microseconds / triangles * 100000.0 << " us per 100k triangles" << std::endl;
+        total = MeshletStats();
+        elapsed = 0.0f;
+        frames = 0;
+    }
+
+private:
+    // the camera, in the meshlets' model space where it can be
+    struct View {
+        glm::vec4 Planes[6];
+        glm::vec3 Eye;
+        bool Cones;
+        float SizeScale;                // radius * SizeScale < distance: under MinPixels across
+    };
+
+    std::vector<Meshlet> meshlets;
+    // the bounds as lanes: sphere centre and radius, cone apex, axis and cutoff
+    std::vector<float> CX, CY, CZ, R, PX, PY, PZ, AX, AY, AZ, CUT;
+    ThreadPool &pool;
+    std::vector<MeshletVerdict> verdicts;
+    std::vector<DrawRanges> ranges;
+    MeshletStats total;
+    float elapsed = 0.0f;
+    unsigned int frames = 0;
+
+    // meshlets first..last, both multiples of 4
+    void test(const View &view, size_t first, size_t last)
+    {
+#ifdef MESHLET_CULLER_SSE
+        const __m128 eyeX = _mm_set1_ps(view.Eye.x), eyeY = _mm_set1_ps(view.Eye.y), eyeZ = _mm_set1_ps(view.Eye.z);
+        const __m128 sizeScale = _mm_set1_ps(view.SizeScale);
+        const __m128i one = _mm_set1_epi32(MESHLET_OUTSIDE), two = _mm_set1_epi32(MESHLET_BACKFACING), three = _mm_set1_epi32(MESHLET_SMALL);
+        for (size_t i = first; i < last; i += 4)
+        {
+            const __m128 cx = _mm_loadu_ps(&CX[i]), cy = _mm_loadu_ps(&CY[i]), cz = _mm_loadu_ps(&CZ[i]), r = _mm_loadu_ps(&R[i]);
+            const __m128 negativeR = _mm_sub_ps(_mm_setzero_ps(), r);
+            __m128 outside = _mm_setzero_ps();
+            for (const glm::vec4 &plane : view.Planes)
+            {
+                const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), cx), _mm_mul_ps(_mm_set1_ps(plane.y), cy)),
+                                                   _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), cz), _mm_set1_ps(plane.w)));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, negativeR));
+            }
+
+            __m128 backfacing = _mm_setzero_ps();
+            if (view.Cones)
+            {
+                const __m128 tx = _mm_sub_ps(_mm_loadu_ps(&PX[i]), eyeX), ty = _mm_sub_ps(_mm_loadu_ps(&PY[i]), eyeY),
+                             tz = _mm_sub_ps(_mm_loadu_ps(&PZ[i]), eyeZ);
+                const __m128 along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, _mm_loadu_ps(&AX[i])), _mm_mul_ps(ty, _mm_loadu_ps(&AY[i]))),
+                                                _mm_mul_ps(tz, _mm_loadu_ps(&AZ[i])));
+                const __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, tx), _mm_mul_ps(ty, ty)), _mm_mul_ps(tz, tz)));
+                backfacing = _mm_cmpge_ps(along, _mm_mul_ps(_mm_loadu_ps(&CUT[i]), length));
+            }
+
+            const __m128 dx = _mm_sub_ps(cx, eyeX), dy = _mm_sub_ps(cy, eyeY), dz = _mm_sub_ps(cz, eyeZ);
+            const __m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+            const __m128 small = _mm_and_ps(_mm_cmpgt_ps(distance, r), _mm_cmplt_ps(_mm_mul_ps(r, sizeScale), distance));
+
+            // outside before backfacing before small, as the scalar tests go
+            const __m128i isOutside = _mm_castps_si128(outside), isBackfacing = _mm_castps_si128(backfacing);
+            __m128i verdict = _mm_and_si128(_mm_castps_si128(small), three);
+            verdict = _mm_or_si128(_mm_and_si128(isBackfacing, two), _mm_andnot_si128(isBackfacing, verdict));
+            verdict = _mm_or_si128(_mm_and_si128(isOutside, one), _mm_andnot_si128(isOutside, verdict));
+            verdict = _mm_packus_epi16(_mm_packs_epi32(verdict, verdict), verdict);
+            const int packed = _mm_cvtsi128_si32(verdict);
+            std::memcpy(&verdicts[i], &packed, 4);
+        }
+#else
+        for (size_t i = first; i < last; ++i)
+        {
+            const glm::vec3 center(CX[i], CY[i], CZ[i]);
+            MeshletVerdict verdict = MESHLET_DRAWN;
+            for (const glm::vec4 &plane : view.Planes)
+                if (glm::dot(glm::vec3(plane), center) + plane.w < -R[i])
+                    verdict = MESHLET_OUTSIDE;
+            if (verdict == MESHLET_DRAWN && view.Cones)
+            {
+                const glm::vec3 toApex = glm::vec3(PX[i], PY[i], PZ[i]) - view.Eye;
+                if (glm::dot(toApex, glm::vec3(AX[i], AY[i], AZ[i])) >= CUT[i] * glm::length(toApex))
+                    verdict = MESHLET_BACKFACING;
+            }
+            if (verdict == MESHLET_DRAWN)
+            {
+                const float distance = glm::length(center - view.Eye);
+                if (distance > R[i] && R[i] * view.SizeScale < distance)
+                    verdict = MESHLET_SMALL;
+            }
+            verdicts[i] = verdict;
+        }
+#endif
+    }
+
+    // the survivors into runs of indices, the rejected into the stats
+    void merge()
+    {
+        for (DrawRanges &subMesh : ranges)
+        {
+            subMesh.Counts.clear();
+            subMesh.Offsets.clear();
+        }
+        Frame = MeshletStats();
+        Frame.Meshlets = meshlets.size();
+        const Meshlet *previous = nullptr;      // the last one drawn
+        for (size_t i = 0; i < meshlets.size(); ++i)
+        {
+            const Meshlet &meshlet = meshlets[i];
+            Frame.Triangles += meshlet.TriangleCount;
+            switch (verdicts[i])
+            {
+            case MESHLET_OUTSIDE: Frame.Outside += meshlet.TriangleCount; continue;
+            case MESHLET_BACKFACING: Frame.Backfacing += meshlet.TriangleCount; continue;
+            case MESHLET_SMALL: Frame.Small += meshlet.TriangleCount; continue;
+            case MESHLET_DRAWN: break;
+            }
+            DrawRanges &subMesh = ranges[std::min<size_t>(meshlet.SubMesh, ranges.size() - 1)];
+            if (previous && previous->SubMesh == meshlet.SubMesh && previous->IndexOffset + previous->TriangleCount * 3 == meshlet.IndexOffset)
+                subMesh.Counts.back() += (GLsizei)meshlet.TriangleCount * 3;
+            else
+            {
+                subMesh.Counts.push_back((GLsizei)meshlet.TriangleCount * 3);
+                subMesh.Offsets.push_back((const void*)((size_t)meshlet.IndexOffset * sizeof(uint32_t)));
+                ++Frame.Ranges;
+            }
+            previous = &meshlet;
+        }
+    }
+};
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define NORMAL_MATRIX_SSE 1
+#include <immintrin.h>
+#endif
+
+// What normals are transformed by: the inverse transpose of a model matrix's upper 3x3, which
+// keeps them perpendicular to their surface under non-uniform scale. Stored the way std140
+// lays out a mat3, three vec4 columns with w unused, so it goes into the Object block and the
+// instance buffers as it is.
+struct NormalMatrix {
+    glm::vec4 Columns[3];
+};
+static_assert(sizeof(NormalMatrix) == 48, "NormalMatrix must match the std140 layout of a mat3");
+
+// Normal matrices computed on the CPU, once per object, instead of an inverse per vertex in the
+// vertex shader. With a, b, c the columns of the upper 3x3 the inverse transpose is
+//
+//     [ b x c, c x a, a x b ] / det,   det = a . (b x c)
+//
+// which compute() evaluates four matrices at a time with SSE: the columns of four models are
+// transposed into one register per component, the cross products and determinants are plain
+// multiplies and subtracts across the lanes, and the results are transposed back. The rest (and
+// every matrix without SSE) goes through glm. A singular matrix leaves its cofactors unscaled;
+// the shaders normalize the normal anyway.
+class NormalMatrices
+{
+public:
+    static NormalMatrix compute(const glm::mat4 &model)
+    {
+        const glm::vec3 a(model[0]), b(model[1]), c(model[2]);
+        const glm::vec3 bc = glm::cross(b, c), ca = glm::cross(c, a), ab = glm::cross(a, b);
+        const float det = glm::dot(a, bc);
+        const float scale = det != 0.0f ? 1.0f / det : 1.0f;
+        NormalMatrix normal;
+        normal.Columns[0] = glm::vec4(bc * scale, 0.0f);
+        normal.Columns[1] = glm::vec4(ca * scale, 0.0f);
+        normal.Columns[2] = glm::vec4(ab * scale, 0.0f);
+        return normal;
+    }
+
+    // count matrices; the strides are in bytes, so models and normals can be members of arrays
+    // of structs (InstanceData, ObjectBlock), even of the same one
+    static void compute(const glm::mat4 *models, size_t modelStride, NormalMatrix *normals, size_t normalStride, size_t count)
+    {
+        const char *in = reinterpret_cast<const char*>(models);
+        char *out = reinterpret_cast<char*>(normals);
+        size_t i = 0;
+#ifdef NORMAL_MATRIX_SSE
+        for (; i + 4 <= count; i += 4)
+        {
+            const float *m[4];
+            for (int lane = 0; lane < 4; ++lane)
+                m[lane] = reinterpret_cast<const float*>(in + (i + lane) * modelStride);
+            __m128 ax = _mm_loadu_ps(m[0]), ay = _mm_loadu_ps(m[1]), az = _mm_loadu_ps(m[2]), aw = _mm_loadu_ps(m[3]);
+            __m128 bx = _mm_loadu_ps(m[0] + 4), by = _mm_loadu_ps(m[1] + 4), bz = _mm_loadu_ps(m[2] + 4), bw = _mm_loadu_ps(m[3] + 4);
+            __m128 cx = _mm_loadu_ps(m[0] + 8), cy = _mm_loadu_ps(m[1] + 8), cz = _mm_loadu_ps(m[2] + 8), cw = _mm_loadu_ps(m[3] + 8);
+            _MM_TRANSPOSE4_PS(ax, ay, az, aw);
+            _MM_TRANSPOSE4_PS(bx, by, bz, bw);
+            _MM_TRANSPOSE4_PS(cx, cy, cz, cw);
+
+            __m128 bcx = _mm_sub_ps(_mm_mul_ps(by, cz), _mm_mul_ps(bz, cy));
+            __m128 bcy = _mm_sub_ps(_mm_mul_ps(bz, cx), _mm_mul_ps(bx, cz));
+            __m128 bcz = _mm_sub_ps(_mm_mul_ps(bx, cy), _mm_mul_ps(by, cx));
+            __m128 cax = _mm_sub_ps(_mm_mul_ps(cy, az), _mm_mul_ps(cz, ay));
+            __m128 cay = _mm_sub_ps(_mm_mul_ps(cz, ax), _mm_mul_ps(cx, az));
+            __m128 caz = _mm_sub_ps(_mm_mul_ps(cx, ay), _mm_mul_ps(cy, ax));
+            __m128 abx = _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(az, by));
+            __m128 aby = _mm_sub_ps(_mm_mul_ps(az, bx), _mm_mul_ps(ax, bz));
+            __m128 abz = _mm_sub_ps(_mm_mul_ps(ax, by), _mm_mul_ps(ay, bx));
+            const __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bcx), _mm_mul_ps(ay, bcy)), _mm_mul_ps(az, bcz));
+            const __m128 singular = _mm_cmpeq_ps(det, _mm_setzero_ps());
+            const __m128 one = _mm_set1_ps(1.0f);
+            const __m128 scale = _mm_div_ps(one, _mm_or_ps(_mm_and_ps(singular, one), _mm_andnot_ps(singular, det)));
+            bcx = _mm_mul_ps(bcx, scale); bcy = _mm_mul_ps(bcy, scale); bcz = _mm_mul_ps(bcz, scale);
+            cax = _mm_mul_ps(cax, scale); cay = _mm_mul_ps(cay, scale); caz = _mm_mul_ps(caz, scale);
+            abx = _mm_mul_ps(abx, scale); aby = _mm_mul_ps(aby, scale); abz = _mm_mul_ps(abz, scale);
+
+            __m128 bcw = _mm_setzero_ps(), caw = _mm_setzero_ps(), abw = _mm_setzero_ps();
+            _MM_TRANSPOSE4_PS(bcx, bcy, bcz, bcw);
+            _MM_TRANSPOSE4_PS(cax, cay, caz, caw);
+            _MM_TRANSPOSE4_PS(abx, aby, abz, abw);
+            const __m128 columns[3][4] = { { bcx, bcy, bcz, bcw }, { cax, cay, caz, caw }, { abx, aby, abz, abw } };
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                float *n = reinterpret_cast<float*>(out + (i + lane) * normalStride);
+                _mm_storeu_ps(n, columns[0][lane]);
+                _mm_storeu_ps(n + 4, columns[1][lane]);
+                _mm_storeu_ps(n + 8, columns[2][lane]);
+            }
+        }
+#endif
+        for (; i < count; ++i)
+            *reinterpret_cast<NormalMatrix*>(out + i * normalStride) = compute(*reinterpret_cast<const glm::mat4*>(in + i * modelStride));
+    }
+};
@@ -0,0 +1,533 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "mesh_data.h"
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Face corner after parsing: 0-based indices into the position/uv/normal pools, -1 when absent
+struct ObjIndex {
+    int32_t Position;
+    int32_t TexCoord;
+    int32_t Normal;
+};
+
+// First triangle drawn with a material (triangles up to the next range's start use it)
+struct ObjMaterialRange {
+    uint32_t FirstTriangle;
+    std::string Material;
+};
+
+// Raw OBJ contents: shared attribute pools plus triangulated corners referencing them
+struct ObjData {
+    std::vector<glm::vec3> Positions;
+    std::vector<glm::vec3> Normals;
+    std::vector<glm::vec2> TexCoords;
+    std::vector<ObjIndex> Corners;                 // 3 per triangle
+    std::vector<ObjMaterialRange> MaterialRanges;
+    std::vector<std::string> MaterialLibraries;    // mtllib names, relative to the OBJ
+};
+
+// One "newmtl" block of an MTL file; map paths are relative to the MTL file
+struct ObjMaterial {
+    std::string Name;
+    glm::vec3 Ambient = glm::vec3(0.0f);
+    glm::vec3 Diffuse = glm::vec3(0.8f);
+    glm::vec3 Specular = glm::vec3(0.0f);
+    glm::vec3 Emission = glm::vec3(0.0f);
+    float Shininess = 0.0f;
+    float Opacity = 1.0f;
+    std::string DiffuseMap;
+    std::string SpecularMap;
+    std::string NormalMap;
+};
+
+// Wavefront OBJ/MTL loader. The file is memory-mapped and split into newline-aligned chunks
+// that are parsed concurrently with std::from_chars straight out of the mapping: no getline,
+// no per-line strings. Chunks are then merged into the shared position/normal/uv pools, with
+// relative (negative) indices resolved against each chunk's starting counts; triangles with a
+// position index that still doesn't resolve are dropped.
+class ObjLoader
+{
+public:
+    // chunks smaller than this aren't worth a thread
+    static const size_t MIN_CHUNK_BYTES = 256 * 1024;
+
+    // parses into ObjData; threads == 0 picks hardware_concurrency()
+    static bool parse(const std::string &path, ObjData &obj, unsigned threads = 0)
+    {
+        MappedFile file(path);
+        if (!file.isOpen())
+        {
+            std::cout << "ERROR::OBJ::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+            return false;
+        }
+        const char *begin = reinterpret_cast<const char*>(file.data());
+        const char *end = begin + file.size();
+
+        if (threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        const size_t maxChunks = std::max<size_t>(1, file.size() / MIN_CHUNK_BYTES);
+        const size_t chunkCount = std::min<size_t>(threads, maxChunks);
+
+        // newline-aligned split points
+        std::vector<const char*> bounds(chunkCount + 1, end);
+        bounds[0] = begin;
+        for (size_t i = 1; i < chunkCount; ++i)
+        {
+            const char *p = std::max(begin + file.size() * i / chunkCount, bounds[i - 1]);
+            while (p < end && *p != '\n')
+                ++p;
+            bounds[i] = p < end ? p + 1 : end;
+        }
+
+        std::vector<Chunk> chunks(chunkCount);
+        if (chunkCount == 1)
+            parseChunk(bounds[0], bounds[1], chunks[0]);
+        else
+        {
+            std::vector<std::thread> workers;
+            for (size_t i = 0; i < chunkCount; ++i)
+                workers.emplace_back(parseChunk, bounds[i], bounds[i + 1], std::ref(chunks[i]));
+            for (std::thread &worker : workers)
+                worker.join();
+        }
+        const size_t dropped = merge(chunks, obj);
+        if (dropped)
+            std::cout << "ERROR::OBJ::FACE_INDEX_OUT_OF_RANGE: dropped " << dropped << " triangles of " << path << std::endl;
+        return true;
+    }
+
+    // welds identical v/vt/vn triples into an indexed MeshData, one SubMeshRange per usemtl
+    static void buildMesh(const ObjData &obj, MeshData &mesh)
+    {
+        mesh = MeshData();
+        mesh.Indices.resize(obj.Corners.size());
+        mesh.Vertices.reserve(obj.Corners.size() / 2);
+
+        // open-addressing table keyed on the corner triple, sized once up front
+        size_t capacity = 16;
+        while (capacity < obj.Corners.size() * 2)
+            capacity <<= 1;
+        std::vector<uint32_t> slots(capacity, UINT32_MAX);
+        std::vector<ObjIndex> slotKeys(capacity);
+        for (size_t i = 0; i < obj.Corners.size(); ++i)
+        {
+            const ObjIndex &c = obj.Corners[i];
+            size_t slot = hashCorner(c) & (capacity - 1);
+            while (slots[slot] != UINT32_MAX && !sameCorner(slotKeys[slot], c))
+                slot = (slot + 1) & (capacity - 1);
+            if (slots[slot] == UINT32_MAX)
+            {
+                Vertex vertex;
+                vertex.Position = obj.Positions[c.Position];
+                vertex.Normal = c.Normal >= 0 ? obj.Normals[c.Normal] : glm::vec3(0.0f);
+                vertex.TexCoords = c.TexCoord >= 0 ? obj.TexCoords[c.TexCoord] : glm::vec2(0.0f);
+                slots[slot] = (uint32_t)mesh.Vertices.size();
+                slotKeys[slot] = c;
+                mesh.Vertices.push_back(vertex);
+            }
+            mesh.Indices[i] = slots[slot];
+        }
+
+        const uint32_t triangleCount = (uint32_t)(obj.Corners.size() / 3);
+        for (size_t i = 0; i < obj.MaterialRanges.size(); ++i)
+        {
+            const uint32_t first = obj.MaterialRanges[i].FirstTriangle;
+            const uint32_t last = i + 1 < obj.MaterialRanges.size() ? obj.MaterialRanges[i + 1].FirstTriangle : triangleCount;
+            if (last <= first)
+                continue;
+            SubMeshRange range;
+            range.IndexOffset = first * 3;
+            range.IndexCount = (last - first) * 3;
+            range.setMaterial(obj.MaterialRanges[i].Material);
+            mesh.SubMeshes.push_back(range);
+        }
+    }
+
+    static bool load(const std::string &path, MeshData &mesh, unsigned threads = 0)
+    {
+        ObjData obj;
+        if (!parse(path, obj, threads))
+            return false;
+        buildMesh(obj, mesh);
+        if (obj.Normals.empty())
+            generateNormals(mesh);
+        return true;
+    }
+
+    // parses an MTL file; unknown statements are ignored
+    static bool loadMaterials(const std::string &path, std::vector<ObjMaterial> &materials)
+    {
+        MappedFile file(path);
+        if (!file.isOpen())
+        {
+            std::cout << "ERROR::MTL::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+            return false;
+        }
+        const char *p = reinterpret_cast<const char*>(file.data());
+        const char *end = p + file.size();
+        ObjMaterial *current = nullptr;
+        while (p < end)
+        {
+            const char *lineEnd = findLineEnd(p, end);
+            const char *q = skipSpaces(p, lineEnd);
+            std::string_view keyword = token(q, lineEnd);
+            if (keyword == "newmtl")
+            {
+                materials.emplace_back();
+                current = &materials.back();
+                current->Name = std::string(restOfLine(q, lineEnd));
+            }
+            else if (current)
+            {
+                if (keyword == "Ka") current->Ambient = parseVec3(q, lineEnd);
+                else if (keyword == "Kd") current->Diffuse = parseVec3(q, lineEnd);
+                else if (keyword == "Ks") current->Specular = parseVec3(q, lineEnd);
+                else if (keyword == "Ke") current->Emission = parseVec3(q, lineEnd);
+                else if (keyword == "Ns") current->Shininess = parseFloat(q, lineEnd);
+                else if (keyword == "d") current->Opacity = parseFloat(q, lineEnd);
+                else if (keyword == "map_Kd") current->DiffuseMap = std::string(restOfLine(q, lineEnd));
+                else if (keyword == "map_Ks") current->SpecularMap = std::string(restOfLine(q, lineEnd));
+                else if (keyword == "map_Bump" || keyword == "map_bump" || keyword == "bump" || keyword == "norm")
+                    current->NormalMap = std::string(restOfLine(q, lineEnd));
+            }
+            p = lineEnd < end ? lineEnd + 1 : end;
+        }
+        return true;
+    }
+
+    // loads every mtllib referenced by the OBJ, resolving paths against the OBJ's directory
+    static std::vector<ObjMaterial> loadMaterials(const std::string &objPath, const ObjData &obj)
+    {
+        std::vector<ObjMaterial> materials;
+        const std::filesystem::path directory = std::filesystem::path(objPath).parent_path();
+        for (const std::string &library : obj.MaterialLibraries)
+            loadMaterials((directory / library).string(), materials);
+        return materials;
+    }
+
+    // area-weighted smooth normals for files that don't provide any
+    static void generateNormals(MeshData &mesh)
+    {
+        for (Vertex &v : mesh.Vertices)
+            v.Normal = glm::vec3(0.0f);
+        for (size_t i = 0; i + 2 < mesh.Indices.size(); i += 3)
+        {
+            Vertex &a = mesh.Vertices[mesh.Indices[i]];
+            Vertex &b = mesh.Vertices[mesh.Indices[i + 1]];
+            Vertex &c = mesh.Vertices[mesh.Indices[i + 2]];
+            glm::vec3 n = glm::cross(b.Position - a.Position, c.Position - a.Position);
+            a.Normal += n;
+            b.Normal += n;
+            c.Normal += n;
+        }
+        for (Vertex &v : mesh.Vertices)
+        {
+            float len = glm::length(v.Normal);
+            v.Normal = len > 0.0f ? v.Normal / len : glm::vec3(0.0f, 1.0f, 0.0f);
+        }
+    }
+
+private:
+    // Relative indices can't be resolved until the chunk's global offsets are known, so they
+    // are stored as (local count + index) - RELATIVE_BIAS, which keeps them negative
+    static const int32_t RELATIVE_BIAS = 1 << 30;
+    static const int32_t MISSING = INT32_MIN;
+
+    struct MaterialEvent {
+        uint32_t FirstTriangle;
+        std::string_view Name;
+    };
+
+    struct Chunk {
+        std::vector<glm::vec3> Positions;
+        std::vector<glm::vec3> Normals;
+        std::vector<glm::vec2> TexCoords;
+        std::vector<ObjIndex> Corners;
+        std::vector<MaterialEvent> Materials;
+        std::vector<std::string_view> Libraries;
+    };
+
+    static void parseChunk(const char *p, const char *end, Chunk &chunk)
+    {
+        // rough guess from typical line lengths, so the pools rarely reallocate
+        const size_t estimatedLines = (size_t)(end - p) / 24;
+        chunk.Positions.reserve(estimatedLines / 2);
+        chunk.Corners.reserve(estimatedLines);
+
+        std::vector<ObjIndex> polygon;
+        polygon.reserve(64);
+        while (p < end)
+        {
+            const char *lineEnd = findLineEnd(p, end);
+            const char *q = skipSpaces(p, lineEnd);
+            if (q < lineEnd && *q != '#')
+            {
+                std::string_view keyword = token(q, lineEnd);
+                if (keyword == "v")
+                    chunk.Positions.push_back(parseVec3(q, lineEnd));
+                else if (keyword == "vn")
+                    chunk.Normals.push_back(parseVec3(q, lineEnd));
+                else if (keyword == "vt")
+                {
+                    glm::vec2 t;
+                    t.x = parseFloat(q, lineEnd);
+                    t.y = parseFloat(q, lineEnd);
+                    chunk.TexCoords.push_back(t);
+                }
+                else if (keyword == "f")
+                {
+                    ObjIndex corner;
+                    polygon.clear();
+                    while (parseCorner(q, lineEnd, chunk, corner))
+                        polygon.push_back(corner);
+                    for (size_t i = 2; i < polygon.size(); ++i)
+                    {
+                        chunk.Corners.push_back(polygon[0]);
+                        chunk.Corners.push_back(polygon[i - 1]);
+                        chunk.Corners.push_back(polygon[i]);
+                    }
+                }
+                else if (keyword == "usemtl")
+                    chunk.Materials.push_back({ (uint32_t)(chunk.Corners.size() / 3), restOfLine(q, lineEnd) });
+                else if (keyword == "mtllib")
+                    chunk.Libraries.push_back(restOfLine(q, lineEnd));
+            }
+            p = lineEnd < end ? lineEnd + 1 : end;
+        }
+    }
+
+    // returns how many triangles were dropped for a position index that doesn't resolve
+    static size_t merge(std::vector<Chunk> &chunks, ObjData &obj)
+    {
+        obj = ObjData();
+        // prefix sums give every chunk its slice of the shared pools
+        std::vector<size_t> positionBase(chunks.size() + 1, 0), normalBase(chunks.size() + 1, 0);
+        std::vector<size_t> uvBase(chunks.size() + 1, 0), cornerBase(chunks.size() + 1, 0);
+        for (size_t i = 0; i < chunks.size(); ++i)
+        {
+            positionBase[i + 1] = positionBase[i] + chunks[i].Positions.size();
+            normalBase[i + 1] = normalBase[i] + chunks[i].Normals.size();
+            uvBase[i + 1] = uvBase[i] + chunks[i].TexCoords.size();
+            cornerBase[i + 1] = cornerBase[i] + chunks[i].Corners.size();
+        }
+        obj.Positions.resize(positionBase.back());
+        obj.Normals.resize(normalBase.back());
+        obj.TexCoords.resize(uvBase.back());
+        obj.Corners.resize(cornerBase.back());
+
+        std::vector<size_t> unresolved(chunks.size(), 0);
+        auto copyChunk = [&](size_t i) {
+            Chunk &chunk = chunks[i];
+            std::copy(chunk.Positions.begin(), chunk.Positions.end(), obj.Positions.begin() + positionBase[i]);
+            std::copy(chunk.Normals.begin(), chunk.Normals.end(), obj.Normals.begin() + normalBase[i]);
+            std::copy(chunk.TexCoords.begin(), chunk.TexCoords.end(), obj.TexCoords.begin() + uvBase[i]);
+            ObjIndex *out = obj.Corners.data() + cornerBase[i];
+            for (const ObjIndex &c : chunk.Corners)
+            {
+                out->Position = resolve(c.Position, positionBase[i], obj.Positions.size());
+                out->TexCoord = resolve(c.TexCoord, uvBase[i], obj.TexCoords.size());
+                out->Normal = resolve(c.Normal, normalBase[i], obj.Normals.size());
+                unresolved[i] += out->Position < 0;
+                ++out;
+            }
+        };
+        if (chunks.size() == 1)
+            copyChunk(0);
+        else
+        {
+            std::vector<std::thread> workers;
+            for (size_t i = 0; i < chunks.size(); ++i)
+                workers.emplace_back(copyChunk, i);
+            for (std::thread &worker : workers)
+                worker.join();
+        }
+
+        // material runs: faces at the start of a chunk inherit the previous chunk's last usemtl
+        obj.MaterialRanges.push_back({ 0, std::string() });
+        for (size_t i = 0; i < chunks.size(); ++i)
+        {
+            for (const MaterialEvent &event : chunks[i].Materials)
+            {
+                const uint32_t first = (uint32_t)(cornerBase[i] / 3) + event.FirstTriangle;
+                if (obj.MaterialRanges.back().FirstTriangle == first)
+                    obj.MaterialRanges.back().Material = std::string(event.Name);
+                else
+                    obj.MaterialRanges.push_back({ first, std::string(event.Name) });
+            }
+            for (std::string_view library : chunks[i].Libraries)
+                obj.MaterialLibraries.emplace_back(library);
+        }
+
+        for (size_t count : unresolved)
+            if (count)
+                return dropUnresolvedTriangles(obj);
+        return 0;
+    }
+
+    // removes every triangle with a corner whose position is -1; the material runs after them
+    // move up, and runs left without triangles give way to the next
+    static size_t dropUnresolvedTriangles(ObjData &obj)
+    {
+        const size_t triangleCount = obj.Corners.size() / 3;
+        std::vector<uint32_t> keptBefore(triangleCount + 1);
+        size_t kept = 0;
+        for (size_t t = 0; t < triangleCount; ++t)
+        {
+            keptBefore[t] = (uint32_t)kept;
+            const ObjIndex *corners = obj.Corners.data() + t * 3;
+            if (corners[0].Position < 0 || corners[1].Position < 0 || corners[2].Position < 0)
+                continue;
+            std::copy(corners, corners + 3, obj.Corners.data() + kept * 3);
+            ++kept;
+        }
+        keptBefore[triangleCount] = (uint32_t)kept;
+        obj.Corners.resize(kept * 3);
+
+        std::vector<ObjMaterialRange> ranges;
+        for (ObjMaterialRange &range : obj.MaterialRanges)
+        {
+            range.FirstTriangle = keptBefore[range.FirstTriangle];
+            if (!ranges.empty() && ranges.back().FirstTriangle == range.FirstTriangle)
+                ranges.back().Material = std::move(range.Material);
+            else
+                ranges.push_back(std::move(range));
+        }
+        obj.MaterialRanges = std::move(ranges);
+        return triangleCount - kept;
+    }
+
+    static int32_t resolve(int32_t index, size_t chunkBase, size_t poolSize)
+    {
+        if (index == MISSING)
+            return -1;
+        int64_t global = index >= 0 ? index : (int64_t)index + RELATIVE_BIAS + (int64_t)chunkBase;
+        return global >= 0 && global < (int64_t)poolSize ? (int32_t)global : -1;
+    }
+
+    static const char* findLineEnd(const char *p, const char *end)
+    {
+        const void *newline = std::memchr(p, '\n', (size_t)(end - p));
+        return newline ? static_cast<const char*>(newline) : end;
+    }
+
+    static bool isSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    static const char* skipSpaces(const char *p, const char *end)
+    {
+        while (p < end && isSpace(*p))
+            ++p;
+        return p;
+    }
+
+    // next whitespace-separated token; advances p past it
+    static std::string_view token(const char *&p, const char *end)
+    {
+        p = skipSpaces(p, end);
+        const char *start = p;
+        while (p < end && !isSpace(*p))
+            ++p;
+        return std::string_view(start, (size_t)(p - start));
+    }
+
+    // remainder of the line without surrounding whitespace (names may contain spaces)
+    static std::string_view restOfLine(const char *p, const char *end)
+    {
+        p = skipSpaces(p, end);
+        while (end > p && isSpace(end[-1]))
+            --end;
+        return std::string_view(p, (size_t)(end - p));
+    }
+
+    static float parseFloat(const char *&p, const char *end)
+    {
+        p = skipSpaces(p, end);
+        if (p < end && *p == '+')
+            ++p; // from_chars doesn't accept a leading plus
+        float value = 0.0f;
+        std::from_chars_result result = std::from_chars(p, end, value);
+        p = result.ptr;
+        while (p < end && !isSpace(*p))
+            ++p; // skip suffixes from_chars didn't consume
+        return value;
+    }
+
+    static glm::vec3 parseVec3(const char *&p, const char *end)
+    {
+        glm::vec3 v;
+        v.x = parseFloat(p, end);
+        v.y = parseFloat(p, end);
+        v.z = parseFloat(p, end);
+        return v;
+    }
+
+    static int32_t parseIndex(const char *&p, const char *end, size_t localCount)
+    {
+        int32_t value = 0;
+        std::from_chars_result result = std::from_chars(p, end, value);
+        if (result.ptr == p)
+            return MISSING;
+        p = result.ptr;
+        if (value > 0)
+            return value - 1;
+        if (value < 0)
+            return (int32_t)localCount + value - RELATIVE_BIAS;
+        return MISSING;
+    }
+
+    // "v", "v/vt", "v//vn" or "v/vt/vn"
+    static bool parseCorner(const char *&p, const char *end, const Chunk &chunk, ObjIndex &corner)
+    {
+        p = skipSpaces(p, end);
+        if (p >= end)
+            return false;
+        corner.Position = parseIndex(p, end, chunk.Positions.size());
+        corner.TexCoord = MISSING;
+        corner.Normal = MISSING;
+        if (corner.Position == MISSING)
+            return false;
+        if (p < end && *p == '/')
+        {
+            ++p;
+            if (p < end && *p != '/')
+                corner.TexCoord = parseIndex(p, end, chunk.TexCoords.size());
+            if (p < end && *p == '/')
+            {
+                ++p;
+                corner.Normal = parseIndex(p, end, chunk.Normals.size());
+            }
+        }
+        while (p < end && !isSpace(*p))
+            ++p;
+        return true;
+    }
+
+    static size_t hashCorner(const ObjIndex &c)
+    {
+        uint64_t h = (uint32_t)c.Position * 0x9E3779B97F4A7C15ull;
+        h ^= ((uint32_t)c.TexCoord + 0x632BE59BD9B4E019ull) * 0xC2B2AE3D27D4EB4Full;
+        h ^= ((uint32_t)c.Normal + 0x85EBCA77C2B2AE63ull) * 0x165667B19E3779F9ull;
+        return (size_t)(h ^ (h >> 29));
+    }
+
+    static bool sameCorner(const ObjIndex &a, const ObjIndex &b)
+    {
+        return a.Position == b.Position && a.TexCoord == b.TexCoord && a.Normal == b.Normal;
+    }
+};
@@ -0,0 +1,372 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "aabb_tree.h"
+#include "profiler.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define OCCLUSION_BUFFER_SSE 1
+#include <immintrin.h>
+#endif
+
+// What one frame of occlusion culling cost and found
+struct OcclusionStats {
+    size_t Triangles = 0;               // occluder triangles rasterized, after clipping
+    size_t Tested = 0;                  // boxes passed to cull()
+    size_t Occluded = 0;                // of those, hidden behind the occluders
+    double RasterMicroseconds = 0.0;    // CPU, from begin() to the last tile being done
+    double TestMicroseconds = 0.0;      // CPU, all of cull()
+};
+
+// A small software depth buffer for occlusion culling. A few low-poly occluders are drawn into
+// it on the CPU every frame, then the screen-space bounds of every object the frustum let
+// through are tested against it; an object whose bounds are behind the occluders at every
+// pixel they touch is not submitted at all.
+//
+// The buffer holds 1/w, which is linear in screen space (so a triangle's depth is a plane) and
+// grows towards the camera; it clears to 0, infinitely far. Triangles are clipped against the
+// near plane and a guard band, binned into TILE_SIZE x TILE_SIZE tiles, and every tile is
+// rasterized by a job of its own: edge functions and depth are stepped four pixels at a time
+// with SSE, and the tile keeps its farthest depth so most boxes are settled without reading a
+// pixel. Occluders are rasterized conservatively: a pixel is written only when the triangle
+// covers all of it, with the triangle's farthest depth over it, so a box is never hidden by an
+// occluder that misses part of a pixel. Pixels straddling an edge shared by two occluder
+// triangles are left empty, which costs some culling but never correctness.
+class OcclusionBuffer
+{
+public:
+    static const int TILE_SIZE = 32;    // pixels, a multiple of 4
+    // clip space |x|, |y| beyond this many times w are clipped away, keeping screen
+    // coordinates small enough for the edge functions to stay exact in float
+    static constexpr float GUARD_BAND = 2.0f;
+
+    OcclusionStats Frame;
+
+    // width and height are rounded up to whole tiles; pool runs the tiles, and the calling
+    // thread joins in while waiting for them
+    OcclusionBuffer(ThreadPool &pool, int width = 256, int height = 192)
+        : pool(pool), tilesX((width + TILE_SIZE - 1) / TILE_SIZE), tilesY((height + TILE_SIZE - 1) / TILE_SIZE),
+          width(tilesX * TILE_SIZE), height(tilesY * TILE_SIZE)
+    {
+        depth.assign((size_t)width * height, 0.0f);
+        tileFarthest.assign((size_t)tilesX * tilesY, 0.0f);
+        bins.resize((size_t)tilesX * tilesY);
+    }
+
+    OcclusionBuffer(const OcclusionBuffer&) = delete;
+    OcclusionBuffer& operator=(const OcclusionBuffer&) = delete;
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    // the rasterized 1/w, bottom row first like glReadPixels
+    const std::vector<float>& getDepth() const { return depth; }
+
+    // starts a frame seen through viewProjection; occluders follow, then rasterize()
+    void begin(const glm::mat4 &viewProjection)
+    {
+        start = std::chrono::steady_clock::now();
+        this->viewProjection = viewProjection;
+        triangles.clear();
+        for (std::vector<uint32_t> &bin : bins)
+            bin.clear();
+        Frame = OcclusionStats();
+    }
+
+    // bins the indexed triangles of positions placed by model; either winding occludes
+    void addOccluder(const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &indices, const glm::mat4 &model)
+    {
+        const glm::mat4 transform = viewProjection * model;
+        clipped.resize(positions.size());
+        for (size_t i = 0; i < positions.size(); ++i)
+            clipped[i] = transform * glm::vec4(positions[i], 1.0f);
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            const glm::vec4 corners[3] = { clipped[indices[i]], clipped[indices[i + 1]], clipped[indices[i + 2]] };
+            // trivially out when all three are beyond the same plane, trivially in when none
+            // is beyond any
+            unsigned int all = ~0u, any = 0;
+            for (const glm::vec4 &c : corners)
+            {
+                const unsigned int outcode = outside(c);
+                all &= outcode;
+                any |= outcode;
+            }
+            if (all)
+                continue;
+            if (!any)
+            {
+                addTriangle(corners[0], corners[1], corners[2]);
+                continue;
+            }
+            // fan out of the polygon left after clipping against every plane it crosses
+            polygon.assign(corners, corners + 3);
+            for (unsigned int plane = 0; plane < PLANES && polygon.size() >= 3; ++plane)
+                if (any & (1u << plane))
+                    clip(plane);
+            for (size_t v = 2; v < polygon.size(); ++v)
+                addTriangle(polygon[0], polygon[v - 1], polygon[v]);
+        }
+    }
+
+    // draws the binned occluders, one job per tile
+    void rasterize()
+    {
+        PROFILE_ZONE("rasterize occluders");
+        JobCounter done;
+        for (int tile = 0; tile < tilesX * tilesY; ++tile)
+            pool.submit([this, tile] { rasterizeTile(tile); }, &done);
+        pool.wait(done);
+        Frame.Triangles = triangles.size();
+        Frame.RasterMicroseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // false when box is behind the occluders wherever it is on screen. Boxes reaching in
+    // front of the near plane, and those entirely off screen (left to frustum culling), are
+    // visible
+    bool visible(const AABB &box) const
+    {
+        float minX = INFINITY, minY = INFINITY, maxX = -INFINITY, maxY = -INFINITY, nearest = 0.0f;
+        for (int corner = 0; corner < 8; ++corner)
+        {
+            const glm::vec3 point((corner & 1) ? box.Max.x : box.Min.x, (corner & 2) ? box.Max.y : box.Min.y, (corner & 4) ? box.Max.z : box.Min.z);
+            const glm::vec4 clip = viewProjection * glm::vec4(point, 1.0f);
+            if (clip.z < -clip.w)
+                return true;
+            const float invW = 1.0f / clip.w;
+            const glm::vec2 screen = toScreen(clip, invW);
+            minX = std::min(minX, screen.x);
+            maxX = std::max(maxX, screen.x);
+            minY = std::min(minY, screen.y);
+            maxY = std::max(maxY, screen.y);
+            nearest = std::max(nearest, invW);
+        }
+        // every pixel the projected box touches
+        const int x0 = std::max(0, (int)std::floor(minX)), x1 = std::min(width - 1, (int)std::floor(maxX));
+        const int y0 = std::max(0, (int)std::floor(minY)), y1 = std::min(height - 1, (int)std::floor(maxY));
+        if (x0 > x1 || y0 > y1)
+            return true;
+
+        // tiles whose farthest pixel is nearer than the box's nearest point hide it whole
+        bool covered = true;
+        for (int ty = y0 / TILE_SIZE; ty <= y1 / TILE_SIZE && covered; ++ty)
+            for (int tx = x0 / TILE_SIZE; tx <= x1 / TILE_SIZE && covered; ++tx)
+                covered = tileFarthest[ty * tilesX + tx] > nearest;
+        if (covered)
+            return false;
+
+        for (int y = y0; y <= y1; ++y)
+        {
+            const float *row = depth.data() + (size_t)y * width;
+            int x = x0;
+#ifdef OCCLUSION_BUFFER_SSE
+            const __m128 boxDepth = _mm_set1_ps(nearest);
+            for (; x + 3 <= x1; x += 4)
+                if (_mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(row + x), boxDepth)))
+                    return true;
+#endif
+            for (; x <= x1; ++x)
+                if (row[x] <= nearest)
+                    return true;
+        }
+        return false;
+    }
+
+    // removes the ids whose bounds(id) visible() rejects, keeping the others in order
+    template <typename Bounds>
+    void cull(std::vector<uint32_t> &ids, const Bounds &bounds)
+    {
+        PROFILE_ZONE("occlusion test");
+        const auto testStart = std::chrono::steady_clock::now();
+        Frame.Tested += ids.size();
+        const size_t before = ids.size();
+        ids.erase(std::remove_if(ids.begin(), ids.end(), [this, &bounds](uint32_t id) { return !visible(bounds(id)); }), ids.end());
+        Frame.Occluded += before - ids.size();
+        Frame.TestMicroseconds += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - testStart).count();
+    }
+
+private:
+    // -x, +x, -y, +y (guard band) and near
+    static const unsigned int PLANES = 5;
+
+    // edge functions A x + B y + C, non-negative where the whole pixel is inside, and the
+    // farthest 1/w over the pixel, both evaluated at pixel centres
+    struct Triangle {
+        float EdgeA[3], EdgeB[3], EdgeC[3];
+        float DepthA, DepthB, DepthC;
+        int MinX, MinY, MaxX, MaxY;     // pixel bounds, clamped to the buffer
+    };
+
+    ThreadPool &pool;
+    int tilesX, tilesY;
+    int width, height;
+    std::vector<float> depth;
+    std::vector<float> tileFarthest;    // smallest 1/w of each tile
+    std::vector<std::vector<uint32_t>> bins;
+    std::vector<Triangle> triangles;
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    std::vector<glm::vec4> clipped, polygon, scratch;
+    std::chrono::steady_clock::time_point start;
+
+    static float distance(const glm::vec4 &c, unsigned int plane)
+    {
+        switch (plane)
+        {
+        case 0: return GUARD_BAND * c.w + c.x;
+        case 1: return GUARD_BAND * c.w - c.x;
+        case 2: return GUARD_BAND * c.w + c.y;
+        case 3: return GUARD_BAND * c.w - c.y;
+        default: return c.w + c.z;
+        }
+    }
+
+    static unsigned int outside(const glm::vec4 &c)
+    {
+        unsigned int outcode = 0;
+        for (unsigned int plane = 0; plane < PLANES; ++plane)
+            outcode |= (distance(c, plane) < 0.0f) << plane;
+        return outcode;
+    }
+
+    // Sutherland-Hodgman: keeps the part of polygon on the inner side of plane
+    void clip(unsigned int plane)
+    {
+        scratch.clear();
+        for (size_t i = 0; i < polygon.size(); ++i)
+        {
+            const glm::vec4 &a = polygon[i], &b = polygon[(i + 1) % polygon.size()];
+            const float da = distance(a, plane), db = distance(b, plane);
+            if (da >= 0.0f)
+                scratch.push_back(a);
+            if ((da >= 0.0f) != (db >= 0.0f))
+                scratch.push_back(glm::mix(a, b, da / (da - db)));
+        }
+        polygon.swap(scratch);
+    }
+
+    glm::vec2 toScreen(const glm::vec4 &clip, float invW) const
+    {
+        return glm::vec2((clip.x * invW * 0.5f + 0.5f) * width, (clip.y * invW * 0.5f + 0.5f) * height);
+    }
+
+    // sets up the edge and depth planes of a clipped triangle and bins it
+    void addTriangle(const glm::vec4 &c0, const glm::vec4 &c1, const glm::vec4 &c2)
+    {
+        const float z[3] = { 1.0f / c0.w, 1.0f / c1.w, 1.0f / c2.w };
+        glm::vec2 v[3] = { toScreen(c0, z[0]), toScreen(c1, z[1]), toScreen(c2, z[2]) };
+        float zv[3] = { z[0], z[1], z[2] };
+        float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+        if (std::fabs(area) < 1e-6f)
+            return;
+        if (area < 0.0f)
+        {
+            // counter-clockwise from here on, so inside is where every edge function is positive
+            std::swap(v[1], v[2]);
+            std::swap(zv[1], zv[2]);
+            area = -area;
+        }
+
+        Triangle triangle;
+        for (int e = 0; e < 3; ++e)
+        {
+            const glm::vec2 &a = v[e], &b = v[(e + 1) % 3];
+            triangle.EdgeA[e] = a.y - b.y;
+            triangle.EdgeB[e] = b.x - a.x;
+            triangle.EdgeC[e] = -(triangle.EdgeA[e] * a.x + triangle.EdgeB[e] * a.y);
+        }
+        triangle.DepthA = ((zv[1] - zv[0]) * (v[2].y - v[0].y) - (zv[2] - zv[0]) * (v[1].y - v[0].y)) / area;
+        triangle.DepthB = ((zv[2] - zv[0]) * (v[1].x - v[0].x) - (zv[1] - zv[0]) * (v[2].x - v[0].x)) / area;
+        triangle.DepthC = zv[0] - triangle.DepthA * v[0].x - triangle.DepthB * v[0].y;
+        // conservative: the edges move inwards by half a pixel's extent along their normal, so a
+        // pixel centre passes only when the whole pixel is inside, and its depth is the plane's
+        // farthest over the pixel rather than at the centre
+        for (int e = 0; e < 3; ++e)
+            triangle.EdgeC[e] -= 0.5f * (std::fabs(triangle.EdgeA[e]) + std::fabs(triangle.EdgeB[e]));
+        triangle.DepthC -= 0.5f * (std::fabs(triangle.DepthA) + std::fabs(triangle.DepthB));
+
+        const glm::vec2 lower = glm::min(v[0], glm::min(v[1], v[2])), upper = glm::max(v[0], glm::max(v[1], v[2]));
+        triangle.MinX = std::max(0, (int)std::floor(lower.x));
+        triangle.MinY = std::max(0, (int)std::floor(lower.y));
+        triangle.MaxX = std::min(width - 1, (int)std::floor(upper.x));
+        triangle.MaxY = std::min(height - 1, (int)std::floor(upper.y));
+        if (triangle.MinX > triangle.MaxX || triangle.MinY > triangle.MaxY)
+            return;
+
+        const uint32_t index = (uint32_t)triangles.size();
+        triangles.push_back(triangle);
+        for (int ty = triangle.MinY / TILE_SIZE; ty <= triangle.MaxY / TILE_SIZE; ++ty)
+            for (int tx = triangle.MinX / TILE_SIZE; tx <= triangle.MaxX / TILE_SIZE; ++tx)
+                bins[ty * tilesX + tx].push_back(index);
+    }
+
+    // clears one tile, draws the triangles binned to it keeping the nearest depth, and finds
+    // its farthest pixel
+    void rasterizeTile(int tile)
+    {
+        const int tileX0 = (tile % tilesX) * TILE_SIZE, tileY0 = (tile / tilesX) * TILE_SIZE;
+        for (int y = tileY0; y < tileY0 + TILE_SIZE; ++y)
+            std::fill_n(depth.data() + (size_t)y * width + tileX0, TILE_SIZE, 0.0f);
+
+        for (uint32_t index : bins[tile])
+        {
+            const Triangle &t = triangles[index];
+            // whole groups of four inside the tile; the edge functions reject the extra pixels
+            const int x0 = std::max(t.MinX, tileX0) & ~3, x1 = std::min(t.MaxX, tileX0 + TILE_SIZE - 1);
+            const int y0 = std::max(t.MinY, tileY0), y1 = std::min(t.MaxY, tileY0 + TILE_SIZE - 1);
+            for (int y = y0; y <= y1; ++y)
+            {
+                float *row = depth.data() + (size_t)y * width;
+                const float py = y + 0.5f, px = x0 + 0.5f;
+#ifdef OCCLUSION_BUFFER_SSE
+                const __m128 offsets = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+                __m128 edge[3], edgeStep[3];
+                for (int e = 0; e < 3; ++e)
+                {
+                    edge[e] = _mm_add_ps(_mm_set1_ps(t.EdgeA[e] * px + t.EdgeB[e] * py + t.EdgeC[e]), _mm_mul_ps(offsets, _mm_set1_ps(t.EdgeA[e])));
+                    edgeStep[e] = _mm_set1_ps(4.0f * t.EdgeA[e]);
+                }
+                __m128 z = _mm_add_ps(_mm_set1_ps(t.DepthA * px + t.DepthB * py + t.DepthC), _mm_mul_ps(offsets, _mm_set1_ps(t.DepthA)));
+                const __m128 zStep = _mm_set1_ps(4.0f * t.DepthA), zero = _mm_setzero_ps();
+                for (int x = x0; x <= x1; x += 4)
+                {
+                    const __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(edge[0], zero), _mm_cmpge_ps(edge[1], zero)), _mm_cmpge_ps(edge[2], zero));
+                    if (_mm_movemask_ps(inside))
+                    {
+                        const __m128 old = _mm_loadu_ps(row + x);
+                        const __m128 nearer = _mm_max_ps(old, z);
+                        _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+                    }
+                    for (int e = 0; e < 3; ++e)
+                        edge[e] = _mm_add_ps(edge[e], edgeStep[e]);
+                    z = _mm_add_ps(z, zStep);
+                }
+#else
+                for (int x = x0; x <= x1; ++x)
+                {
+                    const float cx = px + (x - x0);
+                    bool inside = true;
+                    for (int e = 0; e < 3 && inside; ++e)
+                        inside = t.EdgeA[e] * cx + t.EdgeB[e] * py + t.EdgeC[e] >= 0.0f;
+                    if (inside)
+                        row[x] = std::max(row[x], t.DepthA * cx + t.DepthB * py + t.DepthC);
+                }
+#endif
+            }
+        }
+
+        float farthest = INFINITY;
+        for (int y = tileY0; y < tileY0 + TILE_SIZE; ++y)
+        {
+            const float *row = depth.data() + (size_t)y * width + tileX0;
+            farthest = std::min(farthest, *std::min_element(row, row + TILE_SIZE));
+        }
+        tileFarthest[tile] = farthest;
+    }
+};
@@ -0,0 +1,304 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include "bvh8.h"
+#include "obj_loader.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct PathTracerMaterial {
+    glm::vec3 Albedo;
+    glm::vec3 Emission;
+};
+
+// Progressive CPU path tracer for the Cornell box in models/cornellbox.
+//
+// The six OBJ files are merged into one SAH BVH, collapsed into an 8-wide RayQuery (bvh8.h).
+// Every renderPass() adds one sample per pixel: the image is cut into TILE_SIZE tiles that run
+// on a work-stealing ThreadPool and accumulate into Accumulation. Surfaces are Lambertian. At
+// every bounce the light (light.obj) is sampled explicitly with a shadow ray (next event
+// estimation), so the small ceiling light converges in a few dozen samples instead of waiting
+// for bounce rays to find it. Paths end with Russian roulette after RUSSIAN_ROULETTE_DEPTH
+// bounces.
+class PathTracer
+{
+public:
+    static const unsigned int TILE_SIZE = 32;
+    static const unsigned int MAX_DEPTH = 16;
+    static const unsigned int RUSSIAN_ROULETTE_DEPTH = 3;
+
+    unsigned int Width, Height;
+    bool Loaded = false;
+    RayQuery Scene;
+    // running sum of samples, bottom row first like an OpenGL texture
+    std::vector<glm::vec3> Accumulation;
+    unsigned int SampleCount = 0;
+    // rays (camera, bounce and shadow) and wall time of the last pass
+    uint64_t LastPassRays = 0;
+    double LastPassSeconds = 0.0;
+
+    PathTracer(unsigned int width, unsigned int height, const std::string &sceneDir = "../models/cornellbox/")
+        : Width(width), Height(height), Accumulation((size_t)width * height, glm::vec3(0.0f))
+    {
+        Loaded = loadScene(sceneDir);
+    }
+
+    // one more sample for every pixel
+    void renderPass(ThreadPool &pool)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        std::atomic<uint64_t> rays(0);
+        for (unsigned int y0 = 0; y0 < Height; y0 += TILE_SIZE)
+            for (unsigned int x0 = 0; x0 < Width; x0 += TILE_SIZE)
+                pool.submit([this, x0, y0, &rays] {
+                    rays.fetch_add(renderTile(x0, y0, std::min(x0 + TILE_SIZE, Width), std::min(y0 + TILE_SIZE, Height)),
+                                   std::memory_order_relaxed);
+                });
+        pool.wait();
+        ++SampleCount;
+        LastPassRays = rays.load();
+        LastPassSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void reset()
+    {
+        std::fill(Accumulation.begin(), Accumulation.end(), glm::vec3(0.0f));
+        SampleCount = 0;
+    }
+
+    double mraysPerSecond() const
+    {
+        return LastPassSeconds > 0.0 ? LastPassRays / LastPassSeconds / 1.0e6 : 0.0;
+    }
+
+    // averaged, clamped and gamma corrected RGBA8, bottom row first
+    void resolve(std::vector<unsigned char> &rgba) const
+    {
+        rgba.resize(Accumulation.size() * 4);
+        const float scale = SampleCount ? 1.0f / SampleCount : 0.0f;
+        for (size_t i = 0; i < Accumulation.size(); ++i)
+        {
+            const glm::vec3 color = glm::pow(glm::clamp(Accumulation[i] * scale, 0.0f, 1.0f), glm::vec3(1.0f / 2.2f));
+            rgba[4 * i + 0] = (unsigned char)(color.r * 255.0f + 0.5f);
+            rgba[4 * i + 1] = (unsigned char)(color.g * 255.0f + 0.5f);
+            rgba[4 * i + 2] = (unsigned char)(color.b * 255.0f + 0.5f);
+            rgba[4 * i + 3] = 255;
+        }
+    }
+
+private:
+    struct Surface {
+        glm::vec3 Normal;
+        uint32_t Material;
+    };
+
+    std::vector<PathTracerMaterial> materials;
+    std::vector<Surface> surfaces;          // per BVH triangle id
+    std::vector<uint32_t> lights;           // triangle ids with emission
+    std::vector<BVHTriangle> lightTriangles; // their geometry, in the same order
+    std::vector<float> lightCdf;            // cumulative light triangle areas
+    float lightArea = 0.0f;
+
+    // the classic Cornell box camera, looking down +z at the open side
+    const glm::vec3 eye = glm::vec3(278.0f, 273.0f, -800.0f);
+    const float fov = 40.0f;
+
+    // PCG hash; one stream per pixel and pass, so images don't depend on tile scheduling
+    struct Random {
+        uint32_t State;
+
+        explicit Random(uint32_t seed) : State(seed) {}
+
+        uint32_t nextUint()
+        {
+            State = State * 747796405u + 2891336453u;
+            uint32_t word = ((State >> ((State >> 28u) + 4u)) ^ State) * 277803737u;
+            return (word >> 22u) ^ word;
+        }
+
+        float next()
+        {
+            return (nextUint() >> 8) * (1.0f / 16777216.0f);
+        }
+    };
+
+    bool loadScene(const std::string &dir)
+    {
+        // no MTL files ship with the box; these are the usual reflectances and light
+        const glm::vec3 white(0.725f, 0.71f, 0.68f), red(0.63f, 0.065f, 0.05f), green(0.14f, 0.45f, 0.091f);
+        const glm::vec3 lightEmission = 8.0f * glm::vec3(0.747f + 0.058f, 0.747f + 0.258f, 0.747f) +
+                                        15.6f * glm::vec3(0.740f + 0.287f, 0.740f + 0.160f, 0.740f) +
+                                        18.4f * glm::vec3(0.737f + 0.642f, 0.737f + 0.159f, 0.737f);
+        struct SceneFile { const char *Name; PathTracerMaterial Material; };
+        const SceneFile files[] = {
+            { "floor.obj",    { white, glm::vec3(0.0f) } },
+            { "shortbox.obj", { white, glm::vec3(0.0f) } },
+            { "tallbox.obj",  { white, glm::vec3(0.0f) } },
+            { "left.obj",     { red,   glm::vec3(0.0f) } },
+            { "right.obj",    { green, glm::vec3(0.0f) } },
+            { "light.obj",    { glm::vec3(0.65f), lightEmission } },
+        };
+
+        std::vector<BVHTriangle> triangles;
+        for (const SceneFile &file : files)
+        {
+            MeshData mesh;
+            if (!ObjLoader::load(dir + file.Name, mesh, 1))
+                return false;
+            const uint32_t material = (uint32_t)materials.size();
+            materials.push_back(file.Material);
+            for (size_t i = 0; i + 2 < mesh.Indices.size(); i += 3)
+            {
+                BVHTriangle triangle = { mesh.Vertices[mesh.Indices[i]].Position, mesh.Vertices[mesh.Indices[i + 1]].Position,
+                                         mesh.Vertices[mesh.Indices[i + 2]].Position };
+                const glm::vec3 cross = glm::cross(triangle.V1 - triangle.V0, triangle.V2 - triangle.V0);
+                const float area = 0.5f * glm::length(cross);
+                if (area <= 0.0f)
+                    continue;
+                if (file.Material.Emission != glm::vec3(0.0f))
+                {
+                    lights.push_back((uint32_t)triangles.size());
+                    lightTriangles.push_back(triangle);
+                    lightArea += area;
+                    lightCdf.push_back(lightArea);
+                }
+                surfaces.push_back({ glm::normalize(cross), material });
+                triangles.push_back(triangle);
+            }
+        }
+        if (lights.empty())
+        {
+            std::cout << "ERROR::PATH_TRACER::NO_LIGHT: " << dir << std::endl;
+            return false;
+        }
+        BVH binary;
+        binary.build(triangles);
+        Scene.build(binary);
+        std::cout << "path tracer: " << triangles.size() << " triangles, " << binary.Nodes.size() << " BVH nodes (SAH cost "
+                  << binary.cost() << "), " << Scene.Nodes.size() << " BVH8 nodes, " << rayQueryPathName(Scene.Path)
+                  << " ray queries" << std::endl;
+        return true;
+    }
+
+    uint64_t renderTile(unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1)
+    {
+        const float aspect = (float)Width / (float)Height;
+        const float tanHalfFov = std::tan(glm::radians(fov) * 0.5f);
+        // camera basis: looking down +z with y up puts +x on the left of the image
+        const glm::vec3 front(0.0f, 0.0f, 1.0f), up(0.0f, 1.0f, 0.0f), right(-1.0f, 0.0f, 0.0f);
+        uint64_t rays = 0;
+        for (unsigned int y = y0; y < y1; ++y)
+        {
+            for (unsigned int x = x0; x < x1; ++x)
+            {
+                const size_t pixel = (size_t)y * Width + x;
+                Random random(hash((uint32_t)pixel * 9781u + SampleCount * 6271u + 1u));
+                const float ndcX = 2.0f * (x + random.next()) / Width - 1.0f;
+                const float ndcY = 2.0f * (y + random.next()) / Height - 1.0f;
+                const glm::vec3 direction = glm::normalize(front + ndcX * tanHalfFov * aspect * right + ndcY * tanHalfFov * up);
+                Accumulation[pixel] += trace(Ray(eye, direction), random, rays);
+            }
+        }
+        return rays;
+    }
+
+    glm::vec3 trace(Ray ray, Random &random, uint64_t &rays) const
+    {
+        glm::vec3 radiance(0.0f), throughput(1.0f);
+        for (unsigned int depth = 0; depth < MAX_DEPTH; ++depth)
+        {
+            RayHit hit;
+            ++rays;
+            if (!Scene.intersect(ray, hit))
+                break;
+            const Surface &surface = surfaces[hit.Triangle];
+            const PathTracerMaterial &material = materials[surface.Material];
+            const bool frontFacing = glm::dot(surface.Normal, ray.Direction) < 0.0f;
+            if (material.Emission != glm::vec3(0.0f))
+            {
+                // light reached by a bounce was already counted by the explicit light sample
+                if (depth == 0 && frontFacing)
+                    radiance += throughput * material.Emission;
+                break;
+            }
+
+            const glm::vec3 normal = frontFacing ? surface.Normal : -surface.Normal;
+            const glm::vec3 position = ray.Origin + hit.T * ray.Direction + normal * 0.01f;
+            radiance += throughput * material.Albedo * sampleLight(position, normal, random, rays);
+
+            if (depth >= RUSSIAN_ROULETTE_DEPTH)
+            {
+                const float survival = std::min(0.95f, std::max(throughput.r, std::max(throughput.g, throughput.b)));
+                if (random.next() >= survival)
+                    break;
+                throughput /= survival;
+            }
+            // cosine-weighted bounce: the Lambertian albedo / pi * cos / pdf leaves just the albedo
+            throughput *= material.Albedo;
+            ray = Ray(position, sampleCosine(normal, random));
+        }
+        return radiance;
+    }
+
+    // incoming light from one point on the light, times 1/pi * cos(surface); 0 when shadowed
+    glm::vec3 sampleLight(const glm::vec3 &position, const glm::vec3 &normal, Random &random, uint64_t &rays) const
+    {
+        const float pick = random.next() * lightArea;
+        const size_t index = std::min(lights.size() - 1, (size_t)(std::upper_bound(lightCdf.begin(), lightCdf.end(), pick) - lightCdf.begin()));
+        const uint32_t id = lights[index];
+        const BVHTriangle &triangle = lightTriangles[index];
+        float u = random.next(), v = random.next();
+        if (u + v > 1.0f)
+        {
+            u = 1.0f - u;
+            v = 1.0f - v;
+        }
+        const glm::vec3 target = triangle.V0 + u * (triangle.V1 - triangle.V0) + v * (triangle.V2 - triangle.V0);
+        glm::vec3 toLight = target - position;
+        const float distance2 = glm::dot(toLight, toLight);
+        const float distance = std::sqrt(distance2);
+        toLight /= distance;
+        const float cosSurface = glm::dot(normal, toLight);
+        const float cosLight = -glm::dot(surfaces[id].Normal, toLight);
+        if (cosSurface <= 0.0f || cosLight <= 0.0f)
+            return glm::vec3(0.0f);
+        ++rays;
+        if (Scene.occluded(Ray(position, toLight, distance - 0.02f)))
+            return glm::vec3(0.0f);
+        // area sampling pdf is 1 / lightArea
+        return materials[surfaces[id].Material].Emission * (cosSurface * cosLight * lightArea / (distance2 * glm::pi<float>()));
+    }
+
+    static glm::vec3 sampleCosine(const glm::vec3 &normal, Random &random)
+    {
+        const float r = std::sqrt(random.next());
+        const float phi = 2.0f * glm::pi<float>() * random.next();
+        // branchless orthonormal basis (Duff et al. 2017)
+        const float sign = std::copysign(1.0f, normal.z);
+        const float a = -1.0f / (sign + normal.z);
+        const float b = normal.x * normal.y * a;
+        const glm::vec3 tangent(1.0f + sign * normal.x * normal.x * a, sign * b, -sign * normal.x);
+        const glm::vec3 bitangent(b, sign + normal.y * normal.y * a, -normal.y);
+        return glm::normalize(r * std::cos(phi) * tangent + r * std::sin(phi) * bitangent +
+                              std::sqrt(std::max(0.0f, 1.0f - r * r)) * normal);
+    }
+
+    static uint32_t hash(uint32_t x)
+    {
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return x;
+    }
+};
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Minimal PNG encoder for frame dumps: 8-bit RGBA, no filtering, zlib "stored" (uncompressed)
+// deflate blocks. Files are large but byte-exact, which is all an image-diff check needs, and
+// it saves pulling in zlib or stb_image_write for one call site.
+class PngWriter
+{
+public:
+    // pixels are width * height RGBA8 values; flipY takes OpenGL's bottom-up rows
+    static bool write(const std::string &path, const unsigned char *pixels, unsigned int width, unsigned int height, bool flipY = true)
+    {
+        const size_t rowBytes = (size_t)width * 4;
+        // raw scanlines, each prefixed with filter type 0
+        std::vector<unsigned char> raw;
+        raw.reserve((rowBytes + 1) * height);
+        for (unsigned int y = 0; y < height; ++y)
+        {
+            const unsigned char *row = pixels + rowBytes * (flipY ? height - 1 - y : y);
+            raw.push_back(0);
+            raw.insert(raw.end(), row, row + rowBytes);
+        }
+
+        // zlib stream: header, stored blocks of at most 65535 bytes, adler32
+        std::vector<unsigned char> zlib = { 0x78, 0x01 };
+        zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+        size_t offset = 0;
+        do
+        {
+            const size_t length = std::min<size_t>(raw.size() - offset, 65535);
+            const bool last = offset + length == raw.size();
+            zlib.push_back(last ? 1 : 0);
+            zlib.push_back((unsigned char)(length & 0xff));
+            zlib.push_back((unsigned char)(length >> 8));
+            zlib.push_back((unsigned char)(~length & 0xff));
+            zlib.push_back((unsigned char)((~length >> 8) & 0xff));
+            zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + length);
+            offset += length;
+        } while (offset < raw.size());
+        appendBigEndian(zlib, adler32(raw.data(), raw.size()));
+
+        std::vector<unsigned char> ihdr;
+        appendBigEndian(ihdr, width);
+        appendBigEndian(ihdr, height);
+        ihdr.insert(ihdr.end(), { 8, 6, 0, 0, 0 }); // 8 bit, RGBA, deflate, no filter, no interlace
+
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out)
+            return false;
+        static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+        out.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+        writeChunk(out, "IHDR", ihdr);
+        writeChunk(out, "IDAT", zlib);
+        writeChunk(out, "IEND", {});
+        return (bool)out;
+    }
+
+    static uint32_t crc32(uint32_t crc, const unsigned char *bytes, size_t size)
+    {
+        static const std::vector<uint32_t> table = [] {
+            std::vector<uint32_t> entries(256);
+            for (uint32_t n = 0; n < 256; ++n)
+            {
+                uint32_t c = n;
+                for (int k = 0; k < 8; ++k)
+                    c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                entries[n] = c;
+            }
+            return entries;
+        }();
+        crc = ~crc;
+        for (size_t i = 0; i < size; ++i)
+            crc = table[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    static uint32_t adler32(const unsigned char *bytes, size_t size)
+    {
+        uint32_t a = 1, b = 0;
+        while (size > 0)
+        {
+            // 5552 is the largest block that can't overflow b before the modulo
+            const size_t block = std::min<size_t>(size, 5552);
+            for (size_t i = 0; i < block; ++i)
+            {
+                a += bytes[i];
+                b += a;
+            }
+            a %= 65521;
+            b %= 65521;
+            bytes += block;
+            size -= block;
+        }
+        return (b << 16) | a;
+    }
+
+private:
+    static void appendBigEndian(std::vector<unsigned char> &out, uint32_t value)
+    {
+        out.push_back((unsigned char)(value >> 24));
+        out.push_back((unsigned char)(value >> 16));
+        out.push_back((unsigned char)(value >> 8));
+        out.push_back((unsigned char)value);
+    }
+
+    static void writeChunk(std::ofstream &out, const char type[4], const std::vector<unsigned char> &data)
+    {
+        std::vector<unsigned char> header;
+        appendBigEndian(header, (uint32_t)data.size());
+        header.insert(header.end(), type, type + 4);
+        out.write(reinterpret_cast<const char*>(header.data()), header.size());
+        if (!data.empty())
+            out.write(reinterpret_cast<const char*>(data.data()), data.size());
+        uint32_t crc = crc32(0, reinterpret_cast<const unsigned char*>(type), 4);
+        crc = crc32(crc, data.data(), data.size());
+        std::vector<unsigned char> footer;
+        appendBigEndian(footer, crc);
+        out.write(reinterpret_cast<const char*>(footer.data()), footer.size());
+    }
+};
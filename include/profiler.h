@@ -0,0 +1,383 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Scoped CPU and GPU zones for finding where frame time goes:
+//
+//     PROFILE_ZONE("cull");          // CPU, any thread, until the end of the scope
+//     PROFILE_GPU_ZONE("stress");    // GPU, GL thread only, the commands issued in the scope
+//
+// Zone names must be string literals (only the pointer is stored). With PROFILER_ENABLED
+// defined to 0 both macros expand to nothing and no zone code is compiled at all.
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 1
+#endif
+
+#define PROFILER_CONCAT_(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT_(a, b)
+#if PROFILER_ENABLED
+#define PROFILE_ZONE(name) ProfileZone PROFILER_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_GPU_ZONE(name) GpuProfileZone PROFILER_CONCAT(gpuProfileZone, __LINE__)(name)
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_GPU_ZONE(name)
+#endif
+
+// One finished zone. Times are nanoseconds since the profiler started; GPU zones are moved onto
+// the same clock through a calibrated offset.
+struct ProfileEvent {
+    const char *Name;
+    uint64_t Begin;
+    uint64_t End;
+    uint32_t Thread;   // ProfileThread::Index, or Profiler::GPU_THREAD
+    uint32_t Depth;    // nesting level within its thread, 0 = outermost
+};
+
+// Events recorded by one thread. A single-producer/single-consumer ring: the owning thread
+// pushes when a zone closes, Profiler::newFrame() drains on the GL thread; neither side locks.
+// When the ring is full, new events are dropped and counted rather than blocking the producer.
+class ProfileThread
+{
+public:
+    static const uint32_t CAPACITY = 1 << 14;
+
+    uint32_t Index;
+    std::string Name;
+    uint32_t Depth = 0;                    // owning thread only
+    std::atomic<uint64_t> Dropped{ 0 };
+
+    ProfileThread(uint32_t index, const std::string &name) : Index(index), Name(name), events(CAPACITY) {}
+
+    void push(const ProfileEvent &event)
+    {
+        const uint32_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == CAPACITY)
+        {
+            Dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        events[h % CAPACITY] = event;
+        head.store(h + 1, std::memory_order_release);
+    }
+
+    template <typename F>
+    void drain(F &&consume)
+    {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        const uint32_t h = head.load(std::memory_order_acquire);
+        for (; t != h; ++t)
+            consume(events[t % CAPACITY]);
+        tail.store(t, std::memory_order_release);
+    }
+
+private:
+    std::vector<ProfileEvent> events;
+    std::atomic<uint32_t> head{ 0 };
+    std::atomic<uint32_t> tail{ 0 };
+};
+
+// Collects the zones of every thread once per frame. CPU zones of the frame that just ended are
+// in LastFrame; GPU zones are read back GPU_LATENCY frames late from a ring of GL_TIMESTAMP
+// query pairs (timestamps rather than GL_TIME_ELAPSED, which can't nest and has no start time
+// to place on a timeline), and only once their results are available, so reading them never
+// stalls. A GPU frame whose queries are still pending when its slot comes round is dropped.
+class Profiler
+{
+public:
+    static const uint32_t GPU_THREAD = ~0u;
+    static const unsigned int GPU_LATENCY = 4;
+    static const unsigned int MAX_GPU_ZONES = 64;        // per frame
+    static const size_t MAX_TRACE_EVENTS = 1 << 20;
+
+    // zones of the last finished frame, sorted by thread and begin time
+    std::vector<ProfileEvent> LastFrame;
+    uint64_t LastFrameBegin = 0, LastFrameEnd = 0;
+    // GPU zones of the most recent frame whose queries came back
+    std::vector<ProfileEvent> LastGpuFrame;
+    uint64_t GpuFramesDropped = 0;
+    // when set, every event is also kept for writeChromeTrace()
+    bool Capture = false;
+
+    static Profiler& get()
+    {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    static uint64_t now()
+    {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - get().epoch).count();
+    }
+
+    // the calling thread's event ring, registered (under a lock, once per thread) on first use
+    static ProfileThread& thread()
+    {
+        thread_local ProfileThread *current = get().registerThread();
+        return *current;
+    }
+
+    // names the calling thread in the overlay and the trace; call before its first zone
+    static void nameThread(const std::string &name)
+    {
+        ProfileThread &current = thread();
+        std::lock_guard<std::mutex> lock(get().threadsMutex);
+        current.Name = name;
+    }
+
+    std::vector<std::string> threadNames()
+    {
+        std::lock_guard<std::mutex> lock(threadsMutex);
+        std::vector<std::string> names;
+        for (const std::unique_ptr<ProfileThread> &t : threads)
+            names.push_back(t->Name);
+        return names;
+    }
+
+    // GL thread, at the start of every frame
+    void newFrame()
+    {
+        const uint64_t frameStart = now();
+        LastFrameBegin = LastFrameEnd;
+        LastFrameEnd = frameStart;
+        LastFrame.clear();
+        {
+            std::lock_guard<std::mutex> lock(threadsMutex);
+            for (const std::unique_ptr<ProfileThread> &t : threads)
+                t->drain([this](const ProfileEvent &event) { LastFrame.push_back(event); });
+        }
+        std::sort(LastFrame.begin(), LastFrame.end(), [](const ProfileEvent &a, const ProfileEvent &b) {
+            return a.Thread != b.Thread ? a.Thread < b.Thread : a.Begin < b.Begin;
+        });
+        record(LastFrame);
+
+        if (!gpuAvailable())
+            return;
+        if (gpu.empty())
+            createQueries();
+        if ((frame & 63) == 0)
+            calibrate();
+        // the slot the coming frame records into still holds the zones of GPU_LATENCY frames ago
+        GpuFrame &slot = gpu[frame % GPU_LATENCY];
+        collect(slot);
+        slot.Zones.clear();
+        ++frame;
+    }
+
+    uint64_t droppedEvents()
+    {
+        std::lock_guard<std::mutex> lock(threadsMutex);
+        uint64_t dropped = 0;
+        for (const std::unique_ptr<ProfileThread> &t : threads)
+            dropped += t->Dropped.load(std::memory_order_relaxed);
+        return dropped;
+    }
+
+    // Chrome trace_event JSON ("X" complete events, microseconds), for chrome://tracing or
+    // ui.perfetto.dev; GPU zones show up as their own thread
+    bool writeChromeTrace(const std::string &path)
+    {
+        std::ofstream out(path);
+        if (!out)
+        {
+            std::cout << "ERROR::PROFILER::FILE_NOT_SUCCESFULLY_WRITTEN: " << path << std::endl;
+            return false;
+        }
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        const std::vector<std::string> names = threadNames();
+        for (size_t i = 0; i < names.size(); ++i)
+            out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << i << ",\"args\":{\"name\":\"" << escape(names[i]) << "\"}},\n";
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << GPU_THREAD << ",\"args\":{\"name\":\"GPU\"}}";
+        char line[64];
+        for (const ProfileEvent &event : trace)
+        {
+            std::snprintf(line, sizeof(line), "%.3f,\"dur\":%.3f", event.Begin / 1.0e3, (event.End - event.Begin) / 1.0e3);
+            out << ",\n{\"name\":\"" << escape(event.Name) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.Thread << ",\"ts\":" << line << "}";
+        }
+        out << "\n]}\n";
+        std::cout << "profiler: " << trace.size() << " zones written to " << path
+                  << (traceFull ? " (capture limit reached, later zones are missing)" : "") << std::endl;
+        return (bool)out;
+    }
+
+    // deletes the queries; call while the context is still current
+    void Release()
+    {
+        for (GpuFrame &slot : gpu)
+            glDeleteQueries((GLsizei)slot.Queries.size(), slot.Queries.data());
+        gpu.clear();
+    }
+
+    // --- used by GpuProfileZone ---------------------------------------------------------
+    int beginGpuZone(const char *name)
+    {
+        if (gpu.empty())
+            return -1;
+        GpuFrame &slot = gpu[(frame - 1) % GPU_LATENCY];
+        if (slot.Zones.size() == MAX_GPU_ZONES)
+            return -1;
+        const int zone = (int)slot.Zones.size();
+        slot.Zones.push_back({ name, gpuDepth++ });
+        glQueryCounter(slot.Queries[2 * zone], GL_TIMESTAMP);
+        return zone;
+    }
+
+    void endGpuZone(int zone)
+    {
+        if (zone < 0)
+            return;
+        GpuFrame &slot = gpu[(frame - 1) % GPU_LATENCY];
+        glQueryCounter(slot.Queries[2 * zone + 1], GL_TIMESTAMP);
+        --gpuDepth;
+    }
+
+private:
+    struct GpuZone {
+        const char *Name;
+        uint32_t Depth;
+    };
+
+    struct GpuFrame {
+        std::vector<GLuint> Queries;   // begin/end pairs
+        std::vector<GpuZone> Zones;
+    };
+
+    std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    std::mutex threadsMutex;
+    std::vector<std::unique_ptr<ProfileThread>> threads;
+    std::vector<GpuFrame> gpu;
+    uint64_t frame = 0;
+    uint32_t gpuDepth = 0;
+    int64_t gpuOffset = 0;             // GL_TIMESTAMP - now()
+    std::vector<ProfileEvent> trace;
+    bool traceFull = false;
+
+    Profiler() {}
+
+    ProfileThread* registerThread()
+    {
+        std::lock_guard<std::mutex> lock(threadsMutex);
+        const uint32_t index = (uint32_t)threads.size();
+        threads.emplace_back(new ProfileThread(index, "thread " + std::to_string(index)));
+        return threads.back().get();
+    }
+
+    void record(const std::vector<ProfileEvent> &events)
+    {
+        if (!Capture || traceFull)
+            return;
+        const size_t room = MAX_TRACE_EVENTS - trace.size();
+        trace.insert(trace.end(), events.begin(), events.begin() + std::min(room, events.size()));
+        traceFull = events.size() > room;
+    }
+
+    static bool gpuAvailable()
+    {
+        return glQueryCounter && glGetQueryObjectui64v && glGetInteger64v;
+    }
+
+    void createQueries()
+    {
+        gpu.resize(GPU_LATENCY);
+        for (GpuFrame &slot : gpu)
+        {
+            slot.Queries.resize(2 * MAX_GPU_ZONES);
+            glGenQueries((GLsizei)slot.Queries.size(), slot.Queries.data());
+            slot.Zones.reserve(MAX_GPU_ZONES);
+        }
+    }
+
+    // GL_TIMESTAMP and steady_clock drift apart slowly, so the offset is refreshed now and then
+    void calibrate()
+    {
+        GLint64 gpuNow = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+        gpuOffset = (int64_t)gpuNow - (int64_t)now();
+    }
+
+    void collect(GpuFrame &slot)
+    {
+        if (slot.Zones.empty())
+            return;
+        GLuint available = 0;
+        glGetQueryObjectuiv(slot.Queries[2 * slot.Zones.size() - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+        {
+            ++GpuFramesDropped;
+            return;
+        }
+        LastGpuFrame.clear();
+        for (size_t zone = 0; zone < slot.Zones.size(); ++zone)
+        {
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(slot.Queries[2 * zone], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(slot.Queries[2 * zone + 1], GL_QUERY_RESULT, &end);
+            LastGpuFrame.push_back({ slot.Zones[zone].Name, (uint64_t)((int64_t)begin - gpuOffset), (uint64_t)((int64_t)end - gpuOffset),
+                                     GPU_THREAD, slot.Zones[zone].Depth });
+        }
+        record(LastGpuFrame);
+    }
+
+    static std::string escape(const std::string &text)
+    {
+        std::string escaped;
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+                escaped += '\\';
+            escaped += c;
+        }
+        return escaped;
+    }
+};
+
+// RAII CPU zone; use PROFILE_ZONE rather than naming one directly
+class ProfileZone
+{
+public:
+    explicit ProfileZone(const char *name) : name(name), timeline(Profiler::thread())
+    {
+        ++timeline.Depth;
+        begin = Profiler::now();
+    }
+
+    ~ProfileZone()
+    {
+        const uint64_t end = Profiler::now();
+        --timeline.Depth;
+        timeline.push({ name, begin, end, timeline.Index, timeline.Depth });
+    }
+
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+    const char *name;
+    ProfileThread &timeline;
+    uint64_t begin;
+};
+
+// RAII GPU zone around the GL commands issued in its scope; GL thread only
+class GpuProfileZone
+{
+public:
+    explicit GpuProfileZone(const char *name) : zone(Profiler::get().beginGpuZone(name)) {}
+    ~GpuProfileZone() { Profiler::get().endGpuZone(zone); }
+
+    GpuProfileZone(const GpuProfileZone&) = delete;
+    GpuProfileZone& operator=(const GpuProfileZone&) = delete;
+
+private:
+    int zone;
+};
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <imgui.h>
+
+#include "profiler.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// ImGui window showing the profiler's last frame as a flame chart: one lane per thread that
+// recorded zones, nested zones stacked downwards, plus a GPU lane (a few frames older, see
+// Profiler). Below it, the zones of the frame summed by name, most expensive first.
+class ProfilerOverlay
+{
+public:
+    bool Visible = true;
+    float Width = 500.0f;      // of the timeline, in pixels
+
+    // between ImGui::NewFrame() and ImGui::Render()
+    void draw(Profiler &profiler)
+    {
+        if (!Visible)
+            return;
+        ImGui::SetNextWindowPos(ImVec2(10.0f, 10.0f), ImGuiCond_FirstUseEver);
+        ImGui::SetNextWindowBgAlpha(0.85f);
+        if (!ImGui::Begin("profiler", &Visible, ImGuiWindowFlags_AlwaysAutoResize))
+        {
+            ImGui::End();
+            return;
+        }
+
+        const uint64_t frameBegin = profiler.LastFrameBegin, frameEnd = profiler.LastFrameEnd;
+        ImGui::Text("frame %.2f ms   %zu zones   dropped: %llu events, %llu gpu frames", (frameEnd - frameBegin) / 1.0e6,
+                    profiler.LastFrame.size(), (unsigned long long)profiler.droppedEvents(), (unsigned long long)profiler.GpuFramesDropped);
+
+        // CPU lanes span the frame; the GPU lane spans its own zones
+        const std::vector<std::string> names = profiler.threadNames();
+        size_t first = 0;
+        while (first < profiler.LastFrame.size())
+        {
+            size_t last = first;
+            while (last < profiler.LastFrame.size() && profiler.LastFrame[last].Thread == profiler.LastFrame[first].Thread)
+                ++last;
+            const uint32_t thread = profiler.LastFrame[first].Thread;
+            lane(thread < names.size() ? names[thread].c_str() : "?", &profiler.LastFrame[first], last - first, frameBegin, frameEnd);
+            first = last;
+        }
+        if (!profiler.LastGpuFrame.empty())
+        {
+            uint64_t gpuBegin = UINT64_MAX, gpuEnd = 0;
+            for (const ProfileEvent &event : profiler.LastGpuFrame)
+            {
+                gpuBegin = std::min(gpuBegin, event.Begin);
+                gpuEnd = std::max(gpuEnd, event.End);
+            }
+            lane("GPU", profiler.LastGpuFrame.data(), profiler.LastGpuFrame.size(), gpuBegin, std::max(gpuEnd, gpuBegin + 1));
+        }
+
+        summary(profiler);
+        ImGui::End();
+    }
+
+private:
+    struct Total {
+        const char *Name;
+        unsigned int Calls;
+        uint64_t Nanoseconds;
+    };
+    std::vector<Total> totals;
+
+    static ImU32 color(const char *name)
+    {
+        // FNV-1a of the name, so a zone keeps its colour across frames and runs
+        uint32_t hash = 2166136261u;
+        for (const char *c = name; *c; ++c)
+            hash = (hash ^ (unsigned char)*c) * 16777619u;
+        return IM_COL32(90 + (hash & 0x7f), 90 + ((hash >> 8) & 0x7f), 90 + ((hash >> 16) & 0x7f), 255);
+    }
+
+    void lane(const char *label, const ProfileEvent *events, size_t count, uint64_t begin, uint64_t end)
+    {
+        const float rowHeight = ImGui::GetTextLineHeight() + 4.0f;
+        uint32_t depth = 0;
+        for (size_t i = 0; i < count; ++i)
+            depth = std::max(depth, events[i].Depth);
+        ImGui::TextUnformatted(label);
+        const ImVec2 origin = ImGui::GetCursorScreenPos();
+        const float width = Width;
+        const float height = rowHeight * (depth + 1);
+        ImDrawList *drawList = ImGui::GetWindowDrawList();
+        drawList->AddRectFilled(origin, ImVec2(origin.x + width, origin.y + height), IM_COL32(30, 30, 30, 255));
+
+        const double scale = width / (double)(end - begin);
+        const ImVec2 mouse = ImGui::GetIO().MousePos;
+        for (size_t i = 0; i < count; ++i)
+        {
+            const ProfileEvent &event = events[i];
+            const float x0 = origin.x + (float)std::max(0.0, ((double)event.Begin - (double)begin) * scale);
+            const float x1 = origin.x + (float)std::min((double)width, ((double)event.End - (double)begin) * scale);
+            if (x1 < x0)
+                continue;
+            const ImVec2 min(x0, origin.y + event.Depth * rowHeight), max(std::max(x1, x0 + 1.0f), min.y + rowHeight - 1.0f);
+            drawList->AddRectFilled(min, max, color(event.Name));
+            if (max.x - min.x > ImGui::CalcTextSize(event.Name).x + 4.0f)
+                drawList->AddText(ImVec2(min.x + 2.0f, min.y + 2.0f), IM_COL32(0, 0, 0, 255), event.Name);
+            if (mouse.x >= min.x && mouse.x < max.x && mouse.y >= min.y && mouse.y < max.y)
+                ImGui::SetTooltip("%s: %.3f ms", event.Name, (event.End - event.Begin) / 1.0e6);
+        }
+        ImGui::Dummy(ImVec2(width, height));
+    }
+
+    void summary(const Profiler &profiler)
+    {
+        totals.clear();
+        for (const std::vector<ProfileEvent> *events : { &profiler.LastFrame, &profiler.LastGpuFrame })
+        {
+            for (const ProfileEvent &event : *events)
+            {
+                auto it = std::find_if(totals.begin(), totals.end(), [&](const Total &total) { return std::strcmp(total.Name, event.Name) == 0; });
+                if (it == totals.end())
+                    totals.push_back({ event.Name, 1, event.End - event.Begin });
+                else
+                {
+                    ++it->Calls;
+                    it->Nanoseconds += event.End - event.Begin;
+                }
+            }
+        }
+        std::sort(totals.begin(), totals.end(), [](const Total &a, const Total &b) { return a.Nanoseconds > b.Nanoseconds; });
+        if (!ImGui::BeginTable("zones", 3, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingStretchProp))
+            return;
+        ImGui::TableSetupColumn("zone");
+        ImGui::TableSetupColumn("calls");
+        ImGui::TableSetupColumn("ms");
+        ImGui::TableHeadersRow();
+        for (const Total &total : totals)
+        {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(total.Name);
+            ImGui::TableNextColumn();
+            ImGui::Text("%u", total.Calls);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", total.Nanoseconds / 1.0e6);
+        }
+        ImGui::EndTable();
+    }
+};
@@ -0,0 +1,346 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "normal_matrix.h"
+#include "profiler.h"
+#include "stream_buffer.h"
+#include "uniform_buffer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+// Values of surface.fs' "material" struct for one draw
+struct RenderMaterial {
+    glm::vec3 Ambient;
+    glm::vec3 Diffuse;
+    glm::vec3 Specular;
+    float Shininess;
+};
+
+// Runs of the index buffer drawn by one glMultiDrawElements: index counts and byte offsets
+struct DrawRanges {
+    std::vector<GLsizei> Counts;
+    std::vector<const void*> Offsets;
+};
+
+// One recorded draw. Plain old data: recording is a push_back, sorting moves 16 byte key/index
+// pairs and never the commands. Model and Material point at data that must stay put until
+// RenderQueue::submit(); a null pointer keeps whatever the previous draw had, for programs
+// that don't read it (instanced ones read neither).
+struct DrawCommand {
+    uint64_t Key;                       // RenderQueue::makeKey()
+    const glm::mat4 *Model;
+    const RenderMaterial *Material;
+    uint32_t Program;                   // RenderQueue::addProgram() index
+    uint32_t VAO;
+    uint32_t Texture;                   // GL_TEXTURE_2D on unit 0, 0 = none needed
+    uint32_t IndexCount;
+    uint32_t FirstIndex;
+    uint32_t Instances;                 // 0 = glDrawElements, else glDrawElementsInstanced
+    const DrawRanges *Ranges = nullptr; // set: glMultiDrawElements of these instead of IndexCount/FirstIndex
+};
+
+// GL state changes a list of commands costs
+struct RenderStats {
+    unsigned int ProgramBinds = 0;
+    unsigned int VertexArrayBinds = 0;
+    unsigned int TextureBinds = 0;
+    unsigned int UniformUploads = 0;    // Object blocks streamed
+    unsigned int Draws = 0;
+};
+
+// Commands recorded by one thread. Each recording thread owns a bucket, so recording never
+// locks; submit() merges them.
+class RenderBucket
+{
+public:
+    std::vector<DrawCommand> Commands;
+
+    void draw(const DrawCommand &command)
+    {
+        Commands.push_back(command);
+    }
+};
+
+// Draws recorded in any order, executed sorted. Every command carries a 64 bit key
+//
+//     pass (4) | program (8) | material (16) | vertex array (12) | depth (24)
+//
+// submit() radix-sorts the keys and walks the list with the current GL state in hand, so a
+// program, VAO, texture or uniform is only set when it differs from what is already bound:
+// all draws of a program come together, within it those sharing a texture or material, then
+// those sharing a VAO, and opaque draws of equal state front to back. Unsorted and Sorted hold
+// what the last frame's commands cost in recording order and after sorting.
+//
+// Model matrices and materials don't go through glUniform*: every change is written as an
+// ObjectBlock into a StreamBuffer up front, and drawing only points OBJECT_BINDING at it. The
+// blocks' normal matrices are computed on the way, all of a frame's in one batch.
+class RenderQueue
+{
+public:
+    static const uint32_t OPAQUE_PASS = 0;
+    static const uint32_t OVERLAY_PASS = 15;
+
+    RenderStats Unsorted, Sorted;
+
+    // objects receives the Object blocks; the queue begins and ends its frames
+    explicit RenderQueue(StreamBuffer &objects) : objects(objects) {}
+
+    // index of shader for DrawCommand::Program, which declares the Object block (see
+    // ObjectBlock). Its block binding is set again whenever the program gets relinked, so
+    // hot-reloaded programs keep working. A shader added again keeps its index, so scenes
+    // sharing a ShaderVariants permutation sort together
+    uint32_t addProgram(const Shader &shader)
+    {
+        for (uint32_t i = 0; i < (uint32_t)programs.size(); ++i)
+            if (programs[i].Source == &shader)
+                return i;
+        programs.push_back({ &shader, 0 });
+        return (uint32_t)programs.size() - 1;
+    }
+
+    // buckets must exist before threads record into them; bucket 0 is the GL thread's
+    void reserveBuckets(size_t count)
+    {
+        while (buckets.size() < count)
+            buckets.emplace_back(new RenderBucket);
+    }
+
+    RenderBucket& bucket(size_t index)
+    {
+        return *buckets[index];
+    }
+
+    // material is any id that groups draws with the same uniforms/texture (a texture name, a
+    // material index); depth is the view distance divided by the far plane, 0..1
+    static uint64_t makeKey(uint32_t pass, uint32_t program, uint32_t material, uint32_t vao, float depth)
+    {
+        const uint64_t depthBits = (uint64_t)(std::min(std::max(depth, 0.0f), 1.0f) * 16777215.0f);
+        return ((uint64_t)(pass & 0xf) << 60) | ((uint64_t)(program & 0xff) << 52) | ((uint64_t)(material & 0xffff) << 36) |
+               ((uint64_t)(vao & 0xfff) << 24) | depthBits;
+    }
+
+    // GL thread, once every bucket is recorded: sorts, draws and empties the buckets
+    void submit()
+    {
+        PROFILE_ZONE("render queue");
+        commands.clear();
+        for (const std::unique_ptr<RenderBucket> &b : buckets)
+        {
+            commands.insert(commands.end(), b->Commands.begin(), b->Commands.end());
+            b->Commands.clear();
+        }
+        order.resize(commands.size());
+        for (uint32_t i = 0; i < (uint32_t)commands.size(); ++i)
+            order[i] = { commands[i].Key, i };
+        Unsorted = execute<false>();
+        {
+            PROFILE_ZONE("radix sort");
+            radixSort();
+        }
+        Sorted = execute<true>();
+
+        totalUnsorted = add(totalUnsorted, Unsorted);
+        totalSorted = add(totalSorted, Sorted);
+        ++frames;
+    }
+
+    // averages once per second, like the stress scene; force prints whatever has accumulated
+    void Report(float deltaTime, bool force = false)
+    {
+        elapsed += deltaTime;
+        if ((elapsed < 1.0f && !force) || frames == 0)
+            return;
+        std::cout << "render queue: " << totalSorted.Draws / frames << " draws/frame; state changes per frame unsorted -> sorted: "
+                  << totalUnsorted.ProgramBinds / frames << " -> " << totalSorted.ProgramBinds / frames << " programs, "
+                  << totalUnsorted.VertexArrayBinds / frames << " -> " << totalSorted.VertexArrayBinds / frames << " VAOs, "
+                  << totalUnsorted.TextureBinds / frames << " -> " << totalSorted.TextureBinds / frames << " textures, "
+                  << totalUnsorted.UniformUploads / frames << " -> " << totalSorted.UniformUploads / frames << " uniforms" << std::endl;
+        totalUnsorted = totalSorted = RenderStats();
+        elapsed = 0.0f;
+        frames = 0;
+    }
+
+private:
+    struct Program {
+        const Shader *Source;
+        unsigned int Linked;            // the program ID whose Object block is bound
+    };
+
+    struct SortEntry {
+        uint64_t Key;
+        uint32_t Index;
+    };
+
+    StreamBuffer &objects;
+    std::vector<Program> programs;
+    std::vector<std::unique_ptr<RenderBucket>> buckets;
+    std::vector<DrawCommand> commands;
+    std::vector<SortEntry> order, scratch;
+    std::vector<GLintptr> objectOffsets;   // per sorted command, -1 = Object block unchanged
+    std::vector<ObjectBlock> blocks;        // this frame's Object blocks, in upload order
+    std::vector<size_t> blockCommands;      // the sorted command each of them is bound for
+    RenderStats totalUnsorted, totalSorted;
+    float elapsed = 0.0f;
+    unsigned int frames = 0;
+
+    static RenderStats add(RenderStats a, const RenderStats &b)
+    {
+        a.ProgramBinds += b.ProgramBinds;
+        a.VertexArrayBinds += b.VertexArrayBinds;
+        a.TextureBinds += b.TextureBinds;
+        a.UniformUploads += b.UniformUploads;
+        a.Draws += b.Draws;
+        return a;
+    }
+
+    // LSD radix sort of the keys, 8 bits a pass; all eight histograms come from one read and
+    // passes where every key has the same digit (the pass bits, usually) are skipped
+    void radixSort()
+    {
+        const size_t count = order.size();
+        scratch.resize(count);
+        uint32_t histograms[8][256] = {};
+        for (const SortEntry &entry : order)
+            for (int digit = 0; digit < 8; ++digit)
+                ++histograms[digit][(entry.Key >> (8 * digit)) & 0xff];
+        for (int digit = 0; digit < 8; ++digit)
+        {
+            uint32_t *histogram = histograms[digit];
+            if (count == 0 || histogram[(order[0].Key >> (8 * digit)) & 0xff] == count)
+                continue;
+            uint32_t offset = 0;
+            for (int bin = 0; bin < 256; ++bin)
+            {
+                const uint32_t binCount = histogram[bin];
+                histogram[bin] = offset;
+                offset += binCount;
+            }
+            for (const SortEntry &entry : order)
+                scratch[histogram[(entry.Key >> (8 * digit)) & 0xff]++] = entry;
+            order.swap(scratch);
+        }
+    }
+
+    // walks the commands in order; without Draw it only counts what the walk would change.
+    // The Object blocks are all written first, because without persistent mapping the stream
+    // buffer can't be read while it is mapped, and in between their normal matrices are
+    // computed in one batch
+    template <bool Draw>
+    RenderStats execute()
+    {
+        RenderStats stats;
+        if (Draw)
+        {
+            objectOffsets.resize(order.size());
+            blocks.clear();
+            blockCommands.clear();
+        }
+        const glm::mat4 *boundModel = nullptr;
+        const RenderMaterial *boundMaterial = nullptr;
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            const DrawCommand &command = commands[order[i].Index];
+            const bool modelChanged = command.Model && command.Model != boundModel;
+            const bool materialChanged = command.Material &&
+                (!boundMaterial || std::memcmp(command.Material, boundMaterial, sizeof(RenderMaterial)) != 0);
+            if (Draw)
+                objectOffsets[i] = -1;
+            if (!modelChanged && !materialChanged)
+                continue;
+            if (command.Model)
+                boundModel = command.Model;
+            if (command.Material)
+                boundMaterial = command.Material;
+            ++stats.UniformUploads;
+            if (!Draw)
+                continue;
+            ObjectBlock block = {};
+            block.model = boundModel ? *boundModel : glm::mat4(1.0f);
+            if (boundMaterial)
+            {
+                block.ambient = glm::vec4(boundMaterial->Ambient, 0.0f);
+                block.diffuse = glm::vec4(boundMaterial->Diffuse, 0.0f);
+                block.specular = boundMaterial->Specular;
+                block.shininess = boundMaterial->Shininess;
+            }
+            blocks.push_back(block);
+            blockCommands.push_back(i);
+        }
+        if (Draw)
+        {
+            NormalMatrices::compute(&blocks.data()->model, sizeof(ObjectBlock), &blocks.data()->normalMatrix, sizeof(ObjectBlock), blocks.size());
+            const size_t stride = (sizeof(ObjectBlock) + objects.Alignment - 1) / objects.Alignment * objects.Alignment;
+            objects.reserve(order.size() * stride);
+            objects.beginFrame();
+            for (size_t b = 0; b < blocks.size(); ++b)
+            {
+                const StreamBuffer::Allocation allocation = objects.write(blocks[b]);
+                if (allocation.Data)
+                    objectOffsets[blockCommands[b]] = allocation.Offset;
+            }
+            objects.flush();
+        }
+
+        // whatever ran before the queue, nothing is assumed to be bound
+        uint32_t boundProgram = ~0u, boundVAO = ~0u, boundTexture = ~0u;
+        if (Draw)
+            glActiveTexture(GL_TEXTURE0);
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            const DrawCommand &command = commands[order[i].Index];
+            if (command.Program != boundProgram)
+            {
+                boundProgram = command.Program;
+                ++stats.ProgramBinds;
+                if (Draw)
+                {
+                    Program &program = programs[command.Program];
+                    if (program.Linked != program.Source->ID)
+                    {
+                        program.Source->bindUniformBlock("Object", OBJECT_BINDING);
+                        program.Linked = program.Source->ID;
+                    }
+                    glUseProgram(program.Source->ID);
+                }
+            }
+            if (command.VAO != boundVAO)
+            {
+                boundVAO = command.VAO;
+                ++stats.VertexArrayBinds;
+                if (Draw)
+                    glBindVertexArray(command.VAO);
+            }
+            if (command.Texture && command.Texture != boundTexture)
+            {
+                boundTexture = command.Texture;
+                ++stats.TextureBinds;
+                if (Draw)
+                    glBindTexture(GL_TEXTURE_2D, command.Texture);
+            }
+            ++stats.Draws;
+            if (!Draw)
+                continue;
+            if (objectOffsets[i] >= 0)
+                glBindBufferRange(GL_UNIFORM_BUFFER, OBJECT_BINDING, objects.ID, objectOffsets[i], sizeof(ObjectBlock));
+            const void *offset = (const void*)((size_t)command.FirstIndex * sizeof(uint32_t));
+            if (command.Ranges)
+                glMultiDrawElements(GL_TRIANGLES, command.Ranges->Counts.data(), GL_UNSIGNED_INT, command.Ranges->Offsets.data(),
+                                    (GLsizei)command.Ranges->Counts.size());
+            else if (command.Instances)
+                glDrawElementsInstanced(GL_TRIANGLES, (GLsizei)command.IndexCount, GL_UNSIGNED_INT, offset, (GLsizei)command.Instances);
+            else
+                glDrawElements(GL_TRIANGLES, (GLsizei)command.IndexCount, GL_UNSIGNED_INT, offset);
+        }
+        if (Draw)
+            objects.endFrame();
+        return stats;
+    }
+};
@@ -4,71 +4,113 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
+#include <vector>
+
+// Feature flags a program is compiled with. Each set bit becomes "#define <name>" right after
+// the #version line of both sources, so one file holds every permutation; the surface shaders
+// (shaders/surface.vs, surface.fs) read all three. ShaderVariants keeps one program per mask.
+enum Shader_Feature {
+    SHADER_INSTANCED = 1 << 0,          // model and normal matrix per instance (InstanceData), not from the Object block
+    SHADER_LIT = 1 << 1,                // Phong lighting from "light" and the material; unlit draws the texture, or white
+    SHADER_TEXTURED = 1 << 2            // texture_diffuse1 at the vertices' texture coordinates
+};
+
+const char* const SHADER_FEATURE_NAMES[] = { "INSTANCED", "LIT", "TEXTURED" };
+const uint32_t SHADER_FEATURE_COUNT = sizeof(SHADER_FEATURE_NAMES) / sizeof(SHADER_FEATURE_NAMES[0]);
+
+// Where linked programs are cached: next to the vertex shader, one file per vertex/fragment
+// pair and feature mask ("text.vs+text.fs.progcache", "surface.vs+surface.fs.2.progcache"). The
+// file is a ProgramCacheHeader followed by what glGetProgramBinary returned. Key hashes both
+// sources (features defined) and the driver's vendor, renderer and version strings, so an
+// edited shader or a driver update falls back to compiling.
+struct ProgramCacheHeader {
+    char Magic[4];
+    uint32_t Version;
+    uint64_t Key;
+    uint32_t Format;
+    uint32_t Length;
+};
+
+const char PROGRAM_CACHE_MAGIC[4] = { 'P', 'R', 'G', 'B' };
+const uint32_t PROGRAM_CACHE_VERSION = 1;
 
 class Shader
 {
 public:
     unsigned int ID;
+    std::string VertexPath, FragmentPath;
+    // Shader_Feature bits compiled in
+    uint32_t Features;
+    // true when ID came out of the program binary cache
+    bool FromCache = false;
     // constructor generates the shader on the fly
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath)
+    Shader(const char* vertexPath, const char* fragmentPath, uint32_t features = 0)
+        : VertexPath(vertexPath), FragmentPath(fragmentPath), Features(features)
     {
-        // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        try 
+        // 1. retrieve the vertex/fragment source code from filePath, with the features defined
+        std::string vertexCode, fragmentCode;
+        if (readSource(vertexPath, vertexCode))
+            vertexCode = withFeatures(vertexCode, Features);
+        if (readSource(fragmentPath, fragmentCode))
+            fragmentCode = withFeatures(fragmentCode, Features);
+        // 2. take the linked program from the binary cache when it was built from the same
+        //    sources by the same driver, otherwise compile and link, then refresh the cache
+        ID = loadBinary(vertexCode, fragmentCode);
+        FromCache = ID != 0;
+        if (!FromCache)
         {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();		
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();			
+            ID = compile(vertexCode, fragmentCode);
+            saveBinary(vertexCode, fragmentCode);
         }
-        catch (std::ifstream::failure& e)
-        {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
-        }
-        const char* vShaderCode = vertexCode.c_str();
-        const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
-        // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
-        // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-        // delete the shaders as they're linked into our program now and no longer necessary
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-
+        // 3. query every active uniform once so the setters never hit the driver's string lookup
+        cacheUniformLocations();
+    }
+    // recompiles from the current source files; on success the new program replaces ID (and
+    // the old one is deleted), on failure the old program stays and false is returned. Uniform
+    // values and block bindings start over, so the caller sets them again.
+    // ------------------------------------------------------------------------
+    bool reload()
+    {
+        std::string vertexCode, fragmentCode;
+        if (!readSource(VertexPath.c_str(), vertexCode) || !readSource(FragmentPath.c_str(), fragmentCode))
+            return false;
+        vertexCode = withFeatures(vertexCode, Features);
+        fragmentCode = withFeatures(fragmentCode, Features);
+        unsigned int program = compile(vertexCode, fragmentCode);
+        if (!program)
+            return false;
+        glDeleteProgram(ID);
+        ID = program;
+        FromCache = false;
+        saveBinary(vertexCode, fragmentCode);
+        cacheUniformLocations();
+        return true;
+    }
+    // code with a #define line for every feature in features, inserted after the #version line
+    // (which must stay first); a #line directive keeps the compiler's line numbers those of the file
+    // ------------------------------------------------------------------------
+    static std::string withFeatures(const std::string &code, uint32_t features)
+    {
+        if (!features)
+            return code;
+        std::string defines;
+        for (uint32_t i = 0; i < SHADER_FEATURE_COUNT; ++i)
+            if (features & (1u << i))
+                defines += std::string("#define ") + SHADER_FEATURE_NAMES[i] + "\n";
+        const std::string::size_type version = code.find("#version");
+        const std::string::size_type lineEnd = version == std::string::npos ? std::string::npos : code.find('\n', version);
+        if (lineEnd == std::string::npos)
+            return defines + code;
+        return code.substr(0, lineEnd + 1) + defines + "#line 2\n" + code.substr(lineEnd + 1);
     }
     // activate the shader
     // ------------------------------------------------------------------------
@@ -76,69 +118,304 @@ public:
     { 
         glUseProgram(ID); 
     }
+    // returns the cached location of an active uniform, or -1 if the program doesn't use it
+    // (glUniform* silently ignores -1, same as an unknown name passed to glGetUniformLocation)
+    // ------------------------------------------------------------------------
+    GLint getUniformLocation(const std::string &name) const
+    {
+        auto it = uniformLocations.find(name);
+        return it != uniformLocations.end() ? it->second : -1;
+    }
+    // binds the named uniform block (if the program has one) to a uniform buffer binding point
+    // ------------------------------------------------------------------------
+    void bindUniformBlock(const std::string &name, GLuint binding) const
+    {
+        GLuint index = glGetUniformBlockIndex(ID, name.c_str());
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(ID, index, binding);
+    }
     // utility uniform functions
     // ------------------------------------------------------------------------
     void setBool(const std::string &name, bool value) const
     {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+        setBool(getUniformLocation(name), value); 
     }
     // ------------------------------------------------------------------------
     void setInt(const std::string &name, int value) const
     { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+        setInt(getUniformLocation(name), value); 
     }
     // ------------------------------------------------------------------------
     void setFloat(const std::string &name, float value) const
     { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+        setFloat(getUniformLocation(name), value); 
     }
     // ------------------------------------------------------------------------
     void setVec2(const std::string &name, const glm::vec2 &value) const
     { 
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        setVec2(getUniformLocation(name), value); 
     }
     void setVec2(const std::string &name, float x, float y) const
     { 
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+        setVec2(getUniformLocation(name), x, y); 
     }
     // ------------------------------------------------------------------------
     void setVec3(const std::string &name, const glm::vec3 &value) const
     { 
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        setVec3(getUniformLocation(name), value); 
     }
     void setVec3(const std::string &name, float x, float y, float z) const
     { 
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+        setVec3(getUniformLocation(name), x, y, z); 
     }
     // ------------------------------------------------------------------------
     void setVec4(const std::string &name, const glm::vec4 &value) const
     { 
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        setVec4(getUniformLocation(name), value); 
     }
     void setVec4(const std::string &name, float x, float y, float z, float w) const
     { 
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+        setVec4(getUniformLocation(name), x, y, z, w); 
     }
     // ------------------------------------------------------------------------
     void setMat2(const std::string &name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat2(getUniformLocation(name), mat);
     }
     // ------------------------------------------------------------------------
     void setMat3(const std::string &name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat3(getUniformLocation(name), mat);
     }
     // ------------------------------------------------------------------------
     void setMat4(const std::string &name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat4(getUniformLocation(name), mat);
     }
 
+    // handle-based uniform functions: look the location up once with getUniformLocation()
+    // and pass it here every frame, no strings involved
+    // ------------------------------------------------------------------------
+    void setBool(GLint location, bool value) const { glUniform1i(location, (int)value); }
+    void setInt(GLint location, int value) const { glUniform1i(location, value); }
+    void setFloat(GLint location, float value) const { glUniform1f(location, value); }
+    void setVec2(GLint location, const glm::vec2 &value) const { glUniform2fv(location, 1, &value[0]); }
+    void setVec2(GLint location, float x, float y) const { glUniform2f(location, x, y); }
+    void setVec3(GLint location, const glm::vec3 &value) const { glUniform3fv(location, 1, &value[0]); }
+    void setVec3(GLint location, float x, float y, float z) const { glUniform3f(location, x, y, z); }
+    void setVec4(GLint location, const glm::vec4 &value) const { glUniform4fv(location, 1, &value[0]); }
+    void setVec4(GLint location, float x, float y, float z, float w) const { glUniform4f(location, x, y, z, w); }
+    void setMat2(GLint location, const glm::mat2 &mat) const { glUniformMatrix2fv(location, 1, GL_FALSE, &mat[0][0]); }
+    void setMat3(GLint location, const glm::mat3 &mat) const { glUniformMatrix3fv(location, 1, GL_FALSE, &mat[0][0]); }
+    void setMat4(GLint location, const glm::mat4 &mat) const { glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]); }
+
 private:
+    std::unordered_map<std::string, GLint> uniformLocations;
+
+    static bool readSource(const char* path, std::string &code)
+    {
+        std::ifstream file;
+        // ensure ifstream objects can throw exceptions:
+        file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+        try
+        {
+            file.open(path, std::ios::binary);
+            std::stringstream stream;
+            stream << file.rdbuf();
+            code = stream.str();
+            return true;
+        }
+        catch (std::ifstream::failure& e)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << path << " " << e.what() << std::endl;
+            return false;
+        }
+    }
+
+    // returns the linked program, or 0 (with the log printed) if compiling or linking failed
+    // ------------------------------------------------------------------------
+    static unsigned int compile(const std::string &vertexCode, const std::string &fragmentCode)
+    {
+        const char* vShaderCode = vertexCode.c_str();
+        const char * fShaderCode = fragmentCode.c_str();
+        // vertex shader
+        unsigned int vertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertex, 1, &vShaderCode, NULL);
+        glCompileShader(vertex);
+        bool success = checkCompileErrors(vertex, "VERTEX");
+        // fragment Shader
+        unsigned int fragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragment, 1, &fShaderCode, NULL);
+        glCompileShader(fragment);
+        success &= checkCompileErrors(fragment, "FRAGMENT");
+        // shader Program
+        unsigned int program = glCreateProgram();
+        glAttachShader(program, vertex);
+        glAttachShader(program, fragment);
+        if (binarySupported())
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(program);
+        success &= checkCompileErrors(program, "PROGRAM");
+        // delete the shaders as they're linked into our program now and no longer necessary
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+        if (!success)
+        {
+            glDeleteProgram(program);
+            return 0;
+        }
+        return program;
+    }
+
+    // program binaries need GL 4.1 or ARB_get_program_binary and at least one binary format
+    // ------------------------------------------------------------------------
+    static bool binarySupported()
+    {
+        static const bool supported = []() {
+            if (!glGetProgramBinary || !glProgramBinary || !glProgramParameteri || !glGetString || !glGetIntegerv)
+                return false;
+            GLint formats = 0;
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+            return formats > 0;
+        }();
+        return supported;
+    }
+
+    std::string cachePath() const
+    {
+        const std::string features = Features ? "." + std::to_string(Features) : std::string();
+        return VertexPath + "+" + std::filesystem::path(FragmentPath).filename().string() + features + ".progcache";
+    }
+
+    // FNV-1a, 64 bit, over both sources and the driver identification
+    static uint64_t cacheKey(const std::string &vertexCode, const std::string &fragmentCode)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        auto mix = [&hash](const char *bytes, size_t size) {
+            for (size_t i = 0; i < size; ++i)
+            {
+                hash ^= (unsigned char)bytes[i];
+                hash *= 1099511628211ull;
+            }
+            hash ^= 0xff; // separator, so "ab"+"c" and "a"+"bc" differ
+            hash *= 1099511628211ull;
+        };
+        mix(vertexCode.data(), vertexCode.size());
+        mix(fragmentCode.data(), fragmentCode.size());
+        for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+        {
+            const char *value = reinterpret_cast<const char*>(glGetString(name));
+            mix(value ? value : "", value ? std::strlen(value) : 0);
+        }
+        return hash;
+    }
+
+    // 0 when there is no usable cache entry (missing, stale, or rejected by the driver)
+    unsigned int loadBinary(const std::string &vertexCode, const std::string &fragmentCode) const
+    {
+        if (!binarySupported())
+            return 0;
+        std::ifstream in(cachePath(), std::ios::binary);
+        ProgramCacheHeader header;
+        if (!in || !in.read(reinterpret_cast<char*>(&header), sizeof(header)))
+            return 0;
+        if (std::memcmp(header.Magic, PROGRAM_CACHE_MAGIC, sizeof(header.Magic)) != 0 || header.Version != PROGRAM_CACHE_VERSION ||
+            header.Key != cacheKey(vertexCode, fragmentCode))
+            return 0;
+        std::vector<char> binary(header.Length);
+        if (!in.read(binary.data(), (std::streamsize)binary.size()))
+            return 0;
+        unsigned int program = glCreateProgram();
+        glProgramBinary(program, (GLenum)header.Format, binary.data(), (GLsizei)binary.size());
+        GLint success = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            // drivers may refuse binaries of a different build even with an equal version string
+            glDeleteProgram(program);
+            return 0;
+        }
+        return program;
+    }
+
+    void saveBinary(const std::string &vertexCode, const std::string &fragmentCode) const
+    {
+        if (!ID || !binarySupported())
+            return;
+        GLint length = 0;
+        glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        std::vector<char> binary((size_t)length);
+        GLenum format = 0;
+        glGetProgramBinary(ID, length, &length, &format, binary.data());
+
+        ProgramCacheHeader header = {};
+        std::memcpy(header.Magic, PROGRAM_CACHE_MAGIC, sizeof(header.Magic));
+        header.Version = PROGRAM_CACHE_VERSION;
+        header.Key = cacheKey(vertexCode, fragmentCode);
+        header.Format = format;
+        header.Length = (uint32_t)length;
+
+        // temporary + rename as for the mesh cache; the shader watcher ignores both names
+        const std::string cacheFile = cachePath(), tmpFile = cacheFile + ".tmp";
+        {
+            std::ofstream out(tmpFile, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(binary.data(), length);
+            if (!out)
+            {
+                std::cout << "WARNING::SHADER::COULD_NOT_WRITE_PROGRAM_CACHE: " << cacheFile << std::endl;
+                return;
+            }
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmpFile, cacheFile, ec);
+        if (ec)
+        {
+            std::filesystem::remove(cacheFile, ec);
+            std::filesystem::rename(tmpFile, cacheFile, ec);
+        }
+    }
+
+    // fills the location table from GL_ACTIVE_UNIFORMS; uniforms living in a uniform block
+    // report location -1 and are skipped, arrays are stored both as "name[0]" and "name"
+    // ------------------------------------------------------------------------
+    void cacheUniformLocations()
+    {
+        uniformLocations.clear();
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> name(maxLength > 0 ? maxLength : 1);
+        for (GLint i = 0; i < count; ++i)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(ID, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, name.data());
+            std::string uniformName(name.data(), length);
+            GLint location = glGetUniformLocation(ID, uniformName.c_str());
+            if (location < 0)
+                continue;
+            uniformLocations[uniformName] = location;
+            const std::string::size_type bracket = uniformName.size() > 3 ? uniformName.rfind("[0]") : std::string::npos;
+            if (bracket != std::string::npos && bracket + 3 == uniformName.size())
+            {
+                std::string baseName = uniformName.substr(0, bracket);
+                uniformLocations[baseName] = location;
+                for (GLint element = 1; element < size; ++element)
+                {
+                    std::string elementName = baseName + "[" + std::to_string(element) + "]";
+                    uniformLocations[elementName] = glGetUniformLocation(ID, elementName.c_str());
+                }
+            }
+        }
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
-    void checkCompileErrors(GLuint shader, std::string type)
+    static bool checkCompileErrors(GLuint shader, std::string type)
     {
         GLint success;
         GLchar infoLog[1024];
@@ -160,6 +437,7 @@ private:
                 std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
+        return success != 0;
     }
 };
 #endif
\ No newline at end of file
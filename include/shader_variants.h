@@ -0,0 +1,75 @@
+#pragma once
+
+#include "shader.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+// Every permutation of one vertex/fragment pair, compiled (or taken from the program binary
+// cache) the first time get() asks for its Shader_Feature mask and kept by that mask after.
+// Setup runs on each program as it is created and is what a ShaderWatcher should run after a
+// reload, so block bindings and constant uniforms are set in one place for all of them. The
+// Shaders stay where they are, so the RenderQueue and the watcher can hold on to them.
+class ShaderVariants
+{
+public:
+    typedef std::function<void(Shader&)> Setup;
+
+    ShaderVariants(const std::string &vertexPath, const std::string &fragmentPath, Setup setup = Setup())
+        : vertexPath(vertexPath), fragmentPath(fragmentPath), setup(setup)
+    {
+    }
+
+    ShaderVariants(const ShaderVariants&) = delete;
+    ShaderVariants& operator=(const ShaderVariants&) = delete;
+
+    Shader& get(uint32_t features)
+    {
+        std::unique_ptr<Shader> &variant = variants[features];
+        if (!variant)
+        {
+            variant.reset(new Shader(vertexPath.c_str(), fragmentPath.c_str(), features));
+            if (variant->FromCache)
+                ++cached;
+            if (setup)
+                setup(*variant);
+        }
+        return *variant;
+    }
+
+    // runs setup on shader again, after a reload
+    void configure(Shader &shader) const
+    {
+        if (setup)
+            setup(shader);
+    }
+
+    // visit(Shader&) for every permutation compiled so far
+    template <typename Visit>
+    void forEach(const Visit &visit)
+    {
+        for (auto &variant : variants)
+            visit(*variant.second);
+    }
+
+    size_t size() const { return variants.size(); }
+
+    // how many of them came out of the program binary cache
+    size_t fromCache() const { return cached; }
+
+    void Release()
+    {
+        for (auto &variant : variants)
+            glDeleteProgram(variant.second->ID);
+        variants.clear();
+        cached = 0;
+    }
+
+private:
+    std::string vertexPath, fragmentPath;
+    Setup setup;
+    std::unordered_map<uint32_t, std::unique_ptr<Shader>> variants;
+    size_t cached = 0;
+};
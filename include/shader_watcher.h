@@ -0,0 +1,185 @@
+#pragma once
+
+#include "shader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// Hot reload for shader sources. A background thread watches one directory (inotify on Linux,
+// a modification time scan every quarter second elsewhere) and collects the names of changed
+// files. poll(), called by the GL thread between frames, recompiles only the programs built
+// from those files and swaps each one in through Shader::reload(): the frame being drawn never
+// sees a half-built program, and a program that fails to compile keeps its previous version.
+class ShaderWatcher
+{
+public:
+    // called after a successful reload, to set uniforms and block bindings again
+    typedef std::function<void(Shader&)> ReloadCallback;
+
+    explicit ShaderWatcher(const std::string &directory) : directory(directory)
+    {
+#ifdef __linux__
+        fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd >= 0 && inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+        {
+            ::close(fd);
+            fd = -1;
+        }
+        if (fd < 0)
+            std::cout << "WARNING::SHADER_WATCHER::INOTIFY_UNAVAILABLE: " << directory << ", scanning instead" << std::endl;
+#endif
+        thread = std::thread(&ShaderWatcher::run, this);
+    }
+
+    ShaderWatcher(const ShaderWatcher&) = delete;
+    ShaderWatcher& operator=(const ShaderWatcher&) = delete;
+
+    ~ShaderWatcher()
+    {
+        stop = true;
+        thread.join();
+#ifdef __linux__
+        if (fd >= 0)
+            ::close(fd);
+#endif
+    }
+
+    // the shader must outlive the watcher
+    void watch(Shader &shader, ReloadCallback onReload = ReloadCallback())
+    {
+        watched.push_back({ &shader, onReload });
+    }
+
+    // GL thread, at a frame boundary; returns how many programs were replaced
+    size_t poll()
+    {
+        std::set<std::string> files;
+        {
+            std::lock_guard<std::mutex> lock(changedMutex);
+            if (changed.empty())
+                return 0;
+            files.swap(changed);
+        }
+        size_t reloaded = 0;
+        for (Watched &entry : watched)
+        {
+            Shader &shader = *entry.Program;
+            if (!files.count(fileName(shader.VertexPath)) && !files.count(fileName(shader.FragmentPath)))
+                continue;
+            const auto begin = std::chrono::steady_clock::now();
+            if (!shader.reload())
+            {
+                std::cout << "shader reload failed, keeping the previous program: " << shader.VertexPath << " + " << shader.FragmentPath << std::endl;
+                continue;
+            }
+            if (entry.OnReload)
+                entry.OnReload(shader);
+            ++reloaded;
+            std::cout << "shader reloaded in " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count()
+                      << " ms: " << shader.VertexPath << " + " << shader.FragmentPath << std::endl;
+        }
+        return reloaded;
+    }
+
+private:
+    struct Watched {
+        Shader *Program;
+        ReloadCallback OnReload;
+    };
+
+    std::string directory;
+    std::vector<Watched> watched;
+    std::thread thread;
+    std::atomic<bool> stop{ false };
+    std::mutex changedMutex;
+    std::set<std::string> changed;   // file names, filled by the watcher thread
+    int fd = -1;
+
+    static std::string fileName(const std::string &path)
+    {
+        return std::filesystem::path(path).filename().string();
+    }
+
+    void markChanged(const std::string &name)
+    {
+        // our own program cache files land in the same directory
+        if (name.size() >= 4 && (name.compare(name.size() - 4, 4, ".tmp") == 0 || name.find(".progcache") != std::string::npos))
+            return;
+        std::lock_guard<std::mutex> lock(changedMutex);
+        changed.insert(name);
+    }
+
+    void run()
+    {
+#ifdef __linux__
+        if (fd >= 0)
+        {
+            alignas(inotify_event) char buffer[4096];
+            while (!stop)
+            {
+                pollfd descriptor = { fd, POLLIN, 0 };
+                if (::poll(&descriptor, 1, 100) <= 0)
+                    continue;
+                ssize_t length;
+                while ((length = ::read(fd, buffer, sizeof(buffer))) > 0)
+                {
+                    for (char *p = buffer; p < buffer + length;)
+                    {
+                        const inotify_event *event = reinterpret_cast<const inotify_event*>(p);
+                        if (event->len > 0)
+                            markChanged(event->name);
+                        p += sizeof(inotify_event) + event->len;
+                    }
+                }
+            }
+            return;
+        }
+#endif
+        scan();
+    }
+
+    // portable fallback: compare modification times
+    void scan()
+    {
+        std::vector<std::pair<std::string, std::filesystem::file_time_type>> known;
+        bool first = true;
+        while (!stop)
+        {
+            std::error_code ec;
+            for (const auto &file : std::filesystem::directory_iterator(directory, ec))
+            {
+                const std::string name = file.path().filename().string();
+                const auto time = file.last_write_time(ec);
+                auto it = std::find_if(known.begin(), known.end(), [&](const auto &entry) { return entry.first == name; });
+                if (it == known.end())
+                {
+                    known.push_back({ name, time });
+                    if (!first)
+                        markChanged(name);
+                }
+                else if (it->second != time)
+                {
+                    it->second = time;
+                    markChanged(name);
+                }
+            }
+            first = false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(250));
+        }
+    }
+};
@@ -0,0 +1,311 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "camera.h"
+#include "camera_path.h"
+#include "normal_matrix.h"
+#include "profiler.h"
+#include "thread_pool.h"
+#include "transform_hierarchy.h"
+#include "triple_buffer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// The parts of a Camera one simulation step changes
+struct CameraState {
+    glm::vec3 Position;
+    float Yaw;
+    float Pitch;
+    float Zoom;
+};
+
+// Everything the renderer takes from one simulation step. The simulation thread fills it in
+// and never touches it again once published; the GL thread only reads it.
+struct FrameSnapshot {
+    uint64_t Step = 0;                  // steps simulated, 0 = the initial state
+    double Due = 0.0;                   // when the step was due, seconds since start()
+    float PreviousTime = 0.0f, Time = 0.0f;    // simulated seconds at the two steps
+    CameraState PreviousView, View;     // camera after the step before and after this one
+    glm::vec3 PreviousLightColor, LightColor;
+    glm::mat4 CubeModel, SphereModel, NanosuitModel, LampModel;
+    // what the optional scenes animate, as of this step (not blended), empty without them: the
+    // turning stress objects' world matrices, cubes then spheres, with their normal matrices
+    // when instanced, and the clustered lights' positions
+    std::vector<glm::mat4> StressModels;
+    std::vector<NormalMatrix> StressNormals;
+    TransformStats StressTransforms;
+    std::vector<glm::vec3> LightPositions;
+
+    // the camera alpha of the way from the previous step to this one
+    Camera camera(float alpha) const
+    {
+        Camera blended(glm::mix(PreviousView.Position, View.Position, alpha), glm::vec3(0.0f, 1.0f, 0.0f),
+                       glm::mix(PreviousView.Yaw, View.Yaw, alpha), glm::mix(PreviousView.Pitch, View.Pitch, alpha));
+        blended.Zoom = glm::mix(PreviousView.Zoom, View.Zoom, alpha);
+        return blended;
+    }
+
+    glm::vec3 lightColor(float alpha) const
+    {
+        return glm::mix(PreviousLightColor, LightColor, alpha);
+    }
+
+    // simulated time, for anything animated as a function of it
+    float time(float alpha) const
+    {
+        return glm::mix(PreviousTime, Time, alpha);
+    }
+};
+
+// The scene advanced at a fixed timestep on a thread of its own: camera input (live, or
+// replayed from a CameraPath), the animated light colour and the object transforms. A step
+// runs as jobs on a ThreadPool and is published as a FrameSnapshot through a TripleBuffer, so
+// the GL thread never waits for the simulation nor the simulation for the GL thread: every
+// frame takes the newest snapshot and draws it blended between its two steps, which keeps the
+// camera moving smoothly when frames take longer (or shorter) than a step.
+//
+// Lockstep runs (headless) instead step exactly once per frame, one step ahead of the
+// renderer, so frame N always shows step N whatever the timing.
+class Simulation
+{
+public:
+    // replayed instead of live input when set, and input recorded into; both before start()
+    const CameraPath *Replay = nullptr;
+    CameraPath *Recording = nullptr;
+    // the optional scenes' part of a step, a job next to the camera and the built-in scene:
+    // fills in what they publish in snapshot for time (seconds), on jobs' threads too if it
+    // likes. Before start()
+    std::function<void(FrameSnapshot &snapshot, float time, ThreadPool &jobs)> AnimateScenes;
+
+    Simulation(ThreadPool &jobs, const Camera &camera, const glm::vec3 &lightPos, float timestep, bool lockstep)
+        : jobs(jobs), camera(camera), lightPos(lightPos), timestep(timestep), lockstep(lockstep)
+    {
+        // the initial state, for the first frames before a step is out
+        FrameSnapshot &initial = snapshots.back();
+        animate(initial, 0.0f);
+        initial.PreviousView = initial.View = state();
+        initial.PreviousLightColor = initial.LightColor;
+        previousView = initial.View;
+        previousLightColor = initial.LightColor;
+        snapshots.publish();
+    }
+
+    Simulation(const Simulation&) = delete;
+    Simulation& operator=(const Simulation&) = delete;
+
+    ~Simulation()
+    {
+        stop();
+    }
+
+    void start()
+    {
+        running = true;
+        clockStart = Clock::now();
+        thread = std::thread(&Simulation::run, this);
+    }
+
+    // joins the simulation thread; the last snapshot stays readable
+    void stop()
+    {
+        if (!thread.joinable())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(stepMutex);
+            running = false;
+        }
+        stepped.notify_all();
+        thread.join();
+    }
+
+    // GL thread: input gathered since the last call, movement keys held (bit n for
+    // Camera_Movement n) and mouse/scroll offsets; the next step applies it
+    void post(unsigned int keys, float mouseX, float mouseY, float scroll)
+    {
+        std::lock_guard<std::mutex> lock(inputMutex);
+        input.Keys = keys;
+        input.MouseX += mouseX;
+        input.MouseY += mouseY;
+        input.Scroll += scroll;
+    }
+
+    // GL thread: the newest snapshot, valid until the next call. Lockstep runs wait for the
+    // step after the one taken last time
+    const FrameSnapshot& acquire()
+    {
+        if (!lockstep)
+        {
+            snapshots.acquire();
+            return snapshots.front();
+        }
+        PROFILE_ZONE("wait for simulation");
+        std::unique_lock<std::mutex> lock(stepMutex);
+        stepped.wait(lock, [this] { return published > consumed || !running; });
+        snapshots.acquire();
+        consumed = snapshots.front().Step;
+        lock.unlock();
+        stepped.notify_all();
+        return snapshots.front();
+    }
+
+    // how far the present is between the snapshot's previous step (0) and its own (1); drawing
+    // one step behind this way never needs a state that doesn't exist yet
+    float alpha(const FrameSnapshot &snapshot) const
+    {
+        if (lockstep)
+            return 1.0f;
+        const double now = std::chrono::duration<double>(Clock::now() - clockStart).count();
+        return (float)std::min(std::max((now - snapshot.Due) / timestep, 0.0), 1.0);
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    // what post() gathered for the next step
+    struct Input : CameraPathStep {
+        float Scroll;
+    };
+
+    // steps this far behind are dropped rather than caught up with, after a hitch
+    static const int MAX_STEPS_BEHIND = 5;
+
+    ThreadPool &jobs;
+    Camera camera;                      // simulation thread only
+    glm::vec3 lightPos;
+    float timestep;
+    bool lockstep;
+    TripleBuffer<FrameSnapshot> snapshots;
+    CameraState previousView;
+    glm::vec3 previousLightColor;
+    float previousTime = 0.0f;
+    uint64_t steps = 0;
+
+    std::mutex inputMutex;
+    Input input = {};
+
+    std::thread thread;
+    Clock::time_point clockStart;
+    // lockstep handshake, and running for both
+    std::mutex stepMutex;
+    std::condition_variable stepped;
+    bool running = false;
+    uint64_t published = 0, consumed = 0;
+
+    CameraState state() const
+    {
+        return { camera.Position, camera.Yaw, camera.Pitch, camera.Zoom };
+    }
+
+    Input takeInput()
+    {
+        std::lock_guard<std::mutex> lock(inputMutex);
+        const Input taken = input;
+        input.MouseX = input.MouseY = input.Scroll = 0.0f;
+        return taken;
+    }
+
+    // the light colour cycles over time; every object stays put
+    void animate(FrameSnapshot &snapshot, float time) const
+    {
+        snapshot.LightColor.x = static_cast<float>(sin(time * 2.0));
+        snapshot.LightColor.y = static_cast<float>(sin(time * 0.7));
+        snapshot.LightColor.z = static_cast<float>(sin(time * 1.3));
+        snapshot.CubeModel = glm::mat4(1.0f);
+        snapshot.SphereModel = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(-1.5f, 0.0f, -0.5f)), glm::vec3(0.5f));
+        snapshot.NanosuitModel = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(1.5f, -0.8f, -0.5f)), glm::vec3(0.1f));
+        snapshot.LampModel = glm::scale(glm::translate(glm::mat4(1.0f), lightPos), glm::vec3(0.2f)); // a smaller cube
+    }
+
+    void moveCamera(const Input &step, size_t index)
+    {
+        if (Replay)
+        {
+            Replay->apply(camera, index, timestep);
+            return;
+        }
+        if (Recording)
+            Recording->record(step.Keys, step.MouseX, step.MouseY);
+        for (int direction = FORWARD; direction <= DOWN; ++direction)
+            if (step.Keys & (1u << direction))
+                camera.ProcessKeyboard((Camera_Movement)direction, timestep);
+        if (step.MouseX != 0.0f || step.MouseY != 0.0f)
+            camera.ProcessMouseMovement(step.MouseX, step.MouseY);
+        if (step.Scroll != 0.0f)
+            camera.ProcessMouseScroll(step.Scroll);
+    }
+
+    // one fixed step: the camera and the scenes are independent jobs, published once all ran
+    void step(double due)
+    {
+        PROFILE_ZONE("simulation step");
+        const Input taken = takeInput();
+        const size_t index = (size_t)steps;
+        FrameSnapshot &next = snapshots.back();
+        JobCounter done;
+        jobs.submit([this, &taken, index] { moveCamera(taken, index); }, &done);
+        jobs.submit([this, &next, index] { animate(next, index * timestep); }, &done);
+        if (AnimateScenes)
+            jobs.submit([this, &next, index] { AnimateScenes(next, index * timestep, jobs); }, &done);
+        jobs.wait(done);
+
+        next.Step = ++steps;
+        next.Due = due;
+        next.PreviousTime = previousTime;
+        next.Time = previousTime = index * timestep;
+        next.PreviousView = previousView;
+        next.View = previousView = state();
+        next.PreviousLightColor = previousLightColor;
+        previousLightColor = next.LightColor;
+        snapshots.publish();
+    }
+
+    void run()
+    {
+        Profiler::nameThread("simulation");
+        if (lockstep)
+        {
+            for (;;)
+            {
+                {
+                    // one step ahead at most: the last one published must have been taken
+                    std::unique_lock<std::mutex> lock(stepMutex);
+                    stepped.wait(lock, [this] { return consumed == published || !running; });
+                    if (!running)
+                        return;
+                }
+                step((double)steps * timestep);
+                {
+                    std::lock_guard<std::mutex> lock(stepMutex);
+                    published = steps;
+                }
+                stepped.notify_all();
+            }
+        }
+
+        Clock::time_point due = clockStart;
+        for (;;)
+        {
+            {
+                std::lock_guard<std::mutex> lock(stepMutex);
+                if (!running)
+                    return;
+            }
+            step(std::chrono::duration<double>(due - clockStart).count());
+            due += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(timestep));
+            const Clock::time_point now = Clock::now();
+            if (now - due > std::chrono::duration<double>(timestep * MAX_STEPS_BEHIND))
+                due = now;
+            std::this_thread::sleep_until(due);
+        }
+    }
+};
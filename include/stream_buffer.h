@@ -0,0 +1,284 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+// GL 4.4 / ARB_buffer_storage, which the GL 3.3 loader doesn't know about
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+typedef void (APIENTRYP PFNGLBUFFERSTORAGEPROC_STREAM)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+
+// What one frame of streaming cost
+struct StreamStats {
+    size_t BytesStreamed = 0;
+    unsigned int Allocations = 0;
+    unsigned int Overflows = 0;         // allocations refused because the region was full
+    unsigned int FenceWaits = 0;        // frames that found the GPU still reading their region
+    double FenceWaitMicroseconds = 0.0;
+};
+
+// A buffer for data written once per frame and read by that frame's draws only (per-object
+// uniform blocks, dynamic vertices). It is split into FRAMES_IN_FLIGHT regions used in turn;
+// endFrame() puts a fence behind the draws of a region and beginFrame() waits on the fence of
+// the region it is about to reuse, which normally signalled long ago. Within a frame allocate()
+// is a bump allocator, so nothing is ever orphaned or reallocated by the driver.
+//
+// With GL 4.4 or ARB_buffer_storage the whole buffer is mapped once, persistent and coherent,
+// and writes land directly in memory the GPU reads. Plain GL 3.3 maps the frame's region with
+// glMapBufferRange(UNSYNCHRONIZED) in beginFrame() and unmaps it in flush(): the fences are
+// what makes skipping the driver's synchronisation safe. Either way, call flush() after the
+// last write and before the first draw that reads the data.
+class StreamBuffer
+{
+public:
+    static const unsigned int FRAMES_IN_FLIGHT = 3;
+
+    struct Allocation {
+        void *Data;                     // null when the region is full
+        GLintptr Offset;                // into ID, for glBindBufferRange / attribute pointers
+    };
+
+    unsigned int ID = 0;
+    GLenum Target;
+    size_t Alignment;                   // of every allocation
+    bool Persistent = false;
+
+    // the last frame and the averages Report() prints
+    StreamStats Frame;
+
+    // load resolves glBufferStorage (the loader the context was created with); pass null, or
+    // persistent = false, to stay on the GL 3.3 path
+    StreamBuffer(GLenum target, size_t frameCapacity, GLADloadproc load, bool persistent = true) : Target(target)
+    {
+        GLint alignment = 16;
+        if (target == GL_UNIFORM_BUFFER)
+            glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        Alignment = (size_t)std::max(alignment, 16);
+        if (persistent && load && bufferStorageSupported())
+            bufferStorage = (PFNGLBUFFERSTORAGEPROC_STREAM)load("glBufferStorage");
+        Persistent = bufferStorage != nullptr;
+        create(frameCapacity);
+    }
+
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+    ~StreamBuffer()
+    {
+        Release();
+    }
+
+    size_t frameCapacity() const
+    {
+        return regionSize;
+    }
+
+    // grows every region to at least frameCapacity bytes; waits for the GPU to finish with all
+    // of them first, so call it before beginFrame() and rarely (the queue rounds up)
+    void reserve(size_t frameCapacity)
+    {
+        if (frameCapacity <= regionSize)
+            return;
+        flush();
+        for (unsigned int i = 0; i < FRAMES_IN_FLIGHT; ++i)
+            waitFence(i);
+        destroy();
+        create(frameCapacity + frameCapacity / 2);
+        std::cout << "stream buffer: grown to " << regionSize / 1024 << " KB per frame" << std::endl;
+    }
+
+    // waits until the GPU is done with the next region and starts handing it out
+    void beginFrame()
+    {
+        region = (region + 1) % FRAMES_IN_FLIGHT;
+        head = 0;
+        Frame = StreamStats();
+        waitFence(region);
+        if (Persistent)
+        {
+            mapped = base + region * regionSize;
+            return;
+        }
+        glBindBuffer(Target, ID);
+        mapped = (unsigned char*)glMapBufferRange(Target, (GLintptr)(region * regionSize), (GLsizeiptr)regionSize,
+                                                  GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_FLUSH_EXPLICIT_BIT);
+        if (!mapped)
+            std::cout << "ERROR::STREAM_BUFFER::MAP_FAILED" << std::endl;
+    }
+
+    // bytes of this frame's region, aligned to Alignment; cheap enough to call per object
+    Allocation allocate(size_t bytes)
+    {
+        const size_t offset = (head + Alignment - 1) / Alignment * Alignment;
+        if (!mapped || offset + bytes > regionSize)
+        {
+            ++Frame.Overflows;
+            return { nullptr, 0 };
+        }
+        head = offset + bytes;
+        ++Frame.Allocations;
+        Frame.BytesStreamed += bytes;
+        return { mapped + offset, (GLintptr)(region * regionSize + offset) };
+    }
+
+    // convenience for a single block
+    template <typename T>
+    Allocation write(const T &data)
+    {
+        Allocation allocation = allocate(sizeof(T));
+        if (allocation.Data)
+            std::memcpy(allocation.Data, &data, sizeof(T));
+        return allocation;
+    }
+
+    // makes this frame's writes visible to the GPU; nothing can be allocated afterwards
+    void flush()
+    {
+        if (!mapped)
+            return;
+        if (!Persistent)
+        {
+            glBindBuffer(Target, ID);
+            if (head > 0)
+                glFlushMappedBufferRange(Target, 0, (GLsizeiptr)head);
+            glUnmapBuffer(Target);
+        }
+        mapped = nullptr;
+    }
+
+    // after the draws reading this frame's data have been issued
+    void endFrame()
+    {
+        flush();
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        totals.BytesStreamed += Frame.BytesStreamed;
+        totals.Allocations += Frame.Allocations;
+        totals.Overflows += Frame.Overflows;
+        totals.FenceWaits += Frame.FenceWaits;
+        totals.FenceWaitMicroseconds += Frame.FenceWaitMicroseconds;
+        ++frames;
+    }
+
+    // averages once per second, like the stress scene; force prints whatever has accumulated
+    void Report(float deltaTime, bool force = false)
+    {
+        elapsed += deltaTime;
+        if ((elapsed < 1.0f && !force) || frames == 0)
+            return;
+        std::cout << "stream buffer (" << (Persistent ? "persistent" : "mapped per frame") << "): " << totals.BytesStreamed / frames
+                  << " bytes/frame in " << totals.Allocations / frames << " allocations, " << totals.FenceWaits << " fence waits ("
+                  << totals.FenceWaitMicroseconds / 1000.0 << " ms) and " << totals.Overflows << " overflows in " << frames << " frames" << std::endl;
+        totals = StreamStats();
+        elapsed = 0.0f;
+        frames = 0;
+    }
+
+    void Release()
+    {
+        if (!ID)
+            return;
+        flush();
+        destroy();
+    }
+
+private:
+    PFNGLBUFFERSTORAGEPROC_STREAM bufferStorage = nullptr;
+    size_t regionSize = 0;
+    unsigned char *base = nullptr;      // persistent mapping of the whole buffer
+    unsigned char *mapped = nullptr;    // this frame's region while it can be written
+    size_t head = 0;
+    unsigned int region = FRAMES_IN_FLIGHT - 1;
+    GLsync fences[FRAMES_IN_FLIGHT] = {};
+    StreamStats totals;
+    float elapsed = 0.0f;
+    unsigned int frames = 0;
+
+    static bool bufferStorageSupported()
+    {
+        GLint major = 0, minor = 0, count = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        if (major > 4 || (major == 4 && minor >= 4))
+            return true;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; ++i)
+        {
+            const char *extension = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+            if (extension && std::strcmp(extension, "GL_ARB_buffer_storage") == 0)
+                return true;
+        }
+        return false;
+    }
+
+    void create(size_t frameCapacity)
+    {
+        regionSize = (frameCapacity + Alignment - 1) / Alignment * Alignment;
+        const GLsizeiptr size = (GLsizeiptr)(regionSize * FRAMES_IN_FLIGHT);
+        glGenBuffers(1, &ID);
+        glBindBuffer(Target, ID);
+        if (Persistent)
+        {
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            bufferStorage(Target, size, NULL, flags);
+            base = (unsigned char*)glMapBufferRange(Target, 0, size, flags);
+            if (!base)
+            {
+                std::cout << "ERROR::STREAM_BUFFER::PERSISTENT_MAP_FAILED: falling back to mapping per frame" << std::endl;
+                glDeleteBuffers(1, &ID);
+                Persistent = false;
+                create(frameCapacity);
+                return;
+            }
+        }
+        else
+            glBufferData(Target, size, NULL, GL_STREAM_DRAW);
+        glBindBuffer(Target, 0);
+    }
+
+    void destroy()
+    {
+        for (GLsync &fence : fences)
+        {
+            if (fence)
+                glDeleteSync(fence);
+            fence = nullptr;
+        }
+        if (Persistent && base)
+        {
+            glBindBuffer(Target, ID);
+            glUnmapBuffer(Target);
+        }
+        glDeleteBuffers(1, &ID);
+        ID = 0;
+        base = mapped = nullptr;
+    }
+
+    void waitFence(unsigned int index)
+    {
+        GLsync &fence = fences[index];
+        if (!fence)
+            return;
+        if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+        {
+            PROFILE_ZONE("stream fence wait");
+            const auto begin = std::chrono::steady_clock::now();
+            while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+                ;
+            ++Frame.FenceWaits;
+            Frame.FenceWaitMicroseconds += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+        }
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+};
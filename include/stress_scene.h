@@ -0,0 +1,581 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "shader.h"
+#include "shader_variants.h"
+#include "normal_matrix.h"
+#include "mesh.h"
+#include "mesh_cache.h"
+#include "lod_selector.h"
+#include "instanced_renderer.h"
+#include "aabb_tree.h"
+#include "occlusion_buffer.h"
+#include "obj_loader.h"
+#include "profiler.h"
+#include "render_queue.h"
+#include "simulation.h"
+#include "thread_pool.h"
+#include "transform_hierarchy.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Many lit cubes and spheres scattered in front of the camera, used to measure draw submission
+// cost. Draws go through the RenderQueue. With instancing each mesh is a single
+// glDrawElementsInstanced call; without it every object is its own command (model matrix,
+// material uniforms and a glDrawElements), recorded in scene order by worker threads into a
+// bucket each, which leaves the queue a realistic mix of cubes and spheres to sort. With
+// culling every object is a proxy in a DynamicAABBTree and only those inside the camera
+// frustum are uploaded / drawn. The sphere mesh comes with a LOD chain and every sphere is
+// drawn at the level the LodSelector picks for it; instanced, that is one draw per level in use,
+// each with its own VAO and instance buffer. With occlusion the Cornell box stands in the field,
+// open side to the camera and its back wall halfway through, and is drawn into an
+// OcclusionBuffer every frame; objects it hides are dropped before anything is recorded. Object
+// transforms live in a TransformHierarchy, every object a child of the cluster of the field it
+// sits in, and their world matrices are written by it straight into the instance arrays; with
+// spin the clusters turn in place, so every object is recomputed each simulation step by
+// animate(), published with its normal matrix in the FrameSnapshot, and taken into the
+// instance arrays (and moved in the tree) by apply() on the GL thread. Both
+// programs are LIT permutations of the surface shaders, whose light uniforms the caller sets.
+// Frame time, draw calls, triangles and the culling stats are printed once per second.
+class StressScene
+{
+public:
+    unsigned int DrawCalls = 0;
+    size_t Triangles = 0;
+    // the last frame's culling, zero without culling
+    CullStats Culling;
+    // the last frame's occlusion culling, zero without occlusion
+    OcclusionStats Occlusion;
+
+    // objects below this many are recorded on the calling thread
+    static const size_t PARALLEL_RECORD_MIN = 4096;
+    // instance normal matrices are computed in jobs of this many
+    static const size_t NORMAL_CHUNK = 4096;
+
+    // sphereMesh is any closed OBJ, scaled to fit the unit cube; it and the Cornell box are
+    // quantized within tolerance, if given
+    StressScene(size_t count, bool instanced, bool culling, bool occlusion, bool spin, const std::string &sphereMesh, const VertexTolerance *tolerance,
+                unsigned int cubeVAO, GLsizei cubeIndexCount, ShaderVariants &surfaces, RenderQueue &queue)
+        : instanced(instanced), culling(culling), spin(spin), cubeVAO(cubeVAO), cubeIndexCount(cubeIndexCount),
+          sphere(loadSphere(sphereMesh, tolerance, sphereScale)), queue(queue), occlusionBuffer(recorders)
+    {
+        program = queue.addProgram(surfaces.get(SHADER_LIT));
+        if (instanced)
+            instancedProgram = queue.addProgram(surfaces.get(SHADER_LIT | SHADER_INSTANCED));
+        queue.reserveBuckets(1 + recorders.size());
+        recordedTriangles.resize(recorders.size());
+
+        generate(count);
+        sphere.Report(sphereMesh);
+        if (occlusion)
+            loadOccluders(count, tolerance);
+        if (culling)
+        {
+            for (size_t i = 0; i < cubes.size(); ++i)
+                proxies.push_back(tree.insert(bounds((uint32_t)i), (uint32_t)i));
+            for (size_t i = 0; i < spheres.size(); ++i)
+                proxies.push_back(tree.insert(bounds((uint32_t)i | SPHERE_BIT), (uint32_t)i | SPHERE_BIT));
+        }
+        sphereLods.assign(spheres.size(), 0);
+        if (instanced)
+        {
+            // the instance attributes live at locations 3..8 and 11..13, which the
+            // non-instanced programs never read, so the shared VAOs keep working for them. Level 0 of the
+            // spheres uses the mesh's own VAO, coarser levels get one each
+            cubeInstances.attach(cubeVAO);
+            const size_t levels = std::max<size_t>(sphere.Lods.size(), 1);
+            sphereInstances.resize(levels);
+            sphereLevels.resize(levels);
+            sphereVAOs.push_back(sphere.VAO);
+            for (size_t level = 1; level < levels; ++level)
+                sphereVAOs.push_back(sphere.createVertexArray());
+            for (size_t level = 0; level < levels; ++level)
+                sphereInstances[level].attach(sphereVAOs[level]);
+            // with culling or LODs Draw() replaces these with the visible objects every frame
+            cubeInstances.upload(cubes);
+            sphereInstances[0].upload(spheres);
+        }
+        std::cout << "stress scene: " << cubes.size() << " cubes + " << spheres.size() << " spheres (" << sphereMesh << ", "
+                  << sphere.IndexCount / 3 << " triangles, " << sphere.Lods.size() << " levels of detail), "
+                  << (instanced ? "instanced" : "one draw per object") << (culling ? ", frustum culled" : "")
+                  << (occluderMesh ? ", occlusion culled behind the Cornell box" : "") << ", " << clusters.size() << " clusters"
+                  << (spin ? " turning" : "") << std::endl;
+    }
+
+    // simulation thread, with spin: turns every cluster to where it is at time (seconds) and
+    // publishes the objects' world matrices in snapshot, and their normal matrices when
+    // instanced. The transforms are the simulation's once it has started
+    void animate(FrameSnapshot &snapshot, float time, ThreadPool &jobs)
+    {
+        if (!spin)
+            return;
+        PROFILE_ZONE("stress transforms");
+        for (size_t i = 0; i < clusters.size(); ++i)
+            transforms.setRotation(clusters[i], glm::angleAxis(time * clusterSpeeds[i], glm::vec3(0.0f, 1.0f, 0.0f)));
+        transforms.update(&jobs);
+        snapshot.StressModels.assign(worlds.begin(), worlds.end());
+        snapshot.StressTransforms = transforms.Frame;
+        if (!instanced)
+            return;
+        snapshot.StressNormals.resize(worlds.size());
+        JobCounter computed;
+        for (size_t first = 0; first < worlds.size(); first += NORMAL_CHUNK)
+        {
+            const glm::mat4 *models = worlds.data() + first;
+            NormalMatrix *normals = snapshot.StressNormals.data() + first;
+            const size_t count = std::min(NORMAL_CHUNK, worlds.size() - first);
+            jobs.submit([models, normals, count] {
+                NormalMatrices::compute(models, sizeof(glm::mat4), normals, sizeof(NormalMatrix), count);
+            }, &computed);
+        }
+        jobs.wait(computed);
+    }
+
+    // GL thread, with spin: takes the matrices of the step snapshot holds into the instance
+    // arrays and moves the objects in the culling tree; once per step
+    void apply(const FrameSnapshot &snapshot)
+    {
+        if (!spin || snapshot.Step == appliedStep || snapshot.StressModels.size() != cubes.size() + spheres.size())
+            return;
+        PROFILE_ZONE("stress apply");
+        appliedStep = snapshot.Step;
+        const bool normals = snapshot.StressNormals.size() == snapshot.StressModels.size();
+        for (std::vector<InstanceData> *instances : { &cubes, &spheres })
+        {
+            const size_t first = instances == &cubes ? 0 : cubes.size();
+            for (size_t i = 0; i < instances->size(); ++i)
+            {
+                (*instances)[i].Model = snapshot.StressModels[first + i];
+                if (normals)
+                    (*instances)[i].Normal = snapshot.StressNormals[first + i];
+            }
+        }
+        transformStats = snapshot.StressTransforms;
+        transformMicroseconds += transformStats.Microseconds;
+        if (!culling)
+            return;
+        for (size_t i = 0; i < cubes.size(); ++i)
+            tree.move(proxies[i], bounds((uint32_t)i));
+        for (size_t i = 0; i < spheres.size(); ++i)
+            tree.move(proxies[cubes.size() + i], bounds((uint32_t)i | SPHERE_BIT));
+    }
+
+    // frustum is Camera::GetFrustumPlanes() of this frame and viewProjection the matrix it came
+    // from; records into the queue, which the caller submits. Depth keys are the distance to
+    // viewPos over farPlane
+    void Draw(const std::array<glm::vec4, 6> &frustum, const glm::mat4 &viewProjection, const glm::vec3 &viewPos, float farPlane,
+              const LodSelector &lod)
+    {
+        DrawCalls = 0;
+        Triangles = 0;
+        drawn = &objects;
+        if (culling)
+        {
+            PROFILE_ZONE("stress cull");
+            tree.cull(frustum, visible, Culling);
+            drawn = &visible;
+            cullMicroseconds += Culling.Microseconds;
+        }
+        if (occluderMesh)
+        {
+            if (!culling)
+                visible = objects;
+            occlusionBuffer.begin(viewProjection);
+            occlusionBuffer.addOccluder(occluderPositions, occluderIndices, occluderModel);
+            occlusionBuffer.rasterize();
+            occlusionBuffer.cull(visible, [this](uint32_t id) { return bounds(id); });
+            drawn = &visible;
+            Occlusion = occlusionBuffer.Frame;
+            rasterMicroseconds += Occlusion.RasterMicroseconds;
+            occlusionTestMicroseconds += Occlusion.TestMicroseconds;
+            recordOccluders(viewPos, 1.0f / farPlane);
+        }
+
+        PROFILE_ZONE("stress record");
+        if (instanced)
+        {
+            const bool lods = lod.Enabled && sphere.Lods.size() > 1;
+            if (culling || occluderMesh || lods || spin)
+            {
+                visibleCubes.clear();
+                for (std::vector<InstanceData> &level : sphereLevels)
+                    level.clear();
+                for (uint32_t id : *drawn)
+                {
+                    if (!(id & SPHERE_BIT))
+                    {
+                        visibleCubes.push_back(cubes[id]);
+                        continue;
+                    }
+                    const uint32_t index = id & ~SPHERE_BIT;
+                    const float distance = glm::length(glm::vec3(spheres[index].Model[3]) - viewPos);
+                    sphereLevels[lod.select(sphere.Lods.data(), sphere.Lods.size(), sphereScales[index], distance, sphereLods[index])].push_back(spheres[index]);
+                }
+                if (culling || occluderMesh || spin)
+                    cubeInstances.upload(visibleCubes);
+                for (size_t level = 0; level < sphereLevels.size(); ++level)
+                    sphereInstances[level].upload(sphereLevels[level]);
+            }
+            RenderBucket &bucket = queue.bucket(0);
+            if (cubeInstances.Count)
+            {
+                bucket.draw({ RenderQueue::makeKey(RenderQueue::OPAQUE_PASS, instancedProgram, 0, cubeVAO, 0.0f), nullptr, nullptr,
+                              instancedProgram, cubeVAO, 0, (uint32_t)cubeIndexCount, 0, (uint32_t)cubeInstances.Count });
+                Triangles += cubeInstances.Count * cubeIndexCount / 3;
+                ++DrawCalls;
+            }
+            for (size_t level = 0; level < sphereInstances.size(); ++level)
+            {
+                if (!sphereInstances[level].Count)
+                    continue;
+                const MeshLod range = sphere.lod(level);
+                bucket.draw({ RenderQueue::makeKey(RenderQueue::OPAQUE_PASS, instancedProgram, 0, sphereVAOs[level], 0.0f), nullptr, nullptr,
+                              instancedProgram, sphereVAOs[level], 0, range.IndexCount, range.IndexOffset, (uint32_t)sphereInstances[level].Count });
+                Triangles += sphereInstances[level].Count * range.IndexCount / 3;
+                ++DrawCalls;
+            }
+            return;
+        }
+        DrawCalls += (unsigned int)drawn->size();
+        const float invFar = 1.0f / farPlane;
+        if (drawn->size() < PARALLEL_RECORD_MIN)
+        {
+            Triangles += record(queue.bucket(1), drawn->data(), drawn->size(), viewPos, invFar, lod);
+            return;
+        }
+        // one contiguous range per worker, each into its own bucket; this thread records ranges
+        // too while it waits
+        JobCounter recorded;
+        const size_t workers = recorders.size(), per = (drawn->size() + workers - 1) / workers;
+        for (size_t worker = 0; worker < workers; ++worker)
+        {
+            const size_t first = std::min(drawn->size(), worker * per), count = std::min(drawn->size() - first, per);
+            RenderBucket &bucket = queue.bucket(1 + worker);
+            const uint32_t *ids = drawn->data() + first;
+            recorders.submit([this, &bucket, ids, count, viewPos, invFar, &lod, worker]() {
+                PROFILE_ZONE("record stress objects");
+                recordedTriangles[worker] = record(bucket, ids, count, viewPos, invFar, lod);
+            }, &recorded);
+        }
+        recorders.wait(recorded);
+        for (size_t triangles : recordedTriangles)
+            Triangles += triangles;
+    }
+
+    // visit(position, isSphere, index) for every object the last Draw() recorded, cubes[index]
+    // or spheres[index]
+    template <typename Visit>
+    void visitDrawn(const Visit &visit) const
+    {
+        for (uint32_t id : *drawn)
+        {
+            const bool isSphere = (id & SPHERE_BIT) != 0;
+            const uint32_t index = id & ~SPHERE_BIT;
+            visit(glm::vec3((isSphere ? spheres[index] : cubes[index]).Model[3]), isSphere, index);
+        }
+    }
+
+    // accumulates frame times and prints the average once per second; force prints the last
+    // frame's counts right away (headless runs, whose frame times FrameStats reports)
+    void Report(float deltaTime, bool force = false)
+    {
+        if (force)
+        {
+            std::cout << "stress: " << (cubes.size() + spheres.size()) << " objects, " << DrawCalls << " draw calls, "
+                      << Triangles << " triangles in the last frame" << std::endl;
+            if (occluderMesh)
+                reportOcclusion(Occlusion.RasterMicroseconds, Occlusion.TestMicroseconds);
+            if (spin)
+                reportTransforms(transformStats.Microseconds);
+            return;
+        }
+        elapsed += deltaTime;
+        ++frames;
+        if (elapsed < 1.0f)
+            return;
+        std::cout << "stress: " << (cubes.size() + spheres.size()) << " objects, " << DrawCalls << " draw calls/frame, " << Triangles << " triangles/frame, "
+                  << 1000.0f * elapsed / frames << " ms/frame (" << frames / elapsed << " fps)" << std::endl;
+        if (culling)
+            std::cout << "culling: " << Culling.Visible << " visible, " << Culling.Culled << " culled, " << Culling.NodesVisited
+                      << " nodes visited, " << cullMicroseconds / frames << " us/frame" << std::endl;
+        if (occluderMesh)
+            reportOcclusion(rasterMicroseconds / frames, occlusionTestMicroseconds / frames);
+        if (spin)
+            reportTransforms(transformMicroseconds / frames);
+        elapsed = 0.0f;
+        cullMicroseconds = 0.0f;
+        rasterMicroseconds = 0.0;
+        occlusionTestMicroseconds = 0.0;
+        transformMicroseconds = 0.0;
+        frames = 0;
+    }
+
+    void Release()
+    {
+        glDeleteBuffers(1, &cubeInstances.ID);
+        for (const InstanceBuffer &buffer : sphereInstances)
+            glDeleteBuffers(1, &buffer.ID);
+        for (size_t level = 1; level < sphereVAOs.size(); ++level)
+            glDeleteVertexArrays(1, &sphereVAOs[level]);
+        sphere.Release();
+        if (occluderMesh)
+        {
+            occluderMesh->Release();
+            delete occluderMesh;
+        }
+    }
+
+private:
+    // cull() reports cubes[i] as i and spheres[i] as i | SPHERE_BIT
+    static const uint32_t SPHERE_BIT = 0x80000000u;
+
+    bool instanced;
+    bool culling;
+    bool spin;
+    unsigned int cubeVAO;
+    GLsizei cubeIndexCount;
+    float sphereScale; // set by loadSphere(), so it must be declared before sphere
+    Mesh sphere;
+    RenderQueue &queue;
+    uint32_t program, instancedProgram = 0;
+    ThreadPool recorders;
+    std::vector<InstanceData> cubes, spheres;
+    std::vector<RenderMaterial> cubeMaterials, sphereMaterials;
+    std::vector<uint32_t> objects;  // every object in generation order, ids as cull() reports them
+    std::vector<float> sphereScales;    // model to world units
+    std::vector<uint8_t> sphereLods;    // current level of each sphere, see LodSelector
+    std::vector<size_t> recordedTriangles;
+    InstanceBuffer cubeInstances;
+    std::vector<InstanceBuffer> sphereInstances;   // per level of detail
+    std::vector<unsigned int> sphereVAOs;
+    DynamicAABBTree tree;
+    std::vector<int32_t> proxies;       // the cubes' then the spheres', in the tree
+    std::vector<uint32_t> visible;
+    const std::vector<uint32_t> *drawn = &objects;  // objects or visible, whichever Draw() recorded
+    std::vector<InstanceData> visibleCubes;
+    std::vector<std::vector<InstanceData>> sphereLevels;
+    float cullMicroseconds = 0.0f;
+    // the Cornell box: drawn as one command per file, rasterized as a whole
+    OcclusionBuffer occlusionBuffer;
+    Mesh *occluderMesh = nullptr;
+    glm::mat4 occluderModel;
+    std::vector<glm::vec3> occluderPositions;
+    std::vector<uint32_t> occluderIndices;
+    std::vector<MeshLod> occluderRanges;
+    std::vector<RenderMaterial> occluderMaterials;
+    double rasterMicroseconds = 0.0, occlusionTestMicroseconds = 0.0;
+    // a node per cluster and one under it per object; cubeNodes[i] writes cubes[i].Model and
+    // sphereNodes[i] spheres[i].Model
+    TransformHierarchy transforms;
+    std::vector<uint32_t> clusters, cubeNodes, sphereNodes;
+    std::vector<float> clusterSpeeds;   // radians per second, with spin
+    // with spin, where the simulation thread's updates write the world matrices, cubes then
+    // spheres; the GL thread only sees them through the snapshots
+    std::vector<glm::mat4> worlds;
+    TransformStats transformStats;      // of the step apply() took last
+    uint64_t appliedStep = UINT64_MAX;
+    double transformMicroseconds = 0.0;
+    float elapsed = 0.0f;
+    unsigned int frames = 0;
+
+    // sphere meshes aren't unit sized; scale is what makes them match the unit cube
+    static Mesh loadSphere(const std::string &path, const VertexTolerance *tolerance, float &scale)
+    {
+        CachedMesh data(path, true);
+        float radius = 0.0f;
+        for (uint32_t i = 0; i < data.View.VertexCount; ++i)
+            radius = std::max(radius, glm::length(data.View.Vertices[i].Position));
+        scale = radius > 0.0f ? 0.5f / radius : 1.0f;
+        return Mesh(data.View, tolerance);
+    }
+
+    // world bounds of an object, as the tree holds them
+    AABB bounds(uint32_t id) const
+    {
+        if (id & SPHERE_BIT)
+            return AABB::transformed(spheres[id & ~SPHERE_BIT].Model, glm::vec3(0.5f / sphereScale));
+        return AABB::transformed(cubes[id].Model, glm::vec3(0.5f));
+    }
+
+    // the Cornell box (without its light) as wide and tall as the field plus a margin and half
+    // as deep, turned to face the starting camera with its front at the field's near edge
+    void loadOccluders(size_t count, const VertexTolerance *tolerance)
+    {
+        const glm::vec3 white(0.725f, 0.71f, 0.68f), red(0.63f, 0.065f, 0.05f), green(0.14f, 0.45f, 0.091f);
+        struct OccluderFile { const char *Name; glm::vec3 Color; };
+        const OccluderFile files[] = { { "floor.obj", white }, { "left.obj", red }, { "right.obj", green },
+                                       { "tallbox.obj", white }, { "shortbox.obj", white } };
+        MeshData box;
+        for (const OccluderFile &file : files)
+        {
+            MeshData part;
+            if (!ObjLoader::load(std::string("../models/cornellbox/") + file.Name, part, 1))
+                return;
+            const uint32_t base = (uint32_t)box.Vertices.size();
+            occluderRanges.push_back({ (uint32_t)box.Indices.size(), (uint32_t)part.Indices.size(), 0.0f, 0 });
+            occluderMaterials.push_back({ file.Color * 0.5f, file.Color, glm::vec3(0.1f), 8.0f });
+            box.Vertices.insert(box.Vertices.end(), part.Vertices.begin(), part.Vertices.end());
+            for (uint32_t index : part.Indices)
+                box.Indices.push_back(base + index);
+        }
+        for (const Vertex &vertex : box.Vertices)
+            occluderPositions.push_back(vertex.Position);
+        occluderIndices = box.Indices;
+        occluderMesh = new Mesh(box.view(), tolerance);
+        occluderMesh->Report("cornellbox");
+
+        // the box spans 556 x 548.8 x 559.2 mm with its open side at z = 0
+        const float side = 1.5f * std::cbrt((float)count);
+        const glm::vec3 size(side * 1.2f, side * 1.2f, side * 0.5f);
+        occluderModel = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -2.0f - size.z * 0.5f));
+        occluderModel = glm::scale(occluderModel, size / glm::vec3(556.0f, 548.8f, 559.2f));
+        occluderModel = glm::rotate(occluderModel, 3.14159265f, glm::vec3(0.0f, 1.0f, 0.0f));
+        occluderModel = glm::translate(occluderModel, glm::vec3(-278.0f, -274.4f, -279.6f));
+    }
+
+    // the box's parts into bucket 0 with the non-instanced program
+    void recordOccluders(const glm::vec3 &viewPos, float invFar)
+    {
+        RenderBucket &bucket = queue.bucket(0);
+        const float depth = glm::length(glm::vec3(occluderModel[3]) - viewPos) * invFar;
+        for (size_t i = 0; i < occluderRanges.size(); ++i)
+        {
+            bucket.draw({ RenderQueue::makeKey(RenderQueue::OPAQUE_PASS, program, 0, occluderMesh->VAO, depth), &occluderModel, &occluderMaterials[i],
+                          program, occluderMesh->VAO, 0, occluderRanges[i].IndexCount, occluderRanges[i].IndexOffset, 0 });
+            Triangles += occluderRanges[i].IndexCount / 3;
+            ++DrawCalls;
+        }
+    }
+
+    // draws (or instances) saved are the objects found occluded, one each
+    void reportOcclusion(double rasterMicros, double testMicros) const
+    {
+        std::cout << "occlusion: " << Occlusion.Occluded << " of " << Occlusion.Tested << " objects occluded ("
+                  << (Occlusion.Tested ? 100.0 * Occlusion.Occluded / Occlusion.Tested : 0.0) << "%), "
+                  << (instanced ? "instances " : "draw calls ") << Occlusion.Tested << " -> " << Occlusion.Tested - Occlusion.Occluded << "; "
+                  << Occlusion.Triangles << " occluder triangles rasterized in " << rasterMicros << " us on " << recorders.size()
+                  << " threads, tests " << testMicros << " us" << std::endl;
+    }
+
+    // objects fill a cube of space in front of the starting camera, about 1.5 units apart; the
+    // cube is cut into a grid of clusters of about 512 objects each
+    void generate(size_t count)
+    {
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        const float side = 1.5f * std::cbrt((float)count);
+        const glm::vec3 center(0.0f, 0.0f, -side * 0.5f - 2.0f);
+        const int grid = std::max(1, (int)std::round(std::cbrt(count / 512.0f)));
+        const float cell = side / grid;
+        for (int z = 0; z < grid; ++z)
+            for (int y = 0; y < grid; ++y)
+                for (int x = 0; x < grid; ++x)
+                {
+                    clusters.push_back(transforms.add(TransformHierarchy::NONE, center + (glm::vec3(x, y, z) + 0.5f) * cell - side * 0.5f));
+                    clusterSpeeds.push_back(((x + y + z) % 2 ? 0.2f : -0.2f) * (1.0f + 0.5f * (clusters.size() % 3)));
+                }
+        cubes.reserve(count / 2 + 1);
+        spheres.reserve(count / 2 + 1);
+        for (size_t i = 0; i < count; ++i)
+        {
+            glm::vec3 position = center + (glm::vec3(unit(rng), unit(rng), unit(rng)) - 0.5f) * side;
+            glm::vec3 axis = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) + 0.01f);
+            float scale = 0.3f + 0.4f * unit(rng);
+            const glm::quat rotation = glm::angleAxis(unit(rng) * 6.2831853f, axis);
+            InstanceData instance;
+            instance.Diffuse = glm::vec4(unit(rng), unit(rng), unit(rng), 8.0f + 56.0f * unit(rng));
+            instance.Specular = glm::vec4(0.5f, 0.5f, 0.5f, 0.0f);
+            const RenderMaterial material = { glm::vec3(instance.Diffuse), glm::vec3(instance.Diffuse), glm::vec3(instance.Specular), instance.Diffuse.w };
+            const glm::ivec3 at = glm::clamp(glm::ivec3(glm::floor((position - center + side * 0.5f) / cell)), glm::ivec3(0), glm::ivec3(grid - 1));
+            const uint32_t cluster = clusters[(at.z * grid + at.y) * grid + at.x];
+            const glm::vec3 offset = position - transforms.position(cluster);
+            if (i % 2 == 0)
+            {
+                cubeNodes.push_back(transforms.add(cluster, offset, rotation, glm::vec3(scale)));
+                objects.push_back((uint32_t)cubes.size());
+                cubes.push_back(instance);
+                cubeMaterials.push_back(material);
+            }
+            else
+            {
+                sphereNodes.push_back(transforms.add(cluster, offset, rotation, glm::vec3(scale * sphereScale)));
+                objects.push_back((uint32_t)spheres.size() | SPHERE_BIT);
+                spheres.push_back(instance);
+                sphereScales.push_back(scale * sphereScale);
+                sphereMaterials.push_back(material);
+            }
+        }
+        // the instance arrays are complete, so their matrices stay put
+        for (size_t i = 0; i < cubes.size(); ++i)
+            transforms.bind(cubeNodes[i], &cubes[i].Model);
+        for (size_t i = 0; i < spheres.size(); ++i)
+            transforms.bind(sphereNodes[i], &spheres[i].Model);
+        transforms.update(&recorders);
+        if (instanced)
+            updateNormalMatrices();
+        if (!spin)
+            return;
+        // from here on the simulation updates the transforms, into a buffer of its own
+        worlds.resize(cubes.size() + spheres.size());
+        for (size_t i = 0; i < cubes.size(); ++i)
+            transforms.bind(cubeNodes[i], &worlds[i]);
+        for (size_t i = 0; i < spheres.size(); ++i)
+            transforms.bind(sphereNodes[i], &worlds[cubes.size() + i]);
+    }
+
+    // the instances' normal matrices from their models, after the transforms wrote those
+    void updateNormalMatrices()
+    {
+        PROFILE_ZONE("stress normal matrices");
+        JobCounter computed;
+        for (std::vector<InstanceData> *instances : { &cubes, &spheres })
+            for (size_t first = 0; first < instances->size(); first += NORMAL_CHUNK)
+            {
+                InstanceData *chunk = instances->data() + first;
+                const size_t count = std::min(NORMAL_CHUNK, instances->size() - first);
+                recorders.submit([chunk, count] {
+                    NormalMatrices::compute(&chunk->Model, sizeof(InstanceData), &chunk->Normal, sizeof(InstanceData), count);
+                }, &computed);
+            }
+        recorders.wait(computed);
+    }
+
+    // the recomputed matrices of the last step applied; its time is an average over the frames reported
+    void reportTransforms(double micros) const
+    {
+        std::cout << "transforms: " << transformStats.Updated << " of " << transformStats.Nodes << " nodes in "
+                  << transformStats.Levels << " levels updated in " << micros << " us on the simulation's threads" << std::endl;
+    }
+
+    // one command per object, spheres at their selected level; safe from any thread as long as
+    // each thread has its own bucket and ids. Returns the triangles recorded
+    size_t record(RenderBucket &bucket, const uint32_t *ids, size_t count, const glm::vec3 &viewPos, float invFar, const LodSelector &lod)
+    {
+        size_t triangles = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            const bool isSphere = (ids[i] & SPHERE_BIT) != 0;
+            const uint32_t index = ids[i] & ~SPHERE_BIT;
+            const InstanceData &object = isSphere ? spheres[index] : cubes[index];
+            const unsigned int vao = isSphere ? sphere.VAO : cubeVAO;
+            const float distance = glm::length(glm::vec3(object.Model[3]) - viewPos);
+            MeshLod range = { 0, (uint32_t)cubeIndexCount, 0.0f, 0 };
+            if (isSphere)
+                range = sphere.lod(lod.select(sphere.Lods.data(), sphere.Lods.size(), sphereScales[index], distance, sphereLods[index]));
+            bucket.draw({ RenderQueue::makeKey(RenderQueue::OPAQUE_PASS, program, 0, vao, distance * invFar), &object.Model,
+                          isSphere ? &sphereMaterials[index] : &cubeMaterials[index], program, vao, 0, range.IndexCount, range.IndexOffset, 0 });
+            triangles += range.IndexCount / 3;
+        }
+        return triangles;
+    }
+};
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "glyph_atlas.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// One corner of a glyph quad: pixels from the top-left of the viewport, atlas coordinates,
+// RGBA8 colour
+struct TextVertex {
+    float X, Y;
+    float U, V;
+    uint32_t Color;
+};
+
+enum TextAnchor {
+    TEXT_LEFT,                          // the pen starts at x
+    TEXT_CENTER                         // the run is centred on x
+};
+
+// What one frame of text cost and produced
+struct TextStats {
+    size_t Runs = 0;                    // add() calls
+    size_t Glyphs = 0;                  // quads written
+    size_t RunsShaped = 0;              // runs not found in the cache
+    double Microseconds = 0.0;          // CPU, inside add()
+};
+
+// Lays text out into glyph quads over a GlyphAtlas, every run of a frame into the same vertex
+// array so the whole frame's text is one draw. A run is shaped once, into its glyphs and pen
+// positions (advances plus kerning), and kept by its text and size, so a label drawn every
+// frame costs a hash lookup and its quads. Once the cache holds more than MAX_RUNS, the runs
+// the last frame didn't use are dropped.
+class TextBatch
+{
+public:
+    static const size_t MAX_RUNS = 16384;
+
+    std::vector<TextVertex> Vertices;   // four per glyph: top-left, top-right, bottom-right, bottom-left
+    TextStats Frame;                    // the frame being laid out, see newFrame()
+
+    explicit TextBatch(GlyphAtlas &atlas) : atlas(atlas) {}
+
+    // text (UTF-8) at size pixels with its baseline at y
+    void add(float x, float y, int size, const glm::vec4 &color, const char *text, TextAnchor anchor = TEXT_LEFT)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        const Run &run = shape(text, size);
+        if (anchor == TEXT_CENTER)
+            x -= run.Width * 0.5f;
+        x = std::floor(x + 0.5f);
+        y = std::floor(y + 0.5f);
+        const uint32_t packed = pack(color);
+        const float invWidth = 1.0f / atlas.getWidth(), invHeight = 1.0f / atlas.getHeight();
+        for (const RunGlyph &placed : run.Glyphs)
+        {
+            if (!atlas.place(placed.Glyph, frame))
+                continue;
+            const GlyphInfo &info = atlas.info(placed.Glyph);
+            if (info.Width == 0)
+                continue;
+            const float x0 = x + placed.X + info.BearingX, y0 = y - info.BearingY;
+            const float x1 = x0 + info.Width, y1 = y0 + info.Height;
+            const float u0 = info.X * invWidth, v0 = info.Y * invHeight;
+            const float u1 = (info.X + info.Width) * invWidth, v1 = (info.Y + info.Height) * invHeight;
+            Vertices.push_back({ x0, y0, u0, v0, packed });
+            Vertices.push_back({ x1, y0, u1, v0, packed });
+            Vertices.push_back({ x1, y1, u1, v1, packed });
+            Vertices.push_back({ x0, y1, u0, v1, packed });
+            ++Frame.Glyphs;
+        }
+        ++Frame.Runs;
+        Frame.Microseconds += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // width of text at size, shaping it if it isn't cached
+    float measure(const char *text, int size)
+    {
+        return shape(text, size).Width;
+    }
+
+    size_t cachedRuns() const { return runs.size(); }
+
+    // empties the vertex array for the next frame, whose glyphs the atlas may not evict
+    void newFrame()
+    {
+        Vertices.clear();
+        Frame = TextStats();
+        ++frame;
+        if (runs.size() <= MAX_RUNS)
+            return;
+        for (auto it = runs.begin(); it != runs.end();)
+        {
+            if (it->second.LastUsed + 1 < frame)
+                it = runs.erase(it);
+            else
+                ++it;
+        }
+    }
+
+private:
+    struct RunGlyph {
+        uint32_t Glyph;
+        float X;                        // pen position from the run's start
+    };
+
+    struct Run {
+        std::vector<RunGlyph> Glyphs;
+        float Width = 0.0f;
+        uint32_t LastUsed = 0;
+    };
+
+    GlyphAtlas &atlas;
+    uint32_t frame = 1;                 // 0 is never, for the atlas
+    std::unordered_map<std::string, Run> runs;  // keyed by two bytes of size, then the text
+    std::string key;                    // reused so lookups don't allocate
+
+    static uint32_t pack(const glm::vec4 &color)
+    {
+        const glm::vec4 c = glm::clamp(color, 0.0f, 1.0f) * 255.0f + 0.5f;
+        return (uint32_t)c.r | (uint32_t)c.g << 8 | (uint32_t)c.b << 16 | (uint32_t)c.a << 24;
+    }
+
+    // the next code point of a UTF-8 string, U+FFFD for a malformed sequence
+    static uint32_t decode(const unsigned char *&s)
+    {
+        const uint32_t lead = *s++;
+        if (lead < 0x80)
+            return lead;
+        const int extra = lead >= 0xF0 ? 3 : lead >= 0xE0 ? 2 : lead >= 0xC0 ? 1 : -1;
+        if (extra < 0)
+            return 0xFFFD;
+        uint32_t codepoint = lead & (0x3F >> extra);
+        for (int i = 0; i < extra; ++i, ++s)
+        {
+            if ((*s & 0xC0) != 0x80)
+                return 0xFFFD;
+            codepoint = codepoint << 6 | (*s & 0x3F);
+        }
+        return codepoint;
+    }
+
+    const Run& shape(const char *text, int size)
+    {
+        key.assign(1, (char)(size & 0xFF));
+        key.push_back((char)(size >> 8));
+        key.append(text);
+        auto found = runs.find(key);
+        if (found == runs.end())
+        {
+            ++Frame.RunsShaped;
+            Run run;
+            float pen = 0.0f;
+            uint32_t previous = UINT32_MAX;
+            for (const unsigned char *s = (const unsigned char*)text; *s;)
+            {
+                const uint32_t glyph = atlas.glyph(decode(s), size);
+                if (previous != UINT32_MAX)
+                    pen += atlas.kerning(previous, glyph);
+                run.Glyphs.push_back({ glyph, pen });
+                pen += atlas.info(glyph).Advance;
+                previous = glyph;
+            }
+            run.Width = pen;
+            found = runs.emplace(key, std::move(run)).first;
+        }
+        found->second.LastUsed = frame;
+        return found->second;
+    }
+};
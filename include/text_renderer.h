@@ -0,0 +1,187 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "glyph_atlas.h"
+#include "text_batch.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Screen-space text for HUDs and debug labels: a TextBatch over a GlyphAtlas, drawn once per
+// frame. Draw() uploads the atlas rows that changed and the frame's quads (into an orphaned
+// buffer, like the instance buffers) and draws every glyph of the frame with a single
+// glDrawElements over a shared quad index buffer, blended on top of whatever is there.
+// Runs and glyphs per frame and the CPU time per glyph are printed once per second.
+class TextRenderer
+{
+public:
+    GlyphAtlas Atlas;
+    TextBatch Batch;
+
+    TextRenderer(const std::string &fontPath, int atlasSize = 1024)
+        : Atlas(fontPath, atlasSize, atlasSize), Batch(Atlas), shader("../shaders/text.vs", "../shaders/text.fs")
+    {
+        shader.use();
+        shader.setInt("atlas", 0);
+
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, atlasSize, atlasSize, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        // the whole atlas once, so the texture starts out cleared
+        Atlas.DirtyMinY = 0;
+        Atlas.DirtyMaxY = atlasSize - 1;
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)offsetof(TextVertex, X));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)offsetof(TextVertex, U));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(TextVertex), (void*)offsetof(TextVertex, Color));
+        glBindVertexArray(0);
+    }
+
+    TextRenderer(const TextRenderer&) = delete;
+    TextRenderer& operator=(const TextRenderer&) = delete;
+
+    bool valid() const { return Atlas.valid(); }
+
+    // text (UTF-8) at pixel x, y from the top-left of the viewport, y being the baseline
+    void text(float x, float y, int size, const glm::vec4 &color, const char *text, TextAnchor anchor = TEXT_LEFT)
+    {
+        Batch.add(x, y, size, color, text, anchor);
+    }
+
+    // text centred above a point in the world; nothing behind the camera or off screen
+    void label(const glm::vec3 &position, const glm::mat4 &viewProjection, float viewportWidth, float viewportHeight, int size,
+               const glm::vec4 &color, const char *text)
+    {
+        const glm::vec4 clip = viewProjection * glm::vec4(position, 1.0f);
+        if (clip.w <= 0.0f || clip.x < -clip.w || clip.x > clip.w || clip.y < -clip.w || clip.y > clip.w)
+            return;
+        const float x = (clip.x / clip.w * 0.5f + 0.5f) * viewportWidth, y = (0.5f - clip.y / clip.w * 0.5f) * viewportHeight;
+        Batch.add(x, y, size, color, text, TEXT_CENTER);
+    }
+
+    // everything added since the last call, in one draw call, then starts the next frame
+    void Draw(float viewportWidth, float viewportHeight)
+    {
+        PROFILE_ZONE("text");
+        const auto start = std::chrono::steady_clock::now();
+        if (Atlas.DirtyMinY <= Atlas.DirtyMaxY)
+        {
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, Atlas.DirtyMinY, Atlas.getWidth(), Atlas.DirtyMaxY - Atlas.DirtyMinY + 1, GL_RED, GL_UNSIGNED_BYTE,
+                            Atlas.getPixels() + (size_t)Atlas.DirtyMinY * Atlas.getWidth());
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            Atlas.clean();
+        }
+
+        const size_t quads = Batch.Vertices.size() / 4;
+        if (quads > 0)
+        {
+            glBindVertexArray(VAO);
+            reserveIndices(quads);
+            glBindBuffer(GL_ARRAY_BUFFER, VBO);
+            glBufferData(GL_ARRAY_BUFFER, Batch.Vertices.size() * sizeof(TextVertex), Batch.Vertices.data(), GL_STREAM_DRAW);
+
+            glDisable(GL_DEPTH_TEST);
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            shader.use();
+            shader.setVec2("viewportSize", viewportWidth, viewportHeight);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glDrawElements(GL_TRIANGLES, (GLsizei)(quads * 6), GL_UNSIGNED_INT, (void*)0);
+            glDisable(GL_BLEND);
+            glEnable(GL_DEPTH_TEST);
+            glBindVertexArray(0);
+        }
+
+        last = Batch.Frame;
+        last.Microseconds += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        Batch.newFrame();
+    }
+
+    // the last Draw(): runs, glyphs, run cache misses and CPU time, text() calls and Draw()
+    // itself
+    const TextStats& lastFrame() const { return last; }
+
+    // averages once per second; force prints the last frame right away
+    void Report(float deltaTime, bool force = false)
+    {
+        elapsed += deltaTime;
+        ++frames;
+        microseconds += last.Microseconds;
+        glyphs += last.Glyphs;
+        runs += last.Runs;
+        if (elapsed < 1.0f && !force)
+            return;
+        const double perFrame = force ? last.Microseconds : microseconds / frames;
+        const size_t glyphsPerFrame = force ? last.Glyphs : glyphs / frames;
+        std::cout << "text: " << (force ? last.Runs : runs / frames) << " runs, " << glyphsPerFrame << " glyphs in 1 draw call, " << perFrame << " us CPU ("
+                  << (glyphsPerFrame ? 1000.0 * perFrame / glyphsPerFrame : 0.0) << " ns/glyph); atlas " << Atlas.glyphCount() << " glyphs on "
+                  << Atlas.shelfCount() << " shelves, " << Atlas.Stats.Rasterized << " rasterized, " << Atlas.Stats.EvictedShelves
+                  << " shelves evicted, " << Atlas.Stats.Dropped << " dropped; " << Batch.cachedRuns() << " runs cached" << std::endl;
+        elapsed = 0.0f;
+        frames = 0;
+        microseconds = 0.0;
+        glyphs = runs = 0;
+    }
+
+    void Release()
+    {
+        glDeleteTextures(1, &texture);
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        glDeleteProgram(shader.ID);
+    }
+
+private:
+    Shader shader;
+    unsigned int texture = 0;
+    unsigned int VAO = 0, VBO = 0, EBO = 0;
+    size_t indexedQuads = 0;
+    TextStats last;
+    float elapsed = 0.0f;
+    unsigned int frames = 0;
+    double microseconds = 0.0;
+    size_t glyphs = 0, runs = 0;
+
+    // two triangles per quad, the same for every frame; grown (with the VAO bound) when a
+    // frame has more quads than ever before
+    void reserveIndices(size_t quads)
+    {
+        if (quads <= indexedQuads)
+            return;
+        indexedQuads = std::max(quads, indexedQuads * 2);
+        std::vector<uint32_t> indices(indexedQuads * 6);
+        for (uint32_t quad = 0; quad < indexedQuads; ++quad)
+        {
+            const uint32_t corner = quad * 4;
+            const uint32_t triangles[6] = { corner, corner + 1, corner + 2, corner, corner + 2, corner + 3 };
+            std::copy(triangles, triangles + 6, indices.begin() + quad * 6);
+        }
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+    }
+};
@@ -0,0 +1,264 @@
+#pragma once
+
+#include <SOIL.h>
+
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+// On-disk layout of a ".texcache" file, written next to the source image:
+//
+//     TextureCacheHeader | level 0 | level 1 | ... (RGBA8, largest first)
+//
+// Every level starts on a 16 byte boundary and is exactly what glTexSubImage2D takes, so a warm
+// start maps the file and copies levels straight into the upload buffer without decoding the
+// PNG. Validated against the source's size and mtime, with a content hash when only the mtime
+// moved, like the mesh cache.
+struct TextureCacheHeader {
+    char Magic[4];
+    uint32_t Version;
+    uint64_t SourceMtime;
+    uint64_t SourceSize;
+    uint64_t SourceHash;
+    uint32_t Width;
+    uint32_t Height;
+    uint32_t LevelCount;
+    uint32_t Reserved;
+    uint64_t LevelOffset[16];
+};
+
+const char TEXTURE_CACHE_MAGIC[4] = { 'T', 'E', 'X', 'C' };
+const uint32_t TEXTURE_CACHE_VERSION = 1;
+const uint32_t TEXTURE_MAX_LEVELS = 16;
+
+struct MipLevel {
+    uint32_t Width, Height;
+    const unsigned char *Pixels; // RGBA8, bottom row first like every GL upload
+    size_t Size;
+};
+
+// A decoded image with its full mip chain. The levels point either into the mapped cache file
+// or into decoded storage, which this object owns either way.
+class DecodedTexture
+{
+public:
+    std::vector<MipLevel> Levels;
+    bool FromCache = false;
+
+    DecodedTexture() {}
+    DecodedTexture(const DecodedTexture&) = delete;
+    DecodedTexture& operator=(const DecodedTexture&) = delete;
+
+    size_t byteSize() const
+    {
+        size_t size = 0;
+        for (const MipLevel &level : Levels)
+            size += level.Size;
+        return size;
+    }
+
+    // through the cache when it is valid, otherwise SOIL decodes the image, the mip chain is
+    // box filtered and the cache (re)written; safe to call from worker threads
+    bool load(const std::string &path)
+    {
+        const std::string cacheFile = path + ".texcache";
+        if (openCache(path, cacheFile))
+        {
+            FromCache = true;
+            return true;
+        }
+
+        int width, height, channels;
+        unsigned char *pixels = SOIL_load_image(path.c_str(), &width, &height, &channels, SOIL_LOAD_RGBA);
+        if (!pixels)
+        {
+            std::cout << "ERROR::TEXTURE::FILE_NOT_SUCCESFULLY_READ: " << path << " (" << SOIL_last_result() << ")" << std::endl;
+            return false;
+        }
+        buildMipChain(pixels, (uint32_t)width, (uint32_t)height);
+        SOIL_free_image_data(pixels);
+        if (!writeCache(path, cacheFile))
+            std::cout << "WARNING::TEXTURE_CACHE::COULD_NOT_WRITE: " << cacheFile << std::endl;
+        return true;
+    }
+
+private:
+    MappedFile mapping;
+    std::vector<unsigned char> storage;
+
+    static uint64_t align(uint64_t offset)
+    {
+        return (offset + 15) & ~uint64_t(15);
+    }
+
+    // FNV-1a, 64 bit, as in the mesh cache
+    static uint64_t hashBytes(const unsigned char *bytes, size_t size)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    static uint64_t sourceMtime(const std::string &path)
+    {
+        std::error_code ec;
+        auto time = std::filesystem::last_write_time(path, ec);
+        return ec ? 0 : (uint64_t)time.time_since_epoch().count();
+    }
+
+    // level 0 (flipped: SOIL returns the top row first) plus 2x2 box-filtered halvings down to
+    // 1x1; odd edges repeat their last texel
+    void buildMipChain(const unsigned char *pixels, uint32_t width, uint32_t height)
+    {
+        std::vector<uint64_t> offsets;
+        uint64_t total = 0;
+        for (uint32_t w = width, h = height;; w = std::max(1u, w / 2), h = std::max(1u, h / 2))
+        {
+            offsets.push_back(total);
+            total = align(total + (uint64_t)w * h * 4);
+            if ((w == 1 && h == 1) || offsets.size() == TEXTURE_MAX_LEVELS)
+                break;
+        }
+        storage.resize((size_t)total);
+        const size_t rowSize = (size_t)width * 4;
+        for (uint32_t y = 0; y < height; ++y)
+            std::memcpy(storage.data() + y * rowSize, pixels + (size_t)(height - 1 - y) * rowSize, rowSize);
+
+        Levels.clear();
+        uint32_t w = width, h = height;
+        for (size_t level = 0; level < offsets.size(); ++level)
+        {
+            unsigned char *dst = storage.data() + offsets[level];
+            if (level > 0)
+            {
+                const MipLevel &parent = Levels.back();
+                for (uint32_t y = 0; y < h; ++y)
+                {
+                    const uint32_t y0 = std::min(2 * y, parent.Height - 1), y1 = std::min(2 * y + 1, parent.Height - 1);
+                    for (uint32_t x = 0; x < w; ++x)
+                    {
+                        const uint32_t x0 = std::min(2 * x, parent.Width - 1), x1 = std::min(2 * x + 1, parent.Width - 1);
+                        const unsigned char *a = parent.Pixels + ((size_t)y0 * parent.Width + x0) * 4;
+                        const unsigned char *b = parent.Pixels + ((size_t)y0 * parent.Width + x1) * 4;
+                        const unsigned char *c = parent.Pixels + ((size_t)y1 * parent.Width + x0) * 4;
+                        const unsigned char *d = parent.Pixels + ((size_t)y1 * parent.Width + x1) * 4;
+                        unsigned char *out = dst + ((size_t)y * w + x) * 4;
+                        for (int channel = 0; channel < 4; ++channel)
+                            out[channel] = (unsigned char)((a[channel] + b[channel] + c[channel] + d[channel] + 2) / 4);
+                    }
+                }
+            }
+            Levels.push_back({ w, h, dst, (size_t)w * h * 4 });
+            w = std::max(1u, w / 2);
+            h = std::max(1u, h / 2);
+        }
+    }
+
+    bool writeCache(const std::string &path, const std::string &cacheFile) const
+    {
+        MappedFile source(path);
+        if (!source.isOpen())
+            return false;
+
+        TextureCacheHeader header = {};
+        std::memcpy(header.Magic, TEXTURE_CACHE_MAGIC, sizeof(header.Magic));
+        header.Version = TEXTURE_CACHE_VERSION;
+        header.SourceMtime = sourceMtime(path);
+        header.SourceSize = source.size();
+        header.SourceHash = hashBytes(source.data(), source.size());
+        header.Width = Levels[0].Width;
+        header.Height = Levels[0].Height;
+        header.LevelCount = (uint32_t)Levels.size();
+        uint64_t offset = align(sizeof(TextureCacheHeader));
+        for (size_t level = 0; level < Levels.size(); ++level)
+        {
+            header.LevelOffset[level] = offset;
+            offset = align(offset + Levels[level].Size);
+        }
+
+        // write to a temporary and rename, so a crash never leaves a half-written cache behind;
+        // worker threads writing different textures never share a file name
+        const std::string tmpFile = cacheFile + ".tmp";
+        {
+            std::ofstream out(tmpFile, std::ios::binary | std::ios::trunc);
+            if (!out)
+                return false;
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            for (size_t level = 0; level < Levels.size(); ++level)
+            {
+                out.seekp((std::streamoff)header.LevelOffset[level]);
+                out.write(reinterpret_cast<const char*>(Levels[level].Pixels), (std::streamsize)Levels[level].Size);
+            }
+            if (!out)
+                return false;
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmpFile, cacheFile, ec);
+        if (ec)
+        {
+            // some platforms refuse to rename over an existing file
+            std::filesystem::remove(cacheFile, ec);
+            std::filesystem::rename(tmpFile, cacheFile, ec);
+        }
+        return !ec;
+    }
+
+    bool openCache(const std::string &path, const std::string &cacheFile)
+    {
+        TextureCacheHeader header;
+        {
+            std::ifstream in(cacheFile, std::ios::binary);
+            if (!in || !in.read(reinterpret_cast<char*>(&header), sizeof(header)))
+                return false;
+        }
+        if (std::memcmp(header.Magic, TEXTURE_CACHE_MAGIC, sizeof(header.Magic)) != 0 || header.Version != TEXTURE_CACHE_VERSION ||
+            header.LevelCount == 0 || header.LevelCount > TEXTURE_MAX_LEVELS)
+            return false;
+
+        std::error_code ec;
+        const uint64_t size = std::filesystem::file_size(path, ec);
+        if (ec || size != header.SourceSize)
+            return false;
+        const uint64_t mtime = sourceMtime(path);
+        if (mtime != header.SourceMtime)
+        {
+            MappedFile source(path);
+            if (!source.isOpen() || hashBytes(source.data(), source.size()) != header.SourceHash)
+                return false;
+            header.SourceMtime = mtime;
+            std::fstream patch(cacheFile, std::ios::binary | std::ios::in | std::ios::out);
+            patch.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        }
+
+        if (!mapping.open(cacheFile))
+            return false;
+        Levels.clear();
+        uint32_t w = header.Width, h = header.Height;
+        for (uint32_t level = 0; level < header.LevelCount; ++level)
+        {
+            const size_t levelSize = (size_t)w * h * 4;
+            if (mapping.size() < header.LevelOffset[level] + levelSize)
+            {
+                Levels.clear();
+                mapping.close();
+                return false;
+            }
+            Levels.push_back({ w, h, mapping.data() + header.LevelOffset[level], levelSize });
+            w = std::max(1u, w / 2);
+            h = std::max(1u, h / 2);
+        }
+        return true;
+    }
+};
@@ -0,0 +1,267 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "texture_cache.h"
+#include "profiler.h"
+#include "thread_pool.h"
+
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Loads textures without stalling the render thread. request() returns a handle at once and
+// queues the decode (or a .texcache mapping, see texture_cache.h) plus mip generation on the
+// worker pool. update(), called once per frame, moves finished levels into GL through a pixel
+// unpack buffer, at most UploadBudget bytes a frame, so a burst of decoded textures is spread
+// over several frames instead of one long hitch. texture() is a shared placeholder until the
+// last level of a texture is uploaded.
+class TextureStreamer
+{
+public:
+    typedef size_t Handle;
+    typedef std::chrono::steady_clock Clock;
+
+    // bytes copied into the PBO per update(); a single level larger than this still goes alone
+    size_t UploadBudget;
+    unsigned int Placeholder = 0;
+    // seconds from start (see the constructor), -1 until reached
+    double FirstFrameSeconds = -1.0;
+    double FullyResidentSeconds = -1.0;
+
+    // start is when the clock for the two timings began, usually program start
+    TextureStreamer(ThreadPool &pool, size_t uploadBudget = 4 << 20, Clock::time_point start = Clock::now())
+        : UploadBudget(uploadBudget), pool(pool), start(start)
+    {
+        // 2x2 grey checker, enough to tell "not loaded yet" from a texture that is just dark
+        const unsigned char checker[16] = { 96, 96, 96, 255,  160, 160, 160, 255,  160, 160, 160, 255,  96, 96, 96, 255 };
+        glGenTextures(1, &Placeholder);
+        glBindTexture(GL_TEXTURE_2D, Placeholder);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 2, 2, 0, GL_RGBA, GL_UNSIGNED_BYTE, checker);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glGenBuffers(1, &pbo);
+    }
+
+    // same path twice gives the same handle
+    Handle request(const std::string &path)
+    {
+        for (Handle handle = 0; handle < entries.size(); ++handle)
+            if (entries[handle].Path == path)
+                return handle;
+        const Handle handle = entries.size();
+        entries.emplace_back();
+        entries.back().Path = path;
+        pool.submit([this, handle, path]() {
+            PROFILE_ZONE("decode texture");
+            std::unique_ptr<DecodedTexture> decoded(new DecodedTexture);
+            if (!decoded->load(path))
+                decoded.reset();
+            std::lock_guard<std::mutex> lock(readyMutex);
+            ready.push_back({ handle, std::move(decoded) });
+        });
+        return handle;
+    }
+
+    unsigned int texture(Handle handle) const
+    {
+        return entries[handle].Resident ? entries[handle].ID : Placeholder;
+    }
+
+    bool resident(Handle handle) const
+    {
+        return entries[handle].Resident;
+    }
+
+    size_t residentCount() const
+    {
+        size_t count = 0;
+        for (const Entry &entry : entries)
+            count += entry.Resident;
+        return count;
+    }
+
+    size_t size() const
+    {
+        return entries.size();
+    }
+
+    // GL thread, once per frame, before drawing
+    void update()
+    {
+        {
+            std::lock_guard<std::mutex> lock(readyMutex);
+            while (!ready.empty())
+            {
+                const Handle handle = ready.front().Texture;
+                Entry &entry = entries[handle];
+                entry.Decoded = std::move(ready.front().Decoded);
+                ready.pop_front();
+                if (!entry.Decoded)
+                {
+                    entry.Failed = true;
+                    ++finished;
+                    continue;
+                }
+                if (entry.Decoded->FromCache)
+                    ++cacheHits;
+                uploading.push_back(handle);
+            }
+        }
+        if (!uploading.empty())
+        {
+            PROFILE_ZONE("texture upload");
+            upload();
+        }
+        if (FullyResidentSeconds < 0.0 && !entries.empty() && finished == entries.size())
+        {
+            FullyResidentSeconds = secondsSinceStart();
+            std::cout << "textures: " << residentCount() << " of " << entries.size() << " resident after " << FullyResidentSeconds
+                      << " s (" << cacheHits << " from the texture cache, " << (uploadedBytes >> 20) << " MB uploaded)" << std::endl;
+        }
+    }
+
+    // call after the first frame has been presented
+    void frameRendered()
+    {
+        if (FirstFrameSeconds >= 0.0)
+            return;
+        FirstFrameSeconds = secondsSinceStart();
+        std::cout << "textures: first frame after " << FirstFrameSeconds << " s, " << residentCount() << " of " << entries.size()
+                  << " textures resident" << std::endl;
+    }
+
+    // waits for the workers still decoding, then frees every texture
+    void Release()
+    {
+        pool.wait();
+        for (Entry &entry : entries)
+            if (entry.ID)
+                glDeleteTextures(1, &entry.ID);
+        glDeleteTextures(1, &Placeholder);
+        glDeleteBuffers(1, &pbo);
+    }
+
+private:
+    struct Entry {
+        std::string Path;
+        unsigned int ID = 0;
+        std::unique_ptr<DecodedTexture> Decoded; // between decode and the last level's upload
+        size_t NextLevel = 0;
+        bool Resident = false;
+        bool Failed = false;
+    };
+
+    struct Ready {
+        Handle Texture;
+        std::unique_ptr<DecodedTexture> Decoded; // null when loading failed
+    };
+
+    // one level copied into the PBO this frame
+    struct Upload {
+        Handle Texture;
+        size_t Level;
+        size_t Offset;
+    };
+
+    ThreadPool &pool;
+    Clock::time_point start;
+    std::deque<Entry> entries;
+    std::mutex readyMutex;
+    std::deque<Ready> ready;         // filled by the workers
+    std::deque<Handle> uploading;    // decoded, levels still to upload, oldest first
+    std::vector<Upload> batch;
+    unsigned int pbo = 0;
+    size_t finished = 0;
+    size_t cacheHits = 0;
+    size_t uploadedBytes = 0;
+
+    double secondsSinceStart() const
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    // picks levels up to the budget, copies them into a freshly orphaned PBO in one mapping
+    // and issues glTexSubImage2D from it, so the driver copies on its own time
+    void upload()
+    {
+        batch.clear();
+        size_t bytes = 0;
+        for (Handle handle : uploading)
+        {
+            const Entry &entry = entries[handle];
+            size_t level = entry.NextLevel;
+            for (; level < entry.Decoded->Levels.size(); ++level)
+            {
+                const size_t size = entry.Decoded->Levels[level].Size;
+                if (!batch.empty() && bytes + size > UploadBudget)
+                    break;
+                batch.push_back({ handle, level, bytes });
+                bytes += size;
+            }
+            if (level < entry.Decoded->Levels.size())
+                break;
+        }
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)bytes, NULL, GL_STREAM_DRAW);
+        unsigned char *mapped = static_cast<unsigned char*>(
+            glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+        if (!mapped)
+        {
+            std::cout << "ERROR::TEXTURE_STREAMER::MAP_FAILED" << std::endl;
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            return;
+        }
+        for (const Upload &upload : batch)
+        {
+            const MipLevel &level = entries[upload.Texture].Decoded->Levels[upload.Level];
+            std::memcpy(mapped + upload.Offset, level.Pixels, level.Size);
+        }
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        for (const Upload &upload : batch)
+        {
+            Entry &entry = entries[upload.Texture];
+            const std::vector<MipLevel> &levels = entry.Decoded->Levels;
+            if (!entry.ID)
+                allocate(entry);
+            glBindTexture(GL_TEXTURE_2D, entry.ID);
+            glTexSubImage2D(GL_TEXTURE_2D, (GLint)upload.Level, 0, 0, levels[upload.Level].Width, levels[upload.Level].Height,
+                            GL_RGBA, GL_UNSIGNED_BYTE, (void*)upload.Offset);
+            entry.NextLevel = upload.Level + 1;
+            if (entry.NextLevel == levels.size())
+            {
+                entry.Resident = true;
+                entry.Decoded.reset(); // drops the decoded pixels or unmaps the cache file
+                ++finished;
+            }
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        uploadedBytes += bytes;
+        while (!uploading.empty() && entries[uploading.front()].Resident)
+            uploading.pop_front();
+    }
+
+    // storage for every level, filled in by later uploads (GL 3.3 has no glTexStorage)
+    static void allocate(Entry &entry)
+    {
+        const std::vector<MipLevel> &levels = entry.Decoded->Levels;
+        glGenTextures(1, &entry.ID);
+        glBindTexture(GL_TEXTURE_2D, entry.ID);
+        for (size_t level = 0; level < levels.size(); ++level)
+            glTexImage2D(GL_TEXTURE_2D, (GLint)level, GL_RGBA8, levels[level].Width, levels[level].Height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levels.size() - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "mesh.h"
+#include "mesh_cache.h"
+#include "meshlet_culler.h"
+#include "obj_loader.h"
+#include "render_queue.h"
+#include "texture_streamer.h"
+
+#include <array>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+// An OBJ drawn with its MTL texture maps, which come in through a TextureStreamer. Geometry is
+// uploaded at construction (through the mesh cache); every map of every material is requested
+// at once, and until a diffuse map is resident its submeshes show the streamer's placeholder.
+// With a tolerance the vertices are quantized on upload, see Mesh. With a meshlet pool the mesh
+// is built as meshlets, and once cull() ran, record() only draws the meshlets that survived.
+class TexturedModel
+{
+public:
+    Mesh Geometry;
+    std::vector<ObjMaterial> Materials;
+    std::unique_ptr<MeshletCuller> Culler;  // null without meshlets
+
+    TexturedModel(const std::string &objPath, TextureStreamer &streamer, const VertexTolerance *tolerance = nullptr,
+                  ThreadPool *meshletPool = nullptr)
+        : Geometry(CachedMesh(objPath, false, meshletPool != nullptr).View, tolerance), streamer(streamer)
+    {
+        if (meshletPool && !Geometry.Meshlets.empty())
+            Culler.reset(new MeshletCuller(Geometry.Meshlets, Geometry.SubMeshes.size(), *meshletPool));
+        const std::filesystem::path directory = std::filesystem::path(objPath).parent_path();
+        ObjLoader::loadMaterials(std::filesystem::path(objPath).replace_extension(".mtl").string(), Materials);
+
+        // diffuse maps first: they are the ones drawn, specular and normal maps only warm the cache
+        std::vector<TextureStreamer::Handle> diffuse(Materials.size(), NO_TEXTURE);
+        for (size_t i = 0; i < Materials.size(); ++i)
+            if (!Materials[i].DiffuseMap.empty())
+                diffuse[i] = streamer.request((directory / Materials[i].DiffuseMap).string());
+        for (const ObjMaterial &material : Materials)
+        {
+            if (!material.SpecularMap.empty())
+                streamer.request((directory / material.SpecularMap).string());
+            if (!material.NormalMap.empty())
+                streamer.request((directory / material.NormalMap).string());
+        }
+
+        for (const SubMeshRange &range : Geometry.SubMeshes)
+        {
+            TextureStreamer::Handle handle = NO_TEXTURE;
+            for (size_t i = 0; i < Materials.size(); ++i)
+                if (Materials[i].Name == range.Material)
+                    handle = diffuse[i];
+            subMeshTextures.push_back(handle);
+        }
+    }
+
+    // meshlets of the model at model against the camera, for the next record(); see MeshletCuller
+    void cull(const glm::mat4 &model, const std::array<glm::vec4, 6> &planes, const glm::vec3 &eye, float projectionScale)
+    {
+        if (Culler)
+            Culler->cull(model, planes, eye, projectionScale);
+    }
+
+    // one command per submesh (with meshlets: per submesh with any left), drawn with program (a RenderQueue index for a TEXTURED surface, whose
+    // texture_diffuse1 is unit 0); model must stay put until the queue is submitted
+    void record(RenderBucket &bucket, uint32_t program, const glm::mat4 *model, float depth) const
+    {
+        for (size_t i = 0; i < Geometry.SubMeshes.size(); ++i)
+        {
+            const DrawRanges *ranges = Culler ? &Culler->drawRanges(i) : nullptr;
+            if (ranges && ranges->Counts.empty())
+                continue;
+            const TextureStreamer::Handle handle = subMeshTextures[i];
+            const unsigned int texture = handle == NO_TEXTURE ? streamer.Placeholder : streamer.texture(handle);
+            bucket.draw({ RenderQueue::makeKey(RenderQueue::OPAQUE_PASS, program, texture, Geometry.VAO, depth), model, nullptr,
+                          program, Geometry.VAO, texture, Geometry.SubMeshes[i].IndexCount, Geometry.SubMeshes[i].IndexOffset, 0, ranges });
+        }
+    }
+
+    // textures belong to the streamer and are released with it
+    void Release()
+    {
+        Geometry.Release();
+    }
+
+private:
+    static const TextureStreamer::Handle NO_TEXTURE = ~TextureStreamer::Handle(0);
+
+    TextureStreamer &streamer;
+    std::vector<TextureStreamer::Handle> subMeshTextures;
+};
@@ -0,0 +1,274 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool;
+
+// Jobs of one group still to finish. A job submitted with a counter holds it up until the job
+// has run; ThreadPool::after() holds back a job until a counter drops to zero, which is how
+// job graphs are built (stage two after stage one, a publish after all of a step's jobs).
+// A counter is reusable once it is done.
+class JobCounter
+{
+public:
+    bool done() const
+    {
+        return remaining.load(std::memory_order_acquire) == 0;
+    }
+
+private:
+    friend class ThreadPool;
+    struct Continuation {
+        std::function<void()> Task;
+        JobCounter *Counter;
+    };
+
+    std::atomic<unsigned int> remaining{ 0 };
+    std::mutex mutex;                      // guards dropping to zero against after()
+    std::vector<Continuation> continuations;
+};
+
+// Fixed set of worker threads with one task deque each. submit() deals tasks out round-robin;
+// a worker takes from the back of its own deque and, once that is empty, steals from the front
+// of the others, so uneven tasks (screen tiles that hit more geometry, say) even out without a
+// single shared queue every thread contends on. wait() blocks until everything submitted ran;
+// wait(counter) only until one group did, running queued tasks on the calling thread meanwhile
+// instead of sleeping.
+class ThreadPool
+{
+public:
+    // threads == 0 picks hardware_concurrency()
+    explicit ThreadPool(unsigned int threads = 0)
+    {
+        if (threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned int i = 0; i < threads; ++i)
+            queues.emplace_back(new TaskQueue);
+        for (unsigned int i = 0; i < threads; ++i)
+            workers.emplace_back(&ThreadPool::run, this, i);
+    }
+
+    // the pool only owns CPU resources, so unlike the GL wrappers it cleans up after itself
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread &worker : workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned int size() const
+    {
+        return (unsigned int)workers.size();
+    }
+
+    // counter, if given, is done once task (and everything else submitted with it) has run
+    void submit(std::function<void()> task, JobCounter *counter = nullptr)
+    {
+        if (counter)
+            counter->remaining.fetch_add(1, std::memory_order_relaxed);
+        push({ std::move(task), counter });
+    }
+
+    // task is queued once dependency is done (right away if it already is); counter counts it
+    // from now on, so waiting on counter also waits for dependency
+    void after(JobCounter &dependency, std::function<void()> task, JobCounter *counter = nullptr)
+    {
+        if (counter)
+            counter->remaining.fetch_add(1, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(dependency.mutex);
+            if (dependency.remaining.load(std::memory_order_acquire) != 0)
+            {
+                dependency.continuations.push_back({ std::move(task), counter });
+                return;
+            }
+        }
+        push({ std::move(task), counter });
+    }
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        done.wait(lock, [this] { return pending.load() == 0; });
+    }
+
+    // returns once counter is done, having run whatever the calling thread could take from the
+    // deques in the meantime; tasks of this pool may wait too
+    void wait(JobCounter &counter)
+    {
+        while (!counter.done())
+        {
+            if (runOne())
+                continue;
+            if (queued.load() > 0)
+            {
+                // counted but not in a deque yet, or being taken by another thread
+                std::this_thread::yield();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            ++helpers;
+            done.wait(lock, [&] { return counter.done() || queued.load() > 0; });
+            --helpers;
+        }
+        // the job that finished the counter may still hold its mutex; the caller may destroy
+        // the counter as soon as this returns
+        std::lock_guard<std::mutex> lock(counter.mutex);
+    }
+
+private:
+    struct Job {
+        std::function<void()> Task;
+        JobCounter *Counter;
+    };
+
+    struct TaskQueue {
+        std::mutex Mutex;
+        std::deque<Job> Tasks;
+    };
+
+    std::vector<std::unique_ptr<TaskQueue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> pending{ 0 };      // submitted but not finished
+    std::atomic<size_t> queued{ 0 };       // submitted but not taken; never below what the deques hold
+    std::atomic<unsigned int> nextQueue{ 0 };
+    // sleepMutex is only taken on the way to sleep and to wake a sleeper: a thread registers
+    // in sleepers (workers, on wake) or helpers (wait(counter), on done) before checking queued
+    // under it, and push() checks them after counting its task, so one of the two always sees
+    // the other
+    std::mutex sleepMutex;
+    std::condition_variable wake, done;
+    std::atomic<unsigned int> sleepers{ 0 }, helpers{ 0 };
+    bool stopping = false;                 // guarded by sleepMutex
+
+    void push(Job job)
+    {
+        pending.fetch_add(1);
+        queued.fetch_add(1);
+        TaskQueue &queue = *queues[nextQueue.fetch_add(1) % queues.size()];
+        {
+            std::lock_guard<std::mutex> lock(queue.Mutex);
+            queue.Tasks.push_back(std::move(job));
+        }
+        if (sleepers.load() > 0)
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            wake.notify_one();
+        }
+        if (helpers.load() > 0)
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            done.notify_all();
+        }
+    }
+
+    bool take(unsigned int self, Job &task)
+    {
+        {
+            TaskQueue &own = *queues[self];
+            std::lock_guard<std::mutex> lock(own.Mutex);
+            if (!own.Tasks.empty())
+            {
+                task = std::move(own.Tasks.back());
+                own.Tasks.pop_back();
+                queued.fetch_sub(1);
+                return true;
+            }
+        }
+        for (size_t i = 1; i < queues.size(); ++i)
+        {
+            TaskQueue &victim = *queues[(self + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.Mutex);
+            if (!victim.Tasks.empty())
+            {
+                task = std::move(victim.Tasks.front());
+                victim.Tasks.pop_front();
+                queued.fetch_sub(1);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void execute(Job &job)
+    {
+        job.Task();
+        job.Task = nullptr;
+
+        bool notify = false;
+        if (job.Counter)
+        {
+            std::vector<JobCounter::Continuation> ready;
+            {
+                std::lock_guard<std::mutex> lock(job.Counter->mutex);
+                if (job.Counter->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    ready.swap(job.Counter->continuations);
+                    notify = true;
+                }
+            }
+            // job.Counter may be gone from here on; its continuations are queued before this
+            // job stops counting as pending, so wait() can't see a gap in between
+            for (JobCounter::Continuation &continuation : ready)
+                push({ std::move(continuation.Task), continuation.Counter });
+        }
+        if (pending.fetch_sub(1) == 1)
+            notify = true;
+        if (notify)
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            done.notify_all();
+        }
+    }
+
+    // takes and runs one queued task on the calling thread, if there is any
+    bool runOne()
+    {
+        Job job;
+        if (!take(0, job))
+            return false;
+        execute(job);
+        return true;
+    }
+
+    void run(unsigned int self)
+    {
+        for (;;)
+        {
+            Job job;
+            if (take(self, job))
+            {
+                execute(job);
+                continue;
+            }
+            // nothing to steal: queued can run ahead of the deques for a moment, so give the
+            // pushing thread a chance if it does, and otherwise sleep until a task is counted
+            if (queued.load() > 0)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            ++sleepers;
+            wake.wait(lock, [this] { return queued.load() > 0 || stopping; });
+            --sleepers;
+            if (stopping && queued.load() == 0)
+                return;
+        }
+    }
+};
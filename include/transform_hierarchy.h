@@ -0,0 +1,377 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define TRANSFORM_HIERARCHY_SSE 1
+#include <immintrin.h>
+#endif
+
+// What the last TransformHierarchy::update() did
+struct TransformStats {
+    size_t Nodes = 0;
+    size_t Updated = 0;                 // world matrices recomputed: the changed nodes and everything below them
+    size_t Levels = 0;                  // depth of the deepest node + 1
+    bool Reordered = false;             // nodes were added since the update before
+    double Microseconds = 0.0;
+};
+
+// Local transforms (position, rotation, scale) and a parent per node, turned into world
+// matrices. Everything is stored as structure of arrays: one float array per component of the
+// local transforms, the parent indices, a changed flag, the world matrices. The arrays are kept
+// sorted by depth, roots first, so every parent comes before its children and each level is a
+// contiguous range; nodes are referred to by the handle add() returned, which stays the same
+// when nodes added later make update() sort them again.
+//
+// update() walks the levels in order. A node is recomputed when it was changed or its parent
+// was recomputed in this update, so only the subtrees under changed nodes cost anything. Local
+// matrices are built four nodes at a time from the component arrays with SSE (scalar glm
+// elsewhere), multiplied by the parent's world matrix and, for nodes bound to one, written
+// straight to the caller's matrix (an InstanceData::Model, say). Levels wide enough are split
+// across the pool, since nothing in a level depends on anything else in it.
+class TransformHierarchy
+{
+public:
+    static const uint32_t NONE = UINT32_MAX;
+    // levels narrower than this are done on the calling thread
+    static const size_t PARALLEL_MIN = 8192;
+
+    TransformStats Frame;
+
+    size_t size() const { return parents.size(); }
+
+    // a node under parent (NONE for a root, otherwise a node already added); returns its handle
+    uint32_t add(uint32_t parent, const glm::vec3 &position, const glm::quat &rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
+                 const glm::vec3 &scale = glm::vec3(1.0f))
+    {
+        const uint32_t handle = (uint32_t)slots.size();
+        const uint32_t slot = (uint32_t)parents.size();
+        slots.push_back(slot);
+        handles.push_back(handle);
+        parents.push_back(parent == NONE ? -1 : (int32_t)slots[parent]);
+        dirty.push_back(1);
+        world.emplace_back(1.0f);
+        outputs.push_back(nullptr);
+        for (std::vector<float> &lane : local)
+            lane.resize(padded(slot + 1));
+        store(slot, position, glm::normalize(rotation), scale);
+        ordered = false;
+        return handle;
+    }
+
+    void setPosition(uint32_t node, const glm::vec3 &position)
+    {
+        const uint32_t slot = slots[node];
+        local[PX][slot] = position.x;
+        local[PY][slot] = position.y;
+        local[PZ][slot] = position.z;
+        dirty[slot] = 1;
+    }
+
+    void setRotation(uint32_t node, const glm::quat &rotation)
+    {
+        const uint32_t slot = slots[node];
+        const glm::quat q = glm::normalize(rotation);
+        local[QX][slot] = q.x;
+        local[QY][slot] = q.y;
+        local[QZ][slot] = q.z;
+        local[QW][slot] = q.w;
+        dirty[slot] = 1;
+    }
+
+    void setScale(uint32_t node, const glm::vec3 &scale)
+    {
+        const uint32_t slot = slots[node];
+        local[SX][slot] = scale.x;
+        local[SY][slot] = scale.y;
+        local[SZ][slot] = scale.z;
+        dirty[slot] = 1;
+    }
+
+    glm::vec3 position(uint32_t node) const
+    {
+        const uint32_t slot = slots[node];
+        return glm::vec3(local[PX][slot], local[PY][slot], local[PZ][slot]);
+    }
+
+    glm::quat rotation(uint32_t node) const
+    {
+        const uint32_t slot = slots[node];
+        return glm::quat(local[QW][slot], local[QX][slot], local[QY][slot], local[QZ][slot]);
+    }
+
+    glm::vec3 scale(uint32_t node) const
+    {
+        const uint32_t slot = slots[node];
+        return glm::vec3(local[SX][slot], local[SY][slot], local[SZ][slot]);
+    }
+
+    uint32_t parent(uint32_t node) const
+    {
+        const int32_t slot = parents[slots[node]];
+        return slot < 0 ? NONE : handles[slot];
+    }
+
+    // the world matrix of node as of the last update()
+    const glm::mat4& worldMatrix(uint32_t node) const
+    {
+        return world[slots[node]];
+    }
+
+    // every update() that recomputes node also writes its world matrix to *output (nullptr
+    // to stop); output must stay valid as long as it is bound. Binding counts as a change, so
+    // the next update() fills it in
+    void bind(uint32_t node, glm::mat4 *output)
+    {
+        const uint32_t slot = slots[node];
+        outputs[slot] = output;
+        dirty[slot] = 1;
+    }
+
+    // recomputes the world matrices of changed nodes and their subtrees, on pool's threads
+    // too when a level is wide enough
+    void update(ThreadPool *pool = nullptr)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        Frame = TransformStats();
+        Frame.Nodes = parents.size();
+        if (!ordered)
+        {
+            sortByDepth();
+            Frame.Reordered = true;
+        }
+        Frame.Levels = levels.size() - 1;
+
+        JobCounter done;
+        for (size_t level = 0; level + 1 < levels.size(); ++level)
+        {
+            const uint32_t first = levels[level], last = levels[level + 1];
+            const size_t count = last - first;
+            if (!pool || count < PARALLEL_MIN || pool->size() < 2)
+            {
+                counts[0] += updateRange(first, last);
+                continue;
+            }
+            // a few chunks per thread, so stealing evens them out; multiples of four keep
+            // every batch but the level's last one full
+            const size_t chunks = std::min<size_t>(pool->size() * 4, counts.size());
+            const size_t per = ((count + chunks - 1) / chunks + 3) & ~(size_t)3;
+            for (size_t chunk = 0; chunk * per < count; ++chunk)
+            {
+                const uint32_t begin = first + (uint32_t)(chunk * per), end = (uint32_t)std::min<size_t>(last, begin + per);
+                pool->submit([this, begin, end, chunk] { counts[chunk] += updateRange(begin, end); }, &done);
+            }
+            pool->wait(done);
+        }
+        for (size_t &count : counts)
+        {
+            Frame.Updated += count;
+            count = 0;
+        }
+        std::fill(dirty.begin(), dirty.end(), 0);
+        Frame.Microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+
+private:
+    enum Lane { PX, PY, PZ, QX, QY, QZ, QW, SX, SY, SZ, LANES };
+
+    // slot order: sorted by depth
+    std::array<std::vector<float>, LANES> local;   // padded to a multiple of four, see padded()
+    std::vector<int32_t> parents;       // slot of the parent, -1 for a root
+    std::vector<uint8_t> dirty;         // changed since the last update(), then recomputed in it
+    std::vector<glm::mat4> world;
+    std::vector<glm::mat4*> outputs;
+    std::vector<uint32_t> handles;      // the handle of each slot
+    // and the other way round
+    std::vector<uint32_t> slots;
+    std::vector<uint32_t> levels = { 0 };   // first slot of each level, then size()
+    bool ordered = true;
+    std::array<size_t, 64> counts = {}; // recomputed per chunk, summed once the update is done
+
+    // the lanes are read four slots at a time, so they run on to a multiple of four; the
+    // padding is the identity transform
+    static size_t padded(size_t count)
+    {
+        return (count + 3) & ~(size_t)3;
+    }
+
+    void store(uint32_t slot, const glm::vec3 &position, const glm::quat &rotation, const glm::vec3 &scale)
+    {
+        const float values[LANES] = { position.x, position.y, position.z, rotation.x, rotation.y, rotation.z, rotation.w, scale.x, scale.y, scale.z };
+        for (int lane = 0; lane < LANES; ++lane)
+            local[lane][slot] = values[lane];
+        for (size_t pad = slot + 1; pad < local[PX].size(); ++pad)
+        {
+            local[QW][pad] = 1.0f;
+            local[SX][pad] = local[SY][pad] = local[SZ][pad] = 1.0f;
+        }
+    }
+
+    // stable counting sort of the slots by depth, every array permuted the same way; parents
+    // always come before their children, so depths are found in a single pass
+    void sortByDepth()
+    {
+        const size_t count = parents.size();
+        std::vector<uint32_t> depth(count);
+        uint32_t deepest = 0;
+        for (size_t slot = 0; slot < count; ++slot)
+        {
+            depth[slot] = parents[slot] < 0 ? 0 : depth[parents[slot]] + 1;
+            deepest = std::max(deepest, depth[slot]);
+        }
+        levels.assign(count ? deepest + 2 : 1, 0);
+        for (uint32_t d : depth)
+            ++levels[d + 1];
+        for (size_t level = 1; level < levels.size(); ++level)
+            levels[level] += levels[level - 1];
+        std::vector<uint32_t> next(levels.begin(), levels.end() - 1), moved(count);
+        for (size_t slot = 0; slot < count; ++slot)
+            moved[slot] = next[depth[slot]]++;
+
+        std::vector<int32_t> newParents(count);
+        for (size_t slot = 0; slot < count; ++slot)
+            newParents[moved[slot]] = parents[slot] < 0 ? -1 : (int32_t)moved[parents[slot]];
+        parents.swap(newParents);
+        permute(dirty, moved);
+        permute(world, moved);
+        permute(outputs, moved);
+        for (std::vector<float> &lane : local)
+        {
+            std::vector<float> sorted(lane);
+            for (size_t slot = 0; slot < count; ++slot)
+                sorted[moved[slot]] = lane[slot];
+            lane.swap(sorted);
+        }
+        for (size_t slot = 0; slot < count; ++slot)
+            slots[handles[slot]] = moved[slot];
+        for (uint32_t handle = 0; handle < slots.size(); ++handle)
+            handles[slots[handle]] = handle;
+        ordered = true;
+    }
+
+    template <typename T>
+    static void permute(std::vector<T> &values, const std::vector<uint32_t> &moved)
+    {
+        std::vector<T> sorted(values.size());
+        for (size_t slot = 0; slot < values.size(); ++slot)
+            sorted[moved[slot]] = values[slot];
+        values.swap(sorted);
+    }
+
+    // world = parent's world * local, for the slots of one level in [first, last); returns how
+    // many were recomputed. Parents are all in earlier levels, so ranges of a level can run on
+    // any thread at once
+    size_t updateRange(uint32_t first, uint32_t last)
+    {
+        size_t updated = 0;
+        for (uint32_t batch = first; batch < last; batch += 4)
+        {
+            const uint32_t end = std::min(last, batch + 4);
+            bool any = false;
+            for (uint32_t slot = batch; slot < end; ++slot)
+            {
+                if (parents[slot] >= 0)
+                    dirty[slot] |= dirty[parents[slot]];
+                any |= dirty[slot] != 0;
+            }
+            if (!any)
+                continue;
+            // local matrices of four slots, element [column * 3 + row] of the 3x3 part for
+            // each, then the translation
+            alignas(16) float m[12][4];
+            localMatrices(batch, m);
+            for (uint32_t slot = batch; slot < end; ++slot)
+            {
+                if (!dirty[slot])
+                    continue;
+                const uint32_t lane = slot - batch;
+                multiply(parents[slot] < 0 ? nullptr : &world[parents[slot]], m, lane, world[slot]);
+                if (outputs[slot])
+                    *outputs[slot] = world[slot];
+                ++updated;
+            }
+        }
+        return updated;
+    }
+
+    // translate * rotate * scale of slots batch..batch + 3
+    void localMatrices(uint32_t batch, float (&m)[12][4]) const
+    {
+#ifdef TRANSFORM_HIERARCHY_SSE
+        const __m128 qx = _mm_loadu_ps(&local[QX][batch]), qy = _mm_loadu_ps(&local[QY][batch]);
+        const __m128 qz = _mm_loadu_ps(&local[QZ][batch]), qw = _mm_loadu_ps(&local[QW][batch]);
+        const __m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f);
+        const __m128 xx = _mm_mul_ps(qx, qx), yy = _mm_mul_ps(qy, qy), zz = _mm_mul_ps(qz, qz);
+        const __m128 xy = _mm_mul_ps(qx, qy), xz = _mm_mul_ps(qx, qz), yz = _mm_mul_ps(qy, qz);
+        const __m128 wx = _mm_mul_ps(qw, qx), wy = _mm_mul_ps(qw, qy), wz = _mm_mul_ps(qw, qz);
+        const __m128 sx = _mm_loadu_ps(&local[SX][batch]), sy = _mm_loadu_ps(&local[SY][batch]), sz = _mm_loadu_ps(&local[SZ][batch]);
+        _mm_store_ps(m[0], _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx));
+        _mm_store_ps(m[1], _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx));
+        _mm_store_ps(m[2], _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx));
+        _mm_store_ps(m[3], _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy));
+        _mm_store_ps(m[4], _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy));
+        _mm_store_ps(m[5], _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy));
+        _mm_store_ps(m[6], _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz));
+        _mm_store_ps(m[7], _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz));
+        _mm_store_ps(m[8], _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz));
+        _mm_store_ps(m[9], _mm_loadu_ps(&local[PX][batch]));
+        _mm_store_ps(m[10], _mm_loadu_ps(&local[PY][batch]));
+        _mm_store_ps(m[11], _mm_loadu_ps(&local[PZ][batch]));
+#else
+        for (uint32_t lane = 0; lane < 4; ++lane)
+        {
+            const uint32_t slot = batch + lane;
+            const glm::mat3 r = glm::mat3_cast(glm::quat(local[QW][slot], local[QX][slot], local[QY][slot], local[QZ][slot]));
+            const float scale[3] = { local[SX][slot], local[SY][slot], local[SZ][slot] };
+            for (int column = 0; column < 3; ++column)
+                for (int row = 0; row < 3; ++row)
+                    m[column * 3 + row][lane] = r[column][row] * scale[column];
+            m[9][lane] = local[PX][slot];
+            m[10][lane] = local[PY][slot];
+            m[11][lane] = local[PZ][slot];
+        }
+#endif
+    }
+
+    // result = parent * the local matrix in lane of m, or just the local matrix for a root
+    static void multiply(const glm::mat4 *parent, const float (&m)[12][4], uint32_t lane, glm::mat4 &result)
+    {
+        if (!parent)
+        {
+            for (int column = 0; column < 4; ++column)
+                for (int row = 0; row < 3; ++row)
+                    result[column][row] = m[column * 3 + row][lane];
+            result[0][3] = result[1][3] = result[2][3] = 0.0f;
+            result[3][3] = 1.0f;
+            return;
+        }
+#ifdef TRANSFORM_HIERARCHY_SSE
+        const float *p = &(*parent)[0][0];
+        const __m128 c0 = _mm_loadu_ps(p), c1 = _mm_loadu_ps(p + 4), c2 = _mm_loadu_ps(p + 8), c3 = _mm_loadu_ps(p + 12);
+        float *out = &result[0][0];
+        for (int column = 0; column < 4; ++column)
+        {
+            __m128 sum = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(m[column * 3][lane])), _mm_mul_ps(c1, _mm_set1_ps(m[column * 3 + 1][lane]))),
+                                    _mm_mul_ps(c2, _mm_set1_ps(m[column * 3 + 2][lane])));
+            if (column == 3)
+                sum = _mm_add_ps(sum, c3);
+            _mm_storeu_ps(out + column * 4, sum);
+        }
+#else
+        glm::mat4 localMatrix(1.0f);
+        for (int column = 0; column < 4; ++column)
+            for (int row = 0; row < 3; ++row)
+                localMatrix[column][row] = m[column * 3 + row][lane];
+        result = *parent * localMatrix;
+#endif
+    }
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Hands the newest of a stream of values from one writer thread to one reader thread, without
+// locks and without either side ever waiting on the other. There are three slots: the writer
+// fills back() and publish() swaps it with the middle one; the reader's acquire() swaps the
+// middle slot with front() when something was published since. A value the reader doesn't get
+// to before the next publish() is simply replaced, so the reader always sees the latest one,
+// and front() stays untouched until the reader itself calls acquire() again.
+template <typename T>
+class TripleBuffer
+{
+public:
+    // writer: the slot to fill next
+    T& back()
+    {
+        return slots[backIndex];
+    }
+
+    // writer: makes back() the newest value and hands out another slot to fill
+    void publish()
+    {
+        backIndex = middle.exchange((uint8_t)(backIndex | FRESH), std::memory_order_acq_rel) & INDEX;
+    }
+
+    // reader: moves to the newest value if there is one; returns whether front() changed
+    bool acquire()
+    {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH))
+            return false;
+        frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+
+    // reader: the value taken by the last acquire()
+    const T& front() const
+    {
+        return slots[frontIndex];
+    }
+
+private:
+    static const uint8_t INDEX = 3;
+    static const uint8_t FRESH = 4;        // the middle slot holds a value not yet acquired
+
+    T slots[3];
+    // each side's index on its own cache line, so the two threads don't share one
+    alignas(64) std::atomic<uint8_t> middle{ 1 };
+    alignas(64) uint8_t backIndex = 0;
+    alignas(64) uint8_t frontIndex = 2;
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "normal_matrix.h"
+
+// Binding points shared by every program that declares the matching uniform block
+enum Uniform_Binding {
+    CAMERA_BINDING = 0,
+    OBJECT_BINDING = 1
+};
+
+// Per-frame camera data, laid out to match the std140 "Camera" block:
+//
+//     layout (std140) uniform Camera
+//     {
+//         mat4 view;
+//         mat4 projection;
+//         vec4 viewPos;
+//     };
+//
+// viewPos is a vec4 because std140 pads a vec3 to 16 bytes anyway.
+struct CameraBlock
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec4 viewPos;
+};
+static_assert(sizeof(CameraBlock) == 144, "CameraBlock must match the std140 layout of the Camera block");
+
+// Per-draw data, laid out to match the std140 "Object" block. The RenderQueue streams one per
+// draw whose model or material changed and points OBJECT_BINDING at it:
+//
+//     layout (std140) uniform Object
+//     {
+//         mat4 model;
+//         mat3 normalMatrix;   // NormalMatrices::compute(model)
+//         Material material;   // vec3 ambient, diffuse, specular; float shininess
+//     };
+//
+// std140 pads the vec3s (and the mat3's columns) to 16 bytes except the last one, which
+// shares its slot with shininess.
+struct ObjectBlock
+{
+    glm::mat4 model;
+    NormalMatrix normalMatrix;
+    glm::vec4 ambient;
+    glm::vec4 diffuse;
+    glm::vec3 specular;
+    float shininess;
+};
+static_assert(sizeof(ObjectBlock) == 160, "ObjectBlock must match the std140 layout of the Object block");
+
+// A uniform buffer object holding one T, attached to a fixed binding point. Write it once per
+// frame with update() and every program attached with attach() sees the new contents.
+template <typename T>
+class UniformBuffer
+{
+public:
+    unsigned int ID;
+    GLuint Binding;
+
+    UniformBuffer(GLuint binding) : ID(0), Binding(binding)
+    {
+        glGenBuffers(1, &ID);
+        glBindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(T), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, Binding, ID);
+    }
+    // points the program's uniform block called blockName at this buffer's binding point
+    void attach(const Shader &shader, const std::string &blockName) const
+    {
+        shader.bindUniformBlock(blockName, Binding);
+    }
+
+    // uploads the whole block; the indexed binding is untouched so nothing needs rebinding
+    void update(const T &data) const
+    {
+        glBindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &data);
+    }
+};
@@ -0,0 +1,357 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_precision.hpp>
+
+#include "mesh_data.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+enum PositionEncoding : uint8_t {
+    POSITION_FLOAT,                     // 3 x float
+    POSITION_UNORM16                    // 3 x unsigned short over the mesh's bounds
+};
+
+enum NormalEncoding : uint8_t {
+    NORMAL_FLOAT,                       // 3 x float
+    NORMAL_OCT16,                       // octahedral, 2 x unsigned short
+    NORMAL_OCT8                         // octahedral, 2 x unsigned byte
+};
+
+enum TexCoordEncoding : uint8_t {
+    TEXCOORD_FLOAT,                     // 2 x float
+    TEXCOORD_HALF,                      // 2 x half float
+    TEXCOORD_NONE                       // every coordinate is 0, nothing stored
+};
+
+// How far a quantized vertex may be from the original one
+struct VertexTolerance {
+    float Position = 1e-4f;             // distance, as a fraction of the largest side of the mesh's bounds
+    float NormalDegrees = 1.0f;         // angle between the normals
+    float TexCoord = 1.0f / 2048.0f;    // largest difference of u or v: half a texel of a 1024 texture
+};
+
+// Layout of one quantized vertex, and what the vertex shader needs to decode it: positions are
+// Scale * stored + Offset, the stored value being the unsigned short normalized to 0..1
+struct VertexFormat {
+    PositionEncoding Position = POSITION_FLOAT;
+    NormalEncoding Normal = NORMAL_FLOAT;
+    TexCoordEncoding TexCoords = TEXCOORD_FLOAT;
+    uint32_t Stride = sizeof(Vertex);
+    uint32_t PositionOffset = offsetof(Vertex, Position);
+    uint32_t NormalOffset = offsetof(Vertex, Normal);
+    uint32_t TexCoordOffset = offsetof(Vertex, TexCoords);
+    glm::vec3 Scale = glm::vec3(1.0f), Offset = glm::vec3(0.0f);
+
+    // whether the shader has anything to decode: half floats and missing texture coordinates
+    // are the attribute fetch's business
+    bool needsDecode() const
+    {
+        return Position != POSITION_FLOAT || Normal != NORMAL_FLOAT;
+    }
+
+    // e.g. "unorm16 positions, oct8 normals, half uvs"
+    std::string describe() const
+    {
+        static const char *positions[] = { "float", "unorm16" }, *normals[] = { "float", "oct16", "oct8" }, *uvs[] = { "float", "half", "no" };
+        return std::string(positions[Position]) + " positions, " + normals[Normal] + " normals, " + uvs[TexCoords] + " uvs";
+    }
+};
+
+// The largest differences between the vertices and what the shader will decode from them
+struct QuantizationError {
+    float Position = 0.0f;              // distance, model units
+    float NormalDegrees = 0.0f;
+    float TexCoord = 0.0f;
+};
+
+struct QuantizedVertices {
+    VertexFormat Format;
+    std::vector<uint8_t> Data;          // Format.Stride bytes per vertex
+    QuantizationError Error;
+};
+
+// Packs Vertex streams into smaller formats for the GPU. Each attribute gets the smallest
+// encoding whose error, measured over every vertex against exactly what the shader decodes,
+// stays within the tolerance: positions as 16 bit fractions of the mesh's bounding box,
+// normals octahedral-mapped onto a square at 8 or 16 bits per axis, texture coordinates as
+// half floats. Attributes are laid out widest component first so each one stays aligned to
+// its component size. Vertices are only ever quantized for upload; the mesh cache and
+// everything on the CPU keep the float Vertex.
+//
+// Decoding (the shaders' decodePosition() / decodeNormal()) takes the position scale and
+// offset from two attributes at DECODE_ATTRIB_LOCATION, fed to every vertex from a buffer of one
+// element; the w components say whether positions and normals are encoded at all, so a VAO
+// that doesn't enable them (their default value being 0, 0, 0, 1) decodes as plain floats.
+class VertexQuantizer
+{
+public:
+    static const unsigned int DECODE_ATTRIB_LOCATION = 9;
+
+    // both decode attributes: xyz scale and w = 1 for float positions, then xyz offset and
+    // w = 1 for float normals
+    static void decodeAttributes(const VertexFormat &format, glm::vec4 (&attributes)[2])
+    {
+        attributes[0] = glm::vec4(format.Scale, format.Position == POSITION_FLOAT ? 1.0f : 0.0f);
+        attributes[1] = glm::vec4(format.Offset, format.Normal == NORMAL_FLOAT ? 1.0f : 0.0f);
+    }
+
+    static QuantizedVertices quantize(const Vertex *vertices, size_t count, const VertexTolerance &tolerance)
+    {
+        QuantizedVertices result;
+        VertexFormat &format = result.Format;
+        glm::vec3 lo(0.0f), hi(0.0f);
+        if (count)
+            lo = hi = vertices[0].Position;
+        bool texCoords = false;
+        for (size_t i = 0; i < count; ++i)
+        {
+            lo = glm::min(lo, vertices[i].Position);
+            hi = glm::max(hi, vertices[i].Position);
+            texCoords |= vertices[i].TexCoords != glm::vec2(0.0f);
+        }
+        const glm::vec3 extent = hi - lo;
+
+        // positions: 16 bits per axis if they land close enough
+        format.Scale = extent;
+        format.Offset = lo;
+        float positionError = 0.0f;
+        for (size_t i = 0; i < count; ++i)
+            positionError = std::max(positionError, glm::length(decodePosition(encodePosition(vertices[i].Position, lo, extent), lo, extent) - vertices[i].Position));
+        if (positionError <= tolerance.Position * std::max(std::max(extent.x, extent.y), extent.z))
+        {
+            format.Position = POSITION_UNORM16;
+            result.Error.Position = positionError;
+        }
+        else
+        {
+            format.Scale = glm::vec3(1.0f);
+            format.Offset = glm::vec3(0.0f);
+        }
+
+        // normals: the fewest bits within the angle
+        format.Normal = NORMAL_FLOAT;
+        for (NormalEncoding encoding : { NORMAL_OCT8, NORMAL_OCT16 })
+        {
+            const int bits = encoding == NORMAL_OCT8 ? 8 : 16;
+            float degrees = 0.0f;
+            for (size_t i = 0; i < count && degrees <= tolerance.NormalDegrees; ++i)
+                degrees = std::max(degrees, angle(vertices[i].Normal, decodeNormal(encodeNormal(vertices[i].Normal, bits), bits)));
+            if (degrees <= tolerance.NormalDegrees)
+            {
+                format.Normal = encoding;
+                result.Error.NormalDegrees = degrees;
+                break;
+            }
+        }
+
+        // texture coordinates: none at all, or half floats if close enough
+        format.TexCoords = texCoords ? TEXCOORD_FLOAT : TEXCOORD_NONE;
+        if (texCoords)
+        {
+            float uvError = 0.0f;
+            for (size_t i = 0; i < count && uvError <= tolerance.TexCoord; ++i)
+                for (int axis = 0; axis < 2; ++axis)
+                    uvError = std::max(uvError, std::fabs(fromHalf(toHalf(vertices[i].TexCoords[axis])) - vertices[i].TexCoords[axis]));
+            if (uvError <= tolerance.TexCoord)
+            {
+                format.TexCoords = TEXCOORD_HALF;
+                result.Error.TexCoord = uvError;
+            }
+        }
+
+        layout(format);
+        result.Data.assign(count * format.Stride, 0);
+        for (size_t i = 0; i < count; ++i)
+        {
+            uint8_t *vertex = &result.Data[i * format.Stride];
+            const Vertex &source = vertices[i];
+            if (format.Position == POSITION_UNORM16)
+            {
+                const glm::u16vec3 stored = encodePosition(source.Position, lo, extent);
+                std::memcpy(vertex + format.PositionOffset, &stored, sizeof(stored));
+            }
+            else
+                std::memcpy(vertex + format.PositionOffset, &source.Position, sizeof(source.Position));
+            if (format.Normal == NORMAL_FLOAT)
+                std::memcpy(vertex + format.NormalOffset, &source.Normal, sizeof(source.Normal));
+            else if (format.Normal == NORMAL_OCT16)
+            {
+                const glm::uvec2 stored = encodeNormal(source.Normal, 16);
+                const uint16_t packed[2] = { (uint16_t)stored.x, (uint16_t)stored.y };
+                std::memcpy(vertex + format.NormalOffset, packed, sizeof(packed));
+            }
+            else
+            {
+                const glm::uvec2 stored = encodeNormal(source.Normal, 8);
+                vertex[format.NormalOffset] = (uint8_t)stored.x;
+                vertex[format.NormalOffset + 1] = (uint8_t)stored.y;
+            }
+            if (format.TexCoords == TEXCOORD_FLOAT)
+                std::memcpy(vertex + format.TexCoordOffset, &source.TexCoords, sizeof(source.TexCoords));
+            else if (format.TexCoords == TEXCOORD_HALF)
+            {
+                const uint16_t packed[2] = { toHalf(source.TexCoords.x), toHalf(source.TexCoords.y) };
+                std::memcpy(vertex + format.TexCoordOffset, packed, sizeof(packed));
+            }
+        }
+        return result;
+    }
+
+    // the float layout of Vertex, for meshes uploaded as they are
+    static VertexFormat floatFormat()
+    {
+        return VertexFormat();
+    }
+
+    static glm::u16vec3 encodePosition(const glm::vec3 &position, const glm::vec3 &lo, const glm::vec3 &extent)
+    {
+        glm::u16vec3 stored;
+        for (int axis = 0; axis < 3; ++axis)
+            stored[axis] = extent[axis] > 0.0f ? (uint16_t)std::min(65535.0f, std::floor((position[axis] - lo[axis]) / extent[axis] * 65535.0f + 0.5f)) : 0;
+        return stored;
+    }
+
+    // as the shader does it: the normalized attribute, times the scale, plus the offset
+    static glm::vec3 decodePosition(const glm::u16vec3 &stored, const glm::vec3 &lo, const glm::vec3 &extent)
+    {
+        return glm::vec3(stored) / 65535.0f * extent + lo;
+    }
+
+    // octahedral encoding at bits per axis, unsigned normalized (the signed normalized
+    // conversion differs between GL versions). Of the four roundings around the exact point
+    // the one decoding closest to the normal is kept
+    static glm::uvec2 encodeNormal(const glm::vec3 &normal, int bits)
+    {
+        const float top = (float)((1u << bits) - 1);
+        const float length = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+        if (length == 0.0f)
+            return glm::uvec2(encodeNormal(glm::vec3(0.0f, 0.0f, 1.0f), bits));
+        glm::vec2 p = glm::vec2(normal) / length;
+        if (normal.z < 0.0f)
+            p = (1.0f - glm::abs(glm::vec2(p.y, p.x))) * glm::vec2(p.x >= 0.0f ? 1.0f : -1.0f, p.y >= 0.0f ? 1.0f : -1.0f);
+        const glm::vec2 exact = (p * 0.5f + 0.5f) * top;
+        const glm::vec3 unit = glm::normalize(normal);
+        glm::uvec2 best(0);
+        float bestDot = -2.0f;
+        for (int corner = 0; corner < 4; ++corner)
+        {
+            const glm::uvec2 candidate((unsigned int)std::min(top, corner & 1 ? std::ceil(exact.x) : std::floor(exact.x)),
+                                       (unsigned int)std::min(top, corner & 2 ? std::ceil(exact.y) : std::floor(exact.y)));
+            const float d = glm::dot(decodeNormal(candidate, bits), unit);
+            if (d > bestDot)
+            {
+                bestDot = d;
+                best = candidate;
+            }
+        }
+        return best;
+    }
+
+    // as the shader does it
+    static glm::vec3 decodeNormal(const glm::uvec2 &stored, int bits)
+    {
+        const glm::vec2 e = glm::vec2(stored) / (float)((1u << bits) - 1) * 2.0f - 1.0f;
+        glm::vec3 v(e, 1.0f - std::fabs(e.x) - std::fabs(e.y));
+        const float t = std::max(-v.z, 0.0f);
+        v.x += v.x >= 0.0f ? -t : t;
+        v.y += v.y >= 0.0f ? -t : t;
+        return glm::normalize(v);
+    }
+
+    // IEEE half, rounded to nearest even; out of range values become infinity
+    static uint16_t toHalf(float value)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        const uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+        const int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+        uint32_t mantissa = bits & 0x7fffff;
+        if (((bits >> 23) & 0xff) == 0xff)
+            return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+        if (exponent >= 31)
+            return sign | 0x7c00;
+        if (exponent <= 0)
+        {
+            if (exponent < -10)
+                return sign;
+            mantissa |= 0x800000;
+            const int shift = 14 - exponent;
+            uint32_t half = mantissa >> shift;
+            const uint32_t remainder = mantissa & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+            if (remainder > halfway || (remainder == halfway && (half & 1)))
+                ++half;
+            return sign | (uint16_t)half;
+        }
+        uint32_t half = (uint32_t)exponent << 10 | mantissa >> 13;
+        const uint32_t remainder = mantissa & 0x1fff;
+        if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+            ++half;                     // a carry into the exponent is still the right number
+        return sign | (uint16_t)half;
+    }
+
+    static float fromHalf(uint16_t half)
+    {
+        const uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+        const uint32_t exponent = (half >> 10) & 0x1f, mantissa = half & 0x3ff;
+        uint32_t bits;
+        if (exponent == 0x1f)
+            bits = sign | 0x7f800000 | mantissa << 13;
+        else if (exponent != 0)
+            bits = sign | (exponent - 15 + 127) << 23 | mantissa << 13;
+        else if (mantissa == 0)
+            bits = sign;
+        else
+        {
+            // subnormal: normalize it
+            int shift = 0;
+            uint32_t m = mantissa;
+            while (!(m & 0x400))
+            {
+                m <<= 1;
+                ++shift;
+            }
+            bits = sign | (uint32_t)(127 - 15 - shift + 1) << 23 | (m & 0x3ff) << 13;
+        }
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+private:
+    static float angle(const glm::vec3 &a, const glm::vec3 &b)
+    {
+        const float length = glm::length(a);
+        if (length == 0.0f)
+            return 0.0f;
+        return glm::degrees(std::acos(std::min(1.0f, std::max(-1.0f, glm::dot(a / length, b)))));
+    }
+
+    // offsets for the chosen encodings: 4 byte components first, then 2 byte, then 1 byte
+    static void layout(VertexFormat &format)
+    {
+        struct Attribute { uint32_t *Offset; uint32_t Size, Component; };
+        const Attribute attributes[] = {
+            { &format.PositionOffset, format.Position == POSITION_FLOAT ? 12u : 6u, format.Position == POSITION_FLOAT ? 4u : 2u },
+            { &format.NormalOffset, format.Normal == NORMAL_FLOAT ? 12u : format.Normal == NORMAL_OCT16 ? 4u : 2u,
+              format.Normal == NORMAL_FLOAT ? 4u : format.Normal == NORMAL_OCT16 ? 2u : 1u },
+            { &format.TexCoordOffset, format.TexCoords == TEXCOORD_FLOAT ? 8u : format.TexCoords == TEXCOORD_HALF ? 4u : 0u,
+              format.TexCoords == TEXCOORD_FLOAT ? 4u : 2u },
+        };
+        uint32_t offset = 0;
+        for (uint32_t component : { 4u, 2u, 1u })
+            for (const Attribute &attribute : attributes)
+                if (attribute.Component == component)
+                {
+                    *attribute.Offset = offset;
+                    offset += attribute.Size;
+                }
+        format.Stride = (offset + 3) & ~3u;
+    }
+};
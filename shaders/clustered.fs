@@ -0,0 +1,76 @@
+#version 330 core
+out vec4 FragColor;
+
+struct Material {
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+    float shininess;
+};
+
+in vec3 FragPos;
+in vec3 Normal;
+
+layout (std140) uniform Camera
+{
+    mat4 view;
+    mat4 projection;
+    vec4 viewPos;
+};
+
+layout (std140) uniform Object
+{
+    mat4 model;
+    mat3 normalMatrix;
+    Material material;
+};
+
+// filled in by LightClusters every frame
+uniform samplerBuffer clusterLights;     // two texels per light: position + radius, colour
+uniform usamplerBuffer clusterGrid;      // per cluster: first index, count
+uniform usamplerBuffer clusterIndices;   // light indices, cluster after cluster
+uniform ivec3 clusterCounts;             // tiles across, tiles up, depth slices
+uniform vec2 clusterTileScale;           // tiles per pixel
+uniform vec2 clusterSliceScaleBias;      // slice = log(depth) * x + y
+
+uniform vec3 ambientLight;
+
+void main()
+{
+    // which cluster this fragment is in
+    float depth = -(view * vec4(FragPos, 1.0)).z;
+    ivec3 cell = ivec3(ivec2(gl_FragCoord.xy * clusterTileScale), int(log(depth) * clusterSliceScaleBias.x + clusterSliceScaleBias.y));
+    cell = clamp(cell, ivec3(0), clusterCounts - 1);
+    uvec2 range = texelFetch(clusterGrid, (cell.z * clusterCounts.y + cell.y) * clusterCounts.x + cell.x).xy;
+
+    vec3 norm = normalize(Normal);
+    vec3 viewDir = normalize(viewPos.xyz - FragPos);
+    vec3 result = ambientLight * material.ambient;
+    for (uint i = range.x; i < range.x + range.y; ++i)
+    {
+        int light = int(texelFetch(clusterIndices, int(i)).r);
+        vec4 positionRadius = texelFetch(clusterLights, 2 * light);
+        vec3 color = texelFetch(clusterLights, 2 * light + 1).rgb;
+
+        vec3 toLight = positionRadius.xyz - FragPos;
+        float dist = length(toLight);
+        // inverse square, windowed to reach zero at the light's radius
+        float window = clamp(1.0 - pow(dist / positionRadius.w, 4.0), 0.0, 1.0);
+        float attenuation = window * window / (dist * dist + 1.0);
+        if (attenuation <= 0.0)
+            continue;
+
+        // diffuse
+        vec3 lightDir = toLight / dist;
+        float diff = max(dot(norm, lightDir), 0.0);
+        vec3 diffuse = diff * material.diffuse;
+
+        // specular
+        vec3 reflectDir = reflect(-lightDir, norm);
+        float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+        vec3 specular = spec * material.specular;
+
+        result += color * attenuation * (diffuse + specular);
+    }
+    FragColor = vec4(result, 1.0);
+}
@@ -0,0 +1,99 @@
+#version 330 core
+// The fragment half of surface.vs, with the same features defined:
+//   LIT        Phong lighting from light and the material (the instance's, with INSTANCED),
+//              the texture modulating its ambient and diffuse colour when TEXTURED
+//   TEXTURED   unlit: the texture as it is
+//   neither    white, for the lamps
+out vec4 FragColor;
+
+#ifdef TEXTURED
+in vec2 TexCoords;
+
+uniform sampler2D texture_diffuse1;
+#endif
+
+#ifdef LIT
+struct Light {
+    vec3 position;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+in vec3 FragPos;
+in vec3 Normal;
+
+layout (std140) uniform Camera
+{
+    mat4 view;
+    mat4 projection;
+    vec4 viewPos;
+};
+
+uniform Light light;
+
+#ifdef INSTANCED
+flat in vec4 Diffuse;   // rgb + shininess in w
+flat in vec3 Specular;
+#else
+struct Material {
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+    float shininess;
+};
+
+layout (std140) uniform Object
+{
+    mat4 model;
+    mat3 normalMatrix;
+    Material material;
+};
+#endif
+#endif
+
+void main()
+{
+#ifdef LIT
+#ifdef INSTANCED
+    // the per-instance material uses its diffuse colour as ambient too
+    vec3 materialAmbient = Diffuse.rgb;
+    vec3 materialDiffuse = Diffuse.rgb;
+    vec3 materialSpecular = Specular;
+    float shininess = Diffuse.w;
+#else
+    vec3 materialAmbient = material.ambient;
+    vec3 materialDiffuse = material.diffuse;
+    vec3 materialSpecular = material.specular;
+    float shininess = material.shininess;
+#endif
+#ifdef TEXTURED
+    vec3 albedo = texture(texture_diffuse1, TexCoords).rgb;
+    materialAmbient *= albedo;
+    materialDiffuse *= albedo;
+#endif
+
+    // ambient
+    vec3 ambient = light.ambient * materialAmbient;
+
+    // diffuse
+    vec3 norm = normalize(Normal);
+    vec3 lightDir = normalize(light.position - FragPos);
+    float diff = max(dot(norm, lightDir), 0.0);
+    vec3 diffuse = light.diffuse * (diff * materialDiffuse);
+
+    // specular
+    vec3 viewDir = normalize(viewPos.xyz - FragPos);
+    vec3 reflectDir = reflect(-lightDir, norm);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+    vec3 specular = light.specular * (spec * materialSpecular);
+
+    vec3 result = ambient + diffuse + specular;
+    FragColor = vec4(result, 1.0);
+#elif defined(TEXTURED)
+    FragColor = texture(texture_diffuse1, TexCoords);
+#else
+    FragColor = vec4(1.0);
+#endif
+}
@@ -0,0 +1,90 @@
+#version 330 core
+// Every surface in the scene, compiled once per permutation of these (see Shader_Feature):
+//   INSTANCED  model and normal matrix per instance (InstanceData), not from the Object block
+//   LIT        world position and normal out, for the lighting in surface.fs / clustered.fs
+//   TEXTURED   texture coordinates out
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+#ifdef INSTANCED
+layout (location = 3) in mat4 aModel;
+layout (location = 7) in vec4 aDiffuse;
+layout (location = 8) in vec4 aSpecular;
+layout (location = 11) in mat3 aNormalMatrix;
+#endif
+
+// quantized vertices (see VertexQuantizer): positions are aPos * scale + offset unless
+// aDecodeScale.w is 1, normals are octahedral unless aDecodeOffset.w is 1; meshes that aren't
+// quantized leave both at their default, 0, 0, 0, 1
+layout (location = 9) in vec4 aDecodeScale;
+layout (location = 10) in vec4 aDecodeOffset;
+
+vec3 decodePosition(vec3 p)
+{
+    return aDecodeScale.w > 0.5 ? p : p * aDecodeScale.xyz + aDecodeOffset.xyz;
+}
+
+vec3 decodeNormal(vec3 n)
+{
+    if (aDecodeOffset.w > 0.5)
+        return n;
+    vec2 e = n.xy * 2.0 - 1.0;
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-v.z, 0.0);
+    v.xy += vec2(v.x >= 0.0 ? -t : t, v.y >= 0.0 ? -t : t);
+    return normalize(v);
+}
+
+#ifdef LIT
+out vec3 FragPos;
+out vec3 Normal;
+#endif
+#ifdef TEXTURED
+out vec2 TexCoords;
+#endif
+#ifdef INSTANCED
+flat out vec4 Diffuse;
+flat out vec3 Specular;
+#else
+struct Material {
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+    float shininess;
+};
+
+// the normal matrix is computed once per object on the CPU (NormalMatrices)
+layout (std140) uniform Object
+{
+    mat4 model;
+    mat3 normalMatrix;
+    Material material;
+};
+#endif
+
+layout (std140) uniform Camera
+{
+    mat4 view;
+    mat4 projection;
+    vec4 viewPos;
+};
+
+void main()
+{
+#ifdef INSTANCED
+    mat4 model = aModel;
+    mat3 normalMatrix = aNormalMatrix;
+    Diffuse = aDiffuse;
+    Specular = aSpecular.rgb;
+#endif
+#ifdef TEXTURED
+    TexCoords = aTexCoords;
+#endif
+#ifdef LIT
+    FragPos = vec3(model * vec4(decodePosition(aPos), 1.0));
+    Normal = normalMatrix * decodeNormal(aNormal);
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+#else
+    gl_Position = projection * view * model * vec4(decodePosition(aPos), 1.0);
+#endif
+}
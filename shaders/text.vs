@@ -0,0 +1,18 @@
+#version 330 core
+layout (location = 0) in vec2 aPos;
+layout (location = 1) in vec2 aTexCoords;
+layout (location = 2) in vec4 aColor;
+
+out vec2 TexCoords;
+out vec4 Color;
+
+// pixels from the top-left corner of the viewport, as TextBatch lays them out
+uniform vec2 viewportSize;
+
+void main()
+{
+    TexCoords = aTexCoords;
+    Color = aColor;
+    vec2 ndc = aPos / viewportSize * 2.0 - 1.0;
+    gl_Position = vec4(ndc.x, -ndc.y, 0.0, 1.0);
+}
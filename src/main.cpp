@@ -6,259 +6,615 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "shader.h"
+#include "shader_variants.h"
 #include "camera.h"
+#include "uniform_buffer.h"
+#include "mesh_cache.h"
+#include "mesh.h"
+#include "stress_scene.h"
+#include "app_options.h"
+#include "headless_context.h"
+#include "camera_path.h"
+#include "frame_stats.h"
+#include "png_writer.h"
+#include "path_tracer.h"
+#include "fullscreen_texture.h"
+#include "texture_streamer.h"
+#include "textured_model.h"
+#include "shader_watcher.h"
+#include "profiler.h"
+#include "profiler_overlay.h"
+#include "render_queue.h"
+#include "stream_buffer.h"
+#include "lod_selector.h"
+#include "simulation.h"
+#include "clustered_scene.h"
+#include "lighting_scene.h"
+#ifdef HAVE_FREETYPE
+#include "text_renderer.h"
+#endif
+
+#include <imgui.h>
+#include <imgui_impl_glfw.h>
+#include <imgui_impl_opengl3.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <iostream>
+#include <vector>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
-void processInput(GLFWwindow *window);
+unsigned int processInput(GLFWwindow *window);
+int runPathTracer(const AppOptions &options, GLFWwindow *window);
 
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
 
-// camera
-Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
+// camera input, gathered by the callbacks and handed to the simulation once per frame
 float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
+float mouseOffsetX = 0.0f;
+float mouseOffsetY = 0.0f;
+float scrollOffset = 0.0f;
 
 // timing
 float deltaTime = 0.0f; 
 float lastFrame = 0.0f;
+// the simulation (and so camera paths) advances at a fixed 60 Hz; headless frames are one step
+const float FIXED_TIMESTEP = 1.0f / 60.0f;
 
-// lighting
-glm::vec3 lightPos(1.2f, 1.0f, 2.0f);
+// projection
+const float NEAR_PLANE = 0.1f;
+const float FAR_PLANE = 100.0f;
 
-int main()
+int main(int argc, char *argv[])
 {
-    // glfw: initialize and configure
-    // ------------------------------
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-#ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-#endif
+    // time-to-first-frame and time-to-fully-resident are measured from here
+    const TextureStreamer::Clock::time_point startTime = TextureStreamer::Clock::now();
 
-    // glfw window creation
-    // --------------------
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
-    if (window == NULL)
-    {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
+    AppOptions options;
+    if (!options.parse(argc, argv))
         return -1;
+    Profiler::nameThread("main");
+    Profiler::get().Capture = !options.TraceFile.empty();
+
+    // headless: an offscreen context rendering into an FBO, no window at all
+    // ------------------------------------------------------------------------------
+    GLFWwindow* window = NULL;
+    HeadlessContext headless(SCR_WIDTH, SCR_HEIGHT);
+    if (options.Headless)
+    {
+        if (!headless.create())
+        {
+            std::cout << "Failed to create a headless OpenGL context" << std::endl;
+            headless.destroy();
+            return -1;
+        }
     }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
+    else
+    {
+        // glfw: initialize and configure
+        // ------------------------------
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-    // tell GLFW to capture our mouse
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+#ifdef __APPLE__
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
 
-    // glad: load all OpenGL function pointers
-    // ---------------------------------------
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-    {
-        std::cout << "Failed to initialize GLAD" << std::endl;
-        return -1;
+        // glfw window creation
+        // --------------------
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
+        if (window == NULL)
+        {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetScrollCallback(window, scroll_callback);
+
+        // tell GLFW to capture our mouse
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+        // glad: load all OpenGL function pointers
+        // ---------------------------------------
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+        {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return -1;
+        }
     }
 
     // configure global opengl state
     // -----------------------------
     glEnable(GL_DEPTH_TEST);
 
-    // build and compile our shader zprogram
+    // the CPU path tracer replaces the rasterized scene entirely
+    // ------------------------------------------------------------------------------
+    if (options.PathTrace)
+    {
+        const int result = runPathTracer(options, window);
+        if (options.Headless)
+            headless.destroy();
+        else
+            glfwTerminate();
+        return result;
+    }
+
+    // shared per-frame camera block: written once per frame, read by every program
+    // ------------------------------------------------------------------------------
+    UniformBuffer<CameraBlock> cameraUBO(CAMERA_BINDING);
+
+    // build and compile our shader programs (or load them from the program binary cache): every
+    // surface is a permutation of surface.vs/.fs, compiled the first time something asks for
+    // it, with the uniforms that never change set by the scene's surface setup. The two every
+    // run draws with are compiled here, so the time below covers them
     // ------------------------------------
-    Shader lightingShader("../shaders/materials.vs", "../shaders/materials.fs");
-    Shader lightCubeShader("../shaders/light_cube.vs", "../shaders/light_cube.fs");
+    const TextureStreamer::Clock::time_point shadersStart = TextureStreamer::Clock::now();
+    ShaderVariants surfaces("../shaders/surface.vs", "../shaders/surface.fs", LightingScene::surfaceSetup(cameraUBO));
+    surfaces.get(SHADER_LIT);
+    surfaces.get(0);
+    std::cout << "shaders: ready in " << std::chrono::duration<double, std::milli>(TextureStreamer::Clock::now() - shadersStart).count()
+              << " ms (" << surfaces.fromCache() << " of " << surfaces.size() << " from the program binary cache)" << std::endl;
+
+    // every mesh is uploaded in the smallest vertex formats within the tolerance, unless
+    // --no-quantize; the shaders decode whichever they get
+    const VertexTolerance vertexTolerance = { options.PositionTolerance, options.NormalToleranceDegrees, options.TexCoordTolerance };
+    const VertexTolerance *quantize = options.Quantize ? &vertexTolerance : nullptr;
+
+    // every draw is recorded into the render queue and executed sorted once per frame; the
+    // per-object uniforms it needs are streamed through a triple-buffered uniform buffer
+    // ------------------------------------------------------------------------------
+    StreamBuffer objectStream(GL_UNIFORM_BUFFER, 64 * 1024, options.Headless ? headless.procAddress() : (GLADloadproc)glfwGetProcAddress,
+                              options.PersistentMapping);
+    RenderQueue renderQueue(objectStream);
+    renderQueue.reserveBuckets(1);
+
+    // the cube, the sphere next to it (through its binary cache: parsed from text on the first
+    // run only) and the lamp; meshes with a LOD chain are drawn at the coarsest level that
+    // stays within a pixel of the full mesh on screen
+    // ------------------------------------------------------------------------------
+    LightingScene scene(surfaces, renderQueue, cameraUBO, quantize, (float)SCR_WIDTH, (float)SCR_HEIGHT, NEAR_PLANE, FAR_PLANE);
+    scene.Lods.Enabled = options.Lod;
+    const unsigned int cubeVAO = scene.Cube.VAO;
+    const GLsizei cubeIndexCount = (GLsizei)scene.Cube.IndexCount;
+
+    // optional stress scene for measuring draw submission cost
+    // ------------------------------------------------------------------------------
+    StressScene *stress = nullptr;
+    if (options.StressCount > 0)
+        stress = new StressScene(options.StressCount, options.Instancing, options.Culling, options.Occlusion, options.Spin,
+                                 options.HiresSpheres ? "../models/sphere2.obj" : "../models/sphere.obj", quantize, cubeVAO, cubeIndexCount, surfaces, renderQueue);
+
+    // optional clustered lighting demo: thousands of point lights, assigned to view frustum
+    // clusters on the CPU every frame
+    // ------------------------------------------------------------------------------
+    ClusteredScene *clustered = nullptr;
+    if (options.LightCount > 0)
+        clustered = new ClusteredScene(options.LightCount, cubeVAO, cubeIndexCount, cameraUBO, renderQueue, NEAR_PLANE, FAR_PLANE,
+                                       (float)SCR_WIDTH, (float)SCR_HEIGHT, options.Threads);
+
+    // optional nanosuit: geometry is uploaded right away, its textures are decoded by the worker
+    // pool and uploaded a few megabytes per frame, so the first frame doesn't wait for them
+    // ------------------------------------------------------------------------------
+    ThreadPool *texturePool = nullptr;
+    ThreadPool *meshletPool = nullptr;
+    TextureStreamer *streamer = nullptr;
+    TexturedModel *nanosuit = nullptr;
+    uint32_t modelProgram = 0;
+    if (options.Nanosuit)
+    {
+        texturePool = new ThreadPool(options.Threads);
+        streamer = new TextureStreamer(*texturePool, 4 << 20, startTime);
+        if (options.Meshlets)
+            meshletPool = new ThreadPool(options.Threads);
+        nanosuit = new TexturedModel("../models/nanosuit/nanosuit.obj", *streamer, quantize, meshletPool);
+        modelProgram = renderQueue.addProgram(surfaces.get(SHADER_TEXTURED));
+    }
 
-    // set up vertex data (and buffer(s)) and configure vertex attributes
-    // ------------------------------------------------------------------
-    float vertices[] = {
-        -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-         0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-         0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-         0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-
-        -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
-         0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
-
-        -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
-        -0.5f,  0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
-        -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
-        -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
-        -0.5f, -0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
-        -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
-
-         0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
-         0.5f,  0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
-         0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
-         0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
-         0.5f, -0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
-         0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
-
-        -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
-         0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
-         0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
-         0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
-
-        -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,
-         0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f
-    };
-    // first, configure the cube's VAO (and VBO)
-    unsigned int VBO, cubeVAO;
-    glGenVertexArrays(1, &cubeVAO);
-    glGenBuffers(1, &VBO);
-
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-    glBindVertexArray(cubeVAO);
-
-    // position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    // normal attribute
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-
-
-    // second, configure the light's VAO (VBO stays the same; the vertices are the same for the light object which is also a 3D cube)
-    unsigned int lightCubeVAO;
-    glGenVertexArrays(1, &lightCubeVAO);
-    glBindVertexArray(lightCubeVAO);
-
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    // note that we update the lamp's position attribute's stride to reflect the updated buffer data
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
+    // what the vertex formats came to, the stress scene's meshes included
+    // ------------------------------------------------------------------------------
+    scene.Cube.Report("cube");
+    scene.Sphere.Report("sphere2.obj");
+    if (nanosuit)
+        nanosuit->Geometry.Report("nanosuit.obj");
+    std::cout << "vertex memory: " << Mesh::totals().Uploaded / 1024 << " KB uploaded, " << Mesh::totals().Float / 1024 << " KB as float vertices ("
+              << (Mesh::totals().Float - Mesh::totals().Uploaded) / 1024 << " KB saved)" << std::endl;
+
+    // windowed runs pick up edits to shaders/ without a restart; headless runs stay reproducible
+    // ------------------------------------------------------------------------------
+    ShaderWatcher *shaderWatcher = nullptr;
+    if (!options.Headless)
+    {
+        shaderWatcher = new ShaderWatcher("../shaders");
+        surfaces.forEach([&](Shader &shader) {
+            shaderWatcher->watch(shader, [&surfaces](Shader &reloaded) { surfaces.configure(reloaded); });
+        });
+    }
+
+    // profiler overlay, drawn with Dear ImGui on top of the scene
+    // ------------------------------------------------------------------------------
+    ProfilerOverlay profilerOverlay;
+    if (options.Profile)
+    {
+        IMGUI_CHECKVERSION();
+        ImGui::CreateContext();
+        ImGui::GetIO().IniFilename = NULL; // no imgui.ini next to the binary
+        ImGui::StyleColorsDark();
+        if (window)
+            ImGui_ImplGlfw_InitForOpenGL(window, true);
+        else
+            ImGui::GetIO().DisplaySize = ImVec2((float)SCR_WIDTH, (float)SCR_HEIGHT);
+        ImGui_ImplOpenGL3_Init("#version 330 core");
+    }
+
+    // optional text: a HUD of frame counters and/or a label over every stress object, every
+    // glyph of a frame in one draw call
+    // ------------------------------------------------------------------------------
+#ifdef HAVE_FREETYPE
+    TextRenderer *text = nullptr;
+    if (options.Hud || options.Labels)
+        text = new TextRenderer("../fonts/DejaVuSansMono.ttf");
+    std::chrono::steady_clock::time_point hudLastFrame = std::chrono::steady_clock::now();
+#else
+    if (options.Hud || options.Labels)
+        std::cout << "ERROR::TEXT::BUILT_WITHOUT_FREETYPE" << std::endl;
+#endif
 
+    // the camera, the light, the transforms and the optional scenes' motion are simulated on
+    // their own thread at a fixed timestep; the render loop only draws the snapshots it publishes. Headless runs replay a
+    // camera path in lockstep and time every frame; windowed runs can record one
+    // ------------------------------------------------------------------------------
+    ThreadPool simulationJobs(options.Threads);
+    Simulation simulation(simulationJobs, Camera(glm::vec3(0.0f, 0.0f, 3.0f)), LightingScene::LIGHT_POSITION, FIXED_TIMESTEP, options.Headless);
+    CameraPath cameraPath;
+    FrameStats *frameStats = nullptr;
+    if (options.Headless)
+    {
+        if (!cameraPath.load(options.CameraPathFile))
+            std::cout << "no camera path, the camera stays put" << std::endl;
+        simulation.Replay = &cameraPath;
+        frameStats = new FrameStats(options.Frames);
+    }
+    else if (!options.RecordFile.empty())
+        simulation.Recording = &cameraPath;
+    if (stress || clustered)
+        simulation.AnimateScenes = [stress, clustered](FrameSnapshot &snapshot, float time, ThreadPool &jobs) {
+            if (stress)
+                stress->animate(snapshot, time, jobs);
+            if (clustered)
+                clustered->animate(snapshot, time, jobs);
+        };
+    simulation.start();
 
     // render loop
     // -----------
-    while (!glfwWindowShouldClose(window))
+    for (size_t frame = 0; options.Headless ? frame < options.Frames : !glfwWindowShouldClose(window); ++frame)
     {
-        // per-frame time logic
-        // --------------------
-        float currentFrame = static_cast<float>(glfwGetTime());
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
-
-        // input
-        // -----
-        processInput(window);
-
-        // render
+        // collect the zones of the previous frame, then time this one
+        Profiler::get().newFrame();
+        PROFILE_ZONE("frame");
+
+        if (options.Headless)
+        {
+            // fixed timestep: frame N looks the same on every machine
+            frameStats->beginFrame();
+            deltaTime = FIXED_TIMESTEP;
+        }
+        else
+        {
+            // per-frame time logic
+            // --------------------
+            float currentFrame = static_cast<float>(glfwGetTime());
+            deltaTime = currentFrame - lastFrame;
+            lastFrame = currentFrame;
+
+            // input
+            // -----
+            simulation.post(processInput(window), mouseOffsetX, mouseOffsetY, scrollOffset);
+            mouseOffsetX = mouseOffsetY = scrollOffset = 0.0f;
+        }
+
+        // the newest simulation step, drawn as far between it and the step before as the
+        // present is; it stays put until the next frame acquires another one
+        const FrameSnapshot &snapshot = simulation.acquire();
+        const float alpha = simulation.alpha(snapshot);
+        Camera camera = snapshot.camera(alpha);
+
+        // take in whatever the texture workers finished since the last frame, and swap in
+        // programs recompiled from edited shader files
+        {
+            PROFILE_ZONE("update");
+            if (streamer)
+                streamer->update();
+            if (shaderWatcher)
+                shaderWatcher->poll();
+        }
+
+        // render: the scene, with the optional scenes recorded into its bucket
         // ------
-        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        // be sure to activate shader when setting uniforms/drawing objects
-        lightingShader.use();
-        lightingShader.setVec3("light.position", lightPos);
-        lightingShader.setVec3("viewPos", camera.Position);
-
-        // light properties
-        glm::vec3 lightColor;
-        lightColor.x = static_cast<float>(sin(glfwGetTime() * 2.0));
-        lightColor.y = static_cast<float>(sin(glfwGetTime() * 0.7));
-        lightColor.z = static_cast<float>(sin(glfwGetTime() * 1.3));
-        glm::vec3 diffuseColor = lightColor   * glm::vec3(0.5f); // decrease the influence
-        glm::vec3 ambientColor = diffuseColor * glm::vec3(0.2f); // low influence
-        lightingShader.setVec3("light.ambient", ambientColor);
-        lightingShader.setVec3("light.diffuse", diffuseColor);
-        lightingShader.setVec3("light.specular", 1.0f, 1.0f, 1.0f);
-
-        // material properties
-        lightingShader.setVec3("material.ambient", 1.0f, 0.5f, 0.31f);
-        lightingShader.setVec3("material.diffuse", 1.0f, 0.5f, 0.31f);
-        lightingShader.setVec3("material.specular", 0.5f, 0.5f, 0.5f); // specular lighting doesn't have full effect on this object's material
-        lightingShader.setFloat("material.shininess", 32.0f);
-
-        // view/projection transformations
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        glm::mat4 view = camera.GetViewMatrix();
-        lightingShader.setMat4("projection", projection);
-        lightingShader.setMat4("view", view);
-
-        // world transformation
-        glm::mat4 model = glm::mat4(1.0f);
-        lightingShader.setMat4("model", model);
-
-        // render the cube
-        glBindVertexArray(cubeVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-
-        // also draw the lamp object
-        lightCubeShader.use();
-        lightCubeShader.setMat4("projection", projection);
-        lightCubeShader.setMat4("view", view);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, lightPos);
-        model = glm::scale(model, glm::vec3(0.2f)); // a smaller cube
-        lightCubeShader.setMat4("model", model);
-
-        glBindVertexArray(lightCubeVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        PROFILE_GPU_ZONE("gpu frame");
+        [[maybe_unused]] const CameraBlock cameraBlock = scene.Draw(camera, snapshot, alpha, [&](RenderBucket &bucket, const CameraBlock &block) {
+            if (stress)
+            {
+                stress->apply(snapshot);
+                stress->Draw(camera.GetFrustumPlanes(block.projection), block.projection * block.view,
+                             camera.Position, FAR_PLANE, scene.Lods);
+                if (!options.Headless)
+                    stress->Report(deltaTime);
+            }
+            if (clustered)
+            {
+                clustered->Draw(snapshot, block.view, block.projection, camera.Position, FAR_PLANE);
+                if (!options.Headless)
+                    clustered->Report(deltaTime);
+            }
+            if (nanosuit)
+            {
+                const glm::mat4 &nanosuitModel = snapshot.NanosuitModel;
+                nanosuit->cull(nanosuitModel, camera.GetFrustumPlanes(block.projection), camera.Position, scene.Lods.ProjectionScale);
+                nanosuit->record(bucket, modelProgram, &nanosuitModel, scene.viewDepth(camera, nanosuitModel));
+                if (nanosuit->Culler && !options.Headless)
+                    nanosuit->Culler->Report(deltaTime);
+            }
+        });
+        if (!options.Headless)
+        {
+            renderQueue.Report(deltaTime);
+            objectStream.Report(deltaTime);
+        }
+
+#ifdef HAVE_FREETYPE
+        if (text && text->valid())
+        {
+            PROFILE_GPU_ZONE("gpu text");
+            if (options.Labels && stress)
+            {
+                const glm::mat4 viewProjection = cameraBlock.projection * cameraBlock.view;
+                char name[32];
+                stress->visitDrawn([&](const glm::vec3 &position, bool isSphere, uint32_t index) {
+                    std::snprintf(name, sizeof(name), isSphere ? "sphere %u" : "cube %u", index);
+                    text->label(position, viewProjection, (float)SCR_WIDTH, (float)SCR_HEIGHT, 12, glm::vec4(1.0f), name);
+                });
+            }
+            if (options.Hud)
+            {
+                // wall time between frames, which headless runs don't have in deltaTime
+                const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+                const float frameMilliseconds = std::chrono::duration<float, std::milli>(now - hudLastFrame).count();
+                hudLastFrame = now;
+                const TextStats &textStats = text->lastFrame();
+                char lines[4][128];
+                int count = 0;
+                std::snprintf(lines[count++], sizeof(lines[0]), "frame %zu  %.2f ms (%.0f fps)", frame, frameMilliseconds, 1000.0f / std::max(frameMilliseconds, 0.001f));
+                std::snprintf(lines[count++], sizeof(lines[0]), "camera %.1f %.1f %.1f", camera.Position.x, camera.Position.y, camera.Position.z);
+                if (stress)
+                    std::snprintf(lines[count++], sizeof(lines[0]), "stress %u draws, %zu triangles", stress->DrawCalls, stress->Triangles);
+                std::snprintf(lines[count++], sizeof(lines[0]), "text %zu glyphs, %.0f ns/glyph", textStats.Glyphs,
+                              textStats.Glyphs ? 1000.0 * textStats.Microseconds / textStats.Glyphs : 0.0);
+                // a dark copy one pixel down and right keeps them readable over anything
+                for (int i = 0; i < count; ++i)
+                {
+                    text->text(9.0f, 21.0f + 18.0f * i, 14, glm::vec4(0.0f, 0.0f, 0.0f, 0.8f), lines[i]);
+                    text->text(8.0f, 20.0f + 18.0f * i, 14, glm::vec4(1.0f, 1.0f, 0.8f, 1.0f), lines[i]);
+                }
+            }
+            text->Draw((float)SCR_WIDTH, (float)SCR_HEIGHT);
+            if (!options.Headless)
+                text->Report(deltaTime);
+        }
+#endif
+
+        if (options.Profile)
+        {
+            PROFILE_ZONE("overlay");
+            PROFILE_GPU_ZONE("gpu overlay");
+            ImGui_ImplOpenGL3_NewFrame();
+            if (window)
+                ImGui_ImplGlfw_NewFrame();
+            else
+                ImGui::GetIO().DeltaTime = FIXED_TIMESTEP;
+            ImGui::NewFrame();
+            profilerOverlay.draw(Profiler::get());
+            ImGui::Render();
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        }
+
+        if (options.Headless)
+        {
+            frameStats->endFrame();
+            if (streamer)
+                streamer->frameRendered();
+            // read back outside the timed region; it stalls the pipeline, so the frame after a
+            // dump is not representative
+            if (std::find(options.DumpFrames.begin(), options.DumpFrames.end(), frame) != options.DumpFrames.end())
+            {
+                char name[32];
+                std::snprintf(name, sizeof(name), "/frame_%05zu.png", frame);
+                const std::vector<unsigned char> pixels = headless.readPixels();
+                if (!PngWriter::write(options.DumpDir + name, pixels.data(), headless.Width, headless.Height))
+                    std::cout << "ERROR::PNG::FILE_NOT_SUCCESFULLY_WRITTEN: " << options.DumpDir + name << std::endl;
+            }
+            continue;
+        }
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
+        PROFILE_ZONE("swap");
         glfwSwapBuffers(window);
         glfwPollEvents();
+        if (streamer)
+            streamer->frameRendered();
     }
 
+    simulation.stop();
+    if (frameStats)
+    {
+        frameStats->finish();
+        frameStats->printSummary();
+        renderQueue.Report(0.0f, true);
+        objectStream.Report(0.0f, true);
+        if (stress)
+            stress->Report(0.0f, true);
+        if (clustered)
+            clustered->Report(0.0f, true);
+        if (nanosuit && nanosuit->Culler)
+            nanosuit->Culler->Report(0.0f, true);
+#ifdef HAVE_FREETYPE
+        if (text)
+            text->Report(0.0f, true);
+#endif
+        if (!options.StatsFile.empty())
+            frameStats->write(options.StatsFile);
+        delete frameStats;
+    }
+    if (!options.RecordFile.empty() && !cameraPath.save(options.RecordFile))
+        std::cout << "ERROR::CAMERA_PATH::FILE_NOT_SUCCESFULLY_WRITTEN: " << options.RecordFile << std::endl;
+    Profiler::get().newFrame(); // takes in the zones of the last frame
+    if (!options.TraceFile.empty())
+        Profiler::get().writeChromeTrace(options.TraceFile);
+
     // optional: de-allocate all resources once they've outlived their purpose:
     // ------------------------------------------------------------------------
-    glDeleteVertexArrays(1, &cubeVAO);
-    glDeleteVertexArrays(1, &lightCubeVAO);
-    glDeleteBuffers(1, &VBO);
+    scene.Release();
+    glDeleteBuffers(1, &cameraUBO.ID);
+    objectStream.Release();
+    delete shaderWatcher;
+    Profiler::get().Release();
+    if (options.Profile)
+    {
+        ImGui_ImplOpenGL3_Shutdown();
+        if (window)
+            ImGui_ImplGlfw_Shutdown();
+        ImGui::DestroyContext();
+    }
+    surfaces.Release();
+    if (stress)
+    {
+        stress->Release();
+        delete stress;
+    }
+    if (clustered)
+    {
+        clustered->Release();
+        delete clustered;
+    }
+#ifdef HAVE_FREETYPE
+    if (text)
+    {
+        text->Release();
+        delete text;
+    }
+#endif
+    if (nanosuit)
+    {
+        nanosuit->Release();
+        streamer->Release();
+        delete nanosuit;
+        delete streamer;
+        delete texturePool;
+        delete meshletPool;
+    }
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
-    glfwTerminate();
+    if (options.Headless)
+        headless.destroy();
+    else
+        glfwTerminate();
+    return 0;
+}
+
+// path tracer mode: one sample per pixel per frame, accumulated and shown through a fullscreen
+// texture, or (headless) traced for options.Frames samples and written to DumpDir/pathtrace.png
+// ---------------------------------------------------------------------------------------------------------
+int runPathTracer(const AppOptions &options, GLFWwindow *window)
+{
+    PathTracer tracer(SCR_WIDTH, SCR_HEIGHT);
+    if (!tracer.Loaded)
+        return -1;
+    ThreadPool pool(options.Threads);
+    std::cout << "path tracer: " << pool.size() << " threads, " << SCR_WIDTH << "x" << SCR_HEIGHT << std::endl;
+    std::vector<unsigned char> pixels;
+    uint64_t rays = 0;
+    double seconds = 0.0, reportSeconds = 0.0;
+
+    FullscreenTexture *screen = options.Headless ? nullptr : new FullscreenTexture(SCR_WIDTH, SCR_HEIGHT);
+    for (size_t frame = 0; options.Headless ? frame < options.Frames : !glfwWindowShouldClose(window); ++frame)
+    {
+        tracer.renderPass(pool);
+        rays += tracer.LastPassRays;
+        seconds += tracer.LastPassSeconds;
+        reportSeconds += tracer.LastPassSeconds;
+        if (reportSeconds >= 1.0)
+        {
+            std::cout << tracer.SampleCount << " spp, " << tracer.mraysPerSecond() << " Mrays/s, "
+                      << 1000.0 * tracer.LastPassSeconds << " ms/sample" << std::endl;
+            reportSeconds = 0.0;
+        }
+
+        if (options.Headless)
+        {
+            if (std::find(options.DumpFrames.begin(), options.DumpFrames.end(), frame) != options.DumpFrames.end())
+            {
+                char name[40];
+                std::snprintf(name, sizeof(name), "/pathtrace_%05zu.png", frame);
+                tracer.resolve(pixels);
+                PngWriter::write(options.DumpDir + name, pixels.data(), tracer.Width, tracer.Height);
+            }
+            continue;
+        }
+
+        if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+            glfwSetWindowShouldClose(window, true);
+        tracer.resolve(pixels);
+        screen->upload(pixels.data());
+        screen->Draw();
+        glfwSwapBuffers(window);
+        glfwPollEvents();
+    }
+
+    std::cout << "path tracer: " << tracer.SampleCount << " spp in " << seconds << " s, "
+              << (seconds > 0.0 ? rays / seconds / 1.0e6 : 0.0) << " Mrays/s average" << std::endl;
+    if (options.Headless)
+    {
+        tracer.resolve(pixels);
+        const std::string path = options.DumpDir + "/pathtrace.png";
+        if (!PngWriter::write(path, pixels.data(), tracer.Width, tracer.Height))
+            std::cout << "ERROR::PNG::FILE_NOT_SUCCESFULLY_WRITTEN: " << path << std::endl;
+    }
+    if (screen)
+    {
+        screen->Release();
+        delete screen;
+    }
     return 0;
 }
 
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
+// returns the movement keys held, one bit per Camera_Movement, for the simulation to move the camera by
 // ---------------------------------------------------------------------------------------------------------
-void processInput(GLFWwindow *window)
+unsigned int processInput(GLFWwindow *window)
 {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        camera.ProcessKeyboard(FORWARD, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        camera.ProcessKeyboard(BACKWARD, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        camera.ProcessKeyboard(LEFT, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        camera.ProcessKeyboard(RIGHT, deltaTime);
-
-    if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
-        camera.ProcessKeyboard(DOWN, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
-        camera.ProcessKeyboard(UP, deltaTime);
+    const int keys[] = { GLFW_KEY_W, GLFW_KEY_S, GLFW_KEY_A, GLFW_KEY_D, GLFW_KEY_E, GLFW_KEY_Q }; // indexed by Camera_Movement
+    unsigned int held = 0;
+    for (int direction = FORWARD; direction <= DOWN; ++direction)
+        if (glfwGetKey(window, keys[direction]) == GLFW_PRESS)
+            held |= 1u << direction;
+    return held;
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -289,12 +645,13 @@ void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
     lastX = xpos;
     lastY = ypos;
 
-    camera.ProcessMouseMovement(xoffset, yoffset);
+    mouseOffsetX += xoffset;
+    mouseOffsetY += yoffset;
 }
 
 // glfw: whenever the mouse scroll wheel scrolls, this callback is called
 // ----------------------------------------------------------------------
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
-    camera.ProcessMouseScroll(static_cast<float>(yoffset));
+    scrollOffset += static_cast<float>(yoffset);
 }
\ No newline at end of file